@@ -0,0 +1,221 @@
+#ifndef GP_ANIM_H
+#define GP_ANIM_H
+
+//
+// Joint rotations of animated skeletons, sampled in batches
+// Every joint interpolates between the rotations of two keyframes at its own mu. The joints are kept as
+// SoA streams so a whole skeleton (or many of them) goes through m_quat_slerp_soa or m_quat_nlerp_soa
+// and then m_quat_to_mat3_soa in one call each. Above ANIM_PARALLEL_THRESHOLD joints the work is split
+// over the job system, every chunk interpolates and converts its own joints while they are in cache.
+// Chunks start on a multiple of 8 joints, so they keep the alignment of the streams.
+//
+
+#define ANIM_PARALLEL_THRESHOLD 16384
+#define ANIM_MIN_GRAIN 4096
+#define ANIM_ALIGNMENT 32
+
+enum AnimInterpolation {
+    ANIM_NLERP = 0, // normalized lerp, exact at the keyframes and half way only
+    ANIM_SLERP      // nlerp with mu corrected, close to slerp
+};
+
+typedef struct JointPoses {
+    float4_soa from;    // rotation of each joint at the keyframe before
+    float4_soa to;      // at the keyframe after
+    float* mu;          // position between them
+    float4_soa rotation;
+    float* matrix[9];   // rotation matrices, column major
+    float* streams;     // one allocation for all of the above
+    int count;
+} JointPoses;
+
+void init_joint_poses(JointPoses* jp, int count) {
+    // every stream starts aligned
+    size_t stride = (count + 7) & ~7;
+    float* s = (float*) gp_aligned_malloc(22 * stride * sizeof(float), ANIM_ALIGNMENT);
+    float4_soa* quats[3] = {&jp->from, &jp->to, &jp->rotation};
+    for (int q = 0; q < 3; ++q) {
+        quats[q]->x = s + (q * 4 + 0) * stride;
+        quats[q]->y = s + (q * 4 + 1) * stride;
+        quats[q]->z = s + (q * 4 + 2) * stride;
+        quats[q]->w = s + (q * 4 + 3) * stride;
+    }
+    jp->mu = s + 12 * stride;
+    for (int i = 0; i < 9; ++i) {
+        jp->matrix[i] = s + (13 + i) * stride;
+    }
+    jp->streams = s;
+    jp->count = count;
+}
+
+void free_joint_poses(JointPoses* jp) {
+    gp_aligned_free(jp->streams);
+    jp->streams = NULL;
+    jp->count = 0;
+}
+
+void set_joint_pose(JointPoses* jp, int i, const float4* from, const float4* to, float mu) {
+    jp->from.x[i] = from->x; jp->from.y[i] = from->y; jp->from.z[i] = from->z; jp->from.w[i] = from->w;
+    jp->to.x[i] = to->x; jp->to.y[i] = to->y; jp->to.z[i] = to->z; jp->to.w[i] = to->w;
+    jp->mu[i] = mu;
+}
+
+float4_soa joint_quats_at(const float4_soa* q, int offset) {
+    float4_soa r = {q->x + offset, q->y + offset, q->z + offset, q->w + offset};
+    return r;
+}
+
+typedef struct SampleJointsJob {
+    JointPoses* jp;
+    int interpolation;
+} SampleJointsJob;
+
+void sample_joints_job(void* data, int begin, int end) {
+    SampleJointsJob* job = (SampleJointsJob*) data;
+    JointPoses* jp = job->jp;
+    float4_soa from = joint_quats_at(&jp->from, begin);
+    float4_soa to = joint_quats_at(&jp->to, begin);
+    float4_soa rotation = joint_quats_at(&jp->rotation, begin);
+    float* matrix[9];
+    for (int i = 0; i < 9; ++i) {
+        matrix[i] = jp->matrix[i] + begin;
+    }
+    if (job->interpolation == ANIM_SLERP) {
+        m_quat_slerp_soa(&rotation, &from, &to, jp->mu + begin, end - begin);
+    } else {
+        m_quat_nlerp_soa(&rotation, &from, &to, jp->mu + begin, end - begin);
+    }
+    m_quat_to_mat3_soa(matrix, &rotation, end - begin);
+}
+
+// Fills rotation and matrix of every joint, js can be NULL
+void sample_joint_poses(JobSystem* js, JointPoses* jp, int interpolation) {
+    SampleJointsJob job;
+    job.jp = jp;
+    job.interpolation = interpolation;
+    if (js == NULL || jp->count < ANIM_PARALLEL_THRESHOLD) {
+        sample_joints_job(&job, 0, jp->count);
+        return;
+    }
+    int grain = (job_grain(js, jp->count, ANIM_MIN_GRAIN) + 7) & ~7;
+    parallel_for(js, jp->count, grain, sample_joints_job, &job);
+}
+
+////////////////////////////////////////////////////
+// benchmark
+
+// What sampling was before: m_quat_slerp per joint on AoS keyframes, then the matrix
+void sample_joints_loop(const float4* from, const float4* to, const float* mu, float4* rotation, float* matrix, int count) {
+    for (int i = 0; i < count; ++i) {
+        float4 q;
+        m_quat_slerp(&q, &from[i], &to[i], mu[i]);
+        rotation[i] = q;
+        float x2 = q.x + q.x, y2 = q.y + q.y, z2 = q.z + q.z;
+        float* m = matrix + i * 9;
+        m[0] = 1.0f - (q.y * y2 + q.z * z2); m[1] = q.x * y2 + q.w * z2; m[2] = q.x * z2 - q.w * y2;
+        m[3] = q.x * y2 - q.w * z2; m[4] = 1.0f - (q.x * x2 + q.z * z2); m[5] = q.y * z2 + q.w * x2;
+        m[6] = q.x * z2 + q.w * y2; m[7] = q.y * z2 - q.w * x2; m[8] = 1.0f - (q.x * x2 + q.y * y2);
+    }
+}
+
+// Angle in radians between the sampled rotation of joint i and the exact slerp, computed in double
+double joint_angle_error(const JointPoses* jp, int i) {
+    double a[4] = {jp->from.x[i], jp->from.y[i], jp->from.z[i], jp->from.w[i]};
+    double b[4] = {jp->to.x[i], jp->to.y[i], jp->to.z[i], jp->to.w[i]};
+    double r[4] = {jp->rotation.x[i], jp->rotation.y[i], jp->rotation.z[i], jp->rotation.w[i]};
+    double d = a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3];
+    double sign = d < 0.0 ? -1.0 : 1.0;
+    double theta = acos(M_MIN(fabs(d), 1.0));
+    double wa = 1.0 - jp->mu[i], wb = jp->mu[i];
+    if (theta > 1e-6) {
+        wa = sin(wa * theta) / sin(theta);
+        wb = sin(wb * theta) / sin(theta);
+    }
+    double e = 0.0, l = 0.0;
+    for (int k = 0; k < 4; ++k) {
+        double s = wa * a[k] + wb * sign * b[k];
+        e += s * r[k];
+        l += s * s;
+    }
+    return 2.0 * acos(M_MIN(fabs(e) / sqrt(l), 1.0));
+}
+
+// Samples ANIM_BENCH_JOINTS joints per frame with random keyframes: the m_quat_slerp loop, then the
+// batched functions at every SIMD level the cpu has, with 1 to max_workers workers. err is the largest
+// angle to the exact slerp over all joints.
+#define ANIM_BENCH_JOINTS (128 * 1024)
+#define ANIM_BENCH_FRAMES 100
+
+void gp_anim_benchmark(int max_workers) {
+    if (max_workers <= 0) {
+        max_workers = (int) std::thread::hardware_concurrency();
+    }
+    max_workers = M_CLAMP(max_workers, 1, JOBS_MAX_WORKERS);
+    int count = ANIM_BENCH_JOINTS;
+    int frames = ANIM_BENCH_FRAMES;
+
+    JointPoses jp;
+    init_joint_poses(&jp, count);
+    float4* from = (float4*) malloc(count * sizeof(float4));
+    float4* to = (float4*) malloc(count * sizeof(float4));
+    float4* rotation = (float4*) malloc(count * sizeof(float4));
+    float* matrix = (float*) malloc(count * 9 * sizeof(float));
+
+    m_srand(362436069, 521288629);
+    for (int i = 0; i < count; ++i) {
+        float3 axis = {rand_float_range(-1.0, 1.0), rand_float_range(-1.0, 1.0), rand_float_range(-1.0, 1.0)};
+        M_NORMALIZE3(axis, axis);
+        m_quat_rotation_axis(&from[i], &axis, rand_float_range(-M_PI, M_PI));
+        axis.x += rand_float_range(-0.5, 0.5);
+        M_NORMALIZE3(axis, axis);
+        m_quat_rotation_axis(&to[i], &axis, rand_float_range(-M_PI, M_PI));
+        set_joint_pose(&jp, i, &from[i], &to[i], rand_float_range(0.0, 1.0));
+    }
+
+    printf("anim benchmark: %d joints, %d frames, up to %d workers\n", count, frames, max_workers);
+    g_timer timer;
+    sample_joints_loop(from, to, jp.mu, rotation, matrix, count);
+    start_timer(&timer);
+    for (int f = 0; f < frames; ++f) {
+        sample_joints_loop(from, to, jp.mu, rotation, matrix, count);
+    }
+    stop_timer(&timer);
+    double loop_ms = compute_timer_millis_diff(&timer) / frames;
+    printf("  %-6s %-8s %2d workers %7.3f ms/frame\n", "loop", "scalar", 1, loop_ms);
+
+    int previous = m_simd_level();
+    int best = m_simd_set_level(M_SIMD_AVX2);
+    for (int interpolation = ANIM_NLERP; interpolation <= ANIM_SLERP; ++interpolation) {
+        const char* name = interpolation == ANIM_SLERP ? "slerp" : "nlerp";
+        for (int level = M_SIMD_SCALAR; level <= best; ++level) {
+            m_simd_set_level(level);
+            sample_joint_poses(NULL, &jp, interpolation);
+            double error = 0.0;
+            for (int i = 0; i < count; ++i) {
+                error = M_MAX(error, joint_angle_error(&jp, i));
+            }
+            for (int workers = 1; workers <= max_workers; ++workers) {
+                JobSystem* js = create_job_system(workers);
+                sample_joint_poses(js, &jp, interpolation);
+                start_timer(&timer);
+                for (int f = 0; f < frames; ++f) {
+                    sample_joint_poses(js, &jp, interpolation);
+                }
+                stop_timer(&timer);
+                destroy_job_system(js);
+                double ms = compute_timer_millis_diff(&timer) / frames;
+                printf("  %-6s %-8s %2d workers %7.3f ms/frame %6.2fx  %6.1f M joints/s  err %.1e rad\n", name,
+                       m_simd_level_name(level), workers, ms, loop_ms / ms, count / ms / 1000.0, error);
+            }
+        }
+    }
+    m_simd_set_level(previous);
+
+    free_joint_poses(&jp);
+    free(from);
+    free(to);
+    free(rotation);
+    free(matrix);
+}
+
+#endif
@@ -0,0 +1,727 @@
+#ifndef GP_BVH_H
+#define GP_BVH_H
+
+//
+// Bounding volume hierarchy over the triangles of a mesh
+// Built top down with the surface area heuristic evaluated on BVH_BINS bins of triangle centroids per
+// axis. Ranges above BVH_TASK_SIZE triangles build their two children as jobs, ranges above
+// BVH_PARALLEL_BINNING also get their bounds and bins computed over the job system. Chunks of the
+// binning are merged in order and only hold min, max and counts, so the tree is the same for every
+// worker count.
+//
+// The result is flattened depth first: the first child of an interior node is the next node, the node
+// keeps the index of the second one. Triangles are copied in leaf order as a vertex and two edges, what
+// the ray test needs, indices maps them back to the triangles of the mesh.
+//
+// bvh_intersect finds the closest hit along a ray, bvh_occluded stops at the first one (shadow rays).
+// Their stack holds one node per level, so below BVH_MEDIAN_DEPTH the builder stops using the heuristic
+// and halves ranges: even degenerate input (coincident or collinear triangles that the heuristic keeps
+// peeling one by one) ends in leaves within 31 more levels.
+//
+
+#include <atomic>
+
+#define BVH_BINS 16
+#define BVH_MAX_LEAF 8
+#define BVH_STACK 64
+#define BVH_MEDIAN_DEPTH (BVH_STACK - 32) // deeper ranges are split in half, the tree stays under BVH_STACK levels
+#define BVH_TRAVERSAL_COST 1.0f // relative to one triangle test
+#define BVH_TASK_SIZE 1024
+#define BVH_PARALLEL_BINNING 16384
+#define BVH_BINNING_GRAIN 4096
+
+typedef struct BvhNode {
+    float3 min;
+    int offset;     // first triangle of a leaf, second child of an interior node
+    float3 max;
+    uint16_t count; // triangles of a leaf, 0 for interior nodes
+    uint16_t axis;  // split axis of an interior node, its first child is on the low side
+} BvhNode;
+
+static_assert(sizeof(BvhNode) == 32, "two nodes per cache line");
+
+typedef struct BvhTriangle {
+    float3 v0;
+    float3 e1; // v1 - v0
+    float3 e2; // v2 - v0
+} BvhTriangle;
+
+typedef struct Bvh {
+    BvhNode* nodes;
+    int node_count;
+    BvhTriangle* triangles; // in leaf order
+    int* indices;           // triangle of the mesh for each of them
+    int triangle_count;
+} Bvh;
+
+typedef struct BvhHit {
+    float t;
+    float u, v;   // barycentrics of vertex 1 and 2
+    int triangle; // of the mesh
+} BvhHit;
+
+////////////////////////////////////////////////////
+// build
+
+typedef struct BvhBin {
+    float3 min;
+    float3 max;
+    int count;
+} BvhBin;
+
+typedef struct BvhBuildNode {
+    float3 min;
+    float3 max;
+    int first;
+    int count;
+    int left;  // the children are left and left + 1, -1 for leaves
+    int axis;
+} BvhBuildNode;
+
+typedef struct BvhBuilder {
+    JobSystem* js;
+    const float* positions; // 9 floats per triangle
+    float3* centroids;
+    float3* tri_min;
+    float3* tri_max;
+    int* indices;
+    BvhBuildNode* nodes;
+    std::atomic<int> node_count;
+} BvhBuilder;
+
+// Bounds of a range of triangles and of their centroids, the split is chosen on the latter
+typedef struct BvhRangeBounds {
+    float3 min, max;
+    float3 cmin, cmax;
+} BvhRangeBounds;
+
+float bvh_half_area(const float3* min, const float3* max) {
+    float dx = max->x - min->x, dy = max->y - min->y, dz = max->z - min->z;
+    return dx * dy + dy * dz + dz * dx;
+}
+
+void bvh_empty_bounds(float3* min, float3* max) {
+    set_float3(min, FLT_MAX, FLT_MAX, FLT_MAX);
+    set_float3(max, -FLT_MAX, -FLT_MAX, -FLT_MAX);
+}
+
+void bvh_merge_range_bounds(BvhRangeBounds* dest, const BvhRangeBounds* src) {
+    M_MIN3(dest->min, dest->min, src->min);
+    M_MAX3(dest->max, dest->max, src->max);
+    M_MIN3(dest->cmin, dest->cmin, src->cmin);
+    M_MAX3(dest->cmax, dest->cmax, src->cmax);
+}
+
+void bvh_compute_range_bounds(const BvhBuilder* b, int begin, int end, BvhRangeBounds* rb) {
+    bvh_empty_bounds(&rb->min, &rb->max);
+    bvh_empty_bounds(&rb->cmin, &rb->cmax);
+    for (int i = begin; i < end; ++i) {
+        int t = b->indices[i];
+        M_MIN3(rb->min, rb->min, b->tri_min[t]);
+        M_MAX3(rb->max, rb->max, b->tri_max[t]);
+        M_MIN3(rb->cmin, rb->cmin, b->centroids[t]);
+        M_MAX3(rb->cmax, rb->cmax, b->centroids[t]);
+    }
+}
+
+// Bin of a centroid along axis, the partition uses the same function as the binning
+int bvh_bin_index(const float3* centroid, int axis, const float3* cmin, const float3* scale) {
+    const float* c = (const float*) centroid;
+    int k = (int) ((c[axis] - ((const float*) cmin)[axis]) * ((const float*) scale)[axis]);
+    return M_CLAMP(k, 0, BVH_BINS - 1);
+}
+
+void bvh_bin_range(const BvhBuilder* b, int begin, int end, const float3* cmin, const float3* scale, BvhBin bins[3][BVH_BINS]) {
+    for (int axis = 0; axis < 3; ++axis) {
+        for (int k = 0; k < BVH_BINS; ++k) {
+            bvh_empty_bounds(&bins[axis][k].min, &bins[axis][k].max);
+            bins[axis][k].count = 0;
+        }
+    }
+    for (int i = begin; i < end; ++i) {
+        int t = b->indices[i];
+        for (int axis = 0; axis < 3; ++axis) {
+            BvhBin* bin = &bins[axis][bvh_bin_index(&b->centroids[t], axis, cmin, scale)];
+            M_MIN3(bin->min, bin->min, b->tri_min[t]);
+            M_MAX3(bin->max, bin->max, b->tri_max[t]);
+            bin->count++;
+        }
+    }
+}
+
+// One chunk of BVH_BINNING_GRAIN triangles per entry of the result arrays
+typedef struct BvhBinningJob {
+    const BvhBuilder* builder;
+    int first;
+    float3 cmin, scale;
+    BvhRangeBounds* bounds;
+    BvhBin (*bins)[3][BVH_BINS];
+} BvhBinningJob;
+
+void bvh_bounds_job(void* data, int begin, int end) {
+    BvhBinningJob* job = (BvhBinningJob*) data;
+    bvh_compute_range_bounds(job->builder, job->first + begin, job->first + end, &job->bounds[begin / BVH_BINNING_GRAIN]);
+}
+
+void bvh_binning_job(void* data, int begin, int end) {
+    BvhBinningJob* job = (BvhBinningJob*) data;
+    bvh_bin_range(job->builder, job->first + begin, job->first + end, &job->cmin, &job->scale,
+                  job->bins[begin / BVH_BINNING_GRAIN]);
+}
+
+void bvh_build_node(BvhBuilder* b, int node_index, int first, int count, int depth);
+
+typedef struct BvhChildren {
+    BvhBuilder* builder;
+    int node[2];
+    int first[2];
+    int count[2];
+    int depth;
+} BvhChildren;
+
+void bvh_build_children_job(void* data, int begin, int end) {
+    BvhChildren* children = (BvhChildren*) data;
+    for (int i = begin; i < end; ++i) {
+        bvh_build_node(children->builder, children->node[i], children->first[i], children->count[i], children->depth);
+    }
+}
+
+void bvh_build_node(BvhBuilder* b, int node_index, int first, int count, int depth) {
+    BvhBuildNode* node = &b->nodes[node_index];
+    BvhBin bins[3][BVH_BINS];
+    BvhRangeBounds rb;
+    float3 scale;
+
+    int sah = count > 1 && depth < BVH_MEDIAN_DEPTH;
+    int parallel = b->js != NULL && count > BVH_PARALLEL_BINNING;
+    BvhBinningJob job;
+    int chunks = (count + BVH_BINNING_GRAIN - 1) / BVH_BINNING_GRAIN;
+    if (parallel) {
+        job.builder = b;
+        job.first = first;
+        job.bounds = (BvhRangeBounds*) malloc(chunks * sizeof(BvhRangeBounds));
+        job.bins = (BvhBin (*)[3][BVH_BINS]) malloc(chunks * sizeof(bins));
+        parallel_for(b->js, count, BVH_BINNING_GRAIN, bvh_bounds_job, &job);
+        rb = job.bounds[0];
+        for (int c = 1; c < chunks; ++c) {
+            bvh_merge_range_bounds(&rb, &job.bounds[c]);
+        }
+    } else {
+        bvh_compute_range_bounds(b, first, first + count, &rb);
+    }
+    node->min = rb.min;
+    node->max = rb.max;
+    node->first = first;
+    node->count = count;
+    node->left = -1;
+    node->axis = 0;
+
+    const float* extent_min = (const float*) &rb.cmin;
+    const float* extent_max = (const float*) &rb.cmax;
+    float* s = (float*) &scale;
+    for (int axis = 0; axis < 3; ++axis) {
+        float extent = extent_max[axis] - extent_min[axis];
+        s[axis] = extent > 0.0f ? BVH_BINS / extent : 0.0f;
+    }
+
+    // sweep the bins of every axis, split k puts bins [0, k) on the low side
+    float best_cost = FLT_MAX;
+    int best_axis = -1;
+    int best_split = 0;
+    if (sah) {
+        if (parallel) {
+            job.cmin = rb.cmin;
+            job.scale = scale;
+            parallel_for(b->js, count, BVH_BINNING_GRAIN, bvh_binning_job, &job);
+            memcpy(bins, job.bins[0], sizeof(bins));
+            for (int c = 1; c < chunks; ++c) {
+                for (int axis = 0; axis < 3; ++axis) {
+                    for (int k = 0; k < BVH_BINS; ++k) {
+                        BvhBin* bin = &bins[axis][k];
+                        M_MIN3(bin->min, bin->min, job.bins[c][axis][k].min);
+                        M_MAX3(bin->max, bin->max, job.bins[c][axis][k].max);
+                        bin->count += job.bins[c][axis][k].count;
+                    }
+                }
+            }
+        } else {
+            bvh_bin_range(b, first, first + count, &rb.cmin, &scale, bins);
+        }
+
+        for (int axis = 0; axis < 3; ++axis) {
+            if (s[axis] == 0.0f) {
+                continue;
+            }
+            float right_cost[BVH_BINS];
+            float3 min, max;
+            int n = 0;
+            bvh_empty_bounds(&min, &max);
+            for (int k = BVH_BINS - 1; k > 0; --k) {
+                M_MIN3(min, min, bins[axis][k].min);
+                M_MAX3(max, max, bins[axis][k].max);
+                n += bins[axis][k].count;
+                right_cost[k] = n > 0 ? n * bvh_half_area(&min, &max) : 0.0f;
+            }
+            bvh_empty_bounds(&min, &max);
+            n = 0;
+            for (int k = 1; k < BVH_BINS; ++k) {
+                M_MIN3(min, min, bins[axis][k - 1].min);
+                M_MAX3(max, max, bins[axis][k - 1].max);
+                n += bins[axis][k - 1].count;
+                if (n == 0 || n == count) {
+                    continue;
+                }
+                float cost = n * bvh_half_area(&min, &max) + right_cost[k];
+                if (cost < best_cost) {
+                    best_cost = cost;
+                    best_axis = axis;
+                    best_split = k;
+                }
+            }
+        }
+    }
+    if (parallel) {
+        free(job.bounds);
+        free(job.bins);
+    }
+
+    int left_count;
+    if (best_axis >= 0) {
+        float leaf_cost = (float) count;
+        best_cost = BVH_TRAVERSAL_COST + best_cost / bvh_half_area(&rb.min, &rb.max);
+        if (count <= BVH_MAX_LEAF && leaf_cost <= best_cost) {
+            return;
+        }
+        int* indices = b->indices;
+        int i = first, j = first + count - 1;
+        while (i <= j) {
+            if (bvh_bin_index(&b->centroids[indices[i]], best_axis, &rb.cmin, &scale) < best_split) {
+                i++;
+            } else {
+                int t = indices[i];
+                indices[i] = indices[j];
+                indices[j--] = t;
+            }
+        }
+        left_count = i - first;
+        node->axis = best_axis;
+    } else {
+        // every centroid in the same place or too deep, only the count can tell them apart
+        if (count <= BVH_MAX_LEAF) {
+            return;
+        }
+        left_count = count / 2;
+    }
+
+    int left = b->node_count.fetch_add(2, std::memory_order_relaxed);
+    node->left = left;
+    BvhChildren children = {b, {left, left + 1}, {first, first + left_count}, {left_count, count - left_count}, depth + 1};
+    if (b->js != NULL && count > BVH_TASK_SIZE) {
+        parallel_for(b->js, 2, 1, bvh_build_children_job, &children);
+    } else {
+        bvh_build_children_job(&children, 0, 2);
+    }
+}
+
+typedef struct BvhTriangleJob {
+    BvhBuilder* builder;
+    Bvh* bvh;
+} BvhTriangleJob;
+
+void bvh_triangle_bounds_job(void* data, int begin, int end) {
+    BvhBuilder* b = ((BvhTriangleJob*) data)->builder;
+    for (int t = begin; t < end; ++t) {
+        const float* p = b->positions + t * 9;
+        float3 v0 = {p[0], p[1], p[2]}, v1 = {p[3], p[4], p[5]}, v2 = {p[6], p[7], p[8]};
+        M_MIN3(b->tri_min[t], v0, v1);
+        M_MIN3(b->tri_min[t], b->tri_min[t], v2);
+        M_MAX3(b->tri_max[t], v0, v1);
+        M_MAX3(b->tri_max[t], b->tri_max[t], v2);
+        M_ADD3(b->centroids[t], b->tri_min[t], b->tri_max[t]);
+        mul_scalar(&b->centroids[t], 0.5);
+        b->indices[t] = t;
+    }
+}
+
+void bvh_copy_triangles_job(void* data, int begin, int end) {
+    BvhTriangleJob* job = (BvhTriangleJob*) data;
+    for (int i = begin; i < end; ++i) {
+        const float* p = job->builder->positions + job->bvh->indices[i] * 9;
+        BvhTriangle* tri = &job->bvh->triangles[i];
+        set_float3(&tri->v0, p[0], p[1], p[2]);
+        set_float3(&tri->e1, p[3] - p[0], p[4] - p[1], p[5] - p[2]);
+        set_float3(&tri->e2, p[6] - p[0], p[7] - p[1], p[8] - p[2]);
+    }
+}
+
+// Depth first copy of the subtree of build node i, returns its index in bvh->nodes
+int bvh_flatten(Bvh* bvh, const BvhBuildNode* build_nodes, int i, int* next) {
+    const BvhBuildNode* bn = &build_nodes[i];
+    int index = (*next)++;
+    BvhNode* node = &bvh->nodes[index];
+    node->min = bn->min;
+    node->max = bn->max;
+    node->axis = (uint16_t) bn->axis;
+    if (bn->left < 0) {
+        node->offset = bn->first;
+        node->count = (uint16_t) bn->count;
+        return index;
+    }
+    node->count = 0;
+    bvh_flatten(bvh, build_nodes, bn->left, next);
+    node->offset = bvh_flatten(bvh, build_nodes, bn->left + 1, next);
+    return index;
+}
+
+// positions holds 9 floats per triangle, as load_mesh_data gives them. js can be NULL.
+void build_bvh(Bvh* bvh, JobSystem* js, const float* positions, int triangle_count) {
+    BvhBuilder b;
+    b.js = js;
+    b.positions = positions;
+    b.centroids = (float3*) malloc(triangle_count * sizeof(float3));
+    b.tri_min = (float3*) malloc(triangle_count * sizeof(float3));
+    b.tri_max = (float3*) malloc(triangle_count * sizeof(float3));
+    b.indices = (int*) malloc(M_MAX(triangle_count, 1) * sizeof(int));
+    b.nodes = (BvhBuildNode*) malloc(M_MAX(2 * triangle_count - 1, 1) * sizeof(BvhBuildNode));
+    b.node_count.store(1);
+
+    BvhTriangleJob job = {&b, bvh};
+    parallel_for(js, triangle_count, job_grain(js, triangle_count, 4096), bvh_triangle_bounds_job, &job);
+    bvh_build_node(&b, 0, 0, triangle_count, 0);
+
+    bvh->node_count = b.node_count.load();
+    bvh->nodes = (BvhNode*) gp_aligned_malloc(bvh->node_count * sizeof(BvhNode), 64);
+    int next = 0;
+    bvh_flatten(bvh, b.nodes, 0, &next);
+
+    bvh->triangle_count = triangle_count;
+    bvh->indices = b.indices;
+    bvh->triangles = (BvhTriangle*) malloc(M_MAX(triangle_count, 1) * sizeof(BvhTriangle));
+    parallel_for(js, triangle_count, job_grain(js, triangle_count, 4096), bvh_copy_triangles_job, &job);
+
+    free(b.centroids);
+    free(b.tri_min);
+    free(b.tri_max);
+    free(b.nodes);
+}
+
+void free_bvh(Bvh* bvh) {
+    gp_aligned_free(bvh->nodes);
+    free(bvh->triangles);
+    free(bvh->indices);
+    memset(bvh, 0, sizeof(Bvh));
+}
+
+// Expected cost of a ray under the heuristic, relative to one triangle test
+float bvh_sah_cost(const Bvh* bvh) {
+    float root = bvh_half_area(&bvh->nodes[0].min, &bvh->nodes[0].max);
+    float cost = 0.0f;
+    for (int i = 0; i < bvh->node_count; ++i) {
+        const BvhNode* n = &bvh->nodes[i];
+        float p = bvh_half_area(&n->min, &n->max) / root;
+        cost += n->count > 0 ? p * n->count : p * BVH_TRAVERSAL_COST;
+    }
+    return cost;
+}
+
+////////////////////////////////////////////////////
+// traversal
+
+typedef struct BvhRay {
+    float3 origin;
+    float3 direction;
+    float3 inv_direction;
+    int negative[3]; // direction < 0 per axis, the high child is visited first
+} BvhRay;
+
+void init_bvh_ray(BvhRay* ray, const float3* origin, const float3* direction) {
+    ray->origin = *origin;
+    ray->direction = *direction;
+    set_float3(&ray->inv_direction, 1.0f / direction->x, 1.0f / direction->y, 1.0f / direction->z);
+    ray->negative[0] = direction->x < 0.0f;
+    ray->negative[1] = direction->y < 0.0f;
+    ray->negative[2] = direction->z < 0.0f;
+}
+
+// Slab test of the node box against [0, tmax]
+inline int bvh_ray_box(const BvhRay* ray, const BvhNode* node, float tmax) {
+    float tx0 = (node->min.x - ray->origin.x) * ray->inv_direction.x;
+    float tx1 = (node->max.x - ray->origin.x) * ray->inv_direction.x;
+    float ty0 = (node->min.y - ray->origin.y) * ray->inv_direction.y;
+    float ty1 = (node->max.y - ray->origin.y) * ray->inv_direction.y;
+    float tz0 = (node->min.z - ray->origin.z) * ray->inv_direction.z;
+    float tz1 = (node->max.z - ray->origin.z) * ray->inv_direction.z;
+    float tnear = M_MAX(M_MAX(M_MIN(tx0, tx1), M_MIN(ty0, ty1)), M_MAX(M_MIN(tz0, tz1), 0.0f));
+    float tfar = M_MIN(M_MIN(M_MAX(tx0, tx1), M_MAX(ty0, ty1)), M_MIN(M_MAX(tz0, tz1), tmax));
+    return tnear <= tfar;
+}
+
+// Möller-Trumbore, distance of the hit in (0, tmax) or 0
+inline float bvh_ray_triangle(const BvhRay* ray, const BvhTriangle* tri, float tmax, float* u, float* v) {
+    float3 pvec, tvec, qvec;
+    M_CROSS3(pvec, ray->direction, tri->e2);
+    float det = M_DOT3(tri->e1, pvec);
+    if (det == 0.0f) {
+        return 0.0f;
+    }
+    float inv_det = 1.0f / det;
+    M_SUB3(tvec, ray->origin, tri->v0);
+    *u = M_DOT3(tvec, pvec) * inv_det;
+    if (*u < 0.0f || *u > 1.0f) {
+        return 0.0f;
+    }
+    M_CROSS3(qvec, tvec, tri->e1);
+    *v = M_DOT3(ray->direction, qvec) * inv_det;
+    if (*v < 0.0f || *u + *v > 1.0f) {
+        return 0.0f;
+    }
+    float t = M_DOT3(tri->e2, qvec) * inv_det;
+    return t > 0.0f && t < tmax ? t : 0.0f;
+}
+
+// Closest triangle hit by the ray before tmax, 0 if there is none
+int bvh_intersect(const Bvh* bvh, const float3* origin, const float3* direction, float tmax, BvhHit* hit) {
+    BvhRay ray;
+    init_bvh_ray(&ray, origin, direction);
+    int stack[BVH_STACK];
+    int top = 0;
+    int node_index = 0;
+    int found = -1;
+    hit->t = tmax;
+    while (bvh->node_count > 0) {
+        const BvhNode* node = &bvh->nodes[node_index];
+        if (bvh_ray_box(&ray, node, hit->t)) {
+            if (node->count == 0) {
+                // near child first, the other one waits on the stack
+                if (ray.negative[node->axis]) {
+                    stack[top++] = node_index + 1;
+                    node_index = node->offset;
+                } else {
+                    stack[top++] = node->offset;
+                    node_index = node_index + 1;
+                }
+                continue;
+            }
+            for (int i = node->offset; i < node->offset + node->count; ++i) {
+                float u, v;
+                float t = bvh_ray_triangle(&ray, &bvh->triangles[i], hit->t, &u, &v);
+                if (t > 0.0f) {
+                    hit->t = t;
+                    hit->u = u;
+                    hit->v = v;
+                    found = i;
+                }
+            }
+        }
+        if (top == 0) {
+            break;
+        }
+        node_index = stack[--top];
+    }
+    hit->triangle = found >= 0 ? bvh->indices[found] : -1;
+    return found >= 0;
+}
+
+// 1 if any triangle is hit before tmax
+int bvh_occluded(const Bvh* bvh, const float3* origin, const float3* direction, float tmax) {
+    BvhRay ray;
+    init_bvh_ray(&ray, origin, direction);
+    int stack[BVH_STACK];
+    int top = 0;
+    int node_index = 0;
+    while (bvh->node_count > 0) {
+        const BvhNode* node = &bvh->nodes[node_index];
+        if (bvh_ray_box(&ray, node, tmax)) {
+            if (node->count == 0) {
+                stack[top++] = node->offset;
+                node_index = node_index + 1;
+                continue;
+            }
+            for (int i = node->offset; i < node->offset + node->count; ++i) {
+                float u, v;
+                if (bvh_ray_triangle(&ray, &bvh->triangles[i], tmax, &u, &v) > 0.0f) {
+                    return 1;
+                }
+            }
+        }
+        if (top == 0) {
+            break;
+        }
+        node_index = stack[--top];
+    }
+    return 0;
+}
+
+////////////////////////////////////////////////////
+// benchmark
+
+#define BVH_BENCH_MESH "models/FireHydrant/FireHydrantMesh.obj"
+#define BVH_BENCH_BUILDS 10
+#define BVH_BENCH_RAYS (1 << 20)
+#define BVH_BENCH_CHECKED_RAYS 2048
+
+uint64_t bvh_hash(const Bvh* bvh) {
+    uint64_t hash = 1469598103934665603ull;
+    const uint32_t* words = (const uint32_t*) bvh->nodes;
+    for (size_t i = 0; i < bvh->node_count * sizeof(BvhNode) / 4; ++i) {
+        hash = (hash ^ words[i]) * 1099511628211ull;
+    }
+    for (int i = 0; i < bvh->triangle_count; ++i) {
+        hash = (hash ^ (uint32_t) bvh->indices[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+typedef struct BvhRayJob {
+    const Bvh* bvh;
+    const float3* origins;
+    const float3* directions;
+    float* t;               // closest hit per ray, 0 for a miss
+    unsigned char* occluded;
+} BvhRayJob;
+
+void bvh_closest_job(void* data, int begin, int end) {
+    BvhRayJob* job = (BvhRayJob*) data;
+    for (int i = begin; i < end; ++i) {
+        BvhHit hit;
+        job->t[i] = bvh_intersect(job->bvh, &job->origins[i], &job->directions[i], FLT_MAX, &hit) ? hit.t : 0.0f;
+    }
+}
+
+void bvh_any_job(void* data, int begin, int end) {
+    BvhRayJob* job = (BvhRayJob*) data;
+    for (int i = begin; i < end; ++i) {
+        job->occluded[i] = (unsigned char) bvh_occluded(job->bvh, &job->origins[i], &job->directions[i], FLT_MAX);
+    }
+}
+
+// Closest hit over every triangle of the mesh, what the tree has to agree with
+float bvh_brute_force(const float* positions, int triangle_count, const float3* origin, const float3* direction) {
+    float best = 0.0f;
+    for (int t = 0; t < triangle_count; ++t) {
+        const float* p = positions + t * 9;
+        float3 v0 = {p[0], p[1], p[2]}, v1 = {p[3], p[4], p[5]}, v2 = {p[6], p[7], p[8]};
+        float u, v;
+        float d = m_3d_ray_triangle_intersection((float3*) origin, (float3*) direction, &v0, &v1, &v2, &u, &v);
+        if (d > 0.0f && (best == 0.0f || d < best)) {
+            best = d;
+        }
+    }
+    return best;
+}
+
+// --bench bvh: builds the tree of FireHydrantMesh.obj and traces rays from a sphere around it to points
+// inside its box, with 1 to max_workers workers. The tree has to be the same for every worker count and
+// the first rays are checked against a test of every triangle.
+void gp_bvh_benchmark(int max_workers) {
+    if (max_workers <= 0) {
+        max_workers = (int) std::thread::hardware_concurrency();
+    }
+    max_workers = M_CLAMP(max_workers, 1, JOBS_MAX_WORKERS);
+
+    MeshData data;
+    MeshBounds bounds;
+    if (!load_mesh_data(BVH_BENCH_MESH, &data, &bounds)) {
+        printf("bvh benchmark: can't load %s\n", BVH_BENCH_MESH);
+        return;
+    }
+    int triangle_count = data.vertex_count / 3;
+
+    int ray_count = BVH_BENCH_RAYS;
+    float3* origins = (float3*) malloc(ray_count * sizeof(float3));
+    float3* directions = (float3*) malloc(ray_count * sizeof(float3));
+    float* t = (float*) malloc(ray_count * sizeof(float));
+    float* reference_t = (float*) malloc(ray_count * sizeof(float));
+    unsigned char* occluded = (unsigned char*) malloc(ray_count);
+    m_srand(362436069, 521288629);
+    for (int i = 0; i < ray_count; ++i) {
+        float3 d = {rand_float_range(-1.0, 1.0), rand_float_range(-1.0, 1.0), rand_float_range(-1.0, 1.0)};
+        M_NORMALIZE3(d, d);
+        origins[i] = bounds.center;
+        origins[i].x += d.x * bounds.radius * 2.0f;
+        origins[i].y += d.y * bounds.radius * 2.0f;
+        origins[i].z += d.z * bounds.radius * 2.0f;
+        float3 target = {rand_float_range(bounds.min.x, bounds.max.x), rand_float_range(bounds.min.y, bounds.max.y),
+                         rand_float_range(bounds.min.z, bounds.max.z)};
+        M_SUB3(directions[i], target, origins[i]);
+        M_NORMALIZE3(directions[i], directions[i]);
+    }
+
+    printf("bvh benchmark: %s, %d triangles, %d rays, up to %d workers\n", BVH_BENCH_MESH, triangle_count, ray_count, max_workers);
+    uint64_t reference = 0;
+    double single_build = 0.0, single_closest = 0.0, single_any = 0.0;
+    Bvh bvh;
+    for (int workers = 1; workers <= max_workers; ++workers) {
+        JobSystem* js = create_job_system(workers);
+        g_timer timer;
+        double build_ms = 0.0;
+        for (int i = 0; i < BVH_BENCH_BUILDS; ++i) {
+            if (i > 0) {
+                free_bvh(&bvh);
+            }
+            start_timer(&timer);
+            build_bvh(&bvh, js, data.positions, triangle_count);
+            stop_timer(&timer);
+            build_ms += compute_timer_millis_diff(&timer);
+        }
+        build_ms /= BVH_BENCH_BUILDS;
+
+        BvhRayJob job = {&bvh, origins, directions, t, occluded};
+        int grain = job_grain(js, ray_count, 1024);
+        start_timer(&timer);
+        parallel_for(js, ray_count, grain, bvh_closest_job, &job);
+        stop_timer(&timer);
+        double closest_ms = compute_timer_millis_diff(&timer);
+        start_timer(&timer);
+        parallel_for(js, ray_count, grain, bvh_any_job, &job);
+        stop_timer(&timer);
+        double any_ms = compute_timer_millis_diff(&timer);
+        destroy_job_system(js);
+
+        int hits = 0, mismatches = 0;
+        for (int i = 0; i < ray_count; ++i) {
+            hits += t[i] > 0.0f;
+            mismatches += (t[i] > 0.0f) != (occluded[i] != 0);
+        }
+        uint64_t hash = bvh_hash(&bvh);
+        if (workers == 1) {
+            reference = hash;
+            single_build = build_ms;
+            single_closest = closest_ms;
+            single_any = any_ms;
+            memcpy(reference_t, t, ray_count * sizeof(float));
+            printf("  %d nodes, sah cost %.1f, %d of the rays hit\n", bvh.node_count, bvh_sah_cost(&bvh), hits);
+        }
+        mismatches += memcmp(reference_t, t, ray_count * sizeof(float)) != 0;
+        printf("  %2d workers  build %7.2f ms %5.2fx  closest %6.2f Mrays/s %5.2fx  any %6.2f Mrays/s %5.2fx%s\n", workers,
+               build_ms, single_build / build_ms, ray_count / closest_ms / 1000.0, single_closest / closest_ms,
+               ray_count / any_ms / 1000.0, single_any / any_ms, hash == reference && mismatches == 0 ? "" : "  MISMATCH");
+        if (workers < max_workers) {
+            free_bvh(&bvh);
+        }
+    }
+
+    int wrong = 0;
+    g_timer timer;
+    start_timer(&timer);
+    for (int i = 0; i < BVH_BENCH_CHECKED_RAYS; ++i) {
+        float expected = bvh_brute_force(data.positions, triangle_count, &origins[i], &directions[i]);
+        if ((expected > 0.0f) != (t[i] > 0.0f) || fabsf(expected - t[i]) > 1e-4f * expected) {
+            wrong++;
+        }
+    }
+    stop_timer(&timer);
+    double brute_ms = compute_timer_millis_diff(&timer);
+    printf("  brute force %6.3f Mrays/s, %d of %d rays differ%s\n", BVH_BENCH_CHECKED_RAYS / brute_ms / 1000.0, wrong,
+           BVH_BENCH_CHECKED_RAYS, wrong == 0 ? "" : "  MISMATCH");
+
+    free_bvh(&bvh);
+    free_mesh_data(&data);
+    free(origins);
+    free(directions);
+    free(t);
+    free(reference_t);
+    free(occluded);
+}
+
+#endif
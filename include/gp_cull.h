@@ -0,0 +1,338 @@
+#ifndef GP_CULL_H
+#define GP_CULL_H
+
+//
+// Frustum culling of bounding spheres.
+// Spheres are kept in SoA form (x, y, z, radius streams) padded to 8 elements, so the
+// SSE and AVX paths can test 4 or 8 spheres against a plane with aligned loads and no tail loop.
+// The AVX path is picked at runtime, the binary doesn't need to be built with -mavx.
+//
+
+#if defined(__SSE2__) || defined(_M_X64)
+    #define GP_CULL_SSE 1
+    #include <emmintrin.h>
+#endif
+
+#if defined(GP_CULL_SSE) && defined(__GNUC__)
+    #define GP_CULL_AVX 1
+    #include <immintrin.h>
+#endif
+
+#define CULL_ALIGNMENT 32
+#define CULL_WIDTH 8
+
+// Radius for objects that should never be culled (arrows, anything without bounds)
+#define CULL_NEVER_RADIUS 1e30f
+
+enum CullPath {
+    CULL_PATH_SCALAR = 0,
+    CULL_PATH_SSE,
+    CULL_PATH_AVX
+};
+
+typedef struct CullSpheres {
+    float* x;
+    float* y;
+    float* z;
+    float* r;
+    unsigned char* visible;
+    int count;
+    int capacity; // always a multiple of CULL_WIDTH
+} CullSpheres;
+
+typedef struct CullStats {
+    int tested;
+    int visible;
+    int culled;
+} CullStats;
+
+int cull_round_up(int count) {
+    return (count + CULL_WIDTH - 1) & ~(CULL_WIDTH - 1);
+}
+
+void free_cull_spheres(CullSpheres* s) {
+    gp_aligned_free(s->x);
+    gp_aligned_free(s->y);
+    gp_aligned_free(s->z);
+    gp_aligned_free(s->r);
+    gp_aligned_free(s->visible);
+    memset(s, 0, sizeof(CullSpheres));
+}
+
+void resize_cull_spheres(CullSpheres* s, int count) {
+    int capacity = cull_round_up(count);
+    if (capacity > s->capacity) {
+        free_cull_spheres(s);
+        capacity = M_MAX(capacity, CULL_WIDTH);
+        s->x = (float*) gp_aligned_malloc(capacity * sizeof(float), CULL_ALIGNMENT);
+        s->y = (float*) gp_aligned_malloc(capacity * sizeof(float), CULL_ALIGNMENT);
+        s->z = (float*) gp_aligned_malloc(capacity * sizeof(float), CULL_ALIGNMENT);
+        s->r = (float*) gp_aligned_malloc(capacity * sizeof(float), CULL_ALIGNMENT);
+        s->visible = (unsigned char*) gp_aligned_malloc(capacity, CULL_ALIGNMENT);
+        s->capacity = capacity;
+    }
+    s->count = count;
+
+    // padding lanes are tested too, give them something harmless
+    for (int i = count; i < cull_round_up(count); ++i) {
+        s->x[i] = 0.0f;
+        s->y[i] = 0.0f;
+        s->z[i] = 0.0f;
+        s->r[i] = -1.0f;
+    }
+}
+
+// World space sphere of a mesh under model_matrix. The radius is scaled by the largest axis scale.
+void set_cull_sphere(CullSpheres* s, int index, const float* model_matrix, const MeshBounds* bounds) {
+    if (bounds == NULL) {
+        s->x[index] = model_matrix[12];
+        s->y[index] = model_matrix[13];
+        s->z[index] = model_matrix[14];
+        s->r[index] = CULL_NEVER_RADIUS;
+        return;
+    }
+
+    float3 center;
+    m_mat4_transform3(&center, model_matrix, &bounds->center);
+
+    float sx = model_matrix[0] * model_matrix[0] + model_matrix[1] * model_matrix[1] + model_matrix[2] * model_matrix[2];
+    float sy = model_matrix[4] * model_matrix[4] + model_matrix[5] * model_matrix[5] + model_matrix[6] * model_matrix[6];
+    float sz = model_matrix[8] * model_matrix[8] + model_matrix[9] * model_matrix[9] + model_matrix[10] * model_matrix[10];
+    float scale = sqrtf(M_MAX(sx, M_MAX(sy, sz)));
+
+    s->x[index] = center.x;
+    s->y[index] = center.y;
+    s->z[index] = center.z;
+    s->r[index] = bounds->radius * scale;
+}
+
+// Gribb/Hartmann plane extraction from a column major view_projection matrix.
+// Planes are left, right, bottom, top, near, far, normalized and pointing inside.
+void extract_frustum_planes(float4* planes, const float* m) {
+    for (int i = 0; i < 3; ++i) {
+        float4* a = &planes[i * 2 + 0];
+        float4* b = &planes[i * 2 + 1];
+        a->x = m[3] + m[i];
+        a->y = m[7] + m[4 + i];
+        a->z = m[11] + m[8 + i];
+        a->w = m[15] + m[12 + i];
+        b->x = m[3] - m[i];
+        b->y = m[7] - m[4 + i];
+        b->z = m[11] - m[8 + i];
+        b->w = m[15] - m[12 + i];
+    }
+
+    for (int i = 0; i < 6; ++i) {
+        float l = sqrtf(planes[i].x * planes[i].x + planes[i].y * planes[i].y + planes[i].z * planes[i].z);
+        if (l > 0.0f) {
+            float inv = 1.0f / l;
+            planes[i].x *= inv;
+            planes[i].y *= inv;
+            planes[i].z *= inv;
+            planes[i].w *= inv;
+        }
+    }
+}
+
+////////////////////////////////////////////////////
+// kernels, all of them test [first, first + count) where first is a multiple of CULL_WIDTH
+
+int cull_spheres_scalar(const float4* planes, CullSpheres* s, int first, int count) {
+    int visible_count = 0;
+    for (int i = first; i < first + count; ++i) {
+        int visible = 1;
+        for (int p = 0; p < 6; ++p) {
+            float d = planes[p].x * s->x[i] + planes[p].y * s->y[i] + planes[p].z * s->z[i] + planes[p].w;
+            if (d < -s->r[i]) {
+                visible = 0;
+                break;
+            }
+        }
+        s->visible[i] = visible;
+        visible_count += visible;
+    }
+    return visible_count;
+}
+
+#ifdef GP_CULL_SSE
+int cull_spheres_sse(const float4* planes, CullSpheres* s, int first, int count) {
+    int visible_count = 0;
+    int end = first + count;
+    int simd_end = first + (count & ~3);
+
+    __m128 px[6], py[6], pz[6], pw[6];
+    for (int p = 0; p < 6; ++p) {
+        px[p] = _mm_set1_ps(planes[p].x);
+        py[p] = _mm_set1_ps(planes[p].y);
+        pz[p] = _mm_set1_ps(planes[p].z);
+        pw[p] = _mm_set1_ps(planes[p].w);
+    }
+    __m128 zero = _mm_setzero_ps();
+
+    for (int i = first; i < simd_end; i += 4) {
+        __m128 x = _mm_load_ps(&s->x[i]);
+        __m128 y = _mm_load_ps(&s->y[i]);
+        __m128 z = _mm_load_ps(&s->z[i]);
+        __m128 neg_r = _mm_sub_ps(zero, _mm_load_ps(&s->r[i]));
+
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (int p = 0; p < 6; ++p) {
+            __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px[p], x), _mm_mul_ps(py[p], y)),
+                                  _mm_add_ps(_mm_mul_ps(pz[p], z), pw[p]));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(d, neg_r));
+        }
+
+        int mask = _mm_movemask_ps(inside);
+        s->visible[i + 0] = (mask >> 0) & 1;
+        s->visible[i + 1] = (mask >> 1) & 1;
+        s->visible[i + 2] = (mask >> 2) & 1;
+        s->visible[i + 3] = (mask >> 3) & 1;
+        visible_count += s->visible[i + 0] + s->visible[i + 1] + s->visible[i + 2] + s->visible[i + 3];
+    }
+
+    if (simd_end < end) {
+        visible_count += cull_spheres_scalar(planes, s, simd_end, end - simd_end);
+    }
+    return visible_count;
+}
+#endif
+
+#ifdef GP_CULL_AVX
+__attribute__((target("avx")))
+int cull_spheres_avx(const float4* planes, CullSpheres* s, int first, int count) {
+    int visible_count = 0;
+    int end = first + count;
+    int simd_end = first + (count & ~7);
+
+    __m256 px[6], py[6], pz[6], pw[6];
+    for (int p = 0; p < 6; ++p) {
+        px[p] = _mm256_set1_ps(planes[p].x);
+        py[p] = _mm256_set1_ps(planes[p].y);
+        pz[p] = _mm256_set1_ps(planes[p].z);
+        pw[p] = _mm256_set1_ps(planes[p].w);
+    }
+    __m256 zero = _mm256_setzero_ps();
+
+    for (int i = first; i < simd_end; i += 8) {
+        __m256 x = _mm256_load_ps(&s->x[i]);
+        __m256 y = _mm256_load_ps(&s->y[i]);
+        __m256 z = _mm256_load_ps(&s->z[i]);
+        __m256 neg_r = _mm256_sub_ps(zero, _mm256_load_ps(&s->r[i]));
+
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (int p = 0; p < 6; ++p) {
+            __m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(px[p], x), _mm256_mul_ps(py[p], y)),
+                                     _mm256_add_ps(_mm256_mul_ps(pz[p], z), pw[p]));
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(d, neg_r, _CMP_GE_OQ));
+        }
+
+        int mask = _mm256_movemask_ps(inside);
+        for (int k = 0; k < 8; ++k) {
+            s->visible[i + k] = (mask >> k) & 1;
+        }
+        visible_count += __builtin_popcount(mask);
+    }
+
+    if (simd_end < end) {
+        visible_count += cull_spheres_scalar(planes, s, simd_end, end - simd_end);
+    }
+    return visible_count;
+}
+#endif
+
+int cull_best_path() {
+    static int path = -1;
+    if (path < 0) {
+        path = CULL_PATH_SCALAR;
+#ifdef GP_CULL_SSE
+        path = CULL_PATH_SSE;
+#endif
+#ifdef GP_CULL_AVX
+        if (__builtin_cpu_supports("avx")) {
+            path = CULL_PATH_AVX;
+        }
+#endif
+    }
+    return path;
+}
+
+int cull_spheres_path(int path, const float4* planes, CullSpheres* s, int first, int count) {
+    switch (path) {
+#ifdef GP_CULL_AVX
+        case CULL_PATH_AVX: return cull_spheres_avx(planes, s, first, count);
+#endif
+#ifdef GP_CULL_SSE
+        case CULL_PATH_SSE: return cull_spheres_sse(planes, s, first, count);
+#endif
+        default: return cull_spheres_scalar(planes, s, first, count);
+    }
+}
+
+// Tests spheres [first, first + count) and fills s->visible, returns how many are visible
+int cull_spheres_range(const float4* planes, CullSpheres* s, int first, int count) {
+    return cull_spheres_path(cull_best_path(), planes, s, first, count);
+}
+
+void cull_spheres(const float4* planes, CullSpheres* s, CullStats* stats) {
+    int visible = cull_spheres_range(planes, s, 0, s->count);
+    stats->tested = s->count;
+    stats->visible = visible;
+    stats->culled = s->count - visible;
+}
+
+////////////////////////////////////////////////////
+// benchmark
+
+void gp_cull_benchmark() {
+    const char* path_names[] = {"scalar", "sse", "avx"};
+    int count = 4 * 1024 * 1024;
+    int repeats = 10;
+
+    CullSpheres spheres;
+    memset(&spheres, 0, sizeof(CullSpheres));
+    resize_cull_spheres(&spheres, count);
+
+    m_srand(362436069, 521288629);
+    for (int i = 0; i < count; ++i) {
+        spheres.x[i] = rand_float_range(-100.0, 100.0);
+        spheres.y[i] = rand_float_range(-100.0, 100.0);
+        spheres.z[i] = rand_float_range(-100.0, 100.0);
+        spheres.r[i] = rand_float_range(0.1, 2.0);
+    }
+
+    float projection[] = M_MAT4_IDENTITY();
+    float view[] = M_MAT4_IDENTITY();
+    float view_projection[16];
+    float3 pos = {0.0, 0.0, 0.0};
+    float3 dir = {0.0, 0.0, -1.0};
+    float3 up = {0.0, 1.0, 0.0};
+    m_mat4_perspective(projection, 0.6, 16.0 / 9.0, 0.1, 100.0);
+    m_mat4_lookat(view, &pos, &dir, &up);
+    m_mat4_mul(view_projection, projection, view);
+
+    float4 planes[6];
+    extract_frustum_planes(planes, view_projection);
+
+    printf("cull benchmark: %d spheres, best path %s\n", count, path_names[cull_best_path()]);
+    int reference = -1;
+    for (int path = CULL_PATH_SCALAR; path <= cull_best_path(); ++path) {
+        g_timer timer;
+        int visible = 0;
+        start_timer(&timer);
+        for (int r = 0; r < repeats; ++r) {
+            visible = cull_spheres_path(path, planes, &spheres, 0, count);
+        }
+        stop_timer(&timer);
+        float ms = compute_timer_millis_diff(&timer) / repeats;
+
+        if (reference < 0) {
+            reference = visible;
+        }
+        printf("  %-6s %8.3f ms  %8.2f M spheres/ms  visible %d culled %d%s\n", path_names[path], ms, (count / 1000000.0) / ms,
+               visible, count - visible, visible == reference ? "" : "  MISMATCH");
+    }
+
+    free_cull_spheres(&spheres);
+}
+
+#endif
@@ -0,0 +1,126 @@
+#ifndef GP_DEFERRED_H
+#define GP_DEFERRED_H
+
+//
+// G-buffer for deferred shading
+// The geometry pass writes the surface of every pixel to three small color targets and a depth texture,
+// then a fullscreen pass evaluates the lights once per pixel, so the lighting cost no longer depends on
+// how many triangles or overlapping objects end up on screen.
+//
+//   albedo_ao  RGBA8   albedo rgb, ambient occlusion
+//   normal     RG16    view space normal, octahedral encoding mapped to [0, 1]
+//   material   RG8     metallic, roughness
+//   depth      DEPTH24_STENCIL8, same format as the usual default framebuffer so it can be blitted there
+//
+// View position is rebuilt from depth and the projection, nothing else needs to be stored.
+//
+
+#define GBUFFER_TARGETS 3
+// units of albedo_ao, normal, material and depth in the lighting pass, followed by each other
+#define GBUFFER_TEXTURE_UNIT 0
+
+typedef struct GBuffer {
+    GLuint fbo;
+    GLuint albedo_ao;
+    GLuint normal;
+    GLuint material;
+    GLuint depth;
+    GLuint vao; // empty, the fullscreen triangle comes from gl_VertexID
+    int width;
+    int height;
+} GBuffer;
+
+GLuint create_gbuffer_texture(GLenum internal_format, GLenum format, GLenum type, int width, int height) {
+    GLuint texture;
+    glGenTextures(1, &texture);
+    gp_gl_bind_texture(0, GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, internal_format, width, height, 0, format, type, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    return texture;
+}
+
+int create_gbuffer(GBuffer* gb, int width, int height) {
+    memset(gb, 0, sizeof(GBuffer));
+    gb->width = width;
+    gb->height = height;
+    gb->albedo_ao = create_gbuffer_texture(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, width, height);
+    gb->normal = create_gbuffer_texture(GL_RG16, GL_RG, GL_UNSIGNED_SHORT, width, height);
+    gb->material = create_gbuffer_texture(GL_RG8, GL_RG, GL_UNSIGNED_BYTE, width, height);
+    gb->depth = create_gbuffer_texture(GL_DEPTH24_STENCIL8, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, width, height);
+
+    glGenFramebuffers(1, &gb->fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, gb->fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, gb->albedo_ao, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, gb->normal, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, gb->material, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, gb->depth, 0);
+    GLenum targets[GBUFFER_TARGETS] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2};
+    glDrawBuffers(GBUFFER_TARGETS, targets);
+
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        printf("create_gbuffer: framebuffer incomplete 0x%x\n", status);
+        return 0;
+    }
+
+    glGenVertexArrays(1, &gb->vao);
+    return 1;
+}
+
+void free_gbuffer(GBuffer* gb) {
+    if (gb->fbo == 0) {
+        return;
+    }
+    gp_gl_delete_texture(gb->albedo_ao);
+    gp_gl_delete_texture(gb->normal);
+    gp_gl_delete_texture(gb->material);
+    gp_gl_delete_texture(gb->depth);
+    glDeleteFramebuffers(1, &gb->fbo);
+    gp_gl_delete_vertex_array(gb->vao);
+    memset(gb, 0, sizeof(GBuffer));
+}
+
+// Geometry pass target, cleared to no surface and far depth without touching the clear color
+void begin_gbuffer_pass(GBuffer* gb) {
+    float zero[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    glBindFramebuffer(GL_FRAMEBUFFER, gb->fbo);
+    for (int i = 0; i < GBUFFER_TARGETS; ++i) {
+        glClearBufferfv(GL_COLOR, i, zero);
+    }
+    glClearBufferfi(GL_DEPTH_STENCIL, 0, 1.0f, 0);
+}
+
+void end_gbuffer_pass() {
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void bind_gbuffer_textures(GBuffer* gb) {
+    gp_gl_bind_texture(GBUFFER_TEXTURE_UNIT + 0, GL_TEXTURE_2D, gb->albedo_ao);
+    gp_gl_bind_texture(GBUFFER_TEXTURE_UNIT + 1, GL_TEXTURE_2D, gb->normal);
+    gp_gl_bind_texture(GBUFFER_TEXTURE_UNIT + 2, GL_TEXTURE_2D, gb->material);
+    gp_gl_bind_texture(GBUFFER_TEXTURE_UNIT + 3, GL_TEXTURE_2D, gb->depth);
+}
+
+// Fullscreen triangle with the lighting program already in use, pixels without a surface are discarded
+void draw_gbuffer_lighting(GBuffer* gb) {
+    bind_gbuffer_textures(gb);
+    gp_gl_bind_vertex_array(gb->vao);
+    glDisable(GL_DEPTH_TEST);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glEnable(GL_DEPTH_TEST);
+}
+
+// Copies the depth to the default framebuffer, objects drawn forward after the lighting pass are still
+// hidden by the deferred ones
+void blit_gbuffer_depth(GBuffer* gb) {
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, gb->fbo);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    glBlitFramebuffer(0, 0, gb->width, gb->height, 0, 0, gb->width, gb->height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+#endif
@@ -0,0 +1,202 @@
+#ifndef GP_GL_STATE_H
+#define GP_GL_STATE_H
+
+//
+// Thin cache over the glad entry points that skips binds that would not change anything.
+// Everything that binds programs, VAOs, textures or buffers should go through here,
+// otherwise the cache goes out of sync with the driver.
+// Code we don't own (mv_easy_font) is handled with gp_gl_state_forget() after the call.
+//
+
+#define GP_GL_MAX_TEXTURE_UNITS 16
+#define GP_GL_MAX_BUFFER_TARGETS 5
+
+// value that no real binding can have, forces the next bind through
+#define GP_GL_UNKNOWN 0xFFFFFFFFu
+
+// flags for gp_gl_state_forget
+#define GP_GL_STATE_PROGRAM        (1 << 0)
+#define GP_GL_STATE_VERTEX_ARRAY   (1 << 1)
+#define GP_GL_STATE_ACTIVE_TEXTURE (1 << 2)
+#define GP_GL_STATE_TEXTURES       (1 << 3)
+#define GP_GL_STATE_BUFFERS        (1 << 4)
+#define GP_GL_STATE_ALL            0xFF
+
+typedef struct GLStateStats {
+    int program_calls;
+    int program_elided;
+    int vertex_array_calls;
+    int vertex_array_elided;
+    int active_texture_calls;
+    int active_texture_elided;
+    int texture_calls;
+    int texture_elided;
+    int buffer_calls;
+    int buffer_elided;
+} GLStateStats;
+
+typedef struct GLStateCache {
+    GLuint program;
+    GLuint vertex_array;
+    GLuint active_unit;
+    GLenum texture_targets[GP_GL_MAX_TEXTURE_UNITS];
+    GLuint textures[GP_GL_MAX_TEXTURE_UNITS];
+    GLuint buffers[GP_GL_MAX_BUFFER_TARGETS];
+
+    GLStateStats frame;      // counters of the frame in progress
+    GLStateStats last_frame; // counters of the last finished frame, for display
+} GLStateCache;
+
+GLStateCache gl_state;
+
+void gp_gl_state_forget(int flags) {
+    if (flags & GP_GL_STATE_PROGRAM) {
+        gl_state.program = GP_GL_UNKNOWN;
+    }
+    if (flags & GP_GL_STATE_VERTEX_ARRAY) {
+        gl_state.vertex_array = GP_GL_UNKNOWN;
+        // GL_ELEMENT_ARRAY_BUFFER is part of the VAO
+        gl_state.buffers[1] = GP_GL_UNKNOWN;
+    }
+    if (flags & GP_GL_STATE_ACTIVE_TEXTURE) {
+        gl_state.active_unit = GP_GL_UNKNOWN;
+    }
+    if (flags & GP_GL_STATE_TEXTURES) {
+        for (int i = 0; i < GP_GL_MAX_TEXTURE_UNITS; ++i) {
+            gl_state.texture_targets[i] = 0;
+            gl_state.textures[i] = GP_GL_UNKNOWN;
+        }
+    }
+    if (flags & GP_GL_STATE_BUFFERS) {
+        for (int i = 0; i < GP_GL_MAX_BUFFER_TARGETS; ++i) {
+            gl_state.buffers[i] = GP_GL_UNKNOWN;
+        }
+    }
+}
+
+void gp_gl_state_init() {
+    memset(&gl_state, 0, sizeof(GLStateCache));
+    gp_gl_state_forget(GP_GL_STATE_ALL);
+}
+
+// Call once per frame, before drawing. Keeps the counters of the frame that just ended in last_frame.
+void gp_gl_state_new_frame() {
+    gl_state.last_frame = gl_state.frame;
+    memset(&gl_state.frame, 0, sizeof(GLStateStats));
+}
+
+int gp_gl_state_elided(GLStateStats* stats) {
+    return stats->program_elided + stats->vertex_array_elided + stats->active_texture_elided + stats->texture_elided + stats->buffer_elided;
+}
+
+int gp_gl_state_calls(GLStateStats* stats) {
+    return stats->program_calls + stats->vertex_array_calls + stats->active_texture_calls + stats->texture_calls + stats->buffer_calls;
+}
+
+void gp_gl_use_program(GLuint program) {
+    gl_state.frame.program_calls++;
+    if (gl_state.program == program) {
+        gl_state.frame.program_elided++;
+        return;
+    }
+    gl_state.program = program;
+    glUseProgram(program);
+}
+
+// Deleting a bound program, VAO, texture or buffer frees the name for reuse, the cache must not remember it.
+void gp_gl_delete_program(GLuint program) {
+    if (gl_state.program == program) {
+        gl_state.program = GP_GL_UNKNOWN;
+    }
+    glDeleteProgram(program);
+}
+
+void gp_gl_bind_vertex_array(GLuint vao) {
+    gl_state.frame.vertex_array_calls++;
+    if (gl_state.vertex_array == vao) {
+        gl_state.frame.vertex_array_elided++;
+        return;
+    }
+    gl_state.vertex_array = vao;
+    gl_state.buffers[1] = GP_GL_UNKNOWN;
+    glBindVertexArray(vao);
+}
+
+void gp_gl_delete_vertex_array(GLuint vao) {
+    if (gl_state.vertex_array == vao) {
+        gl_state.vertex_array = GP_GL_UNKNOWN;
+    }
+    glDeleteVertexArrays(1, &vao);
+}
+
+void gp_gl_active_texture(int unit) {
+    assert(unit >= 0 && unit < GP_GL_MAX_TEXTURE_UNITS);
+    gl_state.frame.active_texture_calls++;
+    if (gl_state.active_unit == (GLuint)unit) {
+        gl_state.frame.active_texture_elided++;
+        return;
+    }
+    gl_state.active_unit = unit;
+    glActiveTexture(GL_TEXTURE0 + unit);
+}
+
+// Binds texture to the given unit. The active unit is only switched when the bind is really needed.
+void gp_gl_bind_texture(int unit, GLenum target, GLuint texture) {
+    assert(unit >= 0 && unit < GP_GL_MAX_TEXTURE_UNITS);
+    gl_state.frame.texture_calls++;
+    if (gl_state.textures[unit] == texture && gl_state.texture_targets[unit] == target) {
+        gl_state.frame.texture_elided++;
+        return;
+    }
+    gp_gl_active_texture(unit);
+    gl_state.textures[unit] = texture;
+    gl_state.texture_targets[unit] = target;
+    glBindTexture(target, texture);
+}
+
+void gp_gl_delete_texture(GLuint texture) {
+    for (int i = 0; i < GP_GL_MAX_TEXTURE_UNITS; ++i) {
+        if (gl_state.textures[i] == texture) {
+            gl_state.textures[i] = GP_GL_UNKNOWN;
+        }
+    }
+    glDeleteTextures(1, &texture);
+}
+
+int gp_gl_buffer_slot(GLenum target) {
+    switch (target) {
+        case GL_ARRAY_BUFFER: return 0;
+        case GL_ELEMENT_ARRAY_BUFFER: return 1;
+        case GL_UNIFORM_BUFFER: return 2;
+        case GL_TEXTURE_BUFFER: return 3;
+        case GL_DRAW_INDIRECT_BUFFER: return 4;
+        default: return -1;
+    }
+}
+
+void gp_gl_bind_buffer(GLenum target, GLuint buffer) {
+    int slot = gp_gl_buffer_slot(target);
+    gl_state.frame.buffer_calls++;
+    if (slot < 0) {
+        // not tracked, always goes through
+        glBindBuffer(target, buffer);
+        return;
+    }
+    if (gl_state.buffers[slot] == buffer) {
+        gl_state.frame.buffer_elided++;
+        return;
+    }
+    gl_state.buffers[slot] = buffer;
+    glBindBuffer(target, buffer);
+}
+
+void gp_gl_delete_buffer(GLuint buffer) {
+    for (int i = 0; i < GP_GL_MAX_BUFFER_TARGETS; ++i) {
+        if (gl_state.buffers[i] == buffer) {
+            gl_state.buffers[i] = GP_GL_UNKNOWN;
+        }
+    }
+    glDeleteBuffers(1, &buffer);
+}
+
+#endif
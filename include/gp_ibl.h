@@ -0,0 +1,1341 @@
+#ifndef GP_IBL_H
+#define GP_IBL_H
+
+//
+// Image based lighting baked on the CPU
+// bake_ibl loads an equirectangular HDR with stbi_loadf and precomputes, on every worker of the job system,
+// what the PBR shaders need to light a surface with the environment (split sum approximation):
+//   irradiance   9 spherical harmonic coefficients per channel, convolved with the cosine lobe and divided
+//                by pi, so the diffuse term is albedo * sh(N)
+//   prefiltered  cubemap whose mip m is the environment convolved with GGX at roughness m / (IBL_MIPS - 1).
+//                Samples are importance sampled and read the source mip whose texels cover about the same
+//                solid angle, which keeps a low sample count free of fireflies.
+//   BRDF LUT     scale and bias on F0 of the specular integral, by NdotV (x) and roughness (y)
+//
+// The equirect is first resampled into a source cubemap with a box filtered mip chain, everything after
+// reads that. Every stage works on IBL_WIDTH texels at once with SSE, every lane sums its own texel in the
+// same order as the scalar path, so both give the same bits whatever the worker count. bake_ibl times every
+// stage.
+//
+// Results are saved to <directory>/<key>.ibl, the key hashes the HDR file and the bake parameters, so a
+// later run with the same file only reads them back.
+//
+
+#include "stb_image.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define GP_IBL_SSE
+#endif
+
+#define IBL_MAGIC 0x4c424947u // "GIBL"
+#define IBL_VERSION 2
+#define IBL_PATH 512
+
+#define IBL_SOURCE_SIZE 256 // faces of the source cubemap
+#define IBL_SOURCE_MIPS 9   // 256 .. 1
+#define IBL_SIZE 128        // faces of the prefiltered cubemap, mip 0 is the source mip of the same size
+#define IBL_MIPS 5          // 128 .. 8, all multiples of IBL_WIDTH
+#define IBL_SAMPLES 64      // GGX samples per prefiltered texel
+#define IBL_LUT_SIZE 128
+#define IBL_LUT_SAMPLES 256
+#define IBL_SH_COEFFS 9
+#define IBL_WIDTH 4
+// unit of the prefiltered cubemap, the BRDF LUT takes the next one. After the light clusters.
+#define IBL_TEXTURE_UNIT 9
+
+enum IBLPath {
+    IBL_PATH_SCALAR = 0,
+    IBL_PATH_SSE
+};
+
+enum IBLStage {
+    IBL_STAGE_LOAD = 0,
+    IBL_STAGE_CUBE,
+    IBL_STAGE_SH,
+    IBL_STAGE_PREFILTER,
+    IBL_STAGE_LUT,
+    IBL_STAGE_CACHE,
+    IBL_STAGES
+};
+
+const char* ibl_stage_names[IBL_STAGES] = {"load", "cube", "sh", "prefilter", "lut", "cache"};
+
+// RGBA float texels, the six faces of a mip one after another in GL order +x, -x, +y, -y, +z, -z
+typedef struct IBLCube {
+    float* mips[IBL_SOURCE_MIPS];
+    int size; // of mip 0
+    int mip_count;
+} IBLCube;
+
+typedef struct IBL {
+    float sh[IBL_SH_COEFFS * 3];  // rgb of every coefficient
+    float* prefiltered[IBL_MIPS]; // RGBA, IBL_SIZE >> m per face
+    float* lut;                   // RG, IBL_LUT_SIZE rows of roughness
+    int baked;                    // 0 for the black environment used without an HDR
+
+    JobSystem* jobs; // NULL bakes on the calling thread
+    int path;
+    float ms[IBL_STAGES]; // of the last bake_ibl, stages it skipped are 0
+
+    GLuint prefiltered_texture;
+    GLuint lut_texture;
+    int texture_mips;
+} IBL;
+
+// d = s * [0] + t * [1] + [2] for the texel at (s, t) in [-1, 1] of every face, the GL cubemap conventions
+const float ibl_face_axes[6][3][3] = {
+    {{0.0f, 0.0f, -1.0f}, {0.0f, -1.0f, 0.0f}, {1.0f, 0.0f, 0.0f}},
+    {{0.0f, 0.0f, 1.0f}, {0.0f, -1.0f, 0.0f}, {-1.0f, 0.0f, 0.0f}},
+    {{1.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 1.0f}, {0.0f, 1.0f, 0.0f}},
+    {{1.0f, 0.0f, 0.0f}, {0.0f, 0.0f, -1.0f}, {0.0f, -1.0f, 0.0f}},
+    {{1.0f, 0.0f, 0.0f}, {0.0f, -1.0f, 0.0f}, {0.0f, 0.0f, 1.0f}},
+    {{-1.0f, 0.0f, 0.0f}, {0.0f, -1.0f, 0.0f}, {0.0f, 0.0f, -1.0f}},
+};
+
+int ibl_best_path() {
+#ifdef GP_IBL_SSE
+    return IBL_PATH_SSE;
+#else
+    return IBL_PATH_SCALAR;
+#endif
+}
+
+void init_ibl(IBL* ibl) {
+    memset(ibl, 0, sizeof(IBL));
+    ibl->path = ibl_best_path();
+}
+
+float* alloc_ibl_floats(int count) {
+    return (float*) gp_aligned_malloc(count * sizeof(float), 16);
+}
+
+void free_ibl_cube(IBLCube* cube) {
+    for (int m = 0; m < cube->mip_count; ++m) {
+        gp_aligned_free(cube->mips[m]);
+    }
+    memset(cube, 0, sizeof(IBLCube));
+}
+
+void free_ibl_data(IBL* ibl) {
+    for (int m = 0; m < IBL_MIPS; ++m) {
+        gp_aligned_free(ibl->prefiltered[m]);
+        ibl->prefiltered[m] = NULL;
+    }
+    gp_aligned_free(ibl->lut);
+    ibl->lut = NULL;
+    ibl->baked = 0;
+}
+
+void alloc_ibl_data(IBL* ibl) {
+    free_ibl_data(ibl);
+    for (int m = 0; m < IBL_MIPS; ++m) {
+        int size = IBL_SIZE >> m;
+        ibl->prefiltered[m] = alloc_ibl_floats(6 * size * size * 4);
+    }
+    ibl->lut = alloc_ibl_floats(IBL_LUT_SIZE * IBL_LUT_SIZE * 2);
+}
+
+// Face a direction goes through and where, in [0, 1]. Ties go to x, then y, like the SSE version.
+int ibl_cube_face(float x, float y, float z, float* u, float* v) {
+    float ax = fabsf(x);
+    float ay = fabsf(y);
+    float az = fabsf(z);
+    int face;
+    float sc, tc, ma;
+    if (ax >= ay && ax >= az) {
+        face = x >= 0.0f ? 0 : 1;
+        sc = x >= 0.0f ? -z : z;
+        tc = -y;
+        ma = ax;
+    } else if (ay >= az) {
+        face = y >= 0.0f ? 2 : 3;
+        sc = x;
+        tc = y >= 0.0f ? z : -z;
+        ma = ay;
+    } else {
+        face = z >= 0.0f ? 4 : 5;
+        sc = z >= 0.0f ? x : -x;
+        tc = -y;
+        ma = az;
+    }
+    *u = 0.5f * (sc / ma + 1.0f);
+    *v = 0.5f * (tc / ma + 1.0f);
+    return face;
+}
+
+// Bilinear inside one face, texels past the edge are clamped instead of read from the next face
+void ibl_bilinear_setup(int size, float u, float v, int* offsets, float* weights) {
+    float fx = M_CLAMP(u * size - 0.5f, 0.0f, (float)(size - 1));
+    float fy = M_CLAMP(v * size - 0.5f, 0.0f, (float)(size - 1));
+    int x0 = (int) fx;
+    int y0 = (int) fy;
+    int x1 = M_MIN(x0 + 1, size - 1);
+    int y1 = M_MIN(y0 + 1, size - 1);
+    float wx = fx - x0;
+    float wy = fy - y0;
+    offsets[0] = (y0 * size + x0) * 4;
+    offsets[1] = (y0 * size + x1) * 4;
+    offsets[2] = (y1 * size + x0) * 4;
+    offsets[3] = (y1 * size + x1) * 4;
+    weights[0] = (1.0f - wx) * (1.0f - wy);
+    weights[1] = wx * (1.0f - wy);
+    weights[2] = (1.0f - wx) * wy;
+    weights[3] = wx * wy;
+}
+
+// equirect to cube
+
+typedef struct IBLCubeJob {
+    const float* equirect; // RGB, row 0 is straight up
+    int width;
+    int height;
+    IBLCube* cube;
+} IBLCubeJob;
+
+// atan2 and acos of the equirect lookup, polynomials instead of libm so the SSE path can do the same
+// operations in the same order and give the same bits. Errors of 2e-6 and 5e-7 radians, far below a texel.
+float ibl_atan2(float y, float x) {
+    float ax = fabsf(x);
+    float ay = fabsf(y);
+    float mx = ax > ay ? ax : ay;
+    float mn = ax < ay ? ax : ay;
+    float a = mn / (mx > 1e-30f ? mx : 1e-30f);
+    float s = a * a;
+    float r = (((((-0.01172120f * s + 0.05265332f) * s - 0.11643287f) * s + 0.19354346f) * s - 0.33262347f) * s + 0.99997726f) * a;
+    r = ay > ax ? 1.57079637f - r : r;
+    r = x < 0.0f ? 3.14159274f - r : r;
+    return y < 0.0f ? -r : r;
+}
+
+float ibl_acos(float x) {
+    float ax = fabsf(x);
+    float p = ((((((-0.0012624911f * ax + 0.0066700901f) * ax - 0.0170881256f) * ax + 0.0308918810f) * ax - 0.0501743046f) * ax + 0.0889789874f) * ax - 0.2145988016f) * ax + 1.5707963050f;
+    float r = sqrtf(1.0f - ax) * p;
+    return x < 0.0f ? 3.14159274f - r : r;
+}
+
+void equirect_sample(const IBLCubeJob* job, float x, float y, float z, float* rgb) {
+    float len = sqrtf(x * x + y * y + z * z);
+    float u = 0.5f + ibl_atan2(z, x) * (float)(0.5 / M_PI);
+    float v = ibl_acos(M_CLAMP(y / len, -1.0f, 1.0f)) * (float)(1.0 / M_PI);
+    float fx = u * job->width - 0.5f;
+    float fy = M_CLAMP(v * job->height - 0.5f, 0.0f, (float)(job->height - 1));
+    int x0 = (int) floorf(fx);
+    int y0 = (int) fy;
+    float wx = fx - x0;
+    float wy = fy - y0;
+    // u wraps around, v stops at the poles
+    int x1 = (x0 + 1 + job->width) % job->width;
+    x0 = (x0 + job->width) % job->width;
+    int y1 = M_MIN(y0 + 1, job->height - 1);
+    const float* row0 = job->equirect + (size_t) y0 * job->width * 3;
+    const float* row1 = job->equirect + (size_t) y1 * job->width * 3;
+    for (int c = 0; c < 3; ++c) {
+        rgb[c] = (row0[x0 * 3 + c] * (1.0f - wx) + row0[x1 * 3 + c] * wx) * (1.0f - wy)
+               + (row1[x0 * 3 + c] * (1.0f - wx) + row1[x1 * 3 + c] * wx) * wy;
+    }
+}
+
+// Rows of mip 0, item = face * size + row. Every texel averages 2x2 bilinear samples of the equirect.
+void equirect_to_cube_job(void* data, int begin, int end) {
+    IBLCubeJob* job = (IBLCubeJob*) data;
+    int size = job->cube->size;
+    float step = 2.0f / size;
+    for (int item = begin; item < end; ++item) {
+        int face = item / size;
+        int y = item % size;
+        const float (*axes)[3] = ibl_face_axes[face];
+        float* out = job->cube->mips[0] + (size_t) item * size * 4;
+        for (int x = 0; x < size; ++x) {
+            float sum[3] = {0.0f, 0.0f, 0.0f};
+            for (int sy = 0; sy < 2; ++sy) {
+                for (int sx = 0; sx < 2; ++sx) {
+                    float s = (x + 0.25f + 0.5f * sx) * step - 1.0f;
+                    float t = (y + 0.25f + 0.5f * sy) * step - 1.0f;
+                    float rgb[3];
+                    equirect_sample(job, s * axes[0][0] + t * axes[1][0] + axes[2][0],
+                                    s * axes[0][1] + t * axes[1][1] + axes[2][1],
+                                    s * axes[0][2] + t * axes[1][2] + axes[2][2], rgb);
+                    sum[0] += rgb[0];
+                    sum[1] += rgb[1];
+                    sum[2] += rgb[2];
+                }
+            }
+            out[x * 4 + 0] = sum[0] * 0.25f;
+            out[x * 4 + 1] = sum[1] * 0.25f;
+            out[x * 4 + 2] = sum[2] * 0.25f;
+            out[x * 4 + 3] = 1.0f;
+        }
+    }
+}
+
+#ifdef GP_IBL_SSE
+__m128 select_ps(__m128 mask, __m128 a, __m128 b) {
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+// Four texels of a row at a time, channels in SSE registers. Directions, ibl_atan2, ibl_acos and the
+// bilinear weights are computed for the four lanes at once, only the twelve texel reads are per lane.
+void equirect_to_cube_job_sse(void* data, int begin, int end) {
+    IBLCubeJob* job = (IBLCubeJob*) data;
+    int size = job->cube->size;
+    float step = 2.0f / size;
+    __m128 v_step = _mm_set1_ps(step);
+    __m128 one = _mm_set1_ps(1.0f);
+    __m128 half = _mm_set1_ps(0.5f);
+    __m128 zero = _mm_setzero_ps();
+    __m128 sign = _mm_set1_ps(-0.0f);
+    __m128 pi = _mm_set1_ps(3.14159274f);
+    __m128 width = _mm_set1_ps((float) job->width);
+    __m128 height = _mm_set1_ps((float) job->height);
+    __m128 last_row = _mm_set1_ps((float)(job->height - 1));
+    for (int item = begin; item < end; ++item) {
+        int face = item / size;
+        int y = item % size;
+        const float (*axes)[3] = ibl_face_axes[face];
+        float* out = job->cube->mips[0] + (size_t) item * size * 4;
+        for (int x = 0; x < size; x += IBL_WIDTH) {
+            __m128 lane = _mm_cvtepi32_ps(_mm_setr_epi32(x, x + 1, x + 2, x + 3));
+            __m128 sum[3] = {zero, zero, zero};
+            for (int sy = 0; sy < 2; ++sy) {
+                for (int sx = 0; sx < 2; ++sx) {
+                    __m128 s = _mm_sub_ps(_mm_mul_ps(_mm_add_ps(_mm_add_ps(lane, _mm_set1_ps(0.25f)), _mm_set1_ps(0.5f * sx)), v_step), one);
+                    float t = (y + 0.25f + 0.5f * sy) * step - 1.0f;
+                    __m128 d[3];
+                    for (int i = 0; i < 3; ++i) {
+                        d[i] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(s, _mm_set1_ps(axes[0][i])), _mm_set1_ps(t * axes[1][i])), _mm_set1_ps(axes[2][i]));
+                    }
+                    __m128 len = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(d[0], d[0]), _mm_mul_ps(d[1], d[1])), _mm_mul_ps(d[2], d[2])));
+
+                    // ibl_atan2(z, x)
+                    __m128 ax = _mm_andnot_ps(sign, d[0]);
+                    __m128 az = _mm_andnot_ps(sign, d[2]);
+                    __m128 mx = _mm_max_ps(az, ax);
+                    __m128 mn = _mm_min_ps(az, ax);
+                    __m128 a = _mm_div_ps(mn, _mm_max_ps(mx, _mm_set1_ps(1e-30f)));
+                    __m128 a2 = _mm_mul_ps(a, a);
+                    __m128 r = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(-0.01172120f), a2), _mm_set1_ps(0.05265332f));
+                    r = _mm_sub_ps(_mm_mul_ps(r, a2), _mm_set1_ps(0.11643287f));
+                    r = _mm_add_ps(_mm_mul_ps(r, a2), _mm_set1_ps(0.19354346f));
+                    r = _mm_sub_ps(_mm_mul_ps(r, a2), _mm_set1_ps(0.33262347f));
+                    r = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(r, a2), _mm_set1_ps(0.99997726f)), a);
+                    r = select_ps(_mm_cmpgt_ps(az, ax), _mm_sub_ps(_mm_set1_ps(1.57079637f), r), r);
+                    r = select_ps(_mm_cmplt_ps(d[0], zero), _mm_sub_ps(pi, r), r);
+                    r = select_ps(_mm_cmplt_ps(d[2], zero), _mm_xor_ps(r, sign), r);
+                    __m128 u = _mm_add_ps(half, _mm_mul_ps(r, _mm_set1_ps((float)(0.5 / M_PI))));
+
+                    // ibl_acos(y / len)
+                    __m128 cy = _mm_min_ps(_mm_max_ps(_mm_div_ps(d[1], len), _mm_set1_ps(-1.0f)), one);
+                    __m128 ay = _mm_andnot_ps(sign, cy);
+                    __m128 p = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(-0.0012624911f), ay), _mm_set1_ps(0.0066700901f));
+                    p = _mm_sub_ps(_mm_mul_ps(p, ay), _mm_set1_ps(0.0170881256f));
+                    p = _mm_add_ps(_mm_mul_ps(p, ay), _mm_set1_ps(0.0308918810f));
+                    p = _mm_sub_ps(_mm_mul_ps(p, ay), _mm_set1_ps(0.0501743046f));
+                    p = _mm_add_ps(_mm_mul_ps(p, ay), _mm_set1_ps(0.0889789874f));
+                    p = _mm_sub_ps(_mm_mul_ps(p, ay), _mm_set1_ps(0.2145988016f));
+                    p = _mm_add_ps(_mm_mul_ps(p, ay), _mm_set1_ps(1.5707963050f));
+                    __m128 acos_y = _mm_mul_ps(_mm_sqrt_ps(_mm_sub_ps(one, ay)), p);
+                    acos_y = select_ps(_mm_cmplt_ps(cy, zero), _mm_sub_ps(pi, acos_y), acos_y);
+                    __m128 v = _mm_mul_ps(acos_y, _mm_set1_ps((float)(1.0 / M_PI)));
+
+                    // bilinear weights, floorf without SSE4.1
+                    __m128 fx = _mm_sub_ps(_mm_mul_ps(u, width), half);
+                    __m128 fy = _mm_min_ps(_mm_max_ps(_mm_sub_ps(_mm_mul_ps(v, height), half), zero), last_row);
+                    __m128 x0 = _mm_cvtepi32_ps(_mm_cvttps_epi32(fx));
+                    x0 = _mm_sub_ps(x0, _mm_and_ps(_mm_cmpgt_ps(x0, fx), one));
+                    __m128 y0 = _mm_cvtepi32_ps(_mm_cvttps_epi32(fy));
+                    __m128 wx = _mm_sub_ps(fx, x0);
+                    __m128 wy = _mm_sub_ps(fy, y0);
+
+                    int xs[IBL_WIDTH], ys[IBL_WIDTH];
+                    _mm_storeu_si128((__m128i*) xs, _mm_cvttps_epi32(x0));
+                    _mm_storeu_si128((__m128i*) ys, _mm_cvttps_epi32(y0));
+                    float corners[4][3][IBL_WIDTH];
+                    for (int l = 0; l < IBL_WIDTH; ++l) {
+                        int x1 = (xs[l] + 1 + job->width) % job->width;
+                        int x0l = (xs[l] + job->width) % job->width;
+                        int y1 = M_MIN(ys[l] + 1, job->height - 1);
+                        const float* row0 = job->equirect + (size_t) ys[l] * job->width * 3;
+                        const float* row1 = job->equirect + (size_t) y1 * job->width * 3;
+                        for (int c = 0; c < 3; ++c) {
+                            corners[0][c][l] = row0[x0l * 3 + c];
+                            corners[1][c][l] = row0[x1 * 3 + c];
+                            corners[2][c][l] = row1[x0l * 3 + c];
+                            corners[3][c][l] = row1[x1 * 3 + c];
+                        }
+                    }
+                    __m128 iwx = _mm_sub_ps(one, wx);
+                    __m128 iwy = _mm_sub_ps(one, wy);
+                    for (int c = 0; c < 3; ++c) {
+                        __m128 top = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(corners[0][c]), iwx), _mm_mul_ps(_mm_loadu_ps(corners[1][c]), wx));
+                        __m128 bottom = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(corners[2][c]), iwx), _mm_mul_ps(_mm_loadu_ps(corners[3][c]), wx));
+                        sum[c] = _mm_add_ps(sum[c], _mm_add_ps(_mm_mul_ps(top, iwy), _mm_mul_ps(bottom, wy)));
+                    }
+                }
+            }
+            __m128 quarter = _mm_set1_ps(0.25f);
+            __m128 r = _mm_mul_ps(sum[0], quarter);
+            __m128 g = _mm_mul_ps(sum[1], quarter);
+            __m128 b = _mm_mul_ps(sum[2], quarter);
+            __m128 alpha = one;
+            _MM_TRANSPOSE4_PS(r, g, b, alpha);
+            _mm_store_ps(out + x * 4, r);
+            _mm_store_ps(out + x * 4 + 4, g);
+            _mm_store_ps(out + x * 4 + 8, b);
+            _mm_store_ps(out + x * 4 + 12, alpha);
+        }
+    }
+}
+#endif
+
+// Faces, every mip is the 2x2 average of the one before
+void downsample_cube_job(void* data, int begin, int end) {
+    IBLCube* cube = (IBLCube*) data;
+    for (int face = begin; face < end; ++face) {
+        for (int m = 1; m < cube->mip_count; ++m) {
+            int size = cube->size >> m;
+            const float* src = cube->mips[m - 1] + (size_t) face * size * size * 16;
+            float* dst = cube->mips[m] + (size_t) face * size * size * 4;
+            for (int y = 0; y < size; ++y) {
+                for (int x = 0; x < size; ++x) {
+                    const float* a = src + ((2 * y) * size * 2 + 2 * x) * 4;
+                    const float* b = a + size * 2 * 4;
+                    for (int c = 0; c < 4; ++c) {
+                        dst[(y * size + x) * 4 + c] = (a[c] + a[4 + c] + b[c] + b[4 + c]) * 0.25f;
+                    }
+                }
+            }
+        }
+    }
+}
+
+void build_source_cube(JobSystem* js, int path, IBLCube* cube, const float* equirect, int width, int height) {
+    cube->size = IBL_SOURCE_SIZE;
+    cube->mip_count = IBL_SOURCE_MIPS;
+    for (int m = 0; m < cube->mip_count; ++m) {
+        int size = cube->size >> m;
+        cube->mips[m] = alloc_ibl_floats(6 * size * size * 4);
+    }
+
+    IBLCubeJob job;
+    job.equirect = equirect;
+    job.width = width;
+    job.height = height;
+    job.cube = cube;
+    JobFunction function = equirect_to_cube_job;
+#ifdef GP_IBL_SSE
+    if (path == IBL_PATH_SSE) {
+        function = equirect_to_cube_job_sse;
+    }
+#endif
+    int rows = 6 * cube->size;
+    parallel_for(js, rows, job_grain(js, rows, 8), function, &job);
+    parallel_for(js, 6, 1, downsample_cube_job, cube);
+}
+
+// spherical harmonics
+
+// 27 partial sums per row of the source cube, added up in row order afterwards
+typedef struct IBLSHJob {
+    const IBLCube* cube;
+    float* partials;
+} IBLSHJob;
+
+// Band 0 to 2 real SH of a unit direction
+void sh_basis(float x, float y, float z, float* b) {
+    b[0] = 0.282095f;
+    b[1] = 0.488603f * y;
+    b[2] = 0.488603f * z;
+    b[3] = 0.488603f * x;
+    b[4] = 1.092548f * x * y;
+    b[5] = 1.092548f * y * z;
+    b[6] = 0.315392f * (3.0f * z * z - 1.0f);
+    b[7] = 1.092548f * x * z;
+    b[8] = 0.546274f * (x * x - y * y);
+}
+
+void sh_project_job(void* data, int begin, int end) {
+    IBLSHJob* job = (IBLSHJob*) data;
+    int size = job->cube->size;
+    float step = 2.0f / size;
+    // solid angle of a texel is about step^2 / |d|^3
+    float area = step * step;
+    for (int item = begin; item < end; ++item) {
+        int face = item / size;
+        int y = item % size;
+        const float (*axes)[3] = ibl_face_axes[face];
+        const float* texels = job->cube->mips[0] + (size_t) item * size * 4;
+        float t = (y + 0.5f) * step - 1.0f;
+
+        // one partial sum per lane, the same split as the SSE path
+        float sums[IBL_SH_COEFFS * 3][IBL_WIDTH];
+        memset(sums, 0, sizeof(sums));
+        for (int x = 0; x < size; ++x) {
+            float s = (x + 0.5f) * step - 1.0f;
+            float dx = s * axes[0][0] + (t * axes[1][0] + axes[2][0]);
+            float dy = s * axes[0][1] + (t * axes[1][1] + axes[2][1]);
+            float dz = s * axes[0][2] + (t * axes[1][2] + axes[2][2]);
+            float len2 = dx * dx + dy * dy + dz * dz;
+            float len = sqrtf(len2);
+            float inv = 1.0f / len;
+            float weight = area / (len2 * len);
+            float b[IBL_SH_COEFFS];
+            sh_basis(dx * inv, dy * inv, dz * inv, b);
+            const float* c = texels + x * 4;
+            for (int k = 0; k < IBL_SH_COEFFS; ++k) {
+                float w = b[k] * weight;
+                sums[k * 3 + 0][x % IBL_WIDTH] += c[0] * w;
+                sums[k * 3 + 1][x % IBL_WIDTH] += c[1] * w;
+                sums[k * 3 + 2][x % IBL_WIDTH] += c[2] * w;
+            }
+        }
+        for (int i = 0; i < IBL_SH_COEFFS * 3; ++i) {
+            job->partials[item * IBL_SH_COEFFS * 3 + i] = ((sums[i][0] + sums[i][1]) + sums[i][2]) + sums[i][3];
+        }
+    }
+}
+
+#ifdef GP_IBL_SSE
+void sh_basis_sse(__m128 x, __m128 y, __m128 z, __m128* b) {
+    __m128 c1 = _mm_set1_ps(0.488603f);
+    __m128 c2 = _mm_set1_ps(1.092548f);
+    b[0] = _mm_set1_ps(0.282095f);
+    b[1] = _mm_mul_ps(c1, y);
+    b[2] = _mm_mul_ps(c1, z);
+    b[3] = _mm_mul_ps(c1, x);
+    b[4] = _mm_mul_ps(_mm_mul_ps(c2, x), y);
+    b[5] = _mm_mul_ps(_mm_mul_ps(c2, y), z);
+    b[6] = _mm_mul_ps(_mm_set1_ps(0.315392f), _mm_sub_ps(_mm_mul_ps(_mm_mul_ps(_mm_set1_ps(3.0f), z), z), _mm_set1_ps(1.0f)));
+    b[7] = _mm_mul_ps(_mm_mul_ps(c2, x), z);
+    b[8] = _mm_mul_ps(_mm_set1_ps(0.546274f), _mm_sub_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)));
+}
+
+// Four texels of a row at a time, the size is a multiple of IBL_WIDTH
+void sh_project_job_sse(void* data, int begin, int end) {
+    IBLSHJob* job = (IBLSHJob*) data;
+    int size = job->cube->size;
+    float step = 2.0f / size;
+    __m128 v_step = _mm_set1_ps(step);
+    __m128 v_area = _mm_set1_ps(step * step);
+    __m128 one = _mm_set1_ps(1.0f);
+    __m128 half = _mm_set1_ps(0.5f);
+    for (int item = begin; item < end; ++item) {
+        int face = item / size;
+        int y = item % size;
+        const float (*axes)[3] = ibl_face_axes[face];
+        const float* texels = job->cube->mips[0] + (size_t) item * size * 4;
+        float t = (y + 0.5f) * step - 1.0f;
+        // t and the constant part are the same for the whole row
+        __m128 row_x = _mm_set1_ps(t * axes[1][0] + axes[2][0]);
+        __m128 row_y = _mm_set1_ps(t * axes[1][1] + axes[2][1]);
+        __m128 row_z = _mm_set1_ps(t * axes[1][2] + axes[2][2]);
+
+        __m128 sums[IBL_SH_COEFFS * 3];
+        for (int i = 0; i < IBL_SH_COEFFS * 3; ++i) {
+            sums[i] = _mm_setzero_ps();
+        }
+        for (int x = 0; x < size; x += IBL_WIDTH) {
+            __m128 lane = _mm_cvtepi32_ps(_mm_setr_epi32(x, x + 1, x + 2, x + 3));
+            __m128 s = _mm_sub_ps(_mm_mul_ps(_mm_add_ps(lane, half), v_step), one);
+            __m128 dx = _mm_add_ps(_mm_mul_ps(s, _mm_set1_ps(axes[0][0])), row_x);
+            __m128 dy = _mm_add_ps(_mm_mul_ps(s, _mm_set1_ps(axes[0][1])), row_y);
+            __m128 dz = _mm_add_ps(_mm_mul_ps(s, _mm_set1_ps(axes[0][2])), row_z);
+            __m128 len2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+            __m128 len = _mm_sqrt_ps(len2);
+            __m128 inv = _mm_div_ps(one, len);
+            __m128 weight = _mm_div_ps(v_area, _mm_mul_ps(len2, len));
+            __m128 b[IBL_SH_COEFFS];
+            sh_basis_sse(_mm_mul_ps(dx, inv), _mm_mul_ps(dy, inv), _mm_mul_ps(dz, inv), b);
+
+            // RGBA of four texels to r, g, b of four texels
+            __m128 c0 = _mm_load_ps(texels + x * 4);
+            __m128 c1 = _mm_load_ps(texels + x * 4 + 4);
+            __m128 c2 = _mm_load_ps(texels + x * 4 + 8);
+            __m128 c3 = _mm_load_ps(texels + x * 4 + 12);
+            _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+            for (int k = 0; k < IBL_SH_COEFFS; ++k) {
+                __m128 w = _mm_mul_ps(b[k], weight);
+                sums[k * 3 + 0] = _mm_add_ps(sums[k * 3 + 0], _mm_mul_ps(c0, w));
+                sums[k * 3 + 1] = _mm_add_ps(sums[k * 3 + 1], _mm_mul_ps(c1, w));
+                sums[k * 3 + 2] = _mm_add_ps(sums[k * 3 + 2], _mm_mul_ps(c2, w));
+            }
+        }
+        for (int i = 0; i < IBL_SH_COEFFS * 3; ++i) {
+            float l[IBL_WIDTH];
+            _mm_storeu_ps(l, sums[i]);
+            job->partials[item * IBL_SH_COEFFS * 3 + i] = ((l[0] + l[1]) + l[2]) + l[3];
+        }
+    }
+}
+#endif
+
+void project_sh(JobSystem* js, int path, const IBLCube* cube, float* sh) {
+    int rows = 6 * cube->size;
+    IBLSHJob job;
+    job.cube = cube;
+    job.partials = (float*) malloc(rows * IBL_SH_COEFFS * 3 * sizeof(float));
+    JobFunction function = sh_project_job;
+#ifdef GP_IBL_SSE
+    if (path == IBL_PATH_SSE) {
+        function = sh_project_job_sse;
+    }
+#endif
+    parallel_for(js, rows, job_grain(js, rows, 8), function, &job);
+
+    // cosine lobe convolution is a scale per band, 1/pi of the Lambert BRDF included
+    const float band_scale[IBL_SH_COEFFS] = {1.0f, 2.0f / 3.0f, 2.0f / 3.0f, 2.0f / 3.0f, 0.25f, 0.25f, 0.25f, 0.25f, 0.25f};
+    for (int i = 0; i < IBL_SH_COEFFS * 3; ++i) {
+        float sum = 0.0f;
+        for (int row = 0; row < rows; ++row) {
+            sum += job.partials[row * IBL_SH_COEFFS * 3 + i];
+        }
+        sh[i] = sum * band_scale[i / 3];
+    }
+    free(job.partials);
+}
+
+// prefiltered cubemap
+
+// GGX samples of one roughness around +z, with N = V = R
+typedef struct IBLSamples {
+    float x[IBL_SAMPLES];
+    float y[IBL_SAMPLES];
+    float z[IBL_SAMPLES];
+    float weight[IBL_SAMPLES]; // NdotL
+    int level[IBL_SAMPLES];    // source mip to read
+    int count;                 // the ones above the horizon
+    float total_weight;
+} IBLSamples;
+
+void hammersley(int i, int count, float* u, float* v) {
+    uint32_t bits = (uint32_t) i;
+    bits = (bits << 16u) | (bits >> 16u);
+    bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+    bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+    bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+    bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+    *u = (float) i / count;
+    *v = bits * 2.3283064365386963e-10f;
+}
+
+// Half vector around +z for the GGX distribution with alpha = roughness^2
+void ggx_half_vector(float u, float v, float roughness, float* h) {
+    float a = roughness * roughness;
+    float phi = 2.0f * (float) M_PI * u;
+    float cos_theta = sqrtf((1.0f - v) / (1.0f + (a * a - 1.0f) * v));
+    float sin_theta = sqrtf(1.0f - cos_theta * cos_theta);
+    h[0] = sin_theta * cosf(phi);
+    h[1] = sin_theta * sinf(phi);
+    h[2] = cos_theta;
+}
+
+void make_ibl_samples(IBLSamples* samples, float roughness, int source_size, int source_mips) {
+    float a2 = roughness * roughness * roughness * roughness;
+    float texel_solid_angle = 4.0f * (float) M_PI / (6.0f * source_size * source_size);
+    samples->count = 0;
+    samples->total_weight = 0.0f;
+    for (int i = 0; i < IBL_SAMPLES; ++i) {
+        float u, v, h[3];
+        hammersley(i, IBL_SAMPLES, &u, &v);
+        ggx_half_vector(u, v, roughness, h);
+        // reflect V = +z around H
+        float lz = 2.0f * h[2] * h[2] - 1.0f;
+        if (lz <= 0.0f) {
+            continue;
+        }
+        // pdf of L is D(H) / 4 when N = V, a sample stands for the solid angle 1 / (count * pdf)
+        float d = h[2] * h[2] * (a2 - 1.0f) + 1.0f;
+        float pdf = a2 / ((float) M_PI * d * d) * 0.25f;
+        float sample_solid_angle = 1.0f / (IBL_SAMPLES * pdf + 0.0001f);
+        float level = roughness == 0.0f ? 0.0f : 0.5f * log2f(sample_solid_angle / texel_solid_angle) + 1.0f;
+
+        int n = samples->count++;
+        samples->x[n] = 2.0f * h[2] * h[0];
+        samples->y[n] = 2.0f * h[2] * h[1];
+        samples->z[n] = lz;
+        samples->weight[n] = lz;
+        samples->level[n] = M_CLAMP((int)(level + 0.5f), 0, source_mips - 1);
+        samples->total_weight += lz;
+    }
+}
+
+typedef struct IBLPrefilterJob {
+    const IBLCube* source;
+    const IBLSamples* samples;
+    float* out;
+    int size;
+} IBLPrefilterJob;
+
+// Tangent frame around the unit normal n, t and b are what both paths compute
+void ibl_tangent_frame(const float* n, float* t, float* b) {
+    // cross(up, n) with up = +z, or +x when n is too close to it
+    if (fabsf(n[2]) < 0.999f) {
+        t[0] = -n[1];
+        t[1] = n[0];
+        t[2] = 0.0f;
+    } else {
+        t[0] = 0.0f;
+        t[1] = -n[2];
+        t[2] = n[1];
+    }
+    float inv = 1.0f / sqrtf(t[0] * t[0] + t[1] * t[1] + t[2] * t[2]);
+    t[0] *= inv;
+    t[1] *= inv;
+    t[2] *= inv;
+    b[0] = n[1] * t[2] - n[2] * t[1];
+    b[1] = n[2] * t[0] - n[0] * t[2];
+    b[2] = n[0] * t[1] - n[1] * t[0];
+}
+
+// Rows of one mip, item = face * size + row
+void prefilter_job(void* data, int begin, int end) {
+    IBLPrefilterJob* job = (IBLPrefilterJob*) data;
+    const IBLSamples* samples = job->samples;
+    int size = job->size;
+    float step = 2.0f / size;
+    for (int item = begin; item < end; ++item) {
+        int face = item / size;
+        int y = item % size;
+        const float (*axes)[3] = ibl_face_axes[face];
+        float t = (y + 0.5f) * step - 1.0f;
+        float* out = job->out + (size_t) item * size * 4;
+        for (int x = 0; x < size; ++x) {
+            float s = (x + 0.5f) * step - 1.0f;
+            float d[3];
+            for (int i = 0; i < 3; ++i) {
+                d[i] = s * axes[0][i] + (t * axes[1][i] + axes[2][i]);
+            }
+            float inv = 1.0f / sqrtf(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+            float n[3] = {d[0] * inv, d[1] * inv, d[2] * inv};
+            float tangent[3], bitangent[3];
+            ibl_tangent_frame(n, tangent, bitangent);
+
+            float sum[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+            for (int i = 0; i < samples->count; ++i) {
+                float lx = tangent[0] * samples->x[i] + bitangent[0] * samples->y[i] + n[0] * samples->z[i];
+                float ly = tangent[1] * samples->x[i] + bitangent[1] * samples->y[i] + n[1] * samples->z[i];
+                float lz = tangent[2] * samples->x[i] + bitangent[2] * samples->y[i] + n[2] * samples->z[i];
+                float u, v;
+                int sample_face = ibl_cube_face(lx, ly, lz, &u, &v);
+                int level = samples->level[i];
+                int level_size = job->source->size >> level;
+                int offsets[4];
+                float weights[4];
+                ibl_bilinear_setup(level_size, u, v, offsets, weights);
+                const float* texels = job->source->mips[level] + (size_t) sample_face * level_size * level_size * 4;
+                for (int c = 0; c < 4; ++c) {
+                    float texel = ((texels[offsets[0] + c] * weights[0] + texels[offsets[1] + c] * weights[1])
+                                 + texels[offsets[2] + c] * weights[2]) + texels[offsets[3] + c] * weights[3];
+                    sum[c] += texel * samples->weight[i];
+                }
+            }
+            float scale = 1.0f / samples->total_weight;
+            for (int c = 0; c < 4; ++c) {
+                out[x * 4 + c] = sum[c] * scale;
+            }
+        }
+    }
+}
+
+#ifdef GP_IBL_SSE
+// Four texels of a row at a time. Directions, tangent frames, faces and coordinates are computed for the
+// four lanes at once, the texel reads are the only part left per lane.
+void prefilter_job_sse(void* data, int begin, int end) {
+    IBLPrefilterJob* job = (IBLPrefilterJob*) data;
+    const IBLSamples* samples = job->samples;
+    int size = job->size;
+    float step = 2.0f / size;
+    __m128 v_step = _mm_set1_ps(step);
+    __m128 one = _mm_set1_ps(1.0f);
+    __m128 half = _mm_set1_ps(0.5f);
+    __m128 zero = _mm_setzero_ps();
+    __m128 sign = _mm_set1_ps(-0.0f);
+    for (int item = begin; item < end; ++item) {
+        int face = item / size;
+        int y = item % size;
+        const float (*axes)[3] = ibl_face_axes[face];
+        float t = (y + 0.5f) * step - 1.0f;
+        float* out = job->out + (size_t) item * size * 4;
+        for (int x = 0; x < size; x += IBL_WIDTH) {
+            __m128 lane = _mm_cvtepi32_ps(_mm_setr_epi32(x, x + 1, x + 2, x + 3));
+            __m128 s = _mm_sub_ps(_mm_mul_ps(_mm_add_ps(lane, half), v_step), one);
+            __m128 d[3];
+            for (int i = 0; i < 3; ++i) {
+                d[i] = _mm_add_ps(_mm_mul_ps(s, _mm_set1_ps(axes[0][i])), _mm_set1_ps(t * axes[1][i] + axes[2][i]));
+            }
+            __m128 inv = _mm_div_ps(one, _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(d[0], d[0]), _mm_mul_ps(d[1], d[1])), _mm_mul_ps(d[2], d[2]))));
+            __m128 n[3] = {_mm_mul_ps(d[0], inv), _mm_mul_ps(d[1], inv), _mm_mul_ps(d[2], inv)};
+
+            __m128 abs_nz = _mm_andnot_ps(sign, n[2]);
+            __m128 use_z = _mm_cmplt_ps(abs_nz, _mm_set1_ps(0.999f));
+            __m128 tg[3];
+            tg[0] = select_ps(use_z, _mm_xor_ps(n[1], sign), zero);
+            tg[1] = select_ps(use_z, n[0], _mm_xor_ps(n[2], sign));
+            tg[2] = select_ps(use_z, zero, n[1]);
+            __m128 tinv = _mm_div_ps(one, _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tg[0], tg[0]), _mm_mul_ps(tg[1], tg[1])), _mm_mul_ps(tg[2], tg[2]))));
+            tg[0] = _mm_mul_ps(tg[0], tinv);
+            tg[1] = _mm_mul_ps(tg[1], tinv);
+            tg[2] = _mm_mul_ps(tg[2], tinv);
+            __m128 bt[3];
+            bt[0] = _mm_sub_ps(_mm_mul_ps(n[1], tg[2]), _mm_mul_ps(n[2], tg[1]));
+            bt[1] = _mm_sub_ps(_mm_mul_ps(n[2], tg[0]), _mm_mul_ps(n[0], tg[2]));
+            bt[2] = _mm_sub_ps(_mm_mul_ps(n[0], tg[1]), _mm_mul_ps(n[1], tg[0]));
+
+            __m128 sums[IBL_WIDTH] = {zero, zero, zero, zero};
+            for (int i = 0; i < samples->count; ++i) {
+                __m128 sx = _mm_set1_ps(samples->x[i]);
+                __m128 sy = _mm_set1_ps(samples->y[i]);
+                __m128 sz = _mm_set1_ps(samples->z[i]);
+                __m128 lx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(tg[0], sx), _mm_mul_ps(bt[0], sy)), _mm_mul_ps(n[0], sz));
+                __m128 ly = _mm_add_ps(_mm_add_ps(_mm_mul_ps(tg[1], sx), _mm_mul_ps(bt[1], sy)), _mm_mul_ps(n[1], sz));
+                __m128 lz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(tg[2], sx), _mm_mul_ps(bt[2], sy)), _mm_mul_ps(n[2], sz));
+
+                // ibl_cube_face for four directions
+                __m128 ax = _mm_andnot_ps(sign, lx);
+                __m128 ay = _mm_andnot_ps(sign, ly);
+                __m128 az = _mm_andnot_ps(sign, lz);
+                __m128 major_x = _mm_and_ps(_mm_cmpge_ps(ax, ay), _mm_cmpge_ps(ax, az));
+                __m128 major_y = _mm_andnot_ps(major_x, _mm_cmpge_ps(ay, az));
+                __m128 pos_x = _mm_cmpge_ps(lx, zero);
+                __m128 pos_y = _mm_cmpge_ps(ly, zero);
+                __m128 pos_z = _mm_cmpge_ps(lz, zero);
+                __m128 neg_ly = _mm_xor_ps(ly, sign);
+                __m128 sc = select_ps(major_x, select_ps(pos_x, _mm_xor_ps(lz, sign), lz),
+                                      select_ps(major_y, lx, select_ps(pos_z, lx, _mm_xor_ps(lx, sign))));
+                __m128 tc = select_ps(major_y, select_ps(pos_y, lz, _mm_xor_ps(lz, sign)), neg_ly);
+                __m128 ma = select_ps(major_x, ax, select_ps(major_y, ay, az));
+                __m128 faces = select_ps(major_x, select_ps(pos_x, zero, one),
+                                         select_ps(major_y, select_ps(pos_y, _mm_set1_ps(2.0f), _mm_set1_ps(3.0f)),
+                                                   select_ps(pos_z, _mm_set1_ps(4.0f), _mm_set1_ps(5.0f))));
+                __m128 u = _mm_mul_ps(half, _mm_add_ps(_mm_div_ps(sc, ma), one));
+                __m128 v = _mm_mul_ps(half, _mm_add_ps(_mm_div_ps(tc, ma), one));
+
+                float us[IBL_WIDTH], vs[IBL_WIDTH];
+                int face_index[IBL_WIDTH];
+                _mm_storeu_ps(us, u);
+                _mm_storeu_ps(vs, v);
+                _mm_storeu_si128((__m128i*) face_index, _mm_cvttps_epi32(faces));
+
+                int level = samples->level[i];
+                int level_size = job->source->size >> level;
+                __m128 weight = _mm_set1_ps(samples->weight[i]);
+                for (int l = 0; l < IBL_WIDTH; ++l) {
+                    int offsets[4];
+                    float weights[4];
+                    ibl_bilinear_setup(level_size, us[l], vs[l], offsets, weights);
+                    const float* texels = job->source->mips[level] + (size_t) face_index[l] * level_size * level_size * 4;
+                    __m128 texel = _mm_add_ps(_mm_add_ps(_mm_add_ps(
+                        _mm_mul_ps(_mm_load_ps(texels + offsets[0]), _mm_set1_ps(weights[0])),
+                        _mm_mul_ps(_mm_load_ps(texels + offsets[1]), _mm_set1_ps(weights[1]))),
+                        _mm_mul_ps(_mm_load_ps(texels + offsets[2]), _mm_set1_ps(weights[2]))),
+                        _mm_mul_ps(_mm_load_ps(texels + offsets[3]), _mm_set1_ps(weights[3])));
+                    sums[l] = _mm_add_ps(sums[l], _mm_mul_ps(texel, weight));
+                }
+            }
+            __m128 scale = _mm_set1_ps(1.0f / samples->total_weight);
+            for (int l = 0; l < IBL_WIDTH; ++l) {
+                _mm_store_ps(out + (x + l) * 4, _mm_mul_ps(sums[l], scale));
+            }
+        }
+    }
+}
+#endif
+
+void prefilter_ibl(JobSystem* js, int path, const IBLCube* source, IBL* ibl) {
+    // roughness 0 is a mirror, the source mip of the same size as is
+    int first_level = 0;
+    while ((source->size >> first_level) > IBL_SIZE) {
+        first_level++;
+    }
+    memcpy(ibl->prefiltered[0], source->mips[first_level], 6 * IBL_SIZE * IBL_SIZE * 4 * sizeof(float));
+
+    JobFunction function = prefilter_job;
+#ifdef GP_IBL_SSE
+    if (path == IBL_PATH_SSE) {
+        function = prefilter_job_sse;
+    }
+#endif
+    IBLSamples samples;
+    for (int m = 1; m < IBL_MIPS; ++m) {
+        make_ibl_samples(&samples, (float) m / (IBL_MIPS - 1), source->size, source->mip_count);
+        IBLPrefilterJob job;
+        job.source = source;
+        job.samples = &samples;
+        job.out = ibl->prefiltered[m];
+        job.size = IBL_SIZE >> m;
+        int rows = 6 * job.size;
+        parallel_for(js, rows, job_grain(js, rows, 1), function, &job);
+    }
+}
+
+// BRDF LUT
+
+typedef struct IBLLUTJob {
+    float* lut;
+} IBLLUTJob;
+
+typedef struct IBLLUTRow {
+    float roughness;
+    float k; // Smith for IBL, alpha / 2
+    float hx[IBL_LUT_SAMPLES];
+    float hz[IBL_LUT_SAMPLES]; // V has no y, the y of H doesn't matter
+} IBLLUTRow;
+
+void make_lut_row(IBLLUTRow* row, int y) {
+    row->roughness = (y + 0.5f) / IBL_LUT_SIZE;
+    row->k = row->roughness * row->roughness * 0.5f;
+    for (int i = 0; i < IBL_LUT_SAMPLES; ++i) {
+        float u, v, h[3];
+        hammersley(i, IBL_LUT_SAMPLES, &u, &v);
+        ggx_half_vector(u, v, row->roughness, h);
+        row->hx[i] = h[0];
+        row->hz[i] = h[2];
+    }
+}
+
+// Rows of roughness, every texel integrates its own NdotV
+void brdf_lut_job(void* data, int begin, int end) {
+    IBLLUTJob* job = (IBLLUTJob*) data;
+    IBLLUTRow row;
+    for (int y = begin; y < end; ++y) {
+        make_lut_row(&row, y);
+        for (int x = 0; x < IBL_LUT_SIZE; ++x) {
+            float n_dot_v = (x + 0.5f) / IBL_LUT_SIZE;
+            float vx = sqrtf(1.0f - n_dot_v * n_dot_v);
+            float vz = n_dot_v;
+            float g_v = n_dot_v / (n_dot_v * (1.0f - row.k) + row.k);
+            float a = 0.0f;
+            float b = 0.0f;
+            for (int i = 0; i < IBL_LUT_SAMPLES; ++i) {
+                float v_dot_h = vx * row.hx[i] + vz * row.hz[i];
+                v_dot_h = v_dot_h > 0.0f ? v_dot_h : 0.0f;
+                float n_dot_l = 2.0f * v_dot_h * row.hz[i] - vz;
+                if (n_dot_l > 0.0f) {
+                    float g = g_v * (n_dot_l / (n_dot_l * (1.0f - row.k) + row.k));
+                    float g_vis = g * v_dot_h / (row.hz[i] * n_dot_v);
+                    float o = 1.0f - v_dot_h;
+                    float fc = (o * o) * (o * o) * o;
+                    a += (1.0f - fc) * g_vis;
+                    b += fc * g_vis;
+                }
+            }
+            job->lut[(y * IBL_LUT_SIZE + x) * 2 + 0] = a / IBL_LUT_SAMPLES;
+            job->lut[(y * IBL_LUT_SIZE + x) * 2 + 1] = b / IBL_LUT_SAMPLES;
+        }
+    }
+}
+
+#ifdef GP_IBL_SSE
+// Four texels of NdotV at a time, the samples below the horizon are masked out
+void brdf_lut_job_sse(void* data, int begin, int end) {
+    IBLLUTJob* job = (IBLLUTJob*) data;
+    IBLLUTRow row;
+    __m128 one = _mm_set1_ps(1.0f);
+    __m128 zero = _mm_setzero_ps();
+    __m128 lut_size = _mm_set1_ps((float) IBL_LUT_SIZE);
+    for (int y = begin; y < end; ++y) {
+        make_lut_row(&row, y);
+        __m128 k = _mm_set1_ps(row.k);
+        __m128 one_minus_k = _mm_set1_ps(1.0f - row.k);
+        for (int x = 0; x < IBL_LUT_SIZE; x += IBL_WIDTH) {
+            __m128 lane = _mm_cvtepi32_ps(_mm_setr_epi32(x, x + 1, x + 2, x + 3));
+            __m128 n_dot_v = _mm_div_ps(_mm_add_ps(lane, _mm_set1_ps(0.5f)), lut_size);
+            __m128 vx = _mm_sqrt_ps(_mm_sub_ps(one, _mm_mul_ps(n_dot_v, n_dot_v)));
+            __m128 vz = n_dot_v;
+            __m128 g_v = _mm_div_ps(n_dot_v, _mm_add_ps(_mm_mul_ps(n_dot_v, one_minus_k), k));
+            __m128 a = zero;
+            __m128 b = zero;
+            for (int i = 0; i < IBL_LUT_SAMPLES; ++i) {
+                __m128 hx = _mm_set1_ps(row.hx[i]);
+                __m128 hz = _mm_set1_ps(row.hz[i]);
+                __m128 v_dot_h = _mm_max_ps(_mm_add_ps(_mm_mul_ps(vx, hx), _mm_mul_ps(vz, hz)), zero);
+                __m128 n_dot_l = _mm_sub_ps(_mm_mul_ps(_mm_mul_ps(_mm_set1_ps(2.0f), v_dot_h), hz), vz);
+                __m128 visible = _mm_cmpgt_ps(n_dot_l, zero);
+                __m128 g = _mm_mul_ps(g_v, _mm_div_ps(n_dot_l, _mm_add_ps(_mm_mul_ps(n_dot_l, one_minus_k), k)));
+                __m128 g_vis = _mm_div_ps(_mm_mul_ps(g, v_dot_h), _mm_mul_ps(hz, n_dot_v));
+                g_vis = _mm_and_ps(visible, g_vis);
+                __m128 o = _mm_sub_ps(one, v_dot_h);
+                __m128 o2 = _mm_mul_ps(o, o);
+                __m128 fc = _mm_mul_ps(_mm_mul_ps(o2, o2), o);
+                a = _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(one, fc), g_vis));
+                b = _mm_add_ps(b, _mm_mul_ps(fc, g_vis));
+            }
+            a = _mm_div_ps(a, _mm_set1_ps((float) IBL_LUT_SAMPLES));
+            b = _mm_div_ps(b, _mm_set1_ps((float) IBL_LUT_SAMPLES));
+            // interleave to RG
+            _mm_storeu_ps(job->lut + (y * IBL_LUT_SIZE + x) * 2, _mm_unpacklo_ps(a, b));
+            _mm_storeu_ps(job->lut + (y * IBL_LUT_SIZE + x) * 2 + 4, _mm_unpackhi_ps(a, b));
+        }
+    }
+}
+#endif
+
+void bake_brdf_lut(JobSystem* js, int path, float* lut) {
+    IBLLUTJob job;
+    job.lut = lut;
+    JobFunction function = brdf_lut_job;
+#ifdef GP_IBL_SSE
+    if (path == IBL_PATH_SSE) {
+        function = brdf_lut_job_sse;
+    }
+#endif
+    parallel_for(js, IBL_LUT_SIZE, job_grain(js, IBL_LUT_SIZE, 1), function, &job);
+}
+
+// bake
+
+// RGB floats, width x height, row 0 looking up
+void bake_ibl_pixels(IBL* ibl, const float* equirect, int width, int height) {
+    alloc_ibl_data(ibl);
+    g_timer timer;
+
+    IBLCube source;
+    memset(&source, 0, sizeof(IBLCube));
+    start_timer(&timer);
+    build_source_cube(ibl->jobs, ibl->path, &source, equirect, width, height);
+    stop_timer(&timer);
+    ibl->ms[IBL_STAGE_CUBE] = compute_timer_millis_diff(&timer);
+
+    start_timer(&timer);
+    project_sh(ibl->jobs, ibl->path, &source, ibl->sh);
+    stop_timer(&timer);
+    ibl->ms[IBL_STAGE_SH] = compute_timer_millis_diff(&timer);
+
+    start_timer(&timer);
+    prefilter_ibl(ibl->jobs, ibl->path, &source, ibl);
+    stop_timer(&timer);
+    ibl->ms[IBL_STAGE_PREFILTER] = compute_timer_millis_diff(&timer);
+
+    start_timer(&timer);
+    bake_brdf_lut(ibl->jobs, ibl->path, ibl->lut);
+    stop_timer(&timer);
+    ibl->ms[IBL_STAGE_LUT] = compute_timer_millis_diff(&timer);
+
+    free_ibl_cube(&source);
+    ibl->baked = 1;
+}
+
+// cache
+
+typedef struct IBLCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;
+    uint32_t mips;
+    uint32_t lut_size;
+    uint32_t reserved;
+    uint64_t key;
+} IBLCacheHeader;
+
+// Hash of the file contents and everything that changes the result, 0 if the file can't be read
+uint64_t ibl_cache_key(const char* hdr_path) {
+    FILE* f = fopen(hdr_path, "rb");
+    if (f == NULL) {
+        return 0;
+    }
+    uint64_t hash = 1469598103934665603ull;
+    unsigned char buffer[65536];
+    size_t read;
+    while ((read = fread(buffer, 1, sizeof(buffer), f)) > 0) {
+        for (size_t i = 0; i < read; ++i) {
+            hash = (hash ^ buffer[i]) * 1099511628211ull;
+        }
+    }
+    fclose(f);
+
+    const int params[] = {IBL_VERSION, IBL_SOURCE_SIZE, IBL_SOURCE_MIPS, IBL_SIZE, IBL_MIPS, IBL_SAMPLES,
+                          IBL_LUT_SIZE, IBL_LUT_SAMPLES};
+    for (int i = 0; i < (int)(sizeof(params) / sizeof(params[0])); ++i) {
+        hash = (hash ^ (uint64_t) params[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+size_t ibl_mip_floats(int m) {
+    int size = IBL_SIZE >> m;
+    return (size_t) 6 * size * size * 4;
+}
+
+int load_ibl_cache(IBL* ibl, const char* path, uint64_t key) {
+    FILE* f = fopen(path, "rb");
+    if (f == NULL) {
+        return 0;
+    }
+    IBLCacheHeader header;
+    int valid = fread(&header, sizeof(header), 1, f) == 1
+        && header.magic == IBL_MAGIC
+        && header.version == IBL_VERSION
+        && header.size == IBL_SIZE
+        && header.mips == IBL_MIPS
+        && header.lut_size == IBL_LUT_SIZE
+        && header.key == key;
+    if (valid) {
+        alloc_ibl_data(ibl);
+        valid = fread(ibl->sh, sizeof(ibl->sh), 1, f) == 1;
+        for (int m = 0; m < IBL_MIPS && valid; ++m) {
+            valid = fread(ibl->prefiltered[m], ibl_mip_floats(m) * sizeof(float), 1, f) == 1;
+        }
+        valid = valid && fread(ibl->lut, IBL_LUT_SIZE * IBL_LUT_SIZE * 2 * sizeof(float), 1, f) == 1;
+        if (!valid) {
+            free_ibl_data(ibl);
+        }
+    }
+    fclose(f);
+    ibl->baked = valid;
+    return valid;
+}
+
+// Written to a temporary name and renamed, like the program cache
+void save_ibl_cache(const IBL* ibl, const char* path, uint64_t key) {
+    IBLCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = IBL_MAGIC;
+    header.version = IBL_VERSION;
+    header.size = IBL_SIZE;
+    header.mips = IBL_MIPS;
+    header.lut_size = IBL_LUT_SIZE;
+    header.key = key;
+
+    // a cut temporary name could be renamed over another file
+    char temp_path[IBL_PATH];
+    int n = snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+    FILE* f = n > 0 && n < (int) sizeof(temp_path) ? fopen(temp_path, "wb") : NULL;
+    if (f == NULL) {
+        return;
+    }
+    int written = fwrite(&header, sizeof(header), 1, f) == 1 && fwrite(ibl->sh, sizeof(ibl->sh), 1, f) == 1;
+    for (int m = 0; m < IBL_MIPS && written; ++m) {
+        written = fwrite(ibl->prefiltered[m], ibl_mip_floats(m) * sizeof(float), 1, f) == 1;
+    }
+    written = written && fwrite(ibl->lut, IBL_LUT_SIZE * IBL_LUT_SIZE * 2 * sizeof(float), 1, f) == 1;
+    fclose(f);
+    if (written) {
+        remove(path);
+        rename(temp_path, path);
+    } else {
+        remove(temp_path);
+    }
+}
+
+void print_ibl_times(const IBL* ibl, const char* name) {
+    float total = 0.0f;
+    printf("ibl: %s", name);
+    for (int i = 0; i < IBL_STAGES; ++i) {
+        if (ibl->ms[i] > 0.0f) {
+            printf("  %s %.1f ms", ibl_stage_names[i], ibl->ms[i]);
+            total += ibl->ms[i];
+        }
+    }
+    printf("  total %.1f ms\n", total);
+}
+
+// Loads the HDR and bakes it, or reads the result of an earlier bake from directory (NULL for no cache).
+// Returns 0 if the file can't be loaded, ibl then stays the black environment.
+int bake_ibl(IBL* ibl, const char* hdr_path, const char* directory) {
+    memset(ibl->ms, 0, sizeof(ibl->ms));
+    g_timer timer;
+
+    char cache_path[IBL_PATH];
+    uint64_t key = 0;
+    if (directory != NULL) {
+        start_timer(&timer);
+        key = ibl_cache_key(hdr_path);
+#ifdef _WIN32
+        _mkdir(directory);
+#else
+        mkdir(directory, 0755);
+#endif
+        int n = snprintf(cache_path, sizeof(cache_path), "%s/%016llx.ibl", directory, (unsigned long long) key);
+        if (n <= 0 || n >= (int) sizeof(cache_path)) {
+            printf("ibl: cache directory path too long, not cached\n");
+            key = 0;
+        }
+        int hit = key != 0 && load_ibl_cache(ibl, cache_path, key);
+        stop_timer(&timer);
+        ibl->ms[IBL_STAGE_CACHE] = compute_timer_millis_diff(&timer);
+        if (hit) {
+            print_ibl_times(ibl, "from cache");
+            return 1;
+        }
+    }
+
+    start_timer(&timer);
+    int width, height, channels;
+    float* equirect = stbi_loadf(hdr_path, &width, &height, &channels, 3);
+    stop_timer(&timer);
+    ibl->ms[IBL_STAGE_LOAD] = compute_timer_millis_diff(&timer);
+    if (equirect == NULL) {
+        printf("ibl: can't load %s: %s\n", hdr_path, stbi_failure_reason());
+        return 0;
+    }
+
+    bake_ibl_pixels(ibl, equirect, width, height);
+    stbi_image_free(equirect);
+
+    if (directory != NULL && key != 0) {
+        start_timer(&timer);
+        save_ibl_cache(ibl, cache_path, key);
+        stop_timer(&timer);
+        ibl->ms[IBL_STAGE_CACHE] += compute_timer_millis_diff(&timer);
+    }
+    char name[IBL_PATH + 32];
+    snprintf(name, sizeof(name), "%s %dx%d, %d workers", hdr_path, width, height, ibl->jobs != NULL ? ibl->jobs->worker_count : 1);
+    print_ibl_times(ibl, name);
+    return 1;
+}
+
+// GL
+
+// Without a baked environment the textures are black and the SH zero, the shaders then get no ambient light
+void create_ibl_textures(IBL* ibl) {
+    glGenTextures(1, &ibl->prefiltered_texture);
+    gp_gl_bind_texture(IBL_TEXTURE_UNIT, GL_TEXTURE_CUBE_MAP, ibl->prefiltered_texture);
+    float black[4] = {0.0f, 0.0f, 0.0f, 1.0f};
+    ibl->texture_mips = ibl->baked ? IBL_MIPS : 1;
+    for (int m = 0; m < ibl->texture_mips; ++m) {
+        int size = ibl->baked ? IBL_SIZE >> m : 1;
+        for (int face = 0; face < 6; ++face) {
+            const float* texels = ibl->baked ? ibl->prefiltered[m] + (size_t) face * size * size * 4 : black;
+            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, m, GL_RGB16F, size, size, 0, GL_RGBA, GL_FLOAT, texels);
+        }
+    }
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, ibl->texture_mips - 1);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    // the faces were filtered separately, let the sampler blend across their edges
+    glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+
+    glGenTextures(1, &ibl->lut_texture);
+    gp_gl_bind_texture(IBL_TEXTURE_UNIT + 1, GL_TEXTURE_2D, ibl->lut_texture);
+    int lut_size = ibl->baked ? IBL_LUT_SIZE : 1;
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16F, lut_size, lut_size, 0, GL_RG, GL_FLOAT, ibl->baked ? ibl->lut : black);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+}
+
+void bind_ibl(const IBL* ibl) {
+    gp_gl_bind_texture(IBL_TEXTURE_UNIT, GL_TEXTURE_CUBE_MAP, ibl->prefiltered_texture);
+    gp_gl_bind_texture(IBL_TEXTURE_UNIT + 1, GL_TEXTURE_2D, ibl->lut_texture);
+}
+
+void free_ibl(IBL* ibl) {
+    free_ibl_data(ibl);
+    if (ibl->prefiltered_texture != 0) {
+        gp_gl_delete_texture(ibl->prefiltered_texture);
+        gp_gl_delete_texture(ibl->lut_texture);
+    }
+    ibl->prefiltered_texture = 0;
+    ibl->lut_texture = 0;
+}
+
+// benchmark
+
+uint64_t ibl_hash(const IBL* ibl) {
+    uint64_t hash = 1469598103934665603ull;
+    const uint32_t* words = (const uint32_t*) ibl->sh;
+    for (int i = 0; i < IBL_SH_COEFFS * 3; ++i) {
+        hash = (hash ^ words[i]) * 1099511628211ull;
+    }
+    for (int m = 0; m < IBL_MIPS; ++m) {
+        words = (const uint32_t*) ibl->prefiltered[m];
+        for (size_t i = 0; i < ibl_mip_floats(m); ++i) {
+            hash = (hash ^ words[i]) * 1099511628211ull;
+        }
+    }
+    words = (const uint32_t*) ibl->lut;
+    for (int i = 0; i < IBL_LUT_SIZE * IBL_LUT_SIZE * 2; ++i) {
+        hash = (hash ^ words[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+// Sky gradient, a ground and a small bright sun, for benchmarking without an HDR
+float* make_test_environment(int width, int height) {
+    float* pixels = (float*) malloc((size_t) width * height * 3 * sizeof(float));
+    for (int y = 0; y < height; ++y) {
+        float elevation = 0.5f - (y + 0.5f) / height; // 0.5 up, -0.5 down
+        for (int x = 0; x < width; ++x) {
+            float* p = pixels + ((size_t) y * width + x) * 3;
+            float azimuth = (x + 0.5f) / width;
+            if (elevation > 0.0f) {
+                p[0] = 0.3f + 0.5f * elevation;
+                p[1] = 0.5f + 0.6f * elevation;
+                p[2] = 0.9f + 0.8f * elevation;
+            } else {
+                p[0] = 0.25f;
+                p[1] = 0.2f;
+                p[2] = 0.15f;
+            }
+            float dx = (azimuth - 0.3f) * 2.0f;
+            float dy = elevation - 0.3f;
+            if (dx * dx + dy * dy < 0.0004f) {
+                p[0] = 200.0f;
+                p[1] = 180.0f;
+                p[2] = 150.0f;
+            }
+        }
+    }
+    return pixels;
+}
+
+// --bench ibl [--ibl file.hdr]: every stage with both paths and 1 to max_workers workers, the results
+// have to be the same bits for all of them
+void gp_ibl_benchmark(int max_workers, const char* hdr_path) {
+    const char* path_names[] = {"scalar", "sse"};
+    if (max_workers <= 0) {
+        max_workers = (int) std::thread::hardware_concurrency();
+    }
+    max_workers = M_CLAMP(max_workers, 1, JOBS_MAX_WORKERS);
+    int width = 2048;
+    int height = 1024;
+    float* equirect = NULL;
+    if (hdr_path != NULL) {
+        int channels;
+        equirect = stbi_loadf(hdr_path, &width, &height, &channels, 3);
+        if (equirect == NULL) {
+            printf("ibl benchmark: can't load %s: %s\n", hdr_path, stbi_failure_reason());
+            return;
+        }
+    } else {
+        equirect = make_test_environment(width, height);
+    }
+
+    printf("ibl benchmark: %s %dx%d, %d faces, %d mips of %d samples, %d lut\n", hdr_path != NULL ? hdr_path : "test sky",
+           width, height, IBL_SIZE, IBL_MIPS, IBL_SAMPLES, IBL_LUT_SIZE);
+    uint64_t reference = 0;
+    IBL ibl;
+    init_ibl(&ibl);
+    for (int path = IBL_PATH_SCALAR; path <= ibl_best_path(); ++path) {
+        for (int workers = 1; workers <= max_workers; ++workers) {
+            JobSystem* js = create_job_system(workers);
+            ibl.jobs = js;
+            ibl.path = path;
+            memset(ibl.ms, 0, sizeof(ibl.ms));
+            bake_ibl_pixels(&ibl, equirect, width, height);
+
+            uint64_t hash = ibl_hash(&ibl);
+            if (path == IBL_PATH_SCALAR && workers == 1) {
+                reference = hash;
+            }
+            printf("  %-6s %2d workers  cube %8.2f ms  sh %7.2f ms  prefilter %8.2f ms  lut %7.2f ms%s\n",
+                   path_names[path], workers, ibl.ms[IBL_STAGE_CUBE], ibl.ms[IBL_STAGE_SH],
+                   ibl.ms[IBL_STAGE_PREFILTER], ibl.ms[IBL_STAGE_LUT], hash == reference ? "" : "  MISMATCH");
+
+            ibl.jobs = NULL;
+            destroy_job_system(js);
+        }
+    }
+    printf("  sh0 %.4f %.4f %.4f  lut(0.5, 0.5) %.4f %.4f\n", ibl.sh[0], ibl.sh[1], ibl.sh[2],
+           ibl.lut[(IBL_LUT_SIZE / 2 * IBL_LUT_SIZE + IBL_LUT_SIZE / 2) * 2],
+           ibl.lut[(IBL_LUT_SIZE / 2 * IBL_LUT_SIZE + IBL_LUT_SIZE / 2) * 2 + 1]);
+    free_ibl_data(&ibl);
+    free(equirect);
+}
+
+#endif
@@ -0,0 +1,120 @@
+#ifndef GP_INSTANCING_H
+#define GP_INSTANCING_H
+
+//
+// Per-instance data for glDrawArraysInstanced.
+// Each instance is a model matrix followed by a material vec4 (albedo tint rgb, roughness scale),
+// read in the vertex shader through attributes with a divisor of 1.
+//
+
+#define INSTANCE_FLOATS 20
+#define INSTANCE_ATTRIB_MODEL_MATRIX 4 // a mat4 takes 4 locations, 4 to 7
+#define INSTANCE_ATTRIB_MATERIAL 8
+
+typedef struct InstanceBuffer {
+    GLuint vbo;
+    int capacity;
+    int count;
+    float* data;
+} InstanceBuffer;
+
+void create_instance_buffer(InstanceBuffer* ib, int capacity) {
+    assert(capacity > 0);
+    ib->capacity = capacity;
+    ib->count = 0;
+    ib->data = (float*) malloc(capacity * INSTANCE_FLOATS * sizeof(float));
+
+    glGenBuffers(1, &ib->vbo);
+    gp_gl_bind_buffer(GL_ARRAY_BUFFER, ib->vbo);
+    glBufferData(GL_ARRAY_BUFFER, capacity * INSTANCE_FLOATS * sizeof(float), NULL, GL_STREAM_DRAW);
+}
+
+void resize_instance_buffer(InstanceBuffer* ib, int capacity) {
+    if (capacity <= ib->capacity) {
+        return;
+    }
+    ib->capacity = capacity;
+    ib->data = (float*) realloc(ib->data, capacity * INSTANCE_FLOATS * sizeof(float));
+    // The vbo name stays the same so the VAOs that point at it don't need to be touched
+    gp_gl_bind_buffer(GL_ARRAY_BUFFER, ib->vbo);
+    glBufferData(GL_ARRAY_BUFFER, capacity * INSTANCE_FLOATS * sizeof(float), NULL, GL_STREAM_DRAW);
+}
+
+// Adds the instance attributes to an existing mesh VAO
+void attach_instance_buffer(InstanceBuffer* ib, GLuint vao) {
+    GLsizei stride = INSTANCE_FLOATS * sizeof(float);
+
+    gp_gl_bind_vertex_array(vao);
+    gp_gl_bind_buffer(GL_ARRAY_BUFFER, ib->vbo);
+
+    for (int i = 0; i < 4; ++i) {
+        GLuint loc = INSTANCE_ATTRIB_MODEL_MATRIX + i;
+        glVertexAttribPointer(loc, 4, GL_FLOAT, GL_FALSE, stride, (void*)(i * 4 * sizeof(float)));
+        glEnableVertexAttribArray(loc);
+        glVertexAttribDivisor(loc, 1);
+    }
+
+    glVertexAttribPointer(INSTANCE_ATTRIB_MATERIAL, 4, GL_FLOAT, GL_FALSE, stride, (void*)(16 * sizeof(float)));
+    glEnableVertexAttribArray(INSTANCE_ATTRIB_MATERIAL);
+    glVertexAttribDivisor(INSTANCE_ATTRIB_MATERIAL, 1);
+
+    gp_gl_bind_vertex_array(0);
+}
+
+void set_instance(InstanceBuffer* ib, int index, const float* model_matrix, float4 material) {
+    assert(index < ib->capacity);
+    float* dest = &ib->data[index * INSTANCE_FLOATS];
+    memcpy(dest, model_matrix, 16 * sizeof(float));
+    dest[16] = material.x;
+    dest[17] = material.y;
+    dest[18] = material.z;
+    dest[19] = material.w;
+}
+
+void upload_instance_buffer(InstanceBuffer* ib) {
+    gp_gl_bind_buffer(GL_ARRAY_BUFFER, ib->vbo);
+    // orphan the old storage so we don't wait on draws that still read it
+    glBufferData(GL_ARRAY_BUFFER, ib->capacity * INSTANCE_FLOATS * sizeof(float), NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, ib->count * INSTANCE_FLOATS * sizeof(float), ib->data);
+}
+
+// Points the instance attributes of vao at first_instance, for drivers without base instance draws
+void offset_instance_attributes(InstanceBuffer* ib, GLuint vao, int first_instance) {
+    GLsizei stride = INSTANCE_FLOATS * sizeof(float);
+    size_t base = (size_t)first_instance * stride;
+
+    gp_gl_bind_vertex_array(vao);
+    gp_gl_bind_buffer(GL_ARRAY_BUFFER, ib->vbo);
+    for (int i = 0; i < 4; ++i) {
+        glVertexAttribPointer(INSTANCE_ATTRIB_MODEL_MATRIX + i, 4, GL_FLOAT, GL_FALSE, stride, (void*)(base + i * 4 * sizeof(float)));
+    }
+    glVertexAttribPointer(INSTANCE_ATTRIB_MATERIAL, 4, GL_FLOAT, GL_FALSE, stride, (void*)(base + 16 * sizeof(float)));
+}
+
+// Draws instances [first_instance, first_instance + instance_count) of the buffer
+void draw_instanced_range(InstanceBuffer* ib, GLuint vao, int point_count, int first_instance, int instance_count) {
+    if (instance_count <= 0) {
+        return;
+    }
+    if (first_instance == 0) {
+        gp_gl_bind_vertex_array(vao);
+        glDrawArraysInstanced(GL_TRIANGLES, 0, point_count, instance_count);
+    } else if (GLAD_GL_VERSION_4_2) {
+        gp_gl_bind_vertex_array(vao);
+        glDrawArraysInstancedBaseInstance(GL_TRIANGLES, 0, point_count, instance_count, first_instance);
+    } else {
+        offset_instance_attributes(ib, vao, first_instance);
+        glDrawArraysInstanced(GL_TRIANGLES, 0, point_count, instance_count);
+        offset_instance_attributes(ib, vao, 0);
+    }
+}
+
+void draw_instanced(GLuint vao, int point_count, int instance_count) {
+    if (instance_count <= 0) {
+        return;
+    }
+    gp_gl_bind_vertex_array(vao);
+    glDrawArraysInstanced(GL_TRIANGLES, 0, point_count, instance_count);
+}
+
+#endif
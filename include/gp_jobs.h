@@ -0,0 +1,248 @@
+#ifndef GP_JOBS_H
+#define GP_JOBS_H
+
+//
+// Job system
+// One deque per worker, the thread that calls create_job_system is worker 0 and takes part in the work
+// whenever it waits. Owners push and pop at the bottom of their deque, idle workers steal from the top
+// of the others. Every job can decrement a JobCounter when it finishes, waiting on a counter runs other
+// jobs until it reaches zero, that is how work that depends on other work is expressed.
+//
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#define JOBS_MAX_WORKERS 64
+#define JOBS_DEQUE_SIZE 4096 // power of two
+
+// Runs the items [begin, end)
+typedef void (*JobFunction)(void* data, int begin, int end);
+
+typedef struct JobCounter {
+    std::atomic<int> pending;
+} JobCounter;
+
+typedef struct Job {
+    JobFunction function;
+    void* data;
+    int begin;
+    int end;
+    JobCounter* counter; // decremented when the job is done, can be NULL
+} Job;
+
+typedef struct JobDeque {
+    std::mutex lock;
+    Job jobs[JOBS_DEQUE_SIZE];
+    int top;    // next job to steal
+    int bottom; // next free slot, top == bottom when empty
+} JobDeque;
+
+typedef struct JobSystem {
+    int worker_count; // including worker 0, the thread that created the system
+    JobDeque* deques;
+    std::thread* threads;
+
+    std::atomic<int> queued; // jobs sitting in any deque
+    std::atomic<int> running;
+    std::mutex sleep_lock;
+    std::condition_variable wake;
+} JobSystem;
+
+// worker index of the current thread, 0 for every thread that is not a worker
+thread_local int job_worker_index = 0;
+
+void init_job_counter(JobCounter* counter, int pending) {
+    counter->pending.store(pending, std::memory_order_relaxed);
+}
+
+int push_job(JobSystem* js, int worker, const Job* job) {
+    JobDeque* d = &js->deques[worker];
+    std::lock_guard<std::mutex> guard(d->lock);
+    if (d->bottom - d->top == JOBS_DEQUE_SIZE) {
+        return 0;
+    }
+    d->jobs[d->bottom & (JOBS_DEQUE_SIZE - 1)] = *job;
+    d->bottom++;
+    js->queued.fetch_add(1, std::memory_order_release);
+    return 1;
+}
+
+// Most recently pushed job of the own deque, it is the one with the warmest data
+int pop_job(JobSystem* js, int worker, Job* job) {
+    JobDeque* d = &js->deques[worker];
+    std::lock_guard<std::mutex> guard(d->lock);
+    if (d->bottom == d->top) {
+        return 0;
+    }
+    d->bottom--;
+    *job = d->jobs[d->bottom & (JOBS_DEQUE_SIZE - 1)];
+    js->queued.fetch_sub(1, std::memory_order_relaxed);
+    return 1;
+}
+
+// Oldest job of someone else's deque, usually the biggest chunk of work left there
+int steal_job(JobSystem* js, int victim, Job* job) {
+    JobDeque* d = &js->deques[victim];
+    if (!d->lock.try_lock()) {
+        return 0;
+    }
+    int stolen = 0;
+    if (d->bottom != d->top) {
+        *job = d->jobs[d->top & (JOBS_DEQUE_SIZE - 1)];
+        d->top++;
+        js->queued.fetch_sub(1, std::memory_order_relaxed);
+        stolen = 1;
+    }
+    d->lock.unlock();
+    return stolen;
+}
+
+int next_job(JobSystem* js, int worker, Job* job) {
+    if (pop_job(js, worker, job)) {
+        return 1;
+    }
+    for (int i = 1; i < js->worker_count; ++i) {
+        if (steal_job(js, (worker + i) % js->worker_count, job)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void run_job(const Job* job) {
+    job->function(job->data, job->begin, job->end);
+    if (job->counter != NULL) {
+        job->counter->pending.fetch_sub(1, std::memory_order_release);
+    }
+}
+
+void wake_workers(JobSystem* js) {
+    // taking the lock makes sure a worker can't miss the notification between checking and sleeping
+    { std::lock_guard<std::mutex> guard(js->sleep_lock); }
+    js->wake.notify_all();
+}
+
+void job_worker_main(JobSystem* js, int worker) {
+    job_worker_index = worker;
+    Job job;
+    while (js->running.load(std::memory_order_acquire)) {
+        if (next_job(js, worker, &job)) {
+            run_job(&job);
+            continue;
+        }
+        std::unique_lock<std::mutex> guard(js->sleep_lock);
+        js->wake.wait(guard, [js] {
+            return js->queued.load(std::memory_order_acquire) > 0 || !js->running.load(std::memory_order_acquire);
+        });
+    }
+}
+
+// worker_count <= 0 uses one worker per hardware thread
+JobSystem* create_job_system(int worker_count) {
+    if (worker_count <= 0) {
+        worker_count = (int) std::thread::hardware_concurrency();
+    }
+    worker_count = M_CLAMP(worker_count, 1, JOBS_MAX_WORKERS);
+
+    JobSystem* js = new JobSystem();
+    js->worker_count = worker_count;
+    js->deques = new JobDeque[worker_count];
+    for (int i = 0; i < worker_count; ++i) {
+        js->deques[i].top = 0;
+        js->deques[i].bottom = 0;
+    }
+    js->queued.store(0);
+    js->running.store(1);
+
+    js->threads = new std::thread[worker_count];
+    for (int i = 1; i < worker_count; ++i) {
+        js->threads[i] = std::thread(job_worker_main, js, i);
+    }
+    return js;
+}
+
+void destroy_job_system(JobSystem* js) {
+    js->running.store(0, std::memory_order_release);
+    wake_workers(js);
+    for (int i = 1; i < js->worker_count; ++i) {
+        js->threads[i].join();
+    }
+    delete[] js->threads;
+    delete[] js->deques;
+    delete js;
+}
+
+// Queues a job on the deque of the calling worker, runs it right away if the deque is full
+void submit_job(JobSystem* js, const Job* job) {
+    if (!push_job(js, job_worker_index, job)) {
+        run_job(job);
+        return;
+    }
+    wake_workers(js);
+}
+
+// Runs other jobs until the counter reaches zero
+void wait_job_counter(JobSystem* js, JobCounter* counter) {
+    Job job;
+    while (counter->pending.load(std::memory_order_acquire) > 0) {
+        if (next_job(js, job_worker_index, &job)) {
+            run_job(&job);
+        } else {
+            std::this_thread::yield();
+        }
+    }
+}
+
+// Chunk size that gives every worker a few chunks to balance with, never smaller than min_grain
+int job_grain(JobSystem* js, int count, int min_grain) {
+    int workers = js != NULL ? js->worker_count : 1;
+    return M_MAX(min_grain, count / (workers * 4));
+}
+
+// Splits [0, count) in chunks of grain items and queues them without waiting.
+// The counter is set to the number of chunks, the chunk index is begin / grain.
+void parallel_for_async(JobSystem* js, JobCounter* counter, int count, int grain, JobFunction function, void* data) {
+    assert(grain > 0);
+    int chunks = (count + grain - 1) / grain;
+    init_job_counter(counter, chunks);
+
+    Job job;
+    job.function = function;
+    job.data = data;
+    job.counter = counter;
+
+    int queued = 0;
+    for (int i = 0; i < chunks; ++i) {
+        job.begin = i * grain;
+        job.end = M_MIN(count, job.begin + grain);
+        if (push_job(js, job_worker_index, &job)) {
+            queued++;
+        } else {
+            run_job(&job);
+        }
+    }
+    if (queued > 0) {
+        wake_workers(js);
+    }
+}
+
+// Runs function over [0, count) in chunks of grain items and returns when all of them are done.
+// Without a job system, or with a single chunk, the chunks run in order on the calling thread.
+void parallel_for(JobSystem* js, int count, int grain, JobFunction function, void* data) {
+    if (count <= 0) {
+        return;
+    }
+    if (js == NULL || js->worker_count == 1 || count <= grain) {
+        for (int begin = 0; begin < count; begin += grain) {
+            function(data, begin, M_MIN(count, begin + grain));
+        }
+        return;
+    }
+    JobCounter counter;
+    parallel_for_async(js, &counter, count, grain, function, data);
+    wait_job_counter(js, &counter);
+}
+
+#endif
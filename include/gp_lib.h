@@ -1,6 +1,8 @@
 #define M_MATH_IMPLEMENTATION
 #include "m_math.h"
 
+#include "gp_gl_state.h"
+
 #include "../../assimp/cimport.h"
 #include "../../assimp/postprocess.h"
 #include "../../assimp/scene.h"
@@ -46,9 +48,9 @@ float3 operator+(float3 lhs, const float& rhs) {
 }
 
 float3 operator-(float3 lhs, const float& rhs) { 
-	lhs.x +=rhs;
-	lhs.y +=rhs;
-	lhs.z +=rhs; 
+	lhs.x -=rhs;
+	lhs.y -=rhs;
+	lhs.z -=rhs; 
 
 	return lhs;
 }
@@ -109,6 +111,91 @@ void copy_mat4(float* dest, float* orig) {
 	memcpy(dest, orig, (16 * sizeof(float)));
 }
 
+////////////////////////////////////////////////////
+// memory
+
+// For SoA streams read with aligned SIMD loads, alignment must be a power of two
+void* gp_aligned_malloc(size_t size, size_t alignment) {
+#ifdef _WIN32
+	return _aligned_malloc(size, alignment);
+#else
+	void* ptr = NULL;
+	if (posix_memalign(&ptr, alignment, size) != 0) {
+		return NULL;
+	}
+	return ptr;
+#endif
+}
+
+void gp_aligned_free(void* ptr) {
+#ifdef _WIN32
+	_aligned_free(ptr);
+#else
+	free(ptr);
+#endif
+}
+
+////////////////////////////////////////////////////
+// sorting
+
+inline void radix_scatter(const char* src, char* dst, int n, size_t size, int shift, int* offsets) {
+	for (int i = 0; i < n; ++i) {
+		uint64_t key = *(const uint64_t*) (src + i * size);
+		memcpy(dst + offsets[(key >> shift) & 0xFF]++ * size, src + i * size, size);
+	}
+}
+
+// LSD radix sort of n records of size bytes on the uint64_t key they start with, 8 bits per pass.
+// All histograms are built in one read of the keys and passes where every key has the same byte are
+// skipped. Returns records or scratch, whichever holds the sorted result. The histograms are on the
+// stack, sorts running on different threads share nothing.
+void* radix_sort_records(void* records, void* scratch, int n, size_t size) {
+	if (n < 2) {
+		return records;
+	}
+	int histograms[8][256];
+	memset(histograms, 0, sizeof(histograms));
+	const char* keys = (const char*) records;
+	for (int i = 0; i < n; ++i) {
+		uint64_t key = *(const uint64_t*) (keys + i * size);
+		for (int b = 0; b < 8; ++b) {
+			histograms[b][(key >> (b * 8)) & 0xFF]++;
+		}
+	}
+
+	char* src = (char*) records;
+	char* dst = (char*) scratch;
+	for (int b = 0; b < 8; ++b) {
+		int* histogram = histograms[b];
+		int shift = b * 8;
+		if (histogram[(*(const uint64_t*) src >> shift) & 0xFF] == n) {
+			continue;
+		}
+		int offset = 0;
+		for (int i = 0; i < 256; ++i) {
+			int c = histogram[i];
+			histogram[i] = offset;
+			offset += c;
+		}
+		// constant sizes, so the copies inline
+		if (size == 8) {
+			radix_scatter(src, dst, n, 8, shift, histogram);
+		} else if (size == 16) {
+			radix_scatter(src, dst, n, 16, shift, histogram);
+		} else {
+			radix_scatter(src, dst, n, size, shift, histogram);
+		}
+		char* tmp = src;
+		src = dst;
+		dst = tmp;
+	}
+	return src;
+}
+
+uint64_t* radix_sort_u64(uint64_t* keys, uint64_t* scratch, int n) {
+	return (uint64_t*) radix_sort_records(keys, scratch, n, sizeof(uint64_t));
+}
+
 ////////////////////////////////////////////////////
 // math related functions
 
@@ -134,25 +221,78 @@ float rand_float_range(float min, float max) {
 	return min + (max-min) * m_randf();
 }
 
+// Uniform in the unit ball without rejection, the same method as m_rng_in_unit_sphere: a direction on
+// the sphere, scaled by the largest of 3 draws. That radius is below r with probability r^3, like the
+// volume within r. Uses the global m_rand state, threads should use m_rng_in_unit_sphere.
 float3 rand_in_unit_sphere() {
-    float3 res;
-    float len = 0;
-    do {
-        res.x = 2.0 * m_randf() - 1;
-        res.y = 2.0 * m_randf() - 1;
-        res.z = 2.0 * m_randf() - 1;
-        //squared length
-        len = res.x*res.x + res.y*res.y + res.z*res.z;
-    } while(len >= 1.0);
-
+    float z = 2.0f * m_randf() - 1.0f;
+    float a = 2.0f * M_PI * m_randf();
+    float r = sqrtf(M_MAX(0.0f, 1.0f - z * z));
+    float u0 = m_randf(), u1 = m_randf(), u2 = m_randf();
+    float radius = M_MAX(M_MAX(u0, u1), u2);
+    float3 res = {radius * r * cosf(a), radius * r * sinf(a), radius * z};
     return res;
 }
 
 ////////////////////////////////////////////////////
 // model loading
 
+// Object space bounds, the sphere is centered on the box and encloses every vertex
+typedef struct MeshBounds {
+	float3 min;
+	float3 max;
+	float3 center;
+	float radius;
+} MeshBounds;
+
+void compute_mesh_bounds(MeshBounds* bounds, const float* points, int point_count) {
+	if (point_count <= 0) {
+		memset(bounds, 0, sizeof(MeshBounds));
+		return;
+	}
+
+	set_float3(&bounds->min, points[0], points[1], points[2]);
+	bounds->max = bounds->min;
+	for (int i = 1; i < point_count; ++i) {
+		float3 p;
+		set_float3(&p, points[i * 3 + 0], points[i * 3 + 1], points[i * 3 + 2]);
+		M_MIN3(bounds->min, bounds->min, p);
+		M_MAX3(bounds->max, bounds->max, p);
+	}
+
+	M_ADD3(bounds->center, bounds->min, bounds->max);
+	mul_scalar(&bounds->center, 0.5);
+
+	float radius2 = 0.0;
+	for (int i = 0; i < point_count; ++i) {
+		float3 d;
+		set_float3(&d, points[i * 3 + 0], points[i * 3 + 1], points[i * 3 + 2]);
+		sub_float3_inplace(&d, &bounds->center);
+		radius2 = M_MAX(radius2, M_DOT3(d, d));
+	}
+	bounds->radius = sqrtf(radius2);
+}
+
+// Vertex data of the first mesh of a file, one vertex per triangle corner. Missing attributes are NULL.
+typedef struct MeshData {
+	int vertex_count;
+	float* positions; // xyz
+	float* normals;   // xyz
+	float* uvs;       // xy
+	float* tangents;  // xyz + handedness of the bitangent
+} MeshData;
+
+void free_mesh_data(MeshData* data) {
+	free(data->positions);
+	free(data->normals);
+	free(data->uvs);
+	free(data->tangents);
+	memset(data, 0, sizeof(MeshData));
+}
 
-int load_mesh(const char* file_name, GLuint* vao, int* point_count) {
+// bounds can be NULL
+int load_mesh_data(const char* file_name, MeshData* data, MeshBounds* bounds) {
+	memset(data, 0, sizeof(MeshData));
 
 	const aiScene* scene = aiImportFile(file_name, 
 aiProcess_Triangulate|
@@ -178,62 +318,56 @@ aiProcess_CalcTangentSpace);
 	const aiMesh* mesh = scene->mMeshes[0];
 	printf("Mesh[0] has %d vertices\n",mesh->mNumVertices);
 
-	// Keep point_count
-	*point_count = mesh->mNumVertices;
-
-	// Generate a VAO
-	glGenVertexArrays(1, vao);
-	glBindVertexArray(*vao);
+	int point_count = mesh->mNumVertices;
+	data->vertex_count = point_count;
 
 	// Copy assimp data
 
-	GLfloat* points = NULL;
-	GLfloat* normals = NULL;
-	GLfloat* tex_coords = NULL;
-	GLfloat* tangents = NULL;
-	
-
 	if (mesh->HasPositions()){
 		printf("Loading positions\n");
-		points = (GLfloat*) malloc(*point_count * 3 * sizeof(GLfloat));
-		for (int i = 0; i < *point_count; ++i) {
+		data->positions = (GLfloat*) malloc(point_count * 3 * sizeof(GLfloat));
+		for (int i = 0; i < point_count; ++i) {
 			const aiVector3D* vp = &(mesh->mVertices[i]);
-			points[i * 3 + 0] = (GLfloat)vp->x;
-			points[i * 3 + 1] = (GLfloat)vp->y;
-			points[i * 3 + 2] = (GLfloat)vp->z;
+			data->positions[i * 3 + 0] = (GLfloat)vp->x;
+			data->positions[i * 3 + 1] = (GLfloat)vp->y;
+			data->positions[i * 3 + 2] = (GLfloat)vp->z;
 				
 		}
+
+		if (bounds != NULL) {
+			compute_mesh_bounds(bounds, data->positions, point_count);
+		}
 	}
 
 	if (mesh->HasNormals()){
 		printf("Loading normals\n");
-		normals = (GLfloat*) malloc(*point_count * 3 * sizeof(GLfloat));
-		for (int i = 0; i < *point_count; ++i) {
+		data->normals = (GLfloat*) malloc(point_count * 3 * sizeof(GLfloat));
+		for (int i = 0; i < point_count; ++i) {
 			const aiVector3D* vn = &(mesh->mNormals[i]);
-			normals[i * 3 + 0] = (GLfloat)vn->x;
-			normals[i * 3 + 1] = (GLfloat)vn->y;
-			normals[i * 3 + 2] = (GLfloat)vn->z;
+			data->normals[i * 3 + 0] = (GLfloat)vn->x;
+			data->normals[i * 3 + 1] = (GLfloat)vn->y;
+			data->normals[i * 3 + 2] = (GLfloat)vn->z;
 		}
 	}
 
 	if (mesh->HasTextureCoords(0)){
 		printf("Loading textureCoords(0)\n");
-		tex_coords = (GLfloat*) malloc(*point_count * 2 * sizeof(GLfloat));
-		for (int i = 0; i < *point_count; ++i) {
+		data->uvs = (GLfloat*) malloc(point_count * 2 * sizeof(GLfloat));
+		for (int i = 0; i < point_count; ++i) {
 			const aiVector3D* vt = &(mesh->mTextureCoords[0][i]);
-			tex_coords[i * 2 + 0] = (GLfloat)vt->x;
-			tex_coords[i * 2 + 1] = (GLfloat)vt->y;
+			data->uvs[i * 2 + 0] = (GLfloat)vt->x;
+			data->uvs[i * 2 + 1] = (GLfloat)vt->y;
 		}
 	}
 
 	if (mesh->HasTangentsAndBitangents()) {
 		printf("Loading TangentsAndBitangents???\n");
-		tangents = (GLfloat*) malloc(*point_count * 4 * sizeof(GLfloat));
+		data->tangents = (GLfloat*) malloc(point_count * 4 * sizeof(GLfloat));
 		float3 t;
 		float3 b;
 		float3 n;
 
-		for (int i = 0; i < *point_count; ++i) {
+		for (int i = 0; i < point_count; ++i) {
 			const aiVector3D* tangent = &(mesh->mTangents[i]);
 			const aiVector3D* bitangent = &(mesh->mBitangents[i]);
 			const aiVector3D* normal = &(mesh->mNormals[i]);
@@ -267,96 +401,103 @@ aiProcess_CalcTangentSpace);
 				det = 1.0f;
 			}
 
-			tangents[i * 4 + 0] = (GLfloat)t_i.x;
-			tangents[i * 4 + 1] = (GLfloat)t_i.y;
-			tangents[i * 4 + 2] = (GLfloat)t_i.z;
-			tangents[i * 4 + 3] = (GLfloat)det;
+			data->tangents[i * 4 + 0] = (GLfloat)t_i.x;
+			data->tangents[i * 4 + 1] = (GLfloat)t_i.y;
+			data->tangents[i * 4 + 2] = (GLfloat)t_i.z;
+			data->tangents[i * 4 + 3] = (GLfloat)det;
 
 			
 		}
 	}
 
+	aiReleaseImport(scene);
+	return 1;
+}
+
+// bounds can be NULL
+int load_mesh(const char* file_name, GLuint* vao, int* point_count, MeshBounds* bounds) {
+	MeshData data;
+	if (!load_mesh_data(file_name, &data, bounds)) {
+		return 0;
+	}
+
+	// Keep point_count
+	*point_count = data.vertex_count;
+
+	// Generate a VAO
+	glGenVertexArrays(1, vao);
+	gp_gl_bind_vertex_array(*vao);
+
 	// Copy mesh data to VBO
 
-	if (mesh->HasPositions()){
+	if (data.positions != NULL){
 		GLuint vbo;
 		glGenBuffers(1, &vbo);
-		glBindBuffer(GL_ARRAY_BUFFER, vbo);
+		gp_gl_bind_buffer(GL_ARRAY_BUFFER, vbo);
 		glBufferData(
 			GL_ARRAY_BUFFER,
 			3* (*point_count) * sizeof(GLfloat),
-			points,
+			data.positions,
 			GL_STATIC_DRAW);
 
 		glVertexAttribPointer(0,3,GL_FLOAT, GL_FALSE, 0, NULL);
 		glEnableVertexAttribArray(0);
 
 		printf("VertexAttribArray 0 -> Positions\n");
-
-		// Free temporary local memory;
-		free(points);
 	}
 
-	if (mesh->HasNormals()){
+	if (data.normals != NULL){
 		GLuint vbo;
 		glGenBuffers(1, &vbo);
-		glBindBuffer(GL_ARRAY_BUFFER, vbo);
+		gp_gl_bind_buffer(GL_ARRAY_BUFFER, vbo);
 		glBufferData(
 			GL_ARRAY_BUFFER,
 			3 * (*point_count) * sizeof(GLfloat),
-		normals,
+		data.normals,
 		GL_STATIC_DRAW);
 
 		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, NULL);
 		glEnableVertexAttribArray(1);
 
 		printf("VertexAttribArray 1 -> Normals\n");
-
-		// Free temporary local memory;
-		free(normals);
 	}
 
-	if (mesh->HasTextureCoords(0)){
+	if (data.uvs != NULL){
 		GLuint vbo;
 		glGenBuffers(1, &vbo);
-		glBindBuffer(GL_ARRAY_BUFFER, vbo);
+		gp_gl_bind_buffer(GL_ARRAY_BUFFER, vbo);
 		glBufferData(
 			GL_ARRAY_BUFFER,
 			2 * (*point_count) * sizeof(GLfloat),
-			tex_coords,
+			data.uvs,
 			GL_STATIC_DRAW);
 
 		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, NULL);
 		glEnableVertexAttribArray(2);
 
 		printf("VertexAttribArray 2 -> TextureCoords\n");
-
-		// Free temporary local memory;
-		free(tex_coords);
 	}
 
-	if (mesh->HasTangentsAndBitangents()){
+	if (data.tangents != NULL){
 		GLuint vbo;
 		glGenBuffers(1, &vbo);
-		glBindBuffer(GL_ARRAY_BUFFER, vbo);
+		gp_gl_bind_buffer(GL_ARRAY_BUFFER, vbo);
 		glBufferData(
 			GL_ARRAY_BUFFER,
 			4 * (*point_count) * sizeof(GLfloat),
-			tangents,
+			data.tangents,
 			GL_STATIC_DRAW);
 
 		glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, 0, NULL);
 		glEnableVertexAttribArray(3);
 
 		printf("VertexAttribArray 3 -> TangentsAndBitangents\n");
-
-		// Free temporary local memory;
-		free(tangents);
 	}
 
-	glBindVertexArray(0);
+	gp_gl_bind_vertex_array(0);
 
-	aiReleaseImport(scene);
+	// Free temporary local memory;
+	free_mesh_data(&data);
 	printf("Mesh loaded\n");
 	return 1;
 
@@ -429,6 +570,11 @@ int compile_shader_program(const char* str_vert_shader, const char* str_frag_sha
         glBindAttribLocation(prog_object, 3, attrib_name_3);
     }
 
+    // lets gp_program_cache.h read the binary back, drivers may skip keeping it otherwise
+    if (GLAD_GL_VERSION_4_1) {
+        glProgramParameteri(prog_object, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
     gp_log("Linking shader program");
     glLinkProgram(prog_object);
 
@@ -497,6 +643,8 @@ void gp_log_matrix(char*name, float matrix[]) {
 		t->tv_nsec = now.tv_usec * 1000;
 		return 0;
 	}	
+#else
+	#include <time.h>
 #endif
 
 typedef struct g_timer{
@@ -516,7 +664,8 @@ float compute_timer_millis_diff(g_timer* counter) {
 	const float p10_to_minus6 = pow(10,-6);
 	long diff_sec  =counter->end_time.tv_sec - counter->start_time.tv_sec;
 	long diff_nano =counter->end_time.tv_nsec - counter->start_time.tv_nsec;
-	long diff_millis = diff_sec * 1000 + diff_nano * p10_to_minus6;
+	// keep the fraction, the benchmarks time things well under a millisecond
+	float diff_millis = diff_sec * 1000 + diff_nano * p10_to_minus6;
 	return diff_millis;
 }
 
@@ -587,20 +736,70 @@ struct cpu_timestamp {
 ////////////////////////////////////////////////////
 // file watching stuff
 
-// @note this is really messy for now and only supports osx
+// FSEvents on osx, inotify on linux, nothing elsewhere.
+// Every changed file ends up once in a single producer single consumer ring: the watcher pushes, the
+// frame loop pops with poll_filewatcher, which is one atomic load when nothing changed. Editors
+// write a file in bursts (truncate, several writes, rename), so events for the same file are merged
+// until it has been quiet for FILEWATCHER_DEBOUNCE_MS, FSEvents does that itself with its latency.
 
 #ifdef GP_INCLUDE_FILEWATCHER
-	
-	typedef struct FileWatcherInfo{
-		int files_changed;
-		char* latest_filename;
-	}FileWatcherInfo;
+	#include <atomic>
+	#include <thread>
+
+	#define FILEWATCHER_QUEUE 64 // power of two
+	#define FILEWATCHER_PATH 256
+	#define FILEWATCHER_DEBOUNCE_MS 100.0
+	#define FILEWATCHER_POLL_MS 250 // how long stop_filewatcher can take
+
+	typedef struct FileEvent {
+		char path[FILEWATCHER_PATH];
+	} FileEvent;
+
+	typedef struct FileWatcher {
+		FileEvent events[FILEWATCHER_QUEUE];
+		std::atomic<unsigned> head; // next event to pop, only moved by the frame loop
+		std::atomic<unsigned> tail; // next slot to push, only moved by the watcher
+		std::atomic<int> dropped;   // pushed while the ring was full
+		std::atomic<int> running;
+		char folder[FILEWATCHER_PATH];
+	} FileWatcher;
+
+	FileWatcher filewatcher;
+
+	void start_filewatcher(const char* folder);
+	void stop_filewatcher();
 
-	FileWatcherInfo* filewatcher_context;
+	int push_file_event(FileWatcher* fw, const char* path) {
+		unsigned tail = fw->tail.load(std::memory_order_relaxed);
+		if (tail - fw->head.load(std::memory_order_acquire) == FILEWATCHER_QUEUE) {
+			fw->dropped.fetch_add(1, std::memory_order_relaxed);
+			return 0;
+		}
+		snprintf(fw->events[tail & (FILEWATCHER_QUEUE - 1)].path, FILEWATCHER_PATH, "%s", path);
+		fw->tail.store(tail + 1, std::memory_order_release);
+		return 1;
+	}
 
-	void start_filewatcher(char* folder);
-	void stop_filewatcher();
-	int files_changed_filewatcher();
+	// Next changed file, 0 if there is none
+	int poll_filewatcher(FileEvent* event) {
+		unsigned head = filewatcher.head.load(std::memory_order_relaxed);
+		if (head == filewatcher.tail.load(std::memory_order_acquire)) {
+			return 0;
+		}
+		*event = filewatcher.events[head & (FILEWATCHER_QUEUE - 1)];
+		filewatcher.head.store(head + 1, std::memory_order_release);
+		return 1;
+	}
+
+	// Drops the queued events, returns how many there were
+	int files_changed_filewatcher() {
+		FileEvent event;
+		int count = 0;
+		while (poll_filewatcher(&event)) {
+			count++;
+		}
+		return count;
+	}
 
 	#ifdef __MACH__
 		#include <CoreServices/CoreServices.h>
@@ -619,45 +818,30 @@ struct cpu_timestamp {
 
 			// printf("Callback called\n");
 			for (i=0; i<numEvents; i++) {
-				int count;
 				/* flags are unsigned long, IDs are uint64_t */
 				printf("Change %llu in %s, flags %u\n", eventIds[i], paths[i], eventFlags[i]);
-			}
-
-			if (numEvents > 0) {
-				if (filewatcher_context != NULL) {
-					filewatcher_context->files_changed = numEvents;
-					sprintf(filewatcher_context->latest_filename, "%s", paths[0]);
-				} else {
-					printf("filewatcher_context is NULL ???\n");
-				}	
-			} else {
-				filewatcher_context->files_changed = 0;
-				printf("loop_filewatcher called but no events ???\n");
+				push_file_event(&filewatcher, paths[i]);
 			}
 		}
 
 		void stop_filewatcher() {
+			if (!filewatcher.running.load()) {
+				return;
+			}
 			printf("Stop_filewatcher: stop\n");
 			FSEventStreamStop(stream);
 			FSEventStreamInvalidate(stream);
 			FSEventStreamRelease(stream);
-
-			free(filewatcher_context->latest_filename);
-			free(filewatcher_context);
+			filewatcher.running.store(0);
 		}
 
 		/*
 		 * https://developer.apple.com/library/content/documentation/Darwin/Conceptual/FSEvents_ProgGuide/UsingtheFSEventsFramework/UsingtheFSEventsFramework.html#//apple_ref/doc/uid/TP40005289-CH4-DontLinkElementID_11
 		 */
-		void start_filewatcher(char* folder) {
+		void start_filewatcher(const char* folder) {
 			printf("Start_filewatcher: start\n");
-			filewatcher_context = (FileWatcherInfo*) malloc(sizeof(FileWatcherInfo));
- 			filewatcher_context->files_changed = 0;
- 			filewatcher_context->latest_filename = (char*) malloc(200 * sizeof(char));
+			snprintf(filewatcher.folder, FILEWATCHER_PATH, "%s", folder);
 
-
- 			
  			/* Define variables and create a CFArray object containing
 		       CFString objects containing paths to watch.
 		     */
@@ -682,18 +866,118 @@ struct cpu_timestamp {
 
 		    // Start stream
 		    bool success = FSEventStreamStart(stream);
+		    filewatcher.running.store(success ? 1 : 0);
 		    printf("Start_filewatcher: file event stream started? %d\n", success);
 		}
 
-	#else
-		void start_filewatcher() {
-			printf("\n\n\n\n File watcher not implemented for this platform\n\n\n\n ");
+	#elif defined(__linux__)
+		#include <sys/inotify.h>
+		#include <poll.h>
+		#include <unistd.h>
+
+		int filewatcher_fd = -1;
+		std::thread filewatcher_thread;
+
+		typedef struct PendingFileEvent {
+			char name[FILEWATCHER_PATH];
+			double deadline_ms;
+		} PendingFileEvent;
+
+		double filewatcher_now_ms() {
+			struct timespec t;
+			clock_gettime(CLOCK_MONOTONIC, &t);
+			return t.tv_sec * 1000.0 + t.tv_nsec / 1000000.0;
+		}
+
+		// Waits for inotify events, a file only gets pushed once nothing happened to it for the debounce time
+		void loop_filewatcher() {
+			char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+			PendingFileEvent pending[FILEWATCHER_QUEUE];
+			int pending_count = 0;
+
+			while (filewatcher.running.load(std::memory_order_acquire)) {
+				double now = filewatcher_now_ms();
+				int timeout = FILEWATCHER_POLL_MS;
+				for (int i = 0; i < pending_count; ++i) {
+					timeout = M_MIN(timeout, M_MAX(0, (int) (pending[i].deadline_ms - now) + 1));
+				}
+
+				struct pollfd fd = {filewatcher_fd, POLLIN, 0};
+				if (poll(&fd, 1, timeout) > 0 && (fd.revents & POLLIN)) {
+					ssize_t length = read(filewatcher_fd, buffer, sizeof(buffer));
+					now = filewatcher_now_ms();
+					const struct inotify_event* e;
+					for (char* p = buffer; length > 0 && p < buffer + length; p += sizeof(struct inotify_event) + e->len) {
+						e = (const struct inotify_event*) p;
+						if (e->len == 0 || e->name[0] == '.') {
+							continue; // the folder itself, editor swap files
+						}
+						int i = 0;
+						while (i < pending_count && strcmp(pending[i].name, e->name) != 0) {
+							++i;
+						}
+						if (i == pending_count) {
+							if (pending_count == FILEWATCHER_QUEUE) {
+								continue;
+							}
+							snprintf(pending[pending_count++].name, FILEWATCHER_PATH, "%s", e->name);
+						}
+						pending[i].deadline_ms = now + FILEWATCHER_DEBOUNCE_MS;
+					}
+				}
+
+				now = filewatcher_now_ms();
+				for (int i = 0; i < pending_count;) {
+					if (pending[i].deadline_ms > now) {
+						++i;
+						continue;
+					}
+					char path[FILEWATCHER_PATH * 2];
+					int length = (int) strlen(filewatcher.folder);
+					const char* separator = length > 0 && filewatcher.folder[length - 1] != '/' ? "/" : "";
+					snprintf(path, sizeof(path), "%s%s%s", filewatcher.folder, separator, pending[i].name);
+					printf("Change in %s\n", path);
+					push_file_event(&filewatcher, path);
+					pending[i] = pending[--pending_count];
+				}
+			}
 		}
+
 		void stop_filewatcher() {
+			if (!filewatcher.running.load()) {
+				return;
+			}
+			printf("Stop_filewatcher: stop\n");
+			filewatcher.running.store(0, std::memory_order_release);
+			filewatcher_thread.join();
+			close(filewatcher_fd);
+			filewatcher_fd = -1;
+		}
+
+		void start_filewatcher(const char* folder) {
+			printf("Start_filewatcher: start\n");
+			snprintf(filewatcher.folder, FILEWATCHER_PATH, "%s", folder);
+			filewatcher_fd = inotify_init1(IN_CLOEXEC);
+			if (filewatcher_fd < 0) {
+				printf("Start_filewatcher: inotify_init1 failed\n");
+				return;
+			}
+			// written and closed, or moved over by editors that save to a temporary file first
+			if (inotify_add_watch(filewatcher_fd, folder, IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_MODIFY) < 0) {
+				printf("Start_filewatcher: can't watch %s\n", folder);
+				close(filewatcher_fd);
+				filewatcher_fd = -1;
+				return;
+			}
+			filewatcher.running.store(1, std::memory_order_release);
+			filewatcher_thread = std::thread(loop_filewatcher);
+		}
+
+	#else
+		void start_filewatcher(const char* folder) {
 			printf("\n\n\n\n File watcher not implemented for this platform\n\n\n\n ");
 		}
-		int files_changed_filewatcher() {
-			printf("\n\n\n\n File watcher not implemented for this platform\n\n\n\n ");	
+		void stop_filewatcher() {
 		}
 	#endif
 
@@ -0,0 +1,534 @@
+#ifndef GP_LIGHTS_H
+#define GP_LIGHTS_H
+
+//
+// Clustered point lights
+// The view frustum is split in a LIGHT_CLUSTERS_X x LIGHT_CLUSTERS_Y grid of screen tiles and
+// LIGHT_CLUSTERS_Z exponential depth slices. Every frame the lights are moved to view space and each
+// one is added to the clusters its sphere touches, so a fragment only loops over the lights of its own
+// cluster. Clusters are tested as view space AABBs, a bit conservative at the frustum edges.
+// Slices are binned by different jobs into their own index lists which are then joined in slice order,
+// the result doesn't depend on the worker count.
+//
+// The shader reads three buffer textures: the cluster grid (RG32UI: first index, light count), the light
+// indices (R32UI) and the lights (RGBA32F, 2 texels each: view position and radius, color and intensity).
+//
+
+#include <float.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define GP_LIGHTS_SSE
+#endif
+
+#define LIGHT_CLUSTERS_X 16
+#define LIGHT_CLUSTERS_Y 9
+#define LIGHT_CLUSTERS_Z 24
+#define LIGHT_CLUSTERS_PER_SLICE (LIGHT_CLUSTERS_X * LIGHT_CLUSTERS_Y)
+#define LIGHT_CLUSTER_COUNT (LIGHT_CLUSTERS_PER_SLICE * LIGHT_CLUSTERS_Z)
+#define LIGHT_DATA_FLOATS 8
+// first unit of the three buffer textures, the material textures take the ones before
+#define LIGHT_TEXTURE_UNIT 6
+#define LIGHT_ALIGNMENT 16
+#define LIGHT_WIDTH 4
+
+enum LightPath {
+    LIGHT_PATH_SCALAR = 0,
+    LIGHT_PATH_SSE
+};
+
+typedef struct PointLight {
+    float3 position; // world space
+    float radius;    // no light past it
+    float3 color;
+    float intensity;
+} PointLight;
+
+typedef struct LightClusterStats {
+    int lights;
+    int indices;        // light references in all clusters
+    int max_per_cluster;
+    int used_clusters;  // clusters with at least one light
+} LightClusterStats;
+
+// Binning output of one depth slice, offsets in the grid are relative to the slice until they are joined
+typedef struct LightSlice {
+    unsigned int* indices;
+    int count;
+    int capacity;
+
+    // lights that overlap the slice, SoA padded to LIGHT_WIDTH
+    float* x;
+    float* y;
+    float* z;
+    float* r;
+    int* light;
+    int candidates;
+} LightSlice;
+
+typedef struct LightClusters {
+    PointLight* lights;
+    int light_count;
+    int light_capacity; // also the capacity of the SoA arrays, a multiple of LIGHT_WIDTH
+
+    // view space spheres
+    float* x;
+    float* y;
+    float* z;
+    float* r;
+    float* light_data; // LIGHT_DATA_FLOATS per light, what the shader reads
+
+    // view space bounds of every cluster, rebuilt when the projection changes
+    float3 box_min[LIGHT_CLUSTER_COUNT];
+    float3 box_max[LIGHT_CLUSTER_COUNT];
+    float3 slice_min[LIGHT_CLUSTERS_Z];
+    float3 slice_max[LIGHT_CLUSTERS_Z];
+    float box_key[4]; // projection x and y scale, near and far the bounds were built with
+
+    float near_plane;
+    float far_plane;
+    float depth_scale; // slice = log(-view z) * depth_scale + depth_bias
+    float depth_bias;
+    int width; // viewport, the shader finds the screen tile from gl_FragCoord
+    int height;
+
+    LightSlice slices[LIGHT_CLUSTERS_Z];
+    unsigned int grid[LIGHT_CLUSTER_COUNT * 2];
+    unsigned int* indices;
+    int index_count;
+    int index_capacity;
+
+    GLuint buffers[3]; // grid, indices, lights
+    GLuint textures[3];
+
+    int path;
+    JobSystem* jobs; // NULL bins on the calling thread
+    LightClusterStats stats;
+} LightClusters;
+
+int light_best_path() {
+#ifdef GP_LIGHTS_SSE
+    return LIGHT_PATH_SSE;
+#else
+    return LIGHT_PATH_SCALAR;
+#endif
+}
+
+int light_round_up(int count) {
+    return (count + LIGHT_WIDTH - 1) & ~(LIGHT_WIDTH - 1);
+}
+
+float* alloc_light_floats(int count) {
+    return (float*) gp_aligned_malloc(M_MAX(count, LIGHT_WIDTH) * sizeof(float), LIGHT_ALIGNMENT);
+}
+
+// CPU side only, create_light_textures adds what the shader needs
+void init_light_clusters(LightClusters* lc) {
+    memset(lc, 0, sizeof(LightClusters));
+    lc->path = light_best_path();
+}
+
+void free_light_clusters(LightClusters* lc) {
+    free(lc->lights);
+    gp_aligned_free(lc->x);
+    gp_aligned_free(lc->y);
+    gp_aligned_free(lc->z);
+    gp_aligned_free(lc->r);
+    free(lc->light_data);
+    for (int i = 0; i < LIGHT_CLUSTERS_Z; ++i) {
+        LightSlice* s = &lc->slices[i];
+        free(s->indices);
+        gp_aligned_free(s->x);
+        gp_aligned_free(s->y);
+        gp_aligned_free(s->z);
+        gp_aligned_free(s->r);
+        free(s->light);
+    }
+    free(lc->indices);
+    if (lc->buffers[0] != 0) {
+        for (int i = 0; i < 3; ++i) {
+            gp_gl_delete_texture(lc->textures[i]);
+            gp_gl_delete_buffer(lc->buffers[i]);
+        }
+    }
+    memset(lc, 0, sizeof(LightClusters));
+}
+
+void create_light_textures(LightClusters* lc) {
+    GLenum formats[3] = {GL_RG32UI, GL_R32UI, GL_RGBA32F};
+    glGenBuffers(3, lc->buffers);
+    glGenTextures(3, lc->textures);
+    for (int i = 0; i < 3; ++i) {
+        gp_gl_bind_buffer(GL_TEXTURE_BUFFER, lc->buffers[i]);
+        glBufferData(GL_TEXTURE_BUFFER, 16, NULL, GL_STREAM_DRAW);
+        gp_gl_bind_texture(LIGHT_TEXTURE_UNIT + i, GL_TEXTURE_BUFFER, lc->textures[i]);
+        glTexBuffer(GL_TEXTURE_BUFFER, formats[i], lc->buffers[i]);
+    }
+}
+
+// Makes room for count lights, the contents of lights are kept
+void resize_point_lights(LightClusters* lc, int count) {
+    if (count > lc->light_capacity) {
+        int capacity = light_round_up(M_MAX(count, lc->light_capacity * 2));
+        lc->lights = (PointLight*) realloc(lc->lights, capacity * sizeof(PointLight));
+        lc->light_data = (float*) realloc(lc->light_data, capacity * LIGHT_DATA_FLOATS * sizeof(float));
+
+        gp_aligned_free(lc->x);
+        gp_aligned_free(lc->y);
+        gp_aligned_free(lc->z);
+        gp_aligned_free(lc->r);
+        lc->x = alloc_light_floats(capacity);
+        lc->y = alloc_light_floats(capacity);
+        lc->z = alloc_light_floats(capacity);
+        lc->r = alloc_light_floats(capacity);
+
+        for (int i = 0; i < LIGHT_CLUSTERS_Z; ++i) {
+            LightSlice* s = &lc->slices[i];
+            gp_aligned_free(s->x);
+            gp_aligned_free(s->y);
+            gp_aligned_free(s->z);
+            gp_aligned_free(s->r);
+            s->x = alloc_light_floats(capacity);
+            s->y = alloc_light_floats(capacity);
+            s->z = alloc_light_floats(capacity);
+            s->r = alloc_light_floats(capacity);
+            s->light = (int*) realloc(s->light, capacity * sizeof(int));
+        }
+        lc->light_capacity = capacity;
+    }
+    lc->light_count = count;
+}
+
+// View space bounds of every cluster. Only works for symmetric perspective projections, x and y of a
+// point at distance d in front of the camera are ndc * d / projection scale.
+void build_cluster_bounds(LightClusters* lc, const float* projection_matrix) {
+    float scale_x = projection_matrix[0];
+    float scale_y = projection_matrix[5];
+    float log_range = logf(lc->far_plane / lc->near_plane);
+
+    for (int k = 0; k < LIGHT_CLUSTERS_Z; ++k) {
+        float d0 = lc->near_plane * expf(log_range * k / LIGHT_CLUSTERS_Z);
+        float d1 = lc->near_plane * expf(log_range * (k + 1) / LIGHT_CLUSTERS_Z);
+        for (int ty = 0; ty < LIGHT_CLUSTERS_Y; ++ty) {
+            for (int tx = 0; tx < LIGHT_CLUSTERS_X; ++tx) {
+                float nx[2] = {-1.0f + 2.0f * tx / LIGHT_CLUSTERS_X, -1.0f + 2.0f * (tx + 1) / LIGHT_CLUSTERS_X};
+                float ny[2] = {-1.0f + 2.0f * ty / LIGHT_CLUSTERS_Y, -1.0f + 2.0f * (ty + 1) / LIGHT_CLUSTERS_Y};
+                int c = (k * LIGHT_CLUSTERS_Y + ty) * LIGHT_CLUSTERS_X + tx;
+                float3* bmin = &lc->box_min[c];
+                float3* bmax = &lc->box_max[c];
+                set_float3(bmin, FLT_MAX, FLT_MAX, -d1);
+                set_float3(bmax, -FLT_MAX, -FLT_MAX, -d0);
+                for (int i = 0; i < 2; ++i) {
+                    float d = i == 0 ? d0 : d1;
+                    for (int j = 0; j < 2; ++j) {
+                        float x = nx[j] * d / scale_x;
+                        float y = ny[j] * d / scale_y;
+                        bmin->x = M_MIN(bmin->x, x);
+                        bmin->y = M_MIN(bmin->y, y);
+                        bmax->x = M_MAX(bmax->x, x);
+                        bmax->y = M_MAX(bmax->y, y);
+                    }
+                }
+            }
+        }
+
+        // the far end of the slice is the widest
+        set_float3(&lc->slice_min[k], -d1 / scale_x, -d1 / scale_y, -d1);
+        set_float3(&lc->slice_max[k], d1 / scale_x, d1 / scale_y, -d0);
+    }
+
+    lc->depth_scale = LIGHT_CLUSTERS_Z / log_range;
+    lc->depth_bias = -LIGHT_CLUSTERS_Z * logf(lc->near_plane) / log_range;
+    lc->box_key[0] = scale_x;
+    lc->box_key[1] = scale_y;
+    lc->box_key[2] = lc->near_plane;
+    lc->box_key[3] = lc->far_plane;
+}
+
+////////////////////////////////////////////////////
+// binning kernels, they test spheres [0, count) against a box and append the ones that touch it
+
+int sphere_touches_box(float x, float y, float z, float r, const float3* bmin, const float3* bmax) {
+    float dx = M_MAX(M_MAX(bmin->x - x, x - bmax->x), 0.0f);
+    float dy = M_MAX(M_MAX(bmin->y - y, y - bmax->y), 0.0f);
+    float dz = M_MAX(M_MAX(bmin->z - z, z - bmax->z), 0.0f);
+    return dx * dx + dy * dy + dz * dz <= r * r;
+}
+
+// Appends to out the ids[i] of the spheres that touch the box, ids NULL appends i
+int bin_spheres_scalar(const float* x, const float* y, const float* z, const float* r, const int* ids, int count,
+                       const float3* bmin, const float3* bmax, int* out) {
+    int n = 0;
+    for (int i = 0; i < count; ++i) {
+        if (sphere_touches_box(x[i], y[i], z[i], r[i], bmin, bmax)) {
+            out[n++] = ids != NULL ? ids[i] : i;
+        }
+    }
+    return n;
+}
+
+#ifdef GP_LIGHTS_SSE
+// count is padded to LIGHT_WIDTH, padding lanes must never touch anything
+int bin_spheres_sse(const float* x, const float* y, const float* z, const float* r, const int* ids, int count,
+                    const float3* bmin, const float3* bmax, int* out) {
+    __m128 min_x = _mm_set1_ps(bmin->x);
+    __m128 min_y = _mm_set1_ps(bmin->y);
+    __m128 min_z = _mm_set1_ps(bmin->z);
+    __m128 max_x = _mm_set1_ps(bmax->x);
+    __m128 max_y = _mm_set1_ps(bmax->y);
+    __m128 max_z = _mm_set1_ps(bmax->z);
+    __m128 zero = _mm_setzero_ps();
+
+    int n = 0;
+    for (int i = 0; i < count; i += LIGHT_WIDTH) {
+        __m128 px = _mm_load_ps(&x[i]);
+        __m128 py = _mm_load_ps(&y[i]);
+        __m128 pz = _mm_load_ps(&z[i]);
+        __m128 pr = _mm_load_ps(&r[i]);
+
+        __m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(min_x, px), _mm_sub_ps(px, max_x)), zero);
+        __m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(min_y, py), _mm_sub_ps(py, max_y)), zero);
+        __m128 dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(min_z, pz), _mm_sub_ps(pz, max_z)), zero);
+        __m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+
+        int mask = _mm_movemask_ps(_mm_cmple_ps(d2, _mm_mul_ps(pr, pr)));
+        while (mask != 0) {
+            int k = __builtin_ctz(mask);
+            out[n++] = ids != NULL ? ids[i + k] : i + k;
+            mask &= mask - 1;
+        }
+    }
+    return n;
+}
+#endif
+
+int bin_spheres(int path, const float* x, const float* y, const float* z, const float* r, const int* ids, int count,
+                const float3* bmin, const float3* bmax, int* out) {
+#ifdef GP_LIGHTS_SSE
+    if (path == LIGHT_PATH_SSE) {
+        return bin_spheres_sse(x, y, z, r, ids, light_round_up(count), bmin, bmax, out);
+    }
+#endif
+    return bin_spheres_scalar(x, y, z, r, ids, count, bmin, bmax, out);
+}
+
+// Far away sphere with no radius, it never touches a cluster
+void set_light_padding(float* x, float* y, float* z, float* r, int count) {
+    for (int i = count; i < light_round_up(count); ++i) {
+        x[i] = 1e18f;
+        y[i] = 1e18f;
+        z[i] = 1e18f;
+        r[i] = 0.0f;
+    }
+}
+
+////////////////////////////////////////////////////
+// binning
+
+void bin_light_slice_job(void* data, int begin, int end) {
+    LightClusters* lc = (LightClusters*) data;
+    for (int k = begin; k < end; ++k) {
+        LightSlice* s = &lc->slices[k];
+        s->count = 0;
+
+        // lights that touch the slice at all, the tiles only test those
+        s->candidates = bin_spheres(lc->path, lc->x, lc->y, lc->z, lc->r, NULL, lc->light_count,
+                                    &lc->slice_min[k], &lc->slice_max[k], s->light);
+        for (int i = 0; i < s->candidates; ++i) {
+            int l = s->light[i];
+            s->x[i] = lc->x[l];
+            s->y[i] = lc->y[l];
+            s->z[i] = lc->z[l];
+            s->r[i] = lc->r[l];
+        }
+        set_light_padding(s->x, s->y, s->z, s->r, s->candidates);
+
+        for (int t = 0; t < LIGHT_CLUSTERS_PER_SLICE; ++t) {
+            int c = k * LIGHT_CLUSTERS_PER_SLICE + t;
+            if (s->count + s->candidates > s->capacity) {
+                s->capacity = M_MAX(s->count + s->candidates, s->capacity * 2);
+                s->indices = (unsigned int*) realloc(s->indices, s->capacity * sizeof(unsigned int));
+            }
+            int n = bin_spheres(lc->path, s->x, s->y, s->z, s->r, s->light, s->candidates,
+                                &lc->box_min[c], &lc->box_max[c], (int*) &s->indices[s->count]);
+            lc->grid[c * 2 + 0] = s->count;
+            lc->grid[c * 2 + 1] = n;
+            s->count += n;
+        }
+    }
+}
+
+// Moves the lights to view space and fills the cluster grid and the index list
+void bin_point_lights(LightClusters* lc, const float* view_matrix, const float* projection_matrix, float near_plane, float far_plane) {
+    lc->near_plane = near_plane;
+    lc->far_plane = far_plane;
+    if (lc->box_key[0] != projection_matrix[0] || lc->box_key[1] != projection_matrix[5] ||
+        lc->box_key[2] != near_plane || lc->box_key[3] != far_plane) {
+        build_cluster_bounds(lc, projection_matrix);
+    }
+
+    const float* m = view_matrix;
+    for (int i = 0; i < lc->light_count; ++i) {
+        const PointLight* l = &lc->lights[i];
+        float* d = &lc->light_data[i * LIGHT_DATA_FLOATS];
+        lc->x[i] = m[0] * l->position.x + m[4] * l->position.y + m[8] * l->position.z + m[12];
+        lc->y[i] = m[1] * l->position.x + m[5] * l->position.y + m[9] * l->position.z + m[13];
+        lc->z[i] = m[2] * l->position.x + m[6] * l->position.y + m[10] * l->position.z + m[14];
+        lc->r[i] = l->radius;
+        d[0] = lc->x[i];
+        d[1] = lc->y[i];
+        d[2] = lc->z[i];
+        d[3] = l->radius;
+        d[4] = l->color.x;
+        d[5] = l->color.y;
+        d[6] = l->color.z;
+        d[7] = l->intensity;
+    }
+    set_light_padding(lc->x, lc->y, lc->z, lc->r, lc->light_count);
+
+    parallel_for(lc->jobs, LIGHT_CLUSTERS_Z, 1, bin_light_slice_job, lc);
+
+    // join the slices in order and make the grid offsets absolute
+    int total = 0;
+    for (int k = 0; k < LIGHT_CLUSTERS_Z; ++k) {
+        total += lc->slices[k].count;
+    }
+    if (total > lc->index_capacity) {
+        lc->index_capacity = M_MAX(total, lc->index_capacity * 2);
+        lc->indices = (unsigned int*) realloc(lc->indices, lc->index_capacity * sizeof(unsigned int));
+    }
+
+    LightClusterStats* stats = &lc->stats;
+    memset(stats, 0, sizeof(LightClusterStats));
+    stats->lights = lc->light_count;
+    lc->index_count = 0;
+    for (int k = 0; k < LIGHT_CLUSTERS_Z; ++k) {
+        LightSlice* s = &lc->slices[k];
+        memcpy(&lc->indices[lc->index_count], s->indices, s->count * sizeof(unsigned int));
+        for (int t = 0; t < LIGHT_CLUSTERS_PER_SLICE; ++t) {
+            int c = k * LIGHT_CLUSTERS_PER_SLICE + t;
+            lc->grid[c * 2 + 0] += lc->index_count;
+            stats->max_per_cluster = M_MAX(stats->max_per_cluster, (int) lc->grid[c * 2 + 1]);
+            stats->used_clusters += lc->grid[c * 2 + 1] > 0;
+        }
+        lc->index_count += s->count;
+    }
+    stats->indices = lc->index_count;
+}
+
+void upload_light_clusters(LightClusters* lc) {
+    gp_gl_bind_buffer(GL_TEXTURE_BUFFER, lc->buffers[0]);
+    glBufferData(GL_TEXTURE_BUFFER, sizeof(lc->grid), lc->grid, GL_STREAM_DRAW);
+    // empty buffer textures are not allowed everywhere, keep at least one element
+    gp_gl_bind_buffer(GL_TEXTURE_BUFFER, lc->buffers[1]);
+    glBufferData(GL_TEXTURE_BUFFER, M_MAX(lc->index_count, 1) * sizeof(unsigned int), lc->indices, GL_STREAM_DRAW);
+    gp_gl_bind_buffer(GL_TEXTURE_BUFFER, lc->buffers[2]);
+    glBufferData(GL_TEXTURE_BUFFER, M_MAX(lc->light_count, 1) * LIGHT_DATA_FLOATS * sizeof(float), lc->light_data, GL_STREAM_DRAW);
+}
+
+void bind_light_clusters(const LightClusters* lc) {
+    for (int i = 0; i < 3; ++i) {
+        gp_gl_bind_texture(LIGHT_TEXTURE_UNIT + i, GL_TEXTURE_BUFFER, lc->textures[i]);
+    }
+}
+
+uint64_t light_clusters_hash(const LightClusters* lc) {
+    uint64_t hash = 1469598103934665603ull;
+    for (int i = 0; i < LIGHT_CLUSTER_COUNT * 2; ++i) {
+        hash = (hash ^ lc->grid[i]) * 1099511628211ull;
+    }
+    for (int i = 0; i < lc->index_count; ++i) {
+        hash = (hash ^ lc->indices[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+////////////////////////////////////////////////////
+// demo lights
+
+// Lights scattered in the box center +- half_extent, each one drifting on its own small orbit.
+// Every light only depends on its index, so the layout is the same for any count.
+void animate_point_lights(LightClusters* lc, const float3* center, const float3* half_extent, float radius, float time) {
+    for (int i = 0; i < lc->light_count; ++i) {
+        PointLight* l = &lc->lights[i];
+        unsigned int h = (unsigned int) i * 2654435761u;
+        float u = ((h >> 0) & 1023) / 1023.0f;
+        float v = ((h >> 10) & 1023) / 1023.0f;
+        float w = ((h >> 20) & 1023) / 1023.0f;
+        float phase = time * (0.5f + u) + 6.2831853f * v;
+
+        l->position.x = center->x + half_extent->x * (2.0f * u - 1.0f) + 0.3f * cosf(phase);
+        l->position.y = center->y + half_extent->y * (2.0f * w - 1.0f) + 0.3f * sinf(phase);
+        l->position.z = center->z + half_extent->z * (2.0f * v - 1.0f);
+        l->radius = radius * (0.75f + 0.5f * w);
+        set_float3(&l->color, 0.4f + 0.6f * u, 0.4f + 0.6f * w, 0.4f + 0.6f * v);
+        l->intensity = 1.0f;
+    }
+}
+
+////////////////////////////////////////////////////
+// benchmark
+
+void gp_lights_benchmark(int max_workers) {
+    const char* path_names[] = {"scalar", "sse"};
+    int light_counts[] = {100, 1000, 10000};
+    int repeats = 50;
+    if (max_workers <= 0) {
+        max_workers = (int) std::thread::hardware_concurrency();
+    }
+    max_workers = M_CLAMP(max_workers, 1, JOBS_MAX_WORKERS);
+
+    float projection[] = M_MAT4_IDENTITY();
+    float view[] = M_MAT4_IDENTITY();
+    float3 eye = {0.0, 2.0, 12.0};
+    float3 dir = {0.0, -0.15, -1.0};
+    float3 up = {0.0, 1.0, 0.0};
+    float near_plane = 0.1;
+    float far_plane = 100.0;
+    m_mat4_perspective(projection, 0.6, 16.0 / 9.0, near_plane, far_plane);
+    m_mat4_lookat(view, &eye, &dir, &up);
+
+    float3 center = {0.0, 0.0, 0.0};
+    float3 half_extent = {10.0, 4.0, 10.0};
+
+    LightClusters lc;
+    init_light_clusters(&lc);
+
+    printf("lights benchmark: %dx%dx%d clusters\n", LIGHT_CLUSTERS_X, LIGHT_CLUSTERS_Y, LIGHT_CLUSTERS_Z);
+    for (int n = 0; n < (int)(sizeof(light_counts) / sizeof(light_counts[0])); ++n) {
+        resize_point_lights(&lc, light_counts[n]);
+        animate_point_lights(&lc, &center, &half_extent, 1.5f, 0.0f);
+
+        uint64_t reference = 0;
+        for (int path = LIGHT_PATH_SCALAR; path <= light_best_path(); ++path) {
+            for (int workers = 1; workers <= max_workers; ++workers) {
+                JobSystem* js = create_job_system(workers);
+                lc.jobs = js;
+                lc.path = path;
+
+                g_timer timer;
+                start_timer(&timer);
+                for (int r = 0; r < repeats; ++r) {
+                    bin_point_lights(&lc, view, projection, near_plane, far_plane);
+                }
+                stop_timer(&timer);
+                float ms = compute_timer_millis_diff(&timer) / repeats;
+
+                uint64_t hash = light_clusters_hash(&lc);
+                if (path == LIGHT_PATH_SCALAR && workers == 1) {
+                    reference = hash;
+                }
+                printf("  %5d lights  %-6s %2d workers  %7.3f ms  clusters used %4d  indices %6d  max per cluster %3d%s\n",
+                       lc.light_count, path_names[path], workers, ms, lc.stats.used_clusters, lc.stats.indices,
+                       lc.stats.max_per_cluster, hash == reference ? "" : "  MISMATCH");
+
+                lc.jobs = NULL;
+                destroy_job_system(js);
+            }
+        }
+    }
+
+    free_light_clusters(&lc);
+}
+
+#endif
@@ -0,0 +1,818 @@
+#ifndef GP_MATH_BENCH_H
+#define GP_MATH_BENCH_H
+
+//
+// Microbenchmark of the SIMD matrix functions of m_math.h
+// Every function runs over the same random matrices and vectors once through a direct call of its
+// _scalar version (what the function was before the dispatch) and once per SIMD level the cpu has,
+// through the public name. err is the largest difference to the direct scalar result, relative to
+// the value when it is above 1. The level in use before the benchmark is put back at the end.
+//
+// The batched functions run on SoA streams against a loop of the single element scalar code on the same
+// data kept as AoS (for aabb: its 8 corners through m_mat4_transform3_scalar). The streams are 32 bytes
+// aligned, the error also covers a run with every stream 1 float off (scalar head, then aligned) and
+// one with the destination 2 floats off (unaligned loads).
+//
+// The ray kernels run one ray through a batch of triangles or boxes, or a packet of rays against one,
+// next to a loop of m_3d_ray_triangle_intersection / m_3d_ray_box_intersection. The scalar level is the
+// reference, AVX2 fuses multiply and add so a ray grazing an edge can land on the other side (differ).
+// Degenerate triangles, NaN and inf are checked at every level with known results.
+//
+// The generators: m_randf and m_rng_float in a loop, then m_rng8_fill_uniform at every level, which has
+// to give the same floats as the scalar level (also for a count that isn't a multiple of 8). The sphere
+// samples are timed against the rejection loop rand_in_unit_sphere had, their moments are checked.
+//
+
+#define MATH_BENCH_COUNT 4096
+#define MATH_BENCH_CALLS (1 << 22)
+#define MATH_BENCH_TOLERANCE 1e-4f
+#define MATH_BATCH_COUNT 4096
+#define MATH_BATCH_PAD 4 // room for the misaligned runs
+
+typedef struct MathBench {
+    float* a;     // 16 floats per entry
+    float* b;
+    float4* v;
+    float3* pos;
+    float3* dir;
+    float* out;   // 16 floats per entry
+    float* reference;
+    int count;
+    int repeats;
+} MathBench;
+
+typedef enum MathBenchFunction {
+    MATH_BENCH_MUL,
+    MATH_BENCH_INVERSE,
+    MATH_BENCH_TRANSFORM3,
+    MATH_BENCH_TRANSFORM4,
+    MATH_BENCH_LOOKAT,
+    MATH_BENCH_FUNCTIONS
+} MathBenchFunction;
+
+const char* math_bench_names[MATH_BENCH_FUNCTIONS] = {"mul", "inverse", "transform3", "transform4", "lookat"};
+
+// rotation, scale and translation, well conditioned for the inverse
+void random_transform(float* m) {
+    float3 euler = {rand_float_range(-3.0, 3.0), rand_float_range(-3.0, 3.0), rand_float_range(-3.0, 3.0)};
+    float scale = rand_float_range(0.1, 10.0);
+    m_mat4_identity(m);
+    m_mat4_rotation_euler(m, &euler);
+    for (int i = 0; i < 12; ++i) {
+        m[i] *= scale;
+    }
+    m[12] = rand_float_range(-100.0, 100.0);
+    m[13] = rand_float_range(-100.0, 100.0);
+    m[14] = rand_float_range(-100.0, 100.0);
+}
+
+float math_error(const float* values, const float* reference, int count) {
+    float error = 0.0;
+    for (int i = 0; i < count; ++i) {
+        float d = fabsf(values[i] - reference[i]) / M_MAX(1.0f, fabsf(reference[i]));
+        // NaN counts as a mismatch
+        if (!(d <= error)) {
+            error = d;
+        }
+    }
+    return error;
+}
+
+void run_math_bench(MathBench* mb, int function, int direct) {
+    for (int r = 0; r < mb->repeats; ++r) {
+        for (int i = 0; i < mb->count; ++i) {
+            float* a = mb->a + i * 16;
+            float* b = mb->b + i * 16;
+            float* out = mb->out + i * 16;
+            switch (function) {
+            case MATH_BENCH_MUL:
+                if (direct) m_mat4_mul_scalar(out, a, b);
+                else m_mat4_mul(out, a, b);
+                break;
+            case MATH_BENCH_INVERSE:
+                if (direct) m_mat4_inverse_scalar(out, a);
+                else m_mat4_inverse(out, a);
+                break;
+            case MATH_BENCH_TRANSFORM3:
+                if (direct) m_mat4_transform3_scalar((float3*) out, a, (const float3*) &mb->v[i]);
+                else m_mat4_transform3((float3*) out, a, (const float3*) &mb->v[i]);
+                break;
+            case MATH_BENCH_TRANSFORM4:
+                if (direct) m_mat4_transform4_scalar((float4*) out, a, &mb->v[i]);
+                else m_mat4_transform4((float4*) out, a, &mb->v[i]);
+                break;
+            case MATH_BENCH_LOOKAT: {
+                float3 up = {0.0, 1.0, 0.0};
+                if (direct) m_mat4_lookat_scalar(out, &mb->pos[i], &mb->dir[i], &up);
+                else m_mat4_lookat(out, &mb->pos[i], &mb->dir[i], &up);
+                break;
+            }
+            }
+        }
+    }
+}
+
+// ns per call
+float time_math_bench(MathBench* mb, int function, int direct) {
+    g_timer timer;
+    start_timer(&timer);
+    run_math_bench(mb, function, direct);
+    stop_timer(&timer);
+    return compute_timer_millis_diff(&timer) * 1000000.0 / ((double) mb->count * mb->repeats);
+}
+
+typedef enum MathBatchFunction {
+    MATH_BATCH_TRANSFORM3,
+    MATH_BATCH_ROTATE3,
+    MATH_BATCH_NORMALIZE3,
+    MATH_BATCH_AABB,
+    MATH_BATCH_MUL,
+    MATH_BATCH_FUNCTIONS
+} MathBatchFunction;
+
+const char* math_batch_names[MATH_BATCH_FUNCTIONS] = {"transform3", "rotate3", "normalize3", "aabb", "mul"};
+
+typedef struct MathBatch {
+    float* in[6];        // x, y, z of the points or box minimums, then of the box maximums
+    float* out[6];
+    float* reference[6];
+    float3* points;      // in as AoS for the loop
+    float3* out_points;
+    float* a;            // 16 floats per entry
+    float* b;
+    float* matrices;
+    float* matrices_reference;
+    float matrix[16];
+    int count;
+    int repeats;
+} MathBatch;
+
+int math_batch_streams(int function) {
+    return function == MATH_BATCH_AABB ? 6 : 3;
+}
+
+float3_soa math_batch_soa(float** streams, int offset) {
+    float3_soa soa = {streams[0] + offset, streams[1] + offset, streams[2] + offset};
+    return soa;
+}
+
+// The single element scalar code on AoS, the reference
+void run_math_batch_loop(MathBatch* mb, int function) {
+    int count = mb->count;
+    for (int r = 0; r < mb->repeats; ++r) {
+        switch (function) {
+        case MATH_BATCH_TRANSFORM3:
+            for (int i = 0; i < count; ++i) {
+                m_mat4_transform3_scalar(&mb->out_points[i], mb->matrix, &mb->points[i]);
+            }
+            break;
+        case MATH_BATCH_ROTATE3:
+            for (int i = 0; i < count; ++i) {
+                m_mat4_rotate3(&mb->out_points[i], mb->matrix, &mb->points[i]);
+            }
+            break;
+        case MATH_BATCH_NORMALIZE3:
+            for (int i = 0; i < count; ++i) {
+                M_NORMALIZE3(mb->out_points[i], mb->points[i]);
+            }
+            break;
+        case MATH_BATCH_AABB:
+            for (int i = 0; i < count; ++i) {
+                const float3* mn = &mb->points[i];
+                const float3* mx = &mb->points[count + i];
+                float3 lo = {1e30f, 1e30f, 1e30f};
+                float3 hi = {-1e30f, -1e30f, -1e30f};
+                for (int c = 0; c < 8; ++c) {
+                    float3 corner = {(c & 1) ? mx->x : mn->x, (c & 2) ? mx->y : mn->y, (c & 4) ? mx->z : mn->z};
+                    float3 p;
+                    m_mat4_transform3_scalar(&p, mb->matrix, &corner);
+                    M_MIN3(lo, lo, p);
+                    M_MAX3(hi, hi, p);
+                }
+                mb->out_points[i] = lo;
+                mb->out_points[count + i] = hi;
+            }
+            break;
+        case MATH_BATCH_MUL:
+            for (int i = 0; i < count; ++i) {
+                m_mat4_mul_scalar(mb->matrices + i * 16, mb->a + i * 16, mb->b + i * 16);
+            }
+            break;
+        }
+    }
+}
+
+void run_math_batch(MathBatch* mb, int function, int dest_offset, int src_offset, int count, int repeats) {
+    float3_soa dest = math_batch_soa(mb->out, dest_offset);
+    float3_soa src = math_batch_soa(mb->in, src_offset);
+    float3_soa dest_max = math_batch_soa(mb->out + 3, dest_offset);
+    float3_soa src_max = math_batch_soa(mb->in + 3, src_offset);
+    for (int r = 0; r < repeats; ++r) {
+        switch (function) {
+        case MATH_BATCH_TRANSFORM3: m_mat4_transform3_soa(&dest, mb->matrix, &src, count); break;
+        case MATH_BATCH_ROTATE3: m_mat4_rotate3_soa(&dest, mb->matrix, &src, count); break;
+        case MATH_BATCH_NORMALIZE3: m_normalize3_soa(&dest, &src, count); break;
+        case MATH_BATCH_AABB: m_mat4_transform_aabb_soa(&dest, &dest_max, mb->matrix, &src, &src_max, count); break;
+        case MATH_BATCH_MUL: m_mat4_mul_array(mb->matrices, mb->a, mb->b, count); break;
+        }
+    }
+}
+
+// Runs the batch with the streams moved by the offsets and compares it to the reference
+float check_math_batch(MathBatch* mb, int function, int dest_offset, int src_offset) {
+    int count = mb->count - src_offset;
+    run_math_batch(mb, function, dest_offset, src_offset, count, 1);
+    if (function == MATH_BATCH_MUL) {
+        return math_error(mb->matrices, mb->matrices_reference, mb->count * 16);
+    }
+    float error = 0.0;
+    for (int s = 0; s < math_batch_streams(function); ++s) {
+        error = M_MAX(error, math_error(mb->out[s] + dest_offset, mb->reference[s] + src_offset, count));
+    }
+    return error;
+}
+
+void gp_math_batch_benchmark(int best) {
+    MathBatch mb;
+    mb.count = MATH_BATCH_COUNT;
+    mb.repeats = MATH_BENCH_CALLS / MATH_BATCH_COUNT / 4;
+    size_t stream_size = (mb.count + MATH_BATCH_PAD) * sizeof(float);
+    for (int s = 0; s < 6; ++s) {
+        mb.in[s] = (float*) gp_aligned_malloc(stream_size, 32);
+        mb.out[s] = (float*) gp_aligned_malloc(stream_size, 32);
+        mb.reference[s] = (float*) gp_aligned_malloc(stream_size, 32);
+    }
+    mb.points = (float3*) malloc(2 * mb.count * sizeof(float3));
+    mb.out_points = (float3*) malloc(2 * mb.count * sizeof(float3));
+    mb.a = (float*) malloc(mb.count * 16 * sizeof(float));
+    mb.b = (float*) malloc(mb.count * 16 * sizeof(float));
+    mb.matrices = (float*) malloc(mb.count * 16 * sizeof(float));
+    mb.matrices_reference = (float*) malloc(mb.count * 16 * sizeof(float));
+
+    m_srand(362436069, 521288629);
+    random_transform(mb.matrix);
+    for (int i = 0; i < mb.count + MATH_BATCH_PAD; ++i) {
+        for (int s = 0; s < 3; ++s) {
+            float v = rand_float_range(-10.0, 10.0);
+            mb.in[s][i] = v;
+            mb.in[s + 3][i] = v + rand_float_range(0.0, 5.0);
+        }
+    }
+    for (int i = 0; i < mb.count; ++i) {
+        set_float3(&mb.points[i], mb.in[0][i], mb.in[1][i], mb.in[2][i]);
+        set_float3(&mb.points[mb.count + i], mb.in[3][i], mb.in[4][i], mb.in[5][i]);
+        random_transform(mb.a + i * 16);
+        random_transform(mb.b + i * 16);
+    }
+
+    printf("math benchmark: batches of %d, %d batches per function\n", mb.count, mb.repeats);
+    for (int function = 0; function < MATH_BATCH_FUNCTIONS; ++function) {
+        run_math_batch_loop(&mb, function);
+        g_timer timer;
+        start_timer(&timer);
+        run_math_batch_loop(&mb, function);
+        stop_timer(&timer);
+        float loop_ns = compute_timer_millis_diff(&timer) * 1000000.0 / ((double) mb.count * mb.repeats);
+        printf("  %-10s %-8s %7.2f ns/element\n", math_batch_names[function], "loop", loop_ns);
+
+        for (int i = 0; i < 2 * mb.count; ++i) {
+            mb.reference[(i / mb.count) * 3 + 0][i % mb.count] = mb.out_points[i].x;
+            mb.reference[(i / mb.count) * 3 + 1][i % mb.count] = mb.out_points[i].y;
+            mb.reference[(i / mb.count) * 3 + 2][i % mb.count] = mb.out_points[i].z;
+        }
+        memcpy(mb.matrices_reference, mb.matrices, mb.count * 16 * sizeof(float));
+
+        for (int level = M_SIMD_SCALAR; level <= best; ++level) {
+            m_simd_set_level(level);
+            float error = M_MAX(check_math_batch(&mb, function, 1, 1), check_math_batch(&mb, function, 2, 1));
+            error = M_MAX(error, check_math_batch(&mb, function, 0, 0));
+
+            start_timer(&timer);
+            run_math_batch(&mb, function, 0, 0, mb.count, mb.repeats);
+            stop_timer(&timer);
+            float ns = compute_timer_millis_diff(&timer) * 1000000.0 / ((double) mb.count * mb.repeats);
+            printf("  %-10s %-8s %7.2f ns/element  %5.2fx  err %.1e%s\n", math_batch_names[function], m_simd_level_name(level), ns,
+                   loop_ns / ns, error, error <= MATH_BENCH_TOLERANCE ? "" : "  MISMATCH");
+        }
+    }
+
+    for (int s = 0; s < 6; ++s) {
+        gp_aligned_free(mb.in[s]);
+        gp_aligned_free(mb.out[s]);
+        gp_aligned_free(mb.reference[s]);
+    }
+    free(mb.points);
+    free(mb.out_points);
+    free(mb.a);
+    free(mb.b);
+    free(mb.matrices);
+    free(mb.matrices_reference);
+}
+
+////////////////////////////////////////////////////
+// ray kernels
+
+#define MATH_RAY_COUNT 4096  // primitives of a batch, rays of a packet
+#define MATH_RAY_REPEATS 256 // rays through the batch, primitives against the packet
+
+typedef enum MathRayFunction {
+    MATH_RAY_TRIANGLES,
+    MATH_RAY_BOXES,
+    MATH_RAY_PACKET_TRIANGLE,
+    MATH_RAY_PACKET_BOX,
+    MATH_RAY_FUNCTIONS
+} MathRayFunction;
+
+const char* math_ray_names[MATH_RAY_FUNCTIONS] = {"triangles", "boxes", "packet tri", "packet box"};
+
+typedef struct MathRays {
+    float* triangles[9]; // x, y, z of vert1, vert2, vert3
+    float* boxes[6];     // x, y, z of min, then max
+    float* rays[6];      // x, y, z of origin, then direction
+    float3* triangles_aos;
+    float3* boxes_aos;
+    float3* rays_aos;
+    float* t;
+    float* u;
+    float* v;
+    float* reference;
+    int count;
+} MathRays;
+
+float3_soa math_ray_soa(float** streams) {
+    float3_soa soa = {streams[0], streams[1], streams[2]};
+    return soa;
+}
+
+// The single ray code on AoS, the m_3d functions before the batched ones
+void run_math_ray_loop(MathRays* mr, int function) {
+    int count = mr->count;
+    for (int r = 0; r < MATH_RAY_REPEATS; ++r) {
+        for (int i = 0; i < count; ++i) {
+            int ray = function == MATH_RAY_TRIANGLES || function == MATH_RAY_BOXES ? r : i;
+            int prim = ray == r ? i : r;
+            float3* o = &mr->rays_aos[ray * 2];
+            float3* d = &mr->rays_aos[ray * 2 + 1];
+            float u, v;
+            if (function == MATH_RAY_TRIANGLES || function == MATH_RAY_PACKET_TRIANGLE) {
+                float3* tri = &mr->triangles_aos[prim * 3];
+                mr->t[i] = m_3d_ray_triangle_intersection(o, d, &tri[0], &tri[1], &tri[2], &u, &v);
+            } else {
+                mr->t[i] = m_3d_ray_box_intersection(o, d, &mr->boxes_aos[prim * 2], &mr->boxes_aos[prim * 2 + 1]);
+            }
+        }
+    }
+}
+
+// Hits of the last repeat
+int run_math_rays(MathRays* mr, int function) {
+    float3_soa v1 = math_ray_soa(mr->triangles), v2 = math_ray_soa(mr->triangles + 3), v3 = math_ray_soa(mr->triangles + 6);
+    float3_soa lo = math_ray_soa(mr->boxes), hi = math_ray_soa(mr->boxes + 3);
+    float3_soa origins = math_ray_soa(mr->rays), directions = math_ray_soa(mr->rays + 3);
+    int hits = 0;
+    for (int r = 0; r < MATH_RAY_REPEATS; ++r) {
+        float3* ray = &mr->rays_aos[r * 2];
+        switch (function) {
+        case MATH_RAY_TRIANGLES:
+            hits = m_3d_ray_triangle_intersection_soa(mr->t, mr->u, mr->v, &ray[0], &ray[1], &v1, &v2, &v3, mr->count);
+            break;
+        case MATH_RAY_BOXES:
+            hits = m_3d_ray_box_intersection_soa(mr->t, &ray[0], &ray[1], &lo, &hi, mr->count);
+            break;
+        case MATH_RAY_PACKET_TRIANGLE: {
+            float3* tri = &mr->triangles_aos[r * 3];
+            hits = m_3d_ray_packet_triangle_intersection(mr->t, mr->u, mr->v, &origins, &directions, &tri[0], &tri[1], &tri[2], mr->count);
+            break;
+        }
+        case MATH_RAY_PACKET_BOX:
+            hits = m_3d_ray_packet_box_intersection(mr->t, &origins, &directions, &mr->boxes_aos[r * 2], &mr->boxes_aos[r * 2 + 1], mr->count);
+            break;
+        }
+    }
+    return hits;
+}
+
+typedef struct MathRayCase {
+    const char* name;
+    float3 origin, direction;
+    float3 p[3]; // triangle, or box min and max
+    int box;
+    float t;     // M_RAY_MISS for a miss
+} MathRayCase;
+
+// Degenerate, NaN and inf inputs through both forms with enough copies for the SIMD loop and the
+// scalar head and tail, returns how many of them give a wrong result
+int check_math_ray_cases() {
+    const float nan = NAN, inf = INFINITY;
+    const MathRayCase cases[] = {
+        {"triangle", {0, 0, -1}, {0, 0, 1}, {{-1, -1, 0}, {1, -1, 0}, {0, 1, 0}}, 0, 1.0f},
+        {"degenerate", {0, 0, -1}, {0, 0, 1}, {{-1, 0, 0}, {0, 0, 0}, {1, 0, 0}}, 0, M_RAY_MISS},
+        {"nan vertex", {0, 0, -1}, {0, 0, 1}, {{-1, -1, 0}, {1, nan, 0}, {0, 1, 0}}, 0, M_RAY_MISS},
+        {"inf vertex", {0, 0, -1}, {0, 0, 1}, {{-1, -1, 0}, {inf, -1, 0}, {0, 1, 0}}, 0, M_RAY_MISS},
+        {"nan ray", {0, 0, -1}, {nan, 0, 1}, {{-1, -1, 0}, {1, -1, 0}, {0, 1, 0}}, 0, M_RAY_MISS},
+        {"behind", {0, 0, 1}, {0, 0, 1}, {{-1, -1, 0}, {1, -1, 0}, {0, 1, 0}}, 0, M_RAY_MISS},
+        {"in plane", {-2, 0, 0}, {1, 0, 0}, {{-1, -1, 0}, {1, -1, 0}, {0, 1, 0}}, 0, M_RAY_MISS},
+        {"box", {0.5, 0.5, -3}, {0, 0, 1}, {{-1, -1, -1}, {1, 1, 1}}, 1, 2.0f},
+        {"min face", {-1, 0, -3}, {0, 0, 1}, {{-1, -1, -1}, {1, 1, 1}}, 1, 2.0f},
+        {"max face", {1, 0, -3}, {0, 0, 1}, {{-1, -1, -1}, {1, 1, 1}}, 1, 2.0f},
+        {"max face -0", {1, 0, -3}, {-0.0f, 0, 1}, {{-1, -1, -1}, {1, 1, 1}}, 1, 2.0f},
+        {"beside", {2, 0, -3}, {0, 0, 1}, {{-1, -1, -1}, {1, 1, 1}}, 1, M_RAY_MISS},
+        {"inside", {0, 0, 0}, {1, 0, 0}, {{-1, -1, -1}, {1, 1, 1}}, 1, 0.0f},
+        {"box behind", {0, 0, 3}, {0, 0, 1}, {{-1, -1, -1}, {1, 1, 1}}, 1, M_RAY_MISS},
+        {"nan box", {0, 0, -3}, {0, 0, 1}, {{nan, -1, -1}, {1, 1, 1}}, 1, M_RAY_MISS},
+        {"nan origin", {0, nan, -3}, {0, 0, 1}, {{-1, -1, -1}, {1, 1, 1}}, 1, M_RAY_MISS},
+        {"infinite box", {0, 0, 0}, {0, 0, 1}, {{-inf, -inf, -inf}, {inf, inf, inf}}, 1, 0.0f},
+    };
+    const int copies = 11;
+    float streams[15][16];
+    float t[16], u[16], v[16];
+    int failed = 0;
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); ++c) {
+        const MathRayCase* rc = &cases[c];
+        for (int form = 0; form < 2; ++form) {
+            const float3* values[5] = {&rc->origin, &rc->direction, &rc->p[0], &rc->p[1], &rc->p[2]};
+            for (int s = 0; s < 15; ++s) {
+                for (int i = 0; i < copies; ++i) {
+                    streams[s][i] = ((const float*) values[s / 3])[s % 3];
+                }
+            }
+            float3_soa o = {streams[0], streams[1], streams[2]}, d = {streams[3], streams[4], streams[5]};
+            float3_soa a = {streams[6], streams[7], streams[8]}, b = {streams[9], streams[10], streams[11]};
+            float3_soa e = {streams[12], streams[13], streams[14]};
+            int hits;
+            if (rc->box) {
+                hits = form == 0 ? m_3d_ray_box_intersection_soa(t, &rc->origin, &rc->direction, &a, &b, copies)
+                                 : m_3d_ray_packet_box_intersection(t, &o, &d, &rc->p[0], &rc->p[1], copies);
+            } else {
+                hits = form == 0 ? m_3d_ray_triangle_intersection_soa(t, u, v, &rc->origin, &rc->direction, &a, &b, &e, copies)
+                                 : m_3d_ray_packet_triangle_intersection(t, u, v, &o, &d, &rc->p[0], &rc->p[1], &rc->p[2], copies);
+            }
+            int ok = hits == (rc->t != M_RAY_MISS ? copies : 0);
+            for (int i = 0; i < copies; ++i) {
+                ok = ok && fabsf(t[i] - rc->t) <= 1e-6f * M_MAX(1.0f, rc->t);
+            }
+            if (!ok) {
+                printf("  %s: %s %s gives %g\n", m_simd_level_name(m_simd_level()), form == 0 ? "batch" : "packet", rc->name, t[0]);
+                failed++;
+            }
+        }
+    }
+    return failed;
+}
+
+void gp_math_ray_benchmark(int best) {
+    MathRays mr;
+    mr.count = MATH_RAY_COUNT;
+    size_t stream_size = mr.count * sizeof(float);
+    for (int s = 0; s < 9; ++s) {
+        mr.triangles[s] = (float*) gp_aligned_malloc(stream_size, 32);
+    }
+    for (int s = 0; s < 6; ++s) {
+        mr.boxes[s] = (float*) gp_aligned_malloc(stream_size, 32);
+        mr.rays[s] = (float*) gp_aligned_malloc(stream_size, 32);
+    }
+    mr.triangles_aos = (float3*) malloc(mr.count * 3 * sizeof(float3));
+    mr.boxes_aos = (float3*) malloc(mr.count * 2 * sizeof(float3));
+    mr.rays_aos = (float3*) malloc(mr.count * 2 * sizeof(float3));
+    mr.t = (float*) gp_aligned_malloc(stream_size, 32);
+    mr.u = (float*) gp_aligned_malloc(stream_size, 32);
+    mr.v = (float*) gp_aligned_malloc(stream_size, 32);
+    mr.reference = (float*) malloc(stream_size);
+
+    // small triangles and boxes in [-1, 1], rays from a sphere of radius 3 through that cube
+    m_srand(362436069, 521288629);
+    for (int i = 0; i < mr.count; ++i) {
+        float3 center = {rand_float_range(-1.0, 1.0), rand_float_range(-1.0, 1.0), rand_float_range(-1.0, 1.0)};
+        for (int k = 0; k < 3; ++k) {
+            float3* p = &mr.triangles_aos[i * 3 + k];
+            set_float3(p, center.x + rand_float_range(-0.2, 0.2), center.y + rand_float_range(-0.2, 0.2),
+                       center.z + rand_float_range(-0.2, 0.2));
+        }
+        float3* box = &mr.boxes_aos[i * 2];
+        box[0] = center;
+        set_float3(&box[1], center.x + rand_float_range(0.0, 0.2), center.y + rand_float_range(0.0, 0.2),
+                   center.z + rand_float_range(0.0, 0.2));
+        float3* ray = &mr.rays_aos[i * 2];
+        float3 target = {rand_float_range(-1.0, 1.0), rand_float_range(-1.0, 1.0), rand_float_range(-1.0, 1.0)};
+        set_float3(&ray[0], rand_float_range(-1.0, 1.0), rand_float_range(-1.0, 1.0), rand_float_range(-1.0, 1.0));
+        M_NORMALIZE3(ray[0], ray[0]);
+        mul_scalar(&ray[0], 3.0);
+        M_SUB3(ray[1], target, ray[0]);
+        M_NORMALIZE3(ray[1], ray[1]);
+        for (int s = 0; s < 9; ++s) {
+            mr.triangles[s][i] = ((float*) &mr.triangles_aos[i * 3 + s / 3])[s % 3];
+        }
+        for (int s = 0; s < 6; ++s) {
+            mr.boxes[s][i] = ((float*) &box[s / 3])[s % 3];
+            mr.rays[s][i] = ((float*) &ray[s / 3])[s % 3];
+        }
+    }
+
+    printf("math benchmark: rays, %d x %d tests per function\n", mr.count, MATH_RAY_REPEATS);
+    double tests = (double) mr.count * MATH_RAY_REPEATS;
+    for (int function = 0; function < MATH_RAY_FUNCTIONS; ++function) {
+        g_timer timer;
+        run_math_ray_loop(&mr, function);
+        start_timer(&timer);
+        run_math_ray_loop(&mr, function);
+        stop_timer(&timer);
+        float loop_ns = compute_timer_millis_diff(&timer) * 1000000.0 / tests;
+        printf("  %-10s %-8s %7.2f ns/test\n", math_ray_names[function], "loop", loop_ns);
+
+        for (int level = M_SIMD_SCALAR; level <= best; ++level) {
+            m_simd_set_level(level);
+            run_math_rays(&mr, function);
+            start_timer(&timer);
+            int hits = run_math_rays(&mr, function);
+            stop_timer(&timer);
+            float ns = compute_timer_millis_diff(&timer) * 1000000.0 / tests;
+
+            // scalar is the reference, differ counts rays that hit at one level and miss at the other
+            if (level == M_SIMD_SCALAR) {
+                memcpy(mr.reference, mr.t, stream_size);
+            }
+            int differ = 0;
+            float error = 0.0f;
+            for (int i = 0; i < mr.count; ++i) {
+                if ((mr.t[i] == M_RAY_MISS) != (mr.reference[i] == M_RAY_MISS)) {
+                    differ++;
+                } else if (mr.t[i] != M_RAY_MISS) {
+                    error = M_MAX(error, fabsf(mr.t[i] - mr.reference[i]) / M_MAX(1.0f, mr.reference[i]));
+                }
+            }
+            printf("  %-10s %-8s %7.2f ns/test  %5.2fx  %4d hits  err %.1e  %d differ%s\n", math_ray_names[function],
+                   m_simd_level_name(level), ns, loop_ns / ns, hits, error, differ,
+                   error <= MATH_BENCH_TOLERANCE && differ <= 2 ? "" : "  MISMATCH");
+        }
+    }
+
+    int failed = 0;
+    for (int level = M_SIMD_SCALAR; level <= best; ++level) {
+        m_simd_set_level(level);
+        failed += check_math_ray_cases();
+    }
+    printf("  degenerate, nan and inf cases: %s\n", failed == 0 ? "ok" : "MISMATCH");
+
+    for (int s = 0; s < 9; ++s) {
+        gp_aligned_free(mr.triangles[s]);
+    }
+    for (int s = 0; s < 6; ++s) {
+        gp_aligned_free(mr.boxes[s]);
+        gp_aligned_free(mr.rays[s]);
+    }
+    free(mr.triangles_aos);
+    free(mr.boxes_aos);
+    free(mr.rays_aos);
+    gp_aligned_free(mr.t);
+    gp_aligned_free(mr.u);
+    gp_aligned_free(mr.v);
+    free(mr.reference);
+}
+
+#define MATH_RNG_COUNT (1 << 20)
+#define MATH_RNG_REPEATS 16
+#define MATH_RNG_SAMPLES (1 << 20)
+
+// What rand_in_unit_sphere was: 3 draws per try, 1.9 tries on average
+float3 rand_in_unit_sphere_rejection() {
+    float3 res;
+    float len = 0;
+    do {
+        res.x = 2.0 * m_randf() - 1;
+        res.y = 2.0 * m_randf() - 1;
+        res.z = 2.0 * m_randf() - 1;
+        len = res.x * res.x + res.y * res.y + res.z * res.z;
+    } while (len >= 1.0);
+    return res;
+}
+
+enum MathSphereSampler {
+    MATH_SPHERE_REJECTION = 0,
+    MATH_SPHERE_DIRECT,     // rand_in_unit_sphere
+    MATH_SPHERE_RNG,        // m_rng_in_unit_sphere
+    MATH_SPHERE_HEMISPHERE, // m_rng_on_hemisphere
+    MATH_SPHERE_COSINE,     // m_rng_cosine_hemisphere
+    MATH_SPHERE_SAMPLERS
+};
+
+const char* math_sphere_names[MATH_SPHERE_SAMPLERS] = {"rejection", "direct", "rng", "hemisphere", "cosine"};
+
+// Expected mean of |p|^3 in the ball (r^3 is uniform) and of the cosine to the normal on the hemispheres
+const float math_sphere_expected[MATH_SPHERE_SAMPLERS] = {0.5f, 0.5f, 0.5f, 0.5f, 2.0f / 3.0f};
+
+// Time per sample in ns, the mean of the sample moment and the largest |mean| of the coordinates
+// (ball) or of the tangent ones (hemispheres, around y)
+float run_math_sphere(int sampler, m_rng* rng, double* moment, double* center, int* outside) {
+    const float3 normal = {0.0f, 1.0f, 0.0f};
+    double sum[3] = {0.0, 0.0, 0.0};
+    double m = 0.0;
+    *outside = 0;
+    g_timer timer;
+    start_timer(&timer);
+    for (int i = 0; i < MATH_RNG_SAMPLES; ++i) {
+        float3 p;
+        switch (sampler) {
+        case MATH_SPHERE_REJECTION: p = rand_in_unit_sphere_rejection(); break;
+        case MATH_SPHERE_DIRECT: p = rand_in_unit_sphere(); break;
+        case MATH_SPHERE_RNG: m_rng_in_unit_sphere(&p, rng); break;
+        case MATH_SPHERE_HEMISPHERE: m_rng_on_hemisphere(&p, rng, &normal); break;
+        default: m_rng_cosine_hemisphere(&p, rng, &normal); break;
+        }
+        float l = M_LENGHT3(p);
+        if (sampler >= MATH_SPHERE_HEMISPHERE) {
+            *outside += p.y < 0.0f || fabsf(l - 1.0f) > 1e-5f;
+            m += p.y;
+        } else {
+            *outside += l > 1.0f + 1e-6f;
+            m += (double) l * l * l;
+        }
+        sum[0] += p.x;
+        sum[1] += p.y;
+        sum[2] += p.z;
+    }
+    stop_timer(&timer);
+    *moment = m / MATH_RNG_SAMPLES;
+    *center = 0.0;
+    for (int k = 0; k < 3; ++k) {
+        if (sampler < MATH_SPHERE_HEMISPHERE || k != 1) {
+            *center = M_MAX(*center, fabs(sum[k] / MATH_RNG_SAMPLES));
+        }
+    }
+    return compute_timer_millis_diff(&timer) * 1000000.0 / MATH_RNG_SAMPLES;
+}
+
+void gp_math_rng_benchmark(int best) {
+    int count = MATH_RNG_COUNT;
+    float* out = (float*) malloc(count * sizeof(float));
+    float* reference = (float*) malloc(count * sizeof(float));
+    double floats = (double) count * MATH_RNG_REPEATS;
+    printf("math benchmark: rng, %d floats per function\n", count * MATH_RNG_REPEATS);
+
+    // xoshiro128** from {1, 2, 3, 4} starts with 11520, 0, 5927040
+    m_rng rng = {{1, 2, 3, 4}};
+    unsigned int first[3];
+    for (int i = 0; i < 3; ++i) {
+        first[i] = m_rng_next(&rng);
+    }
+    int known = first[0] == 11520 && first[1] == 0 && first[2] == 5927040;
+
+    g_timer timer;
+    start_timer(&timer);
+    for (int r = 0; r < MATH_RNG_REPEATS; ++r) {
+        for (int i = 0; i < count; ++i) {
+            out[i] = m_randf();
+        }
+    }
+    stop_timer(&timer);
+    float loop_ns = compute_timer_millis_diff(&timer) * 1000000.0 / floats;
+    printf("  %-10s %-8s %7.3f ns/float\n", "m_randf", "loop", loop_ns);
+
+    m_rng_seed(&rng, 362436069);
+    start_timer(&timer);
+    for (int r = 0; r < MATH_RNG_REPEATS; ++r) {
+        for (int i = 0; i < count; ++i) {
+            out[i] = m_rng_float(&rng);
+        }
+    }
+    stop_timer(&timer);
+    float ns = compute_timer_millis_diff(&timer) * 1000000.0 / floats;
+    printf("  %-10s %-8s %7.3f ns/float  %5.2fx\n", "m_rng", "loop", ns, loop_ns / ns);
+
+    for (int level = M_SIMD_SCALAR; level <= best; ++level) {
+        m_simd_set_level(level);
+        m_rng8 lanes;
+        m_rng_seed(&rng, 362436069);
+        m_rng8_split(&lanes, &rng);
+        start_timer(&timer);
+        for (int r = 0; r < MATH_RNG_REPEATS; ++r) {
+            m_rng8_fill_uniform(out, &lanes, 0.0f, 1.0f, count);
+        }
+        stop_timer(&timer);
+        ns = compute_timer_millis_diff(&timer) * 1000000.0 / floats;
+
+        // the first fill again, then a count ending in a partial group
+        m_rng_seed(&rng, 362436069);
+        m_rng8_split(&lanes, &rng);
+        m_rng8_fill_uniform(out, &lanes, 0.0f, 1.0f, count);
+        if (level == M_SIMD_SCALAR) {
+            memcpy(reference, out, count * sizeof(float));
+        }
+        int differ = memcmp(out, reference, count * sizeof(float)) != 0;
+        m_rng_seed(&rng, 362436069);
+        m_rng8_split(&lanes, &rng);
+        m_rng8_fill_uniform(out, &lanes, 0.0f, 1.0f, count - 3);
+        differ += memcmp(out, reference, (count - 3) * sizeof(float)) != 0;
+
+        double mean = 0.0, variance = 0.0;
+        for (int i = 0; i < count; ++i) {
+            mean += out[i];
+            variance += (double) out[i] * out[i];
+        }
+        mean /= count;
+        variance = variance / count - mean * mean;
+        int uniform = fabs(mean - 0.5) < 2e-3 && fabs(variance - 1.0 / 12.0) < 1e-3;
+        printf("  %-10s %-8s %7.3f ns/float  %5.2fx  mean %.4f  var %.4f%s\n", "m_rng8", m_simd_level_name(level), ns,
+               loop_ns / ns, mean, variance, differ == 0 && uniform ? "" : "  MISMATCH");
+    }
+
+    // split streams start far apart, none of their first draws are the same
+    m_rng_seed(&rng, 362436069);
+    m_rng streams[8];
+    for (int i = 0; i < 8; ++i) {
+        m_rng_split(&streams[i], &rng);
+    }
+    int same = 0;
+    for (int i = 0; i < 1024; ++i) {
+        unsigned int v[8];
+        for (int k = 0; k < 8; ++k) {
+            v[k] = m_rng_next(&streams[k]);
+            for (int j = 0; j < k; ++j) {
+                same += v[j] == v[k];
+            }
+        }
+    }
+    printf("  xoshiro128** reference values %s, split streams %s\n", known ? "ok" : "MISMATCH",
+           same == 0 ? "ok" : "MISMATCH");
+
+    float rejection_ns = 0.0f;
+    for (int sampler = 0; sampler < MATH_SPHERE_SAMPLERS; ++sampler) {
+        double moment, center;
+        int outside;
+        m_srand(362436069, 521288629);
+        m_rng_seed(&rng, 362436069);
+        ns = run_math_sphere(sampler, &rng, &moment, &center, &outside);
+        if (sampler == MATH_SPHERE_REJECTION) {
+            rejection_ns = ns;
+        }
+        int ok = outside == 0 && fabs(moment - math_sphere_expected[sampler]) < 2e-3 && center < 2e-3;
+        printf("  %-10s %-8s %7.3f ns/sample  %5.2fx  moment %.4f  center %.4f%s\n", math_sphere_names[sampler],
+               "sphere", ns, rejection_ns / ns, moment, center, ok ? "" : "  MISMATCH");
+    }
+
+    free(out);
+    free(reference);
+}
+
+void gp_math_benchmark() {
+    MathBench mb;
+    mb.count = MATH_BENCH_COUNT;
+    mb.repeats = MATH_BENCH_CALLS / MATH_BENCH_COUNT;
+    mb.a = (float*) malloc(mb.count * 16 * sizeof(float));
+    mb.b = (float*) malloc(mb.count * 16 * sizeof(float));
+    mb.out = (float*) calloc(mb.count * 16, sizeof(float));
+    mb.reference = (float*) calloc(mb.count * 16, sizeof(float));
+    mb.v = (float4*) malloc(mb.count * sizeof(float4));
+    mb.pos = (float3*) malloc(mb.count * sizeof(float3));
+    mb.dir = (float3*) malloc(mb.count * sizeof(float3));
+
+    m_srand(362436069, 521288629);
+    for (int i = 0; i < mb.count; ++i) {
+        random_transform(mb.a + i * 16);
+        random_transform(mb.b + i * 16);
+        mb.v[i].x = rand_float_range(-10.0, 10.0);
+        mb.v[i].y = rand_float_range(-10.0, 10.0);
+        mb.v[i].z = rand_float_range(-10.0, 10.0);
+        mb.v[i].w = rand_float_range(0.5, 1.5);
+        mb.pos[i].x = rand_float_range(-100.0, 100.0);
+        mb.pos[i].y = rand_float_range(-100.0, 100.0);
+        mb.pos[i].z = rand_float_range(-100.0, 100.0);
+        mb.dir[i].x = rand_float_range(-1.0, 1.0);
+        mb.dir[i].y = rand_float_range(-1.0, 1.0);
+        mb.dir[i].z = rand_float_range(-1.0, 1.0);
+    }
+
+    int previous = m_simd_level();
+    int best = m_simd_set_level(M_SIMD_AVX2);
+    printf("math benchmark: %d calls per function, best level %s\n", mb.count * mb.repeats, m_simd_level_name(best));
+    for (int function = 0; function < MATH_BENCH_FUNCTIONS; ++function) {
+        // warm up, then the reference. transform3 only writes 3 floats of each entry
+        memset(mb.out, 0, mb.count * 16 * sizeof(float));
+        run_math_bench(&mb, function, 1);
+        float direct_ns = time_math_bench(&mb, function, 1);
+        memcpy(mb.reference, mb.out, mb.count * 16 * sizeof(float));
+        printf("  %-10s %-8s %7.2f ns\n", math_bench_names[function], "direct", direct_ns);
+
+        for (int level = M_SIMD_SCALAR; level <= best; ++level) {
+            m_simd_set_level(level);
+            memset(mb.out, 0, mb.count * 16 * sizeof(float));
+            float ns = time_math_bench(&mb, function, 0);
+            float error = math_error(mb.out, mb.reference, mb.count * 16);
+            printf("  %-10s %-8s %7.2f ns  %5.2fx  err %.1e%s\n", math_bench_names[function], m_simd_level_name(level), ns,
+                   direct_ns / ns, error, error <= MATH_BENCH_TOLERANCE ? "" : "  MISMATCH");
+        }
+    }
+    gp_math_batch_benchmark(best);
+    gp_math_ray_benchmark(best);
+    gp_math_rng_benchmark(best);
+    m_simd_set_level(previous);
+
+    free(mb.a);
+    free(mb.b);
+    free(mb.out);
+    free(mb.reference);
+    free(mb.v);
+    free(mb.pos);
+    free(mb.dir);
+}
+
+#endif
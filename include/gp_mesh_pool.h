@@ -0,0 +1,191 @@
+#ifndef GP_MESH_POOL_H
+#define GP_MESH_POOL_H
+
+//
+// Mesh pool and indirect draws
+// Meshes in the pool share one interleaved vertex buffer, one index buffer and one VAO, so draws of
+// different meshes only differ in their DrawElementsIndirectCommand and a whole run of them can be
+// submitted with a single glMultiDrawElementsIndirect.
+// Per draw data comes from the instance buffer: baseInstance points every command at its range of
+// instances, which does the job gl_DrawID would do without needing GL 4.6.
+//
+
+// position 3, normal 3, uv 2, tangent 4, the attribute locations are the ones of load_mesh
+#define MESH_POOL_VERTEX_FLOATS 12
+
+// Layout fixed by GL
+typedef struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instance_count;
+    GLuint first_index;
+    GLint base_vertex;
+    GLuint base_instance;
+} DrawElementsIndirectCommand;
+
+typedef struct PoolMesh {
+    int first_index;
+    int index_count;
+    int base_vertex;
+    int vertex_count;
+} PoolMesh;
+
+typedef struct MeshPool {
+    GLuint vao;
+    GLuint vbo;
+    GLuint ebo;
+
+    float* vertices;
+    int vertex_count;
+    GLuint* indices;
+    int index_count;
+
+    PoolMesh* meshes;
+    int mesh_count;
+} MeshPool;
+
+typedef struct IndirectBuffer {
+    GLuint buffer;
+    DrawElementsIndirectCommand* commands;
+    int count;
+    int capacity;
+} IndirectBuffer;
+
+void create_mesh_pool(MeshPool* pool) {
+    memset(pool, 0, sizeof(MeshPool));
+    glGenVertexArrays(1, &pool->vao);
+    glGenBuffers(1, &pool->vbo);
+    glGenBuffers(1, &pool->ebo);
+
+    GLsizei stride = MESH_POOL_VERTEX_FLOATS * sizeof(float);
+    gp_gl_bind_vertex_array(pool->vao);
+    gp_gl_bind_buffer(GL_ARRAY_BUFFER, pool->vbo);
+    gp_gl_bind_buffer(GL_ELEMENT_ARRAY_BUFFER, pool->ebo);
+
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)(0 * sizeof(float)));
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)(3 * sizeof(float)));
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*)(6 * sizeof(float)));
+    glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, stride, (void*)(8 * sizeof(float)));
+    for (int i = 0; i < 4; ++i) {
+        glEnableVertexAttribArray(i);
+    }
+
+    gp_gl_bind_vertex_array(0);
+}
+
+// Appends the mesh to the CPU copy of the pool, upload_mesh_pool sends it to the GPU.
+// Attributes missing in data are filled with zeros, tangents with (1, 0, 0, 1).
+int add_pool_mesh(MeshPool* pool, const MeshData* data) {
+    int index = pool->mesh_count++;
+    pool->meshes = (PoolMesh*) realloc(pool->meshes, pool->mesh_count * sizeof(PoolMesh));
+    PoolMesh* m = &pool->meshes[index];
+    m->first_index = pool->index_count;
+    m->index_count = data->vertex_count;
+    m->base_vertex = pool->vertex_count;
+    m->vertex_count = data->vertex_count;
+
+    pool->vertices = (float*) realloc(pool->vertices, (pool->vertex_count + data->vertex_count) * MESH_POOL_VERTEX_FLOATS * sizeof(float));
+    pool->indices = (GLuint*) realloc(pool->indices, (pool->index_count + data->vertex_count) * sizeof(GLuint));
+
+    for (int i = 0; i < data->vertex_count; ++i) {
+        float* v = &pool->vertices[(pool->vertex_count + i) * MESH_POOL_VERTEX_FLOATS];
+        memset(v, 0, MESH_POOL_VERTEX_FLOATS * sizeof(float));
+        if (data->positions != NULL) {
+            memcpy(&v[0], &data->positions[i * 3], 3 * sizeof(float));
+        }
+        if (data->normals != NULL) {
+            memcpy(&v[3], &data->normals[i * 3], 3 * sizeof(float));
+        }
+        if (data->uvs != NULL) {
+            memcpy(&v[6], &data->uvs[i * 2], 2 * sizeof(float));
+        }
+        if (data->tangents != NULL) {
+            memcpy(&v[8], &data->tangents[i * 4], 4 * sizeof(float));
+        } else {
+            v[8] = 1.0f;
+            v[11] = 1.0f;
+        }
+        // meshes come with one vertex per triangle corner, indices are relative to base_vertex
+        pool->indices[pool->index_count + i] = i;
+    }
+
+    pool->vertex_count += data->vertex_count;
+    pool->index_count += data->vertex_count;
+    return index;
+}
+
+void upload_mesh_pool(MeshPool* pool) {
+    gp_gl_bind_vertex_array(pool->vao);
+    gp_gl_bind_buffer(GL_ARRAY_BUFFER, pool->vbo);
+    glBufferData(GL_ARRAY_BUFFER, pool->vertex_count * MESH_POOL_VERTEX_FLOATS * sizeof(float), pool->vertices, GL_STATIC_DRAW);
+    gp_gl_bind_buffer(GL_ELEMENT_ARRAY_BUFFER, pool->ebo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, pool->index_count * sizeof(GLuint), pool->indices, GL_STATIC_DRAW);
+    gp_gl_bind_vertex_array(0);
+}
+
+void create_indirect_buffer(IndirectBuffer* ib, int capacity) {
+    assert(capacity > 0);
+    ib->count = 0;
+    ib->capacity = capacity;
+    ib->commands = (DrawElementsIndirectCommand*) malloc(capacity * sizeof(DrawElementsIndirectCommand));
+    glGenBuffers(1, &ib->buffer);
+}
+
+void reset_indirect_buffer(IndirectBuffer* ib) {
+    ib->count = 0;
+}
+
+void push_indirect_command(IndirectBuffer* ib, const PoolMesh* mesh, int first_instance, int instance_count) {
+    if (ib->count == ib->capacity) {
+        ib->capacity = M_MAX(64, ib->capacity * 2);
+        ib->commands = (DrawElementsIndirectCommand*) realloc(ib->commands, ib->capacity * sizeof(DrawElementsIndirectCommand));
+    }
+    DrawElementsIndirectCommand* c = &ib->commands[ib->count++];
+    c->count = mesh->index_count;
+    c->instance_count = instance_count;
+    c->first_index = mesh->first_index;
+    c->base_vertex = mesh->base_vertex;
+    c->base_instance = first_instance;
+}
+
+// Only needed by glMultiDrawElementsIndirect, the fallback reads the commands from memory
+void upload_indirect_buffer(IndirectBuffer* ib) {
+    if (ib->count == 0 || !GLAD_GL_VERSION_4_3) {
+        return;
+    }
+    gp_gl_bind_buffer(GL_DRAW_INDIRECT_BUFFER, ib->buffer);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, ib->capacity * sizeof(DrawElementsIndirectCommand), NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, ib->count * sizeof(DrawElementsIndirectCommand), ib->commands);
+}
+
+// Draws commands [first, first + count) from the pool VAO. With multi_draw set and GL 4.3 that is one
+// call, otherwise one call per command. Returns the number of draw calls.
+int draw_indirect_commands(IndirectBuffer* ib, int first, int count, InstanceBuffer* instances, GLuint vao, int multi_draw) {
+    if (count <= 0) {
+        return 0;
+    }
+    gp_gl_bind_vertex_array(vao);
+
+    if (multi_draw && GLAD_GL_VERSION_4_3) {
+        gp_gl_bind_buffer(GL_DRAW_INDIRECT_BUFFER, ib->buffer);
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)(first * sizeof(DrawElementsIndirectCommand)), count, 0);
+        return 1;
+    }
+
+    for (int i = first; i < first + count; ++i) {
+        const DrawElementsIndirectCommand* c = &ib->commands[i];
+        void* indices = (void*)(c->first_index * sizeof(GLuint));
+        if (GLAD_GL_VERSION_4_2) {
+            glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, c->count, GL_UNSIGNED_INT, indices,
+                                                          c->instance_count, c->base_vertex, c->base_instance);
+        } else if (c->base_instance == 0) {
+            glDrawElementsInstancedBaseVertex(GL_TRIANGLES, c->count, GL_UNSIGNED_INT, indices, c->instance_count, c->base_vertex);
+        } else {
+            offset_instance_attributes(instances, vao, c->base_instance);
+            glDrawElementsInstancedBaseVertex(GL_TRIANGLES, c->count, GL_UNSIGNED_INT, indices, c->instance_count, c->base_vertex);
+            offset_instance_attributes(instances, vao, 0);
+        }
+    }
+    return count;
+}
+
+#endif
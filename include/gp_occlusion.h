@@ -0,0 +1,624 @@
+#ifndef GP_OCCLUSION_H
+#define GP_OCCLUSION_H
+
+//
+// Software occlusion culling
+// Occluder meshes (boxes or other simple hulls that fit inside the real mesh) are rasterized into a small
+// depth buffer on the CPU, then object bounds are tested against it before their draws are submitted.
+// The buffer is split in 8x8 tiles that keep the farthest depth they contain, most tests are answered
+// by the tiles alone. Rows of tiles are rasterized by different jobs, every pixel has a single writer and
+// depth only ever goes down, so the result doesn't depend on the worker count.
+//
+// Depth is NDC z mapped to [0, 1], 1 being the far plane. Occluders must be closed meshes with counter
+// clockwise front faces, back faces are skipped.
+//
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define GP_OCCLUSION_SSE
+#endif
+
+#define OCCLUSION_TILE 8
+#define OCCLUSION_ALIGNMENT 16
+
+enum OcclusionPath {
+    OCCLUSION_PATH_SCALAR = 0,
+    OCCLUSION_PATH_SSE
+};
+
+typedef struct OccluderMesh {
+    float* positions; // xyz
+    int vertex_count;
+    int* indices;
+    int triangle_count;
+} OccluderMesh;
+
+// Screen space triangle ready to be rasterized, edge and depth functions are a * x + b * y + c
+typedef struct OcclusionTriangle {
+    float edge_a[3];
+    float edge_b[3];
+    float edge_c[3];
+    float depth_a;
+    float depth_b;
+    float depth_c;
+    float depth_min;
+    float depth_max;
+    int min_x;
+    int max_x;
+    int min_y;
+    int max_y;
+} OcclusionTriangle;
+
+typedef struct OcclusionStats {
+    int occluders;
+    int triangles; // triangles that reached the rasterizer
+    int tested;
+    int occluded;
+} OcclusionStats;
+
+typedef struct OcclusionBuffer {
+    int width;  // multiple of OCCLUSION_TILE
+    int height; // multiple of OCCLUSION_TILE
+    int tiles_x;
+    int tiles_y;
+    float* depth;    // width * height, row 0 is the bottom of the screen
+    float* tile_max; // farthest depth of every tile
+
+    OcclusionTriangle* triangles;
+    int triangle_count;
+    int triangle_capacity;
+
+    float view_projection[16];
+    int path;
+    OcclusionStats stats;
+} OcclusionBuffer;
+
+int occlusion_best_path() {
+#ifdef GP_OCCLUSION_SSE
+    return OCCLUSION_PATH_SSE;
+#else
+    return OCCLUSION_PATH_SCALAR;
+#endif
+}
+
+// width and height are rounded up to whole tiles
+void create_occlusion_buffer(OcclusionBuffer* ob, int width, int height) {
+    memset(ob, 0, sizeof(OcclusionBuffer));
+    ob->tiles_x = (width + OCCLUSION_TILE - 1) / OCCLUSION_TILE;
+    ob->tiles_y = (height + OCCLUSION_TILE - 1) / OCCLUSION_TILE;
+    ob->width = ob->tiles_x * OCCLUSION_TILE;
+    ob->height = ob->tiles_y * OCCLUSION_TILE;
+    ob->depth = (float*) gp_aligned_malloc(ob->width * ob->height * sizeof(float), OCCLUSION_ALIGNMENT);
+    ob->tile_max = (float*) malloc(ob->tiles_x * ob->tiles_y * sizeof(float));
+    ob->triangle_capacity = 256;
+    ob->triangles = (OcclusionTriangle*) malloc(ob->triangle_capacity * sizeof(OcclusionTriangle));
+    ob->path = occlusion_best_path();
+    m_mat4_identity(ob->view_projection);
+}
+
+void free_occlusion_buffer(OcclusionBuffer* ob) {
+    gp_aligned_free(ob->depth);
+    free(ob->tile_max);
+    free(ob->triangles);
+    memset(ob, 0, sizeof(OcclusionBuffer));
+}
+
+// Box occluder, 8 vertices and 12 counter clockwise triangles facing out
+void make_box_occluder(OccluderMesh* mesh, const float3* min, const float3* max) {
+    static const int box_indices[36] = {
+        0, 2, 1,  0, 3, 2, // -z
+        4, 5, 6,  4, 6, 7, // +z
+        0, 1, 5,  0, 5, 4, // -y
+        3, 7, 6,  3, 6, 2, // +y
+        0, 4, 7,  0, 7, 3, // -x
+        1, 2, 6,  1, 6, 5  // +x
+    };
+
+    mesh->vertex_count = 8;
+    mesh->triangle_count = 12;
+    mesh->positions = (float*) malloc(8 * 3 * sizeof(float));
+    mesh->indices = (int*) malloc(36 * sizeof(int));
+    memcpy(mesh->indices, box_indices, sizeof(box_indices));
+
+    for (int i = 0; i < 8; ++i) {
+        mesh->positions[i * 3 + 0] = (i == 1 || i == 2 || i == 5 || i == 6) ? max->x : min->x;
+        mesh->positions[i * 3 + 1] = (i == 2 || i == 3 || i == 6 || i == 7) ? max->y : min->y;
+        mesh->positions[i * 3 + 2] = (i >= 4) ? max->z : min->z;
+    }
+}
+
+void free_occluder_mesh(OccluderMesh* mesh) {
+    free(mesh->positions);
+    free(mesh->indices);
+    memset(mesh, 0, sizeof(OccluderMesh));
+}
+
+// Clears the depth buffer, triangles added after this use view_projection
+void begin_occlusion_frame(OcclusionBuffer* ob, const float* view_projection) {
+    memcpy(ob->view_projection, view_projection, 16 * sizeof(float));
+    ob->triangle_count = 0;
+    memset(&ob->stats, 0, sizeof(OcclusionStats));
+}
+
+float3 occlusion_to_screen(OcclusionBuffer* ob, const float4* clip) {
+    float3 s;
+    float inv_w = 1.0f / clip->w;
+    s.x = (clip->x * inv_w * 0.5f + 0.5f) * ob->width;
+    s.y = (clip->y * inv_w * 0.5f + 0.5f) * ob->height;
+    s.z = clip->z * inv_w * 0.5f + 0.5f;
+    return s;
+}
+
+void setup_occlusion_triangle(OcclusionBuffer* ob, const float3* v0, const float3* v1, const float3* v2) {
+    float area = (v1->x - v0->x) * (v2->y - v0->y) - (v1->y - v0->y) * (v2->x - v0->x);
+    if (!(area > 0.0f)) {
+        // back facing or degenerate
+        return;
+    }
+
+    float min_x = M_MIN(v0->x, M_MIN(v1->x, v2->x));
+    float max_x = M_MAX(v0->x, M_MAX(v1->x, v2->x));
+    float min_y = M_MIN(v0->y, M_MIN(v1->y, v2->y));
+    float max_y = M_MAX(v0->y, M_MAX(v1->y, v2->y));
+
+    OcclusionTriangle t;
+    t.min_x = M_MAX(0, (int) floorf(min_x));
+    t.max_x = M_MIN(ob->width - 1, (int) floorf(max_x));
+    t.min_y = M_MAX(0, (int) floorf(min_y));
+    t.max_y = M_MIN(ob->height - 1, (int) floorf(max_y));
+    if (t.min_x > t.max_x || t.min_y > t.max_y) {
+        return;
+    }
+
+    // edge i is opposite to vertex i, positive inside
+    const float3* v[3] = {v0, v1, v2};
+    for (int i = 0; i < 3; ++i) {
+        const float3* a = v[(i + 1) % 3];
+        const float3* b = v[(i + 2) % 3];
+        t.edge_a[i] = a->y - b->y;
+        t.edge_b[i] = b->x - a->x;
+        t.edge_c[i] = a->x * b->y - a->y * b->x;
+    }
+
+    float dzdx = ((v1->z - v0->z) * (v2->y - v0->y) - (v2->z - v0->z) * (v1->y - v0->y)) / area;
+    float dzdy = ((v2->z - v0->z) * (v1->x - v0->x) - (v1->z - v0->z) * (v2->x - v0->x)) / area;
+    t.depth_a = dzdx;
+    t.depth_b = dzdy;
+    t.depth_c = v0->z - dzdx * v0->x - dzdy * v0->y;
+    // pixels right on an edge extrapolate a little, never let that bring the depth closer
+    t.depth_min = M_MIN(v0->z, M_MIN(v1->z, v2->z));
+    t.depth_max = M_MAX(v0->z, M_MAX(v1->z, v2->z));
+
+    if (ob->triangle_count == ob->triangle_capacity) {
+        ob->triangle_capacity *= 2;
+        ob->triangles = (OcclusionTriangle*) realloc(ob->triangles, ob->triangle_capacity * sizeof(OcclusionTriangle));
+    }
+    ob->triangles[ob->triangle_count++] = t;
+}
+
+// Clips against the near plane (z > -w) and queues the resulting one or two triangles
+void add_occlusion_triangle(OcclusionBuffer* ob, const float4* c0, const float4* c1, const float4* c2) {
+    const float4* in[3] = {c0, c1, c2};
+    float4 out[4];
+    int out_count = 0;
+
+    for (int i = 0; i < 3; ++i) {
+        const float4* a = in[i];
+        const float4* b = in[(i + 1) % 3];
+        float da = a->z + a->w;
+        float db = b->z + b->w;
+        if (da >= 0.0f) {
+            out[out_count++] = *a;
+        }
+        if ((da >= 0.0f) != (db >= 0.0f)) {
+            float t = da / (da - db);
+            out[out_count].x = a->x + (b->x - a->x) * t;
+            out[out_count].y = a->y + (b->y - a->y) * t;
+            out[out_count].z = a->z + (b->z - a->z) * t;
+            out[out_count].w = a->w + (b->w - a->w) * t;
+            out_count++;
+        }
+    }
+    if (out_count < 3) {
+        return;
+    }
+
+    float3 s[4];
+    for (int i = 0; i < out_count; ++i) {
+        if (out[i].w <= 0.0f) {
+            // only possible when the near plane is at w = 0, nothing sensible to draw
+            return;
+        }
+        s[i] = occlusion_to_screen(ob, &out[i]);
+    }
+    setup_occlusion_triangle(ob, &s[0], &s[1], &s[2]);
+    if (out_count == 4) {
+        setup_occlusion_triangle(ob, &s[0], &s[2], &s[3]);
+    }
+}
+
+void add_occluder(OcclusionBuffer* ob, const OccluderMesh* mesh, const float* model_matrix) {
+    float mvp[16];
+    m_mat4_mul(mvp, ob->view_projection, model_matrix);
+
+    float4 stack_clip[64];
+    float4* clip = mesh->vertex_count <= 64 ? stack_clip : (float4*) malloc(mesh->vertex_count * sizeof(float4));
+    for (int i = 0; i < mesh->vertex_count; ++i) {
+        float4 p = {mesh->positions[i * 3 + 0], mesh->positions[i * 3 + 1], mesh->positions[i * 3 + 2], 1.0f};
+        m_mat4_transform4(&clip[i], mvp, &p);
+    }
+
+    int before = ob->triangle_count;
+    for (int i = 0; i < mesh->triangle_count; ++i) {
+        const int* tri = &mesh->indices[i * 3];
+        add_occlusion_triangle(ob, &clip[tri[0]], &clip[tri[1]], &clip[tri[2]]);
+    }
+    if (ob->triangle_count > before) {
+        ob->stats.occluders++;
+    }
+
+    if (clip != stack_clip) {
+        free(clip);
+    }
+}
+
+////////////////////////////////////////////////////
+// rasterization
+
+void rasterize_triangle_rows_scalar(OcclusionBuffer* ob, const OcclusionTriangle* t, int y0, int y1) {
+    for (int y = y0; y <= y1; ++y) {
+        float py = y + 0.5f;
+        float e0 = t->edge_b[0] * py + t->edge_c[0];
+        float e1 = t->edge_b[1] * py + t->edge_c[1];
+        float e2 = t->edge_b[2] * py + t->edge_c[2];
+        float z_row = t->depth_b * py + t->depth_c;
+        float* row = &ob->depth[y * ob->width];
+
+        for (int x = t->min_x; x <= t->max_x; ++x) {
+            float px = x + 0.5f;
+            float w0 = t->edge_a[0] * px + e0;
+            float w1 = t->edge_a[1] * px + e1;
+            float w2 = t->edge_a[2] * px + e2;
+            if (w0 >= 0.0f && w1 >= 0.0f && w2 >= 0.0f) {
+                float z = t->depth_a * px + z_row;
+                z = M_MIN(M_MAX(z, t->depth_min), t->depth_max);
+                if (z < row[x]) {
+                    row[x] = z;
+                }
+            }
+        }
+    }
+}
+
+#ifdef GP_OCCLUSION_SSE
+// Same math as the scalar version, 4 pixels at a time. Rows are a multiple of 4 wide and aligned,
+// pixels of the group outside the bounding box fail the edge tests.
+void rasterize_triangle_rows_sse(OcclusionBuffer* ob, const OcclusionTriangle* t, int y0, int y1) {
+    __m128 a0 = _mm_set1_ps(t->edge_a[0]);
+    __m128 a1 = _mm_set1_ps(t->edge_a[1]);
+    __m128 a2 = _mm_set1_ps(t->edge_a[2]);
+    __m128 za = _mm_set1_ps(t->depth_a);
+    __m128 z_min = _mm_set1_ps(t->depth_min);
+    __m128 z_max = _mm_set1_ps(t->depth_max);
+    __m128 zero = _mm_setzero_ps();
+    __m128 lane = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+    int x_start = t->min_x & ~3;
+
+    for (int y = y0; y <= y1; ++y) {
+        float py = y + 0.5f;
+        __m128 e0 = _mm_set1_ps(t->edge_b[0] * py + t->edge_c[0]);
+        __m128 e1 = _mm_set1_ps(t->edge_b[1] * py + t->edge_c[1]);
+        __m128 e2 = _mm_set1_ps(t->edge_b[2] * py + t->edge_c[2]);
+        __m128 z_row = _mm_set1_ps(t->depth_b * py + t->depth_c);
+        float* row = &ob->depth[y * ob->width];
+
+        for (int x = x_start; x <= t->max_x; x += 4) {
+            __m128 px = _mm_add_ps(_mm_set1_ps((float) x), lane);
+            __m128 w0 = _mm_add_ps(_mm_mul_ps(a0, px), e0);
+            __m128 w1 = _mm_add_ps(_mm_mul_ps(a1, px), e1);
+            __m128 w2 = _mm_add_ps(_mm_mul_ps(a2, px), e2);
+            __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(w0, zero), _mm_cmpge_ps(w1, zero)), _mm_cmpge_ps(w2, zero));
+            if (_mm_movemask_ps(inside) == 0) {
+                continue;
+            }
+
+            __m128 z = _mm_add_ps(_mm_mul_ps(za, px), z_row);
+            z = _mm_min_ps(_mm_max_ps(z, z_min), z_max);
+            __m128 d = _mm_load_ps(&row[x]);
+            __m128 nearer = _mm_min_ps(d, z);
+            _mm_store_ps(&row[x], _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, d)));
+        }
+    }
+}
+#endif
+
+void update_occlusion_tiles(OcclusionBuffer* ob, int tile_row) {
+    for (int tx = 0; tx < ob->tiles_x; ++tx) {
+        float farthest = 0.0f;
+        for (int y = 0; y < OCCLUSION_TILE; ++y) {
+            const float* row = &ob->depth[(tile_row * OCCLUSION_TILE + y) * ob->width + tx * OCCLUSION_TILE];
+            for (int x = 0; x < OCCLUSION_TILE; ++x) {
+                farthest = M_MAX(farthest, row[x]);
+            }
+        }
+        ob->tile_max[tile_row * ob->tiles_x + tx] = farthest;
+    }
+}
+
+// Job over rows of tiles: clears them, draws every triangle that touches them and updates the tiles
+void rasterize_occlusion_job(void* data, int begin, int end) {
+    OcclusionBuffer* ob = (OcclusionBuffer*) data;
+    int y0 = begin * OCCLUSION_TILE;
+    int y1 = end * OCCLUSION_TILE - 1;
+
+    for (int i = y0 * ob->width; i < (y1 + 1) * ob->width; ++i) {
+        ob->depth[i] = 1.0f;
+    }
+
+    for (int i = 0; i < ob->triangle_count; ++i) {
+        const OcclusionTriangle* t = &ob->triangles[i];
+        int ty0 = M_MAX(y0, t->min_y);
+        int ty1 = M_MIN(y1, t->max_y);
+        if (ty0 > ty1) {
+            continue;
+        }
+#ifdef GP_OCCLUSION_SSE
+        if (ob->path == OCCLUSION_PATH_SSE) {
+            rasterize_triangle_rows_sse(ob, t, ty0, ty1);
+            continue;
+        }
+#endif
+        rasterize_triangle_rows_scalar(ob, t, ty0, ty1);
+    }
+
+    for (int tile_row = begin; tile_row < end; ++tile_row) {
+        update_occlusion_tiles(ob, tile_row);
+    }
+}
+
+void rasterize_occluders(OcclusionBuffer* ob, JobSystem* js) {
+    ob->stats.triangles = ob->triangle_count;
+    parallel_for(js, ob->tiles_y, 1, rasterize_occlusion_job, ob);
+}
+
+////////////////////////////////////////////////////
+// queries
+
+// Returns 1 if any pixel of [x0, x1] x [y0, y1] is farther than depth
+int occlusion_rect_visible(const OcclusionBuffer* ob, int x0, int y0, int x1, int y1, float depth) {
+    for (int ty = y0 / OCCLUSION_TILE; ty <= y1 / OCCLUSION_TILE; ++ty) {
+        for (int tx = x0 / OCCLUSION_TILE; tx <= x1 / OCCLUSION_TILE; ++tx) {
+            if (ob->tile_max[ty * ob->tiles_x + tx] < depth) {
+                // everything in the tile is in front
+                continue;
+            }
+            int py0 = M_MAX(y0, ty * OCCLUSION_TILE);
+            int py1 = M_MIN(y1, ty * OCCLUSION_TILE + OCCLUSION_TILE - 1);
+            int px0 = M_MAX(x0, tx * OCCLUSION_TILE);
+            int px1 = M_MIN(x1, tx * OCCLUSION_TILE + OCCLUSION_TILE - 1);
+            for (int y = py0; y <= py1; ++y) {
+                const float* row = &ob->depth[y * ob->width];
+                for (int x = px0; x <= px1; ++x) {
+                    if (row[x] >= depth) {
+                        return 1;
+                    }
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+// Returns 0 only when the box under model_matrix is certainly hidden behind the occluders
+int occlusion_bounds_visible(const OcclusionBuffer* ob, const MeshBounds* bounds, const float* model_matrix) {
+    float mvp[16];
+    m_mat4_mul(mvp, ob->view_projection, model_matrix);
+
+    // one corner is transformed, the others are that plus the clip space edges of the box
+    float4 base;
+    float4 min_corner = {bounds->min.x, bounds->min.y, bounds->min.z, 1.0f};
+    m_mat4_transform4(&base, mvp, &min_corner);
+    float3 size;
+    M_SUB3(size, bounds->max, bounds->min);
+    float4 edges[3];
+    for (int axis = 0; axis < 3; ++axis) {
+        float extent = axis == 0 ? size.x : (axis == 1 ? size.y : size.z);
+        edges[axis].x = mvp[axis * 4 + 0] * extent;
+        edges[axis].y = mvp[axis * 4 + 1] * extent;
+        edges[axis].z = mvp[axis * 4 + 2] * extent;
+        edges[axis].w = mvp[axis * 4 + 3] * extent;
+    }
+
+    float min_x = 1e30f, min_y = 1e30f, max_x = -1e30f, max_y = -1e30f;
+    float min_z = 1e30f;
+    for (int i = 0; i < 8; ++i) {
+        float4 clip = base;
+        for (int axis = 0; axis < 3; ++axis) {
+            if (i & (1 << axis)) {
+                clip.x += edges[axis].x;
+                clip.y += edges[axis].y;
+                clip.z += edges[axis].z;
+                clip.w += edges[axis].w;
+            }
+        }
+        if (clip.z < -clip.w) {
+            // crosses the near plane, the projected rectangle would be wrong
+            return 1;
+        }
+        float inv_w = 1.0f / clip.w;
+        float sx = (clip.x * inv_w * 0.5f + 0.5f) * ob->width;
+        float sy = (clip.y * inv_w * 0.5f + 0.5f) * ob->height;
+        float sz = clip.z * inv_w * 0.5f + 0.5f;
+        min_x = M_MIN(min_x, sx);
+        max_x = M_MAX(max_x, sx);
+        min_y = M_MIN(min_y, sy);
+        max_y = M_MAX(max_y, sy);
+        min_z = M_MIN(min_z, sz);
+    }
+
+    int x0 = M_MAX(0, (int) floorf(min_x));
+    int x1 = M_MIN(ob->width - 1, (int) floorf(max_x));
+    int y0 = M_MAX(0, (int) floorf(min_y));
+    int y1 = M_MIN(ob->height - 1, (int) floorf(max_y));
+    if (x0 > x1 || y0 > y1) {
+        // off screen, that is for the frustum culling to decide
+        return 1;
+    }
+    return occlusion_rect_visible(ob, x0, y0, x1, y1, min_z);
+}
+
+uint64_t occlusion_depth_hash(const OcclusionBuffer* ob) {
+    uint64_t hash = 1469598103934665603ull;
+    for (int i = 0; i < ob->width * ob->height; ++i) {
+        uint32_t bits;
+        memcpy(&bits, &ob->depth[i], sizeof(bits));
+        hash = (hash ^ bits) * 1099511628211ull;
+    }
+    return hash;
+}
+
+////////////////////////////////////////////////////
+// benchmark
+
+typedef struct OcclusionTestJob {
+    OcclusionBuffer* ob;
+    MeshBounds* bounds;
+    float* model_matrices;
+    unsigned char* visible;
+    std::atomic<int> occluded;
+} OcclusionTestJob;
+
+void occlusion_test_job(void* data, int begin, int end) {
+    OcclusionTestJob* job = (OcclusionTestJob*) data;
+    int occluded = 0;
+    for (int i = begin; i < end; ++i) {
+        job->visible[i] = occlusion_bounds_visible(job->ob, job->bounds, &job->model_matrices[i * 16]);
+        occluded += !job->visible[i];
+    }
+    job->occluded.fetch_add(occluded, std::memory_order_relaxed);
+}
+
+// Indoor like scene: rows of walls with a door in each one and many small boxes spread between them.
+// Runs rasterization and tests for every path and 1 to max_workers workers, all results must match.
+void gp_occlusion_benchmark(int max_workers) {
+    const char* path_names[] = {"scalar", "sse"};
+    int object_count = 200000;
+    int wall_rows = 24;
+    int repeats = 10;
+    if (max_workers <= 0) {
+        max_workers = (int) std::thread::hardware_concurrency();
+    }
+    max_workers = M_CLAMP(max_workers, 1, JOBS_MAX_WORKERS);
+
+    OcclusionBuffer ob;
+    create_occlusion_buffer(&ob, 320, 256);
+
+    float view[] = M_MAT4_IDENTITY();
+    float projection[] = M_MAT4_IDENTITY();
+    float view_projection[16];
+    float3 position = {0.0, 1.5, 0.0};
+    float3 direction = {0.0, 0.0, -1.0};
+    float3 up = {0.0, 1.0, 0.0};
+    m_mat4_lookat(view, &position, &direction, &up);
+    m_mat4_perspective(projection, 0.6, 320.0 / 256.0, 0.1, 200.0);
+    m_mat4_mul(view_projection, projection, view);
+
+    m_srand(362436069, 521288629);
+
+    // walls are boxes of unit size scaled into place, two per row with a door between them
+    OccluderMesh unit_box;
+    float3 box_min = {0.0, 0.0, 0.0};
+    float3 box_max = {1.0, 1.0, 1.0};
+    make_box_occluder(&unit_box, &box_min, &box_max);
+
+    int wall_count = wall_rows * 2;
+    float* walls = (float*) malloc(wall_count * 16 * sizeof(float));
+    for (int r = 0; r < wall_rows; ++r) {
+        float z = -4.0f - r * 4.0f;
+        float door = rand_float_range(-15.0, 14.0);
+        float left[2] = {-40.0f, door + 1.0f};
+        float right[2] = {door, 40.0f};
+        for (int k = 0; k < 2; ++k) {
+            float* m = &walls[(r * 2 + k) * 16];
+            m_mat4_identity(m);
+            m[0] = right[k] - left[k];
+            m[5] = 4.0f;
+            m[10] = 0.2f;
+            m[12] = left[k];
+            m[13] = 0.0f;
+            m[14] = z;
+        }
+    }
+
+    MeshBounds object_bounds;
+    set_float3(&object_bounds.min, -0.2, -0.2, -0.2);
+    set_float3(&object_bounds.max, 0.2, 0.2, 0.2);
+    set_float3(&object_bounds.center, 0.0, 0.0, 0.0);
+    object_bounds.radius = 0.35f;
+
+    float* objects = (float*) malloc(object_count * 16 * sizeof(float));
+    for (int i = 0; i < object_count; ++i) {
+        float* m = &objects[i * 16];
+        m_mat4_identity(m);
+        m[12] = rand_float_range(-12.0, 12.0);
+        m[13] = rand_float_range(0.2, 3.0);
+        m[14] = rand_float_range(-1.0, -4.0f - wall_rows * 4.0f);
+    }
+
+    OcclusionTestJob job;
+    job.ob = &ob;
+    job.bounds = &object_bounds;
+    job.model_matrices = objects;
+    job.visible = (unsigned char*) malloc(object_count);
+
+    printf("occlusion benchmark: %dx%d buffer, %d walls, %d objects\n", ob.width, ob.height, wall_count, object_count);
+    uint64_t reference_depth = 0;
+    int reference_occluded = -1;
+    for (int path = OCCLUSION_PATH_SCALAR; path <= occlusion_best_path(); ++path) {
+        for (int workers = 1; workers <= max_workers; ++workers) {
+            JobSystem* js = create_job_system(workers);
+            ob.path = path;
+            g_timer timer;
+            float raster_ms = 0.0;
+            float test_ms = 0.0;
+
+            for (int r = 0; r < repeats; ++r) {
+                start_timer(&timer);
+                begin_occlusion_frame(&ob, view_projection);
+                for (int w = 0; w < wall_count; ++w) {
+                    add_occluder(&ob, &unit_box, &walls[w * 16]);
+                }
+                rasterize_occluders(&ob, js);
+                stop_timer(&timer);
+                raster_ms += compute_timer_millis_diff(&timer);
+
+                start_timer(&timer);
+                job.occluded.store(0);
+                parallel_for(js, object_count, job_grain(js, object_count, 1024), occlusion_test_job, &job);
+                stop_timer(&timer);
+                test_ms += compute_timer_millis_diff(&timer);
+            }
+
+            uint64_t depth_hash = occlusion_depth_hash(&ob);
+            int occluded = job.occluded.load();
+            if (reference_occluded < 0) {
+                reference_depth = depth_hash;
+                reference_occluded = occluded;
+            }
+            int same = (depth_hash == reference_depth && occluded == reference_occluded);
+            printf("  %-6s %2d workers  raster %7.3f ms (%d triangles)  test %7.3f ms  occluded %d of %d%s\n",
+                   path_names[path], workers, raster_ms / repeats, ob.stats.triangles, test_ms / repeats,
+                   occluded, object_count, same ? "" : "  MISMATCH");
+
+            destroy_job_system(js);
+        }
+    }
+
+    free(job.visible);
+    free(objects);
+    free(walls);
+    free_occluder_mesh(&unit_box);
+    free_occlusion_buffer(&ob);
+}
+
+#endif
@@ -0,0 +1,213 @@
+#ifndef GP_PROGRAM_CACHE_H
+#define GP_PROGRAM_CACHE_H
+
+//
+// On disk cache of linked programs
+// compile_program_cached is compile_shader_program that first looks for a binary saved by a previous run.
+// The key hashes both sources, the attribute bindings and the GL vendor, renderer and version strings,
+// so an edited shader or a driver update just misses. A binary the driver rejects anyway is recompiled
+// and overwritten. Needs glProgramBinary (GL 4.1), without it every program is compiled as before.
+//
+// File: ProgramCacheHeader followed by the binary, written to a temporary name and renamed so a crash
+// can't leave a half written file behind.
+//
+
+#include <sys/stat.h>
+#include <mutex>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+#define PROGRAM_CACHE_MAGIC 0x42505047u // "GPPB"
+#define PROGRAM_CACHE_PATH 512
+#define PROGRAM_CACHE_DIRECTORY (PROGRAM_CACHE_PATH - 32) // leaves room for "/<key>.bin.tmp"
+
+typedef struct ProgramCacheHeader {
+    uint32_t magic;
+    uint32_t format;
+    uint32_t length;
+    uint32_t reserved;
+    uint64_t key;
+} ProgramCacheHeader;
+
+typedef struct ProgramCache {
+    int enabled;
+    char directory[PROGRAM_CACHE_DIRECTORY];
+    uint64_t driver_hash; // vendor, renderer and version
+
+    int hits;
+    int compiled;
+    int rejected; // binaries found on disk that the driver didn't take
+    float ms;     // spent in compile_program_cached
+} ProgramCache;
+
+ProgramCache program_cache;
+// the counters, compile_program_cached also runs on the prewarm thread of gp_shader_variants.h
+std::mutex program_cache_lock;
+
+uint64_t program_cache_hash(uint64_t hash, const char* s) {
+    if (s == NULL) {
+        s = "";
+    }
+    for (; *s != '\0'; ++s) {
+        hash = (hash ^ (unsigned char) *s) * 1099511628211ull;
+    }
+    // separator, so "ab" + "c" and "a" + "bc" don't collide
+    return (hash ^ 0xff) * 1099511628211ull;
+}
+
+// directory NULL (or too long) leaves the cache disabled
+void init_program_cache(ProgramCache* cache, const char* directory) {
+    memset(cache, 0, sizeof(ProgramCache));
+    if (directory == NULL) {
+        return;
+    }
+    if (strlen(directory) >= PROGRAM_CACHE_DIRECTORY) {
+        printf("program cache: directory path longer than %d characters, compiling every time\n", PROGRAM_CACHE_DIRECTORY - 1);
+        return;
+    }
+
+    GLint formats = 0;
+    if (GLAD_GL_VERSION_4_1) {
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    }
+    if (formats <= 0) {
+        printf("program cache: program binaries not supported, compiling every time\n");
+        return;
+    }
+
+#ifdef _WIN32
+    _mkdir(directory);
+#else
+    mkdir(directory, 0755);
+#endif
+    snprintf(cache->directory, PROGRAM_CACHE_DIRECTORY, "%s", directory);
+
+    uint64_t hash = 1469598103934665603ull;
+    hash = program_cache_hash(hash, (const char*) glGetString(GL_VENDOR));
+    hash = program_cache_hash(hash, (const char*) glGetString(GL_RENDERER));
+    hash = program_cache_hash(hash, (const char*) glGetString(GL_VERSION));
+    cache->driver_hash = hash;
+    cache->enabled = 1;
+}
+
+GLuint load_program_binary(ProgramCache* cache, const char* path, uint64_t key) {
+    FILE* f = fopen(path, "rb");
+    if (f == NULL) {
+        return 0;
+    }
+
+    ProgramCacheHeader header;
+    void* binary = NULL;
+    int valid = fread(&header, sizeof(header), 1, f) == 1
+        && header.magic == PROGRAM_CACHE_MAGIC
+        && header.key == key
+        && header.length > 0;
+    if (valid) {
+        binary = malloc(header.length);
+        valid = fread(binary, header.length, 1, f) == 1;
+    }
+    fclose(f);
+
+    GLuint program = 0;
+    if (valid) {
+        program = glCreateProgram();
+        glProgramBinary(program, header.format, binary, header.length);
+        GLint linked = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        if (!linked) {
+            gp_gl_delete_program(program);
+            program = 0;
+        }
+    }
+    if (program == 0) {
+        std::lock_guard<std::mutex> guard(program_cache_lock);
+        cache->rejected++;
+    }
+    free(binary);
+    return program;
+}
+
+void save_program_binary(const char* path, GLuint program, uint64_t key) {
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) {
+        return;
+    }
+
+    ProgramCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = PROGRAM_CACHE_MAGIC;
+    header.key = key;
+    void* binary = malloc(length);
+    GLenum format = 0;
+    glGetProgramBinary(program, length, NULL, &format, binary);
+    header.format = format;
+    header.length = length;
+
+    // a cut temporary name could be renamed over another file
+    char temp_path[PROGRAM_CACHE_PATH];
+    int n = snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+    FILE* f = n > 0 && n < (int) sizeof(temp_path) ? fopen(temp_path, "wb") : NULL;
+    if (f != NULL) {
+        int written = fwrite(&header, sizeof(header), 1, f) == 1 && fwrite(binary, length, 1, f) == 1;
+        fclose(f);
+        if (written) {
+            // rename doesn't replace an existing file on Windows
+            remove(path);
+            rename(temp_path, path);
+        } else {
+            remove(temp_path);
+        }
+    }
+    free(binary);
+}
+
+// Same arguments and result as compile_shader_program
+GLuint compile_program_cached(const char* str_vert_shader, const char* str_frag_shader, const char* attrib_name_0,
+                              const char* attrib_name_1, const char* attrib_name_2, const char* attrib_name_3) {
+    ProgramCache* cache = &program_cache;
+    if (!cache->enabled || str_vert_shader == NULL || str_frag_shader == NULL) {
+        return compile_shader_program(str_vert_shader, str_frag_shader, attrib_name_0, attrib_name_1, attrib_name_2, attrib_name_3);
+    }
+
+    g_timer timer;
+    start_timer(&timer);
+
+    uint64_t key = cache->driver_hash;
+    key = program_cache_hash(key, str_vert_shader);
+    key = program_cache_hash(key, str_frag_shader);
+    key = program_cache_hash(key, attrib_name_0);
+    key = program_cache_hash(key, attrib_name_1);
+    key = program_cache_hash(key, attrib_name_2);
+    key = program_cache_hash(key, attrib_name_3);
+
+    char path[PROGRAM_CACHE_PATH];
+    int n = snprintf(path, sizeof(path), "%s/%016llx.bin", cache->directory, (unsigned long long) key);
+    int cached = n > 0 && n < (int) sizeof(path);
+
+    GLuint program = cached ? load_program_binary(cache, path, key) : 0;
+    int hit = program != 0;
+    if (!hit) {
+        program = compile_shader_program(str_vert_shader, str_frag_shader, attrib_name_0, attrib_name_1, attrib_name_2, attrib_name_3);
+        GLint linked = GL_FALSE;
+        if (program != 0) {
+            glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        }
+        if (linked && cached) {
+            save_program_binary(path, program, key);
+        }
+    }
+
+    stop_timer(&timer);
+    std::lock_guard<std::mutex> guard(program_cache_lock);
+    if (hit) {
+        cache->hits++;
+    } else {
+        cache->compiled++;
+    }
+    cache->ms += compute_timer_millis_diff(&timer);
+    return program;
+}
+
+#endif
@@ -0,0 +1,140 @@
+#ifndef GP_RENDER_QUEUE_H
+#define GP_RENDER_QUEUE_H
+
+//
+// Render queue
+// Scene code submits draw packets, the queue radix sorts them by a 64 bit key every frame.
+// Key layout, from the most significant bit:
+//
+//   pass 4 | program 10 | material 12 | mesh 12 | depth 26
+//
+// Everything above the depth bits is render state, so packets that only differ in depth are
+// consecutive after the sort and can be merged into one draw. Depth is the view distance quantized
+// to 26 bits, front to back for opaque passes and back to front for the transparent one.
+//
+
+#define RQ_DEPTH_BITS 26
+#define RQ_MESH_BITS 12
+#define RQ_MATERIAL_BITS 12
+#define RQ_PROGRAM_BITS 10
+#define RQ_PASS_BITS 4
+
+#define RQ_MESH_SHIFT (RQ_DEPTH_BITS)
+#define RQ_MATERIAL_SHIFT (RQ_MESH_SHIFT + RQ_MESH_BITS)
+#define RQ_PROGRAM_SHIFT (RQ_MATERIAL_SHIFT + RQ_MATERIAL_BITS)
+#define RQ_PASS_SHIFT (RQ_PROGRAM_SHIFT + RQ_PROGRAM_BITS)
+
+#define RQ_DEPTH_MASK ((1ull << RQ_DEPTH_BITS) - 1)
+#define RQ_STATE_MASK (~RQ_DEPTH_MASK)
+// pass, program and material, batches that only differ in mesh
+#define RQ_GROUP_MASK (~((1ull << RQ_MATERIAL_SHIFT) - 1))
+
+enum RenderPass {
+    PASS_OPAQUE = 0,
+    PASS_TRANSPARENT = 1,
+    PASS_COUNT
+};
+
+typedef struct DrawPacket {
+    uint64_t key;
+    int object;
+    int pad;
+} DrawPacket;
+
+typedef struct RenderQueue {
+    DrawPacket* packets;
+    DrawPacket* scratch;
+    int count;
+    int capacity;
+} RenderQueue;
+
+void create_render_queue(RenderQueue* q, int capacity) {
+    assert(capacity > 0);
+    q->packets = (DrawPacket*) malloc(capacity * sizeof(DrawPacket));
+    q->scratch = (DrawPacket*) malloc(capacity * sizeof(DrawPacket));
+    q->count = 0;
+    q->capacity = capacity;
+}
+
+void free_render_queue(RenderQueue* q) {
+    free(q->packets);
+    free(q->scratch);
+    q->packets = NULL;
+    q->scratch = NULL;
+    q->count = 0;
+    q->capacity = 0;
+}
+
+void reset_render_queue(RenderQueue* q) {
+    q->count = 0;
+}
+
+void reserve_render_queue(RenderQueue* q, int capacity) {
+    if (capacity <= q->capacity) {
+        return;
+    }
+    q->packets = (DrawPacket*) realloc(q->packets, capacity * sizeof(DrawPacket));
+    q->scratch = (DrawPacket*) realloc(q->scratch, capacity * sizeof(DrawPacket));
+    q->capacity = capacity;
+}
+
+// depth is expected in [0, 1], 0 being the near plane
+uint64_t make_sort_key(int pass, int program, int material, int mesh, float depth) {
+    assert(pass >= 0 && pass < (1 << RQ_PASS_BITS));
+    assert(program >= 0 && program < (1 << RQ_PROGRAM_BITS));
+    assert(material >= 0 && material < (1 << RQ_MATERIAL_BITS));
+    assert(mesh >= 0 && mesh < (1 << RQ_MESH_BITS));
+
+    depth = M_CLAMP(depth, 0.0f, 1.0f);
+    uint64_t d = (uint64_t)(depth * (float)RQ_DEPTH_MASK);
+    if (pass == PASS_TRANSPARENT) {
+        d = RQ_DEPTH_MASK - d;
+    }
+
+    return ((uint64_t)pass << RQ_PASS_SHIFT)
+         | ((uint64_t)program << RQ_PROGRAM_SHIFT)
+         | ((uint64_t)material << RQ_MATERIAL_SHIFT)
+         | ((uint64_t)mesh << RQ_MESH_SHIFT)
+         | d;
+}
+
+int sort_key_pass(uint64_t key)     { return (int)(key >> RQ_PASS_SHIFT) & ((1 << RQ_PASS_BITS) - 1); }
+int sort_key_program(uint64_t key)  { return (int)(key >> RQ_PROGRAM_SHIFT) & ((1 << RQ_PROGRAM_BITS) - 1); }
+int sort_key_material(uint64_t key) { return (int)(key >> RQ_MATERIAL_SHIFT) & ((1 << RQ_MATERIAL_BITS) - 1); }
+int sort_key_mesh(uint64_t key)     { return (int)(key >> RQ_MESH_SHIFT) & ((1 << RQ_MESH_BITS) - 1); }
+
+void submit_draw_packet(RenderQueue* q, uint64_t key, int object) {
+    if (q->count == q->capacity) {
+        reserve_render_queue(q, q->capacity * 2);
+    }
+    DrawPacket* p = &q->packets[q->count++];
+    p->key = key;
+    p->object = object;
+    p->pad = 0;
+}
+
+static_assert(offsetof(DrawPacket, key) == 0, "radix_sort_records sorts on the leading key");
+
+// radix_sort_records of gp_lib.h: passes where every key has the same byte are skipped, which is most
+// of them since the state bits only take a handful of values
+void sort_render_queue(RenderQueue* q) {
+    DrawPacket* sorted = (DrawPacket*) radix_sort_records(q->packets, q->scratch, q->count, sizeof(DrawPacket));
+    // keep the sorted result in packets
+    if (sorted != q->packets) {
+        q->scratch = q->packets;
+        q->packets = sorted;
+    }
+}
+
+// Returns one past the last packet that can be merged with the packet at start,
+// they have the same pass, program, material and mesh.
+int render_queue_batch_end(RenderQueue* q, int start) {
+    uint64_t state = q->packets[start].key & RQ_STATE_MASK;
+    int end = start + 1;
+    while (end < q->count && (q->packets[end].key & RQ_STATE_MASK) == state) {
+        end++;
+    }
+    return end;
+}
+
+#endif
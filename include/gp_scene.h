@@ -0,0 +1,1041 @@
+#ifndef GP_SCENE_H
+#define GP_SCENE_H
+
+#include <algorithm>
+
+//
+// Scene: programs, meshes, materials and objects referenced by index.
+// Every frame the objects are turned into draw packets (build_render_queue) and the sorted
+// queue is submitted (execute_render_queue). Consecutive packets with the same program,
+// material and mesh become a single instanced draw when the program is an instanced one.
+// With a job system set, everything before the GL calls is split in chunks across the workers.
+// With depth_prepass set, opaque batches whose program has a depth program are drawn twice: first
+// depth only, then shaded with GL_EQUAL and depth writes off, so every pixel is shaded once.
+// With occlusion set, the nearest objects whose mesh has an occluder are rasterized on the CPU and
+// objects hidden behind them are dropped before the render queue is built (occlusion_cull_scene).
+// With deferred set, batches whose program has a G-buffer program are drawn into the G-buffer and lit by
+// the lighting program in one fullscreen pass, the rest are drawn forward on top (gp_deferred.h).
+// Programs with light cluster uniforms get the point lights binned in FrameParams.clusters (gp_lights.h),
+// programs with environment uniforms the image based lighting of FrameParams.ibl (gp_ibl.h).
+//
+
+#define SCENE_MAX_PROGRAMS 16
+#define SCENE_MAX_MESHES 64
+#define SCENE_MAX_MATERIALS 64
+#define MATERIAL_TEXTURES 6
+
+// smallest chunk of objects given to a job, a multiple of CULL_WIDTH so the SIMD cull kernels stay aligned
+#define SCENE_MIN_GRAIN 1024
+// nearest objects with an occluder mesh that get rasterized every frame
+#define SCENE_MAX_OCCLUDERS 256
+
+typedef struct ModelProgram {
+    GLuint program;
+    int instanced;
+    GLint loc_time;
+    GLint loc_light;
+    GLint loc_camera_world;
+    GLint loc_model_matrix;
+    GLint loc_view_matrix;
+    GLint loc_projection_matrix;
+    GLint loc_camera_object; // per draw values derived from the model matrix, -1 when unused
+    GLint loc_light_object;
+    GLint loc_normal_matrix;
+    GLint loc_cluster_dims; // -1 for programs that don't read the light clusters
+    GLint loc_cluster_scale;
+    GLint loc_cluster_depth;
+    GLint loc_sh; // -1 for programs without image based lighting
+    GLint loc_prefiltered_mips;
+    int uniforms_frame; // frame in which the per-frame uniforms were last set
+    int depth_program; // scene program used in the depth pre-pass, -1 for none
+    int gbuffer_program; // scene program that writes the G-buffer in deferred mode, -1 to always draw forward
+} ModelProgram;
+
+typedef struct Mesh {
+    GLuint vao;
+    int point_count;
+    int has_bounds; // meshes without bounds are never culled
+    MeshBounds bounds;
+    const OccluderMesh* occluder; // simplified hull that fits inside the mesh, NULL if it can't occlude
+    int pool_mesh; // index in the scene mesh pool, -1 for meshes with their own VAO
+} Mesh;
+
+// texture units are: u_texture, u_albedoMap, u_normalMap, u_metallicMap, u_roughnessMap, u_aoMap
+typedef struct Material {
+    GLuint textures[MATERIAL_TEXTURES];
+    float4 params; // albedo tint rgb, roughness scale
+} Material;
+
+typedef struct RenderObject {
+    int program;
+    int mesh;
+    int material;
+    int pass;
+    int enabled;
+    float model_matrix[16];
+} RenderObject;
+
+typedef struct FrameParams {
+    int frame;
+    float time;
+    float near_plane;
+    float far_plane;
+    float3 camera_position;
+    float3 light;
+    float* view_matrix;
+    float* projection_matrix;
+    const LightClusters* clusters; // binned point lights for the programs that use them, can be NULL
+    const IBL* ibl;                // environment light for the programs that use it, can be NULL
+} FrameParams;
+
+typedef struct SceneStats {
+    int packets;
+    int draw_calls;
+    int depth_draw_calls;
+    GLuint depth_samples;   // samples that passed the depth test in the pre-pass
+    GLuint shaded_samples;  // samples that passed the depth test in the shading pass
+} SceneStats;
+
+// GL_SAMPLES_PASSED query with a few frames of latency, so reading it back doesn't stall.
+// With early depth testing, the samples that pass are the fragments that get shaded.
+#define FRAGMENT_COUNTER_FRAMES 3
+
+typedef struct FragmentCounter {
+    GLuint queries[FRAGMENT_COUNTER_FRAMES];
+    int issued[FRAGMENT_COUNTER_FRAMES];
+    int current;
+    GLuint samples; // result of the most recent query that came back
+} FragmentCounter;
+
+typedef struct OccluderCandidate {
+    float depth;
+    int object;
+} OccluderCandidate;
+
+enum QueuePass {
+    QUEUE_PASS_DEPTH = 0, // depth pre-pass
+    QUEUE_PASS_GBUFFER,   // deferred geometry pass
+    QUEUE_PASS_FORWARD    // everything that is not deferred
+};
+
+enum DepthMode {
+    DEPTH_MODE_UNKNOWN = 0,
+    DEPTH_MODE_WRITE,  // GL_LESS, depth writes on
+    DEPTH_MODE_EQUAL   // GL_EQUAL, depth writes off, after a pre-pass
+};
+
+typedef struct Scene {
+    ModelProgram programs[SCENE_MAX_PROGRAMS];
+    int program_count;
+
+    Mesh meshes[SCENE_MAX_MESHES];
+    int mesh_count;
+
+    Material materials[SCENE_MAX_MATERIALS];
+    int material_count;
+
+    RenderObject* objects;
+    int object_count;
+    int object_capacity;
+
+    InstanceBuffer instances;
+    MeshPool pool;
+    IndirectBuffer indirect;
+    int multi_draw; // submit runs of pool meshes with glMultiDrawElementsIndirect
+    RenderQueue queue;
+    SceneStats stats;
+
+    int culling;
+    CullSpheres cull; // one sphere per object
+    CullStats cull_stats;
+
+    int depth_prepass;
+    int depth_mode;
+    FragmentCounter depth_counter;
+    FragmentCounter shading_counter;
+
+    int occlusion;
+    OcclusionBuffer occlusion_buffer; // width 0 until created
+    OccluderCandidate* occluder_candidates;
+    int occluder_capacity;
+
+    int deferred;
+    GBuffer gbuffer;      // fbo 0 until created
+    int lighting_program; // fullscreen pass over the G-buffer, -1 until set
+
+    JobSystem* jobs; // NULL runs everything on the calling thread
+    int* chunk_counts; // one per job chunk, used to compact results in chunk order
+    int chunk_capacity;
+} Scene;
+
+void create_fragment_counter(FragmentCounter* c) {
+    memset(c, 0, sizeof(FragmentCounter));
+    glGenQueries(FRAGMENT_COUNTER_FRAMES, c->queries);
+}
+
+void begin_fragment_counter(FragmentCounter* c) {
+    GLuint query = c->queries[c->current];
+    if (c->issued[c->current]) {
+        // issued FRAGMENT_COUNTER_FRAMES frames ago, normally available by now
+        glGetQueryObjectuiv(query, GL_QUERY_RESULT, &c->samples);
+    }
+    glBeginQuery(GL_SAMPLES_PASSED, query);
+}
+
+void end_fragment_counter(FragmentCounter* c) {
+    glEndQuery(GL_SAMPLES_PASSED);
+    c->issued[c->current] = 1;
+    c->current = (c->current + 1) % FRAGMENT_COUNTER_FRAMES;
+}
+
+void init_scene(Scene* scene) {
+    memset(scene, 0, sizeof(Scene));
+    scene->object_capacity = 64;
+    scene->objects = (RenderObject*) malloc(scene->object_capacity * sizeof(RenderObject));
+    create_instance_buffer(&scene->instances, 64);
+    create_render_queue(&scene->queue, 64);
+    create_mesh_pool(&scene->pool);
+    attach_instance_buffer(&scene->instances, scene->pool.vao);
+    create_indirect_buffer(&scene->indirect, 64);
+    scene->culling = 1;
+    scene->lighting_program = -1;
+    create_fragment_counter(&scene->depth_counter);
+    create_fragment_counter(&scene->shading_counter);
+}
+
+// Sets the program and refreshes its uniform locations, also used after a shader reload
+void set_scene_program(Scene* scene, int index, GLuint program) {
+    ModelProgram* p = &scene->programs[index];
+    p->program = program;
+    p->loc_time = glGetUniformLocation(program, "u_time");
+    p->loc_light = glGetUniformLocation(program, "u_light");
+    p->loc_camera_world = glGetUniformLocation(program, "u_camera_world");
+    p->loc_model_matrix = glGetUniformLocation(program, "u_model_matrix");
+    p->loc_view_matrix = glGetUniformLocation(program, "u_view_matrix");
+    p->loc_projection_matrix = glGetUniformLocation(program, "u_projection_matrix");
+    p->loc_camera_object = glGetUniformLocation(program, "u_camera_object");
+    p->loc_light_object = glGetUniformLocation(program, "u_light_object");
+    p->loc_normal_matrix = glGetUniformLocation(program, "u_normal_matrix");
+    p->loc_cluster_dims = glGetUniformLocation(program, "u_cluster_dims");
+    p->loc_cluster_scale = glGetUniformLocation(program, "u_cluster_scale");
+    p->loc_cluster_depth = glGetUniformLocation(program, "u_cluster_depth");
+    p->loc_sh = glGetUniformLocation(program, "u_sh");
+    p->loc_prefiltered_mips = glGetUniformLocation(program, "u_prefiltered_mips");
+    p->uniforms_frame = -1;
+
+    // Sampler uniforms are program state, they only need to be set when the program changes
+    gp_gl_use_program(program);
+    glUniform1i(glGetUniformLocation(program, "u_texture"), 0);
+    glUniform1i(glGetUniformLocation(program, "u_albedoMap"), 1);
+    glUniform1i(glGetUniformLocation(program, "u_normalMap"), 2);
+    glUniform1i(glGetUniformLocation(program, "u_metallicMap"), 3);
+    glUniform1i(glGetUniformLocation(program, "u_roughnessMap"), 4);
+    glUniform1i(glGetUniformLocation(program, "u_aoMap"), 5);
+    glUniform1i(glGetUniformLocation(program, "u_gbuffer_albedo_ao"), GBUFFER_TEXTURE_UNIT + 0);
+    glUniform1i(glGetUniformLocation(program, "u_gbuffer_normal"), GBUFFER_TEXTURE_UNIT + 1);
+    glUniform1i(glGetUniformLocation(program, "u_gbuffer_material"), GBUFFER_TEXTURE_UNIT + 2);
+    glUniform1i(glGetUniformLocation(program, "u_gbuffer_depth"), GBUFFER_TEXTURE_UNIT + 3);
+    glUniform1i(glGetUniformLocation(program, "u_cluster_grid"), LIGHT_TEXTURE_UNIT + 0);
+    glUniform1i(glGetUniformLocation(program, "u_light_indices"), LIGHT_TEXTURE_UNIT + 1);
+    glUniform1i(glGetUniformLocation(program, "u_light_data"), LIGHT_TEXTURE_UNIT + 2);
+    glUniform1i(glGetUniformLocation(program, "u_prefiltered"), IBL_TEXTURE_UNIT);
+    glUniform1i(glGetUniformLocation(program, "u_brdf_lut"), IBL_TEXTURE_UNIT + 1);
+}
+
+int add_scene_program(Scene* scene, GLuint program, int instanced) {
+    assert(scene->program_count < SCENE_MAX_PROGRAMS);
+    int index = scene->program_count++;
+    scene->programs[index].instanced = instanced;
+    scene->programs[index].depth_program = -1;
+    scene->programs[index].gbuffer_program = -1;
+    set_scene_program(scene, index, program);
+    return index;
+}
+
+// Meshes drawn by instanced programs get the instance attributes added to their VAO
+int add_scene_mesh(Scene* scene, GLuint vao, int point_count, int instanced, const MeshBounds* bounds) {
+    assert(scene->mesh_count < SCENE_MAX_MESHES);
+    int index = scene->mesh_count++;
+    scene->meshes[index].vao = vao;
+    scene->meshes[index].point_count = point_count;
+    scene->meshes[index].has_bounds = (bounds != NULL);
+    scene->meshes[index].occluder = NULL;
+    scene->meshes[index].pool_mesh = -1;
+    if (bounds != NULL) {
+        scene->meshes[index].bounds = *bounds;
+    }
+    if (instanced) {
+        attach_instance_buffer(&scene->instances, vao);
+    }
+    return index;
+}
+
+// Adds the mesh to the shared pool, pool meshes can only be drawn by instanced programs
+int add_scene_pool_mesh(Scene* scene, const MeshData* data, const MeshBounds* bounds) {
+    int pool_mesh = add_pool_mesh(&scene->pool, data);
+    upload_mesh_pool(&scene->pool);
+    int index = add_scene_mesh(scene, scene->pool.vao, scene->pool.meshes[pool_mesh].index_count, 0, bounds);
+    scene->meshes[index].pool_mesh = pool_mesh;
+    return index;
+}
+
+int add_scene_material(Scene* scene, const GLuint* textures, float4 params) {
+    assert(scene->material_count < SCENE_MAX_MATERIALS);
+    int index = scene->material_count++;
+    Material* m = &scene->materials[index];
+    for (int i = 0; i < MATERIAL_TEXTURES; ++i) {
+        m->textures[i] = textures != NULL ? textures[i] : 0;
+    }
+    m->params = params;
+    return index;
+}
+
+void free_scene_cpu_data(Scene* scene) {
+    free(scene->objects);
+    free(scene->chunk_counts);
+    free(scene->occluder_candidates);
+    free_render_queue(&scene->queue);
+    free_cull_spheres(&scene->cull);
+    scene->objects = NULL;
+    scene->chunk_counts = NULL;
+    scene->occluder_candidates = NULL;
+    scene->occluder_capacity = 0;
+    scene->object_count = 0;
+    scene->object_capacity = 0;
+    scene->chunk_capacity = 0;
+}
+
+void reserve_scene_objects(Scene* scene, int capacity) {
+    if (capacity <= scene->object_capacity) {
+        return;
+    }
+    scene->object_capacity = capacity;
+    scene->objects = (RenderObject*) realloc(scene->objects, capacity * sizeof(RenderObject));
+}
+
+int add_scene_object(Scene* scene, int program, int mesh, int material, int pass) {
+    if (scene->object_count == scene->object_capacity) {
+        reserve_scene_objects(scene, scene->object_capacity * 2);
+    }
+    int index = scene->object_count++;
+    RenderObject* o = &scene->objects[index];
+    o->program = program;
+    o->mesh = mesh;
+    o->material = material;
+    o->pass = pass;
+    o->enabled = 1;
+    m_mat4_identity(o->model_matrix);
+    return index;
+}
+
+////////////////////////////////////////////////////
+// queue building and submission
+
+// Depth used for sorting is the distance of the object origin to the camera
+float object_sort_depth(const RenderObject* o, const FrameParams* params) {
+    float3 d;
+    d.x = o->model_matrix[12] - params->camera_position.x;
+    d.y = o->model_matrix[13] - params->camera_position.y;
+    d.z = o->model_matrix[14] - params->camera_position.z;
+    return M_LENGHT3(d) / params->far_plane;
+}
+
+// Chunk size for per object jobs, rounded so chunks start on a CULL_WIDTH boundary
+int scene_grain(Scene* scene, int count) {
+    return cull_round_up(job_grain(scene->jobs, count, SCENE_MIN_GRAIN));
+}
+
+int* scene_chunk_counts(Scene* scene, int count, int grain) {
+    int chunks = (count + grain - 1) / grain;
+    if (chunks > scene->chunk_capacity) {
+        scene->chunk_capacity = chunks;
+        scene->chunk_counts = (int*) realloc(scene->chunk_counts, chunks * sizeof(int));
+    }
+    return scene->chunk_counts;
+}
+
+typedef struct CullJob {
+    Scene* scene;
+    float4 planes[6];
+    std::atomic<int> visible;
+} CullJob;
+
+void cull_scene_job(void* data, int begin, int end) {
+    CullJob* job = (CullJob*) data;
+    Scene* scene = job->scene;
+    CullSpheres* spheres = &scene->cull;
+
+    for (int i = begin; i < end; ++i) {
+        const RenderObject* o = &scene->objects[i];
+        const Mesh* mesh = &scene->meshes[o->mesh];
+        set_cull_sphere(spheres, i, o->model_matrix, mesh->has_bounds ? &mesh->bounds : NULL);
+        if (!o->enabled) {
+            spheres->r[i] = -1.0f;
+        } else if (!scene->culling) {
+            spheres->r[i] = CULL_NEVER_RADIUS;
+        }
+    }
+
+    int visible = cull_spheres_range(job->planes, spheres, begin, end - begin);
+    job->visible.fetch_add(visible, std::memory_order_relaxed);
+}
+
+// Updates the world space sphere of every object and tests them against the view frustum.
+// Disabled objects get a negative radius so they come out as not visible.
+void cull_scene(Scene* scene, const FrameParams* params) {
+    resize_cull_spheres(&scene->cull, scene->object_count);
+
+    CullJob job;
+    job.scene = scene;
+    job.visible.store(0);
+
+    float view_projection[16];
+    m_mat4_mul(view_projection, params->projection_matrix, params->view_matrix);
+    extract_frustum_planes(job.planes, view_projection);
+
+    // resolved once here, the first call is not safe to race on
+    cull_best_path();
+
+    parallel_for(scene->jobs, scene->object_count, scene_grain(scene, scene->object_count), cull_scene_job, &job);
+
+    scene->cull_stats.tested = scene->object_count;
+    scene->cull_stats.visible = job.visible.load();
+    scene->cull_stats.culled = scene->object_count - scene->cull_stats.visible;
+}
+
+bool occluder_candidate_less(const OccluderCandidate& a, const OccluderCandidate& b) {
+    return a.depth < b.depth || (a.depth == b.depth && a.object < b.object);
+}
+
+typedef struct OcclusionCullJob {
+    Scene* scene;
+    std::atomic<int> tested;
+    std::atomic<int> occluded;
+} OcclusionCullJob;
+
+void occlusion_cull_job(void* data, int begin, int end) {
+    OcclusionCullJob* job = (OcclusionCullJob*) data;
+    Scene* scene = job->scene;
+    int tested = 0;
+    int occluded = 0;
+    for (int i = begin; i < end; ++i) {
+        const RenderObject* o = &scene->objects[i];
+        const Mesh* mesh = &scene->meshes[o->mesh];
+        if (!scene->cull.visible[i] || !mesh->has_bounds) {
+            continue;
+        }
+        tested++;
+        if (!occlusion_bounds_visible(&scene->occlusion_buffer, &mesh->bounds, o->model_matrix)) {
+            scene->cull.visible[i] = 0;
+            occluded++;
+        }
+    }
+    job->tested.fetch_add(tested, std::memory_order_relaxed);
+    job->occluded.fetch_add(occluded, std::memory_order_relaxed);
+}
+
+// Runs after cull_scene, clears the visible flag of objects hidden behind the nearest occluders.
+// Occluders are picked by distance with the object index breaking ties, the result is deterministic.
+void occlusion_cull_scene(Scene* scene, const FrameParams* params) {
+    OcclusionBuffer* ob = &scene->occlusion_buffer;
+    if (!scene->occlusion || ob->width == 0) {
+        memset(&ob->stats, 0, sizeof(OcclusionStats));
+        return;
+    }
+
+    if (scene->object_count > scene->occluder_capacity) {
+        scene->occluder_capacity = scene->object_count;
+        scene->occluder_candidates = (OccluderCandidate*) realloc(scene->occluder_candidates, scene->occluder_capacity * sizeof(OccluderCandidate));
+    }
+    OccluderCandidate* candidates = scene->occluder_candidates;
+    int candidate_count = 0;
+    for (int i = 0; i < scene->object_count; ++i) {
+        const RenderObject* o = &scene->objects[i];
+        if (scene->cull.visible[i] && scene->meshes[o->mesh].occluder != NULL) {
+            candidates[candidate_count].depth = object_sort_depth(o, params);
+            candidates[candidate_count].object = i;
+            candidate_count++;
+        }
+    }
+    int occluder_count = M_MIN(candidate_count, SCENE_MAX_OCCLUDERS);
+    if (candidate_count > occluder_count) {
+        std::nth_element(candidates, candidates + occluder_count, candidates + candidate_count, occluder_candidate_less);
+    }
+
+    float view_projection[16];
+    m_mat4_mul(view_projection, params->projection_matrix, params->view_matrix);
+    begin_occlusion_frame(ob, view_projection);
+    for (int i = 0; i < occluder_count; ++i) {
+        const RenderObject* o = &scene->objects[candidates[i].object];
+        add_occluder(ob, scene->meshes[o->mesh].occluder, o->model_matrix);
+    }
+    rasterize_occluders(ob, scene->jobs);
+
+    OcclusionCullJob job;
+    job.scene = scene;
+    job.tested.store(0);
+    job.occluded.store(0);
+    parallel_for(scene->jobs, scene->object_count, scene_grain(scene, scene->object_count), occlusion_cull_job, &job);
+
+    ob->stats.tested = job.tested.load();
+    ob->stats.occluded = job.occluded.load();
+    scene->cull_stats.visible -= ob->stats.occluded;
+    scene->cull_stats.culled += ob->stats.occluded;
+}
+
+// One command per batch of a pool mesh, in queue order. Only needs the sorted queue, so it runs on
+// whatever thread built it.
+void build_indirect_commands(Scene* scene) {
+    RenderQueue* q = &scene->queue;
+    reset_indirect_buffer(&scene->indirect);
+
+    int first_instance = 0;
+    int end = 0;
+    for (int start = 0; start < q->count; start = end) {
+        end = render_queue_batch_end(q, start);
+        uint64_t key = q->packets[start].key;
+        const ModelProgram* program = &scene->programs[sort_key_program(key)];
+        const Mesh* mesh = &scene->meshes[sort_key_mesh(key)];
+        if (mesh->pool_mesh >= 0) {
+            assert(program->instanced);
+            push_indirect_command(&scene->indirect, &scene->pool.meshes[mesh->pool_mesh], first_instance, end - start);
+        }
+        if (program->instanced) {
+            first_instance += end - start;
+        }
+    }
+}
+
+typedef struct QueueJob {
+    Scene* scene;
+    const FrameParams* params;
+    int grain;
+} QueueJob;
+
+// Writes the packets of the visible objects of the chunk at the start of the chunk's own range
+void build_render_queue_job(void* data, int begin, int end) {
+    QueueJob* job = (QueueJob*) data;
+    Scene* scene = job->scene;
+    DrawPacket* packets = &scene->queue.packets[begin];
+
+    int count = 0;
+    for (int i = begin; i < end; ++i) {
+        const RenderObject* o = &scene->objects[i];
+        if (!scene->cull.visible[i]) {
+            continue;
+        }
+        packets[count].key = make_sort_key(o->pass, o->program, o->material, o->mesh, object_sort_depth(o, job->params));
+        packets[count].object = i;
+        packets[count].pad = 0;
+        count++;
+    }
+    scene->chunk_counts[begin / job->grain] = count;
+}
+
+// Expects cull_scene, and occlusion_cull_scene if used, to have been run for this frame
+void build_render_queue(Scene* scene, const FrameParams* params) {
+    RenderQueue* q = &scene->queue;
+    reset_render_queue(q);
+    reserve_render_queue(q, scene->object_count);
+
+    QueueJob job;
+    job.scene = scene;
+    job.params = params;
+    job.grain = scene_grain(scene, scene->object_count);
+    int* chunk_counts = scene_chunk_counts(scene, scene->object_count, job.grain);
+
+    parallel_for(scene->jobs, scene->object_count, job.grain, build_render_queue_job, &job);
+
+    // close the gaps between chunks, they stay in object order so the queue is the same for any worker count
+    int chunks = (scene->object_count + job.grain - 1) / job.grain;
+    for (int c = 0; c < chunks; ++c) {
+        if (q->count != c * job.grain) {
+            memmove(&q->packets[q->count], &q->packets[c * job.grain], chunk_counts[c] * sizeof(DrawPacket));
+        }
+        q->count += chunk_counts[c];
+    }
+
+    sort_render_queue(q);
+    build_indirect_commands(scene);
+}
+
+void set_frame_uniforms(ModelProgram* p, const FrameParams* params) {
+    if (p->uniforms_frame == params->frame) {
+        return;
+    }
+    p->uniforms_frame = params->frame;
+    glUniform1f(p->loc_time, params->time);
+    glUniform3f(p->loc_camera_world, params->camera_position.x, params->camera_position.y, params->camera_position.z);
+    glUniform3f(p->loc_light, params->light.x, params->light.y, params->light.z);
+    glUniformMatrix4fv(p->loc_view_matrix, 1, GL_FALSE, params->view_matrix);
+    glUniformMatrix4fv(p->loc_projection_matrix, 1, GL_FALSE, params->projection_matrix);
+
+    const LightClusters* lc = params->clusters;
+    if (p->loc_cluster_dims >= 0 && lc != NULL) {
+        glUniform3i(p->loc_cluster_dims, LIGHT_CLUSTERS_X, LIGHT_CLUSTERS_Y, LIGHT_CLUSTERS_Z);
+        glUniform2f(p->loc_cluster_scale, (float) LIGHT_CLUSTERS_X / lc->width, (float) LIGHT_CLUSTERS_Y / lc->height);
+        glUniform2f(p->loc_cluster_depth, lc->depth_scale, lc->depth_bias);
+        // nothing else uses these units, binding once per frame is enough
+        bind_light_clusters(lc);
+    }
+
+    const IBL* ibl = params->ibl;
+    if (p->loc_sh >= 0 && ibl != NULL) {
+        glUniform3fv(p->loc_sh, IBL_SH_COEFFS, ibl->sh);
+        glUniform1f(p->loc_prefiltered_mips, (float)(ibl->texture_mips - 1));
+        bind_ibl(ibl);
+    }
+}
+
+void bind_material(const Material* m) {
+    for (int i = 0; i < MATERIAL_TEXTURES; ++i) {
+        if (m->textures[i] != 0) {
+            gp_gl_bind_texture(i, GL_TEXTURE_2D, m->textures[i]);
+        }
+    }
+}
+
+typedef struct InstanceJob {
+    Scene* scene;
+    int grain;
+} InstanceJob;
+
+void count_instances_job(void* data, int begin, int end) {
+    InstanceJob* job = (InstanceJob*) data;
+    Scene* scene = job->scene;
+    int count = 0;
+    for (int i = begin; i < end; ++i) {
+        const RenderObject* o = &scene->objects[scene->queue.packets[i].object];
+        count += scene->programs[o->program].instanced;
+    }
+    scene->chunk_counts[begin / job->grain] = count;
+}
+
+// chunk_counts holds the first instance of every chunk at this point
+void fill_instances_job(void* data, int begin, int end) {
+    InstanceJob* job = (InstanceJob*) data;
+    Scene* scene = job->scene;
+    int index = scene->chunk_counts[begin / job->grain];
+    for (int i = begin; i < end; ++i) {
+        const RenderObject* o = &scene->objects[scene->queue.packets[i].object];
+        if (scene->programs[o->program].instanced) {
+            set_instance(&scene->instances, index++, o->model_matrix, scene->materials[o->material].params);
+        }
+    }
+}
+
+// Instance data goes in sorted order, so every batch is a contiguous range of the buffer
+void fill_instance_buffer(Scene* scene) {
+    RenderQueue* q = &scene->queue;
+    InstanceBuffer* ib = &scene->instances;
+    resize_instance_buffer(ib, q->count);
+
+    InstanceJob job;
+    job.scene = scene;
+    job.grain = job_grain(scene->jobs, q->count, SCENE_MIN_GRAIN);
+    int* chunk_counts = scene_chunk_counts(scene, q->count, job.grain);
+
+    parallel_for(scene->jobs, q->count, job.grain, count_instances_job, &job);
+
+    int chunks = (q->count + job.grain - 1) / job.grain;
+    int first = 0;
+    for (int c = 0; c < chunks; ++c) {
+        int count = chunk_counts[c];
+        chunk_counts[c] = first;
+        first += count;
+    }
+    ib->count = first;
+
+    parallel_for(scene->jobs, q->count, job.grain, fill_instances_job, &job);
+}
+
+void set_depth_mode(Scene* scene, int mode) {
+    if (scene->depth_mode == mode) {
+        return;
+    }
+    scene->depth_mode = mode;
+    if (mode == DEPTH_MODE_EQUAL) {
+        glDepthFunc(GL_EQUAL);
+        glDepthMask(GL_FALSE);
+    } else {
+        glDepthFunc(GL_LESS);
+        glDepthMask(GL_TRUE);
+    }
+}
+
+// Opaque batches of programs with a depth program get their depth laid down by the pre-pass
+int batch_has_depth_prepass(Scene* scene, uint64_t key) {
+    return scene->depth_prepass
+        && sort_key_pass(key) == PASS_OPAQUE
+        && scene->programs[sort_key_program(key)].depth_program >= 0;
+}
+
+// Uniforms of a non instanced draw that depend on its model matrix. They are computed once per draw here
+// instead of inverting the model and view matrices for every vertex in the shader.
+void set_object_uniforms(ModelProgram* p, const FrameParams* params, const float* model_matrix) {
+    glUniformMatrix4fv(p->loc_model_matrix, 1, GL_FALSE, model_matrix);
+    if (p->loc_camera_object < 0 && p->loc_light_object < 0 && p->loc_normal_matrix < 0) {
+        return;
+    }
+
+    float inverse[16];
+    m_mat4_inverse(inverse, model_matrix);
+    float3 camera_object;
+    float3 light_object;
+    m_mat4_transform3(&camera_object, inverse, &params->camera_position);
+    m_mat4_transform3(&light_object, inverse, &params->light);
+    glUniform3f(p->loc_camera_object, camera_object.x, camera_object.y, camera_object.z);
+    glUniform3f(p->loc_light_object, light_object.x, light_object.y, light_object.z);
+
+    if (p->loc_normal_matrix >= 0) {
+        // upper 3x3 of the inverse transpose, columns stay columns
+        float normal_matrix[9];
+        for (int c = 0; c < 3; ++c) {
+            for (int r = 0; r < 3; ++r) {
+                normal_matrix[c * 3 + r] = inverse[r * 4 + c];
+            }
+        }
+        glUniformMatrix3fv(p->loc_normal_matrix, 1, GL_FALSE, normal_matrix);
+    }
+}
+
+// Draws packets [start, end) of the queue, all with the same mesh, with the program already in use
+int draw_batch(Scene* scene, const FrameParams* params, ModelProgram* program, Mesh* mesh, int start, int end, int first_instance) {
+    if (program->instanced) {
+        draw_instanced_range(&scene->instances, mesh->vao, mesh->point_count, first_instance, end - start);
+        return 1;
+    }
+    gp_gl_bind_vertex_array(mesh->vao);
+    for (int i = start; i < end; ++i) {
+        const RenderObject* o = &scene->objects[scene->queue.packets[i].object];
+        set_object_uniforms(program, params, o->model_matrix);
+        glDrawArrays(GL_TRIANGLES, 0, mesh->point_count);
+    }
+    return end - start;
+}
+
+int key_uses_pool(Scene* scene, uint64_t key) {
+    return scene->meshes[sort_key_mesh(key)].pool_mesh >= 0;
+}
+
+int batch_is_deferred(Scene* scene, uint64_t key) {
+    return scene->deferred && scene->programs[sort_key_program(key)].gbuffer_program >= 0;
+}
+
+// Program that draws the batch in the given pass, NULL if the batch is not part of it
+ModelProgram* pass_program(Scene* scene, uint64_t key, int pass) {
+    ModelProgram* program = &scene->programs[sort_key_program(key)];
+    switch (pass) {
+        case QUEUE_PASS_DEPTH:
+            return batch_has_depth_prepass(scene, key) ? &scene->programs[program->depth_program] : NULL;
+        case QUEUE_PASS_GBUFFER:
+            return batch_is_deferred(scene, key) ? &scene->programs[program->gbuffer_program] : NULL;
+        default:
+            return batch_is_deferred(scene, key) ? NULL : program;
+    }
+}
+
+// Walks the sorted queue once for one QueuePass. Batches of pool meshes are drawn from the indirect
+// commands, with multi_draw set the batches of every pool mesh that share pass, program and material
+// go in a single call. Returns the number of draw calls.
+int draw_queue_pass(Scene* scene, const FrameParams* params, int pass) {
+    RenderQueue* q = &scene->queue;
+    int draw_calls = 0;
+    int first_instance = 0;
+    int command = 0;
+    int end = 0;
+    for (int start = 0; start < q->count; start = end) {
+        end = render_queue_batch_end(q, start);
+
+        uint64_t key = q->packets[start].key;
+        ModelProgram* program = &scene->programs[sort_key_program(key)];
+        Mesh* mesh = &scene->meshes[sort_key_mesh(key)];
+        int pooled = key_uses_pool(scene, key);
+        int commands = pooled;
+        if (pooled && scene->multi_draw) {
+            uint64_t group = key & RQ_GROUP_MASK;
+            while (end < q->count && (q->packets[end].key & RQ_GROUP_MASK) == group && key_uses_pool(scene, q->packets[end].key)) {
+                end = render_queue_batch_end(q, end);
+                commands++;
+            }
+        }
+        // instance ranges and commands follow the shading programs in every pass
+        int instances = program->instanced ? end - start : 0;
+
+        ModelProgram* draw_program = pass_program(scene, key, pass);
+        if (draw_program == NULL) {
+            first_instance += instances;
+            command += commands;
+            continue;
+        }
+        assert(draw_program->instanced == program->instanced);
+        if (pass != QUEUE_PASS_DEPTH) {
+            set_depth_mode(scene, batch_has_depth_prepass(scene, key) ? DEPTH_MODE_EQUAL : DEPTH_MODE_WRITE);
+        }
+
+        gp_gl_use_program(draw_program->program);
+        set_frame_uniforms(draw_program, params);
+        if (pass != QUEUE_PASS_DEPTH) {
+            bind_material(&scene->materials[sort_key_material(key)]);
+        }
+
+        if (pooled) {
+            draw_calls += draw_indirect_commands(&scene->indirect, command, commands, &scene->instances, mesh->vao, scene->multi_draw);
+        } else {
+            draw_calls += draw_batch(scene, params, draw_program, mesh, start, end, first_instance);
+        }
+        first_instance += instances;
+        command += commands;
+    }
+    return draw_calls;
+}
+
+void execute_depth_prepass(Scene* scene, const FrameParams* params) {
+    begin_fragment_counter(&scene->depth_counter);
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    set_depth_mode(scene, DEPTH_MODE_WRITE);
+
+    scene->stats.depth_draw_calls = draw_queue_pass(scene, params, QUEUE_PASS_DEPTH);
+
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    end_fragment_counter(&scene->depth_counter);
+    scene->stats.depth_samples = scene->depth_counter.samples;
+}
+
+void execute_lighting_pass(Scene* scene, const FrameParams* params) {
+    ModelProgram* program = &scene->programs[scene->lighting_program];
+    gp_gl_use_program(program->program);
+    set_frame_uniforms(program, params);
+    draw_gbuffer_lighting(&scene->gbuffer);
+}
+
+void execute_render_queue(Scene* scene, const FrameParams* params) {
+    RenderQueue* q = &scene->queue;
+    InstanceBuffer* ib = &scene->instances;
+
+    scene->stats.packets = q->count;
+    scene->stats.draw_calls = 0;
+    scene->stats.depth_draw_calls = 0;
+    scene->stats.depth_samples = 0;
+    // glDepthFunc and glDepthMask may have been changed outside the scene since last frame
+    scene->depth_mode = DEPTH_MODE_UNKNOWN;
+
+    fill_instance_buffer(scene);
+    if (ib->count > 0) {
+        upload_instance_buffer(ib);
+    }
+    if (scene->multi_draw) {
+        upload_indirect_buffer(&scene->indirect);
+    }
+
+    // falls back to forward without a G-buffer or a lighting program.
+    // The pre-pass goes to the G-buffer depth when deferred, the G-buffer pass then tests against it.
+    scene->deferred = scene->deferred && scene->gbuffer.fbo != 0 && scene->lighting_program >= 0;
+    int deferred = scene->deferred;
+    if (deferred) {
+        set_depth_mode(scene, DEPTH_MODE_WRITE);
+        begin_gbuffer_pass(&scene->gbuffer);
+    }
+
+    if (scene->depth_prepass) {
+        execute_depth_prepass(scene, params);
+    }
+
+    begin_fragment_counter(&scene->shading_counter);
+    if (deferred) {
+        scene->stats.draw_calls += draw_queue_pass(scene, params, QUEUE_PASS_GBUFFER);
+        end_gbuffer_pass();
+        execute_lighting_pass(scene, params);
+        blit_gbuffer_depth(&scene->gbuffer);
+    }
+    scene->stats.draw_calls += draw_queue_pass(scene, params, QUEUE_PASS_FORWARD);
+    end_fragment_counter(&scene->shading_counter);
+
+    scene->stats.shaded_samples = scene->shading_counter.samples;
+    set_depth_mode(scene, DEPTH_MODE_WRITE);
+}
+
+////////////////////////////////////////////////////
+// stress scene
+
+// Makes the scene have count stress objects after the first first_object ones, cycling through meshes and materials
+void resize_stress_objects(Scene* scene, int first_object, int count, int program, int first_mesh, int mesh_count, int first_material, int material_count) {
+    reserve_scene_objects(scene, first_object + count);
+    scene->object_count = first_object;
+    for (int i = 0; i < count; ++i) {
+        add_scene_object(scene, program, first_mesh + (i / material_count) % mesh_count, first_material + i % material_count, PASS_OPAQUE);
+    }
+}
+
+typedef struct StressJob {
+    Scene* scene;
+    int first_object;
+    int side;
+    float time;
+} StressJob;
+
+void update_stress_job(void* data, int begin, int end) {
+    StressJob* job = (StressJob*) data;
+    int side = job->side;
+    float spacing = 0.35;
+    float half = (side - 1) * spacing * 0.5f;
+    float3 scale = {0.1, 0.1, 0.1};
+    float3 translation;
+
+    float scale_matrix[] = M_MAT4_IDENTITY();
+    float rotation_matrix[] = M_MAT4_IDENTITY();
+    m_mat4_scale(scale_matrix, &scale);
+
+    for (int i = begin; i < end; ++i) {
+        RenderObject* o = &job->scene->objects[job->first_object + i];
+        int x = i % side;
+        int y = (i / side) % side;
+        int z = i / (side * side);
+
+        m_mat4_rotation_axis(rotation_matrix, &Y_AXIS, job->time * (1.0f + (i % 7) * 0.25f));
+        m_mat4_mul(o->model_matrix, rotation_matrix, scale_matrix);
+        set_float3(&translation, x * spacing - half, y * spacing - half + 0.5f, z * spacing - half);
+        m_mat4_translation(o->model_matrix, &translation);
+    }
+}
+
+// Cube shaped grid of objects that spin around Y at different speeds
+void update_stress_objects(Scene* scene, int first_object, float time) {
+    int count = scene->object_count - first_object;
+    if (count <= 0) {
+        return;
+    }
+
+    StressJob job;
+    job.scene = scene;
+    job.first_object = first_object;
+    job.side = (int) ceilf(cbrtf((float) count));
+    job.time = time;
+    parallel_for(scene->jobs, count, job_grain(scene->jobs, count, SCENE_MIN_GRAIN), update_stress_job, &job);
+}
+
+////////////////////////////////////////////////////
+// benchmark
+
+// Scene with count stress objects and no GL objects, enough for everything before execute_render_queue
+void init_benchmark_scene(Scene* scene, int count) {
+    memset(scene, 0, sizeof(Scene));
+    scene->culling = 1;
+    scene->object_capacity = count;
+    scene->objects = (RenderObject*) malloc(count * sizeof(RenderObject));
+    create_render_queue(&scene->queue, count);
+
+    scene->program_count = 1;
+    scene->programs[0].instanced = 1;
+
+    MeshBounds bounds;
+    set_float3(&bounds.min, -1.0, -1.0, -1.0);
+    set_float3(&bounds.max, 1.0, 1.0, 1.0);
+    set_float3(&bounds.center, 0.0, 0.0, 0.0);
+    bounds.radius = sqrtf(3.0f);
+    int mesh = add_scene_mesh(scene, 0, 36, 0, &bounds);
+
+    for (int i = 0; i < 4; ++i) {
+        float4 tint = {1.0f - i * 0.2f, 1.0f, 1.0f, 1.0f};
+        add_scene_material(scene, NULL, tint);
+    }
+
+    // capacity is set by hand so resize_instance_buffer never has to touch GL
+    scene->instances.capacity = count;
+    scene->instances.data = (float*) malloc(count * INSTANCE_FLOATS * sizeof(float));
+
+    resize_stress_objects(scene, 0, count, 0, mesh, 1, 0, 4);
+}
+
+// Runs the CPU side of a frame (stress update, culling, queue building, instance data) over a
+// large stress scene with 1 to max_workers workers. The resulting queue is checked to be the same
+// for every worker count.
+void gp_scene_benchmark(int max_workers) {
+    int count = 1000000;
+    int frames = 20;
+    if (max_workers <= 0) {
+        max_workers = (int) std::thread::hardware_concurrency();
+    }
+    max_workers = M_CLAMP(max_workers, 1, JOBS_MAX_WORKERS);
+
+    Scene scene;
+    init_benchmark_scene(&scene, count);
+
+    float view_matrix[] = M_MAT4_IDENTITY();
+    float projection_matrix[] = M_MAT4_IDENTITY();
+    float3 position = {0.0, 0.5, 40.0};
+    float3 direction = {0.0, 0.0, -1.0};
+    float3 up = {0.0, 1.0, 0.0};
+    m_mat4_lookat(view_matrix, &position, &direction, &up);
+    m_mat4_perspective(projection_matrix, 0.6, 16.0 / 9.0, 0.1, 100.0);
+
+    FrameParams params;
+    memset(&params, 0, sizeof(FrameParams));
+    params.far_plane = 100.0;
+    params.camera_position = position;
+    params.view_matrix = view_matrix;
+    params.projection_matrix = projection_matrix;
+
+    printf("scene benchmark: %d objects, %d frames, up to %d workers\n", count, frames, max_workers);
+    double single_ms = 0.0;
+    uint64_t reference = 0;
+    for (int workers = 1; workers <= max_workers; ++workers) {
+        scene.jobs = create_job_system(workers);
+        float stage_ms[4] = {0.0, 0.0, 0.0, 0.0};
+        g_timer timer;
+
+        for (int f = 0; f < frames; ++f) {
+            params.frame = f;
+            params.time = f / 50.0f;
+
+            start_timer(&timer);
+            update_stress_objects(&scene, 0, params.time);
+            stop_timer(&timer);
+            stage_ms[0] += compute_timer_millis_diff(&timer);
+
+            start_timer(&timer);
+            cull_scene(&scene, &params);
+            stop_timer(&timer);
+            stage_ms[1] += compute_timer_millis_diff(&timer);
+
+            start_timer(&timer);
+            build_render_queue(&scene, &params);
+            stop_timer(&timer);
+            stage_ms[2] += compute_timer_millis_diff(&timer);
+
+            start_timer(&timer);
+            fill_instance_buffer(&scene);
+            stop_timer(&timer);
+            stage_ms[3] += compute_timer_millis_diff(&timer);
+        }
+
+        uint64_t hash = 1469598103934665603ull;
+        for (int i = 0; i < scene.queue.count; ++i) {
+            hash = (hash ^ scene.queue.packets[i].key) * 1099511628211ull;
+            hash = (hash ^ (uint64_t) scene.queue.packets[i].object) * 1099511628211ull;
+        }
+        if (workers == 1) {
+            reference = hash;
+        }
+
+        float total_ms = 0.0;
+        for (int i = 0; i < 4; ++i) {
+            stage_ms[i] /= frames;
+            total_ms += stage_ms[i];
+        }
+        if (workers == 1) {
+            single_ms = total_ms;
+        }
+        printf("  %2d workers  update %7.3f  cull %7.3f  queue %7.3f  instances %7.3f  total %8.3f ms  x%.2f  visible %d%s\n",
+               workers, stage_ms[0], stage_ms[1], stage_ms[2], stage_ms[3], total_ms, single_ms / total_ms,
+               scene.cull_stats.visible, hash == reference ? "" : "  MISMATCH");
+
+        destroy_job_system(scene.jobs);
+        scene.jobs = NULL;
+    }
+
+    free(scene.instances.data);
+    free_scene_cpu_data(&scene);
+}
+
+#endif
@@ -0,0 +1,251 @@
+#ifndef GP_SHADER_COMPILER_H
+#define GP_SHADER_COMPILER_H
+
+//
+// Programs compiled without waiting for them, for hot reload
+// With GL_KHR_parallel_shader_compile (or the ARB one) start_async_program only issues the compile and
+// link, the driver does the work on its own threads and poll_async_program asks GL_COMPLETION_STATUS_KHR,
+// which never blocks. Without it the work goes to a thread with a context that shares objects with the
+// drawing one. Without that either, start_async_program compiles right away as before.
+//
+// The extension isn't part of the glad loader, the entry point is looked up through the get_proc passed
+// to init_shader_compiler.
+//
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+
+typedef void (APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
+
+typedef enum AsyncProgramState {
+    ASYNC_PROGRAM_QUEUED,  // waiting for the worker
+    ASYNC_PROGRAM_LINKING, // issued to a driver with parallel compile
+    ASYNC_PROGRAM_DONE,
+} AsyncProgramState;
+
+typedef struct AsyncProgram {
+    char* vertex_source;
+    char* fragment_source;
+    const char* attribs[4];
+
+    GLuint program; // 0 once done if it didn't compile or link
+    GLuint shaders[2];
+    std::atomic<int> state;
+    struct AsyncProgram* next; // worker queue
+} AsyncProgram;
+
+typedef struct ShaderCompiler {
+    int parallel; // driver side parallel compile
+    void (*make_current)(void* context);
+    void* context;
+
+    std::thread worker;
+    std::mutex lock;
+    std::condition_variable wake;
+    AsyncProgram* first;
+    AsyncProgram* last;
+    int running;
+} ShaderCompiler;
+
+ShaderCompiler shader_compiler;
+
+int has_gl_extension(const char* name) {
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (int i = 0; i < count; ++i) {
+        const char* extension = (const char*) glGetStringi(GL_EXTENSIONS, i);
+        if (extension != NULL && strcmp(extension, name) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// get_proc loads GL entry points for the current context (glfwGetProcAddress). make_current and context
+// are for the worker, it takes the context on the first compile it gets, so nothing else may be using it
+// by then (prewarm_shader_variants, wait_shader_prewarm). NULL to have no worker.
+void init_shader_compiler(ShaderCompiler* sc, void* (*get_proc)(const char* name), void (*make_current)(void*), void* context) {
+    sc->parallel = 0;
+    sc->make_current = make_current;
+    sc->context = context;
+    sc->first = NULL;
+    sc->last = NULL;
+    sc->running = 0;
+
+    PFNGLMAXSHADERCOMPILERTHREADSKHRPROC max_threads = NULL;
+    if (has_gl_extension("GL_KHR_parallel_shader_compile")) {
+        max_threads = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC) get_proc("glMaxShaderCompilerThreadsKHR");
+    } else if (has_gl_extension("GL_ARB_parallel_shader_compile")) {
+        max_threads = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC) get_proc("glMaxShaderCompilerThreadsARB");
+    }
+    if (max_threads != NULL) {
+        // as many threads as the driver likes
+        max_threads(0xFFFFFFFFu);
+        sc->parallel = 1;
+    }
+    printf("shader compiler: %s\n", sc->parallel ? "parallel compile extension" : context != NULL ? "worker context" : "blocking");
+}
+
+// Status, logs and cleanup of a program whose compile and link are over
+void finish_async_program(AsyncProgram* ap) {
+    GLint linked = GL_FALSE;
+    glGetProgramiv(ap->program, GL_LINK_STATUS, &linked);
+    if (!linked) {
+        char log[1024];
+        for (int i = 0; i < 2; ++i) {
+            GLint compiled = GL_FALSE;
+            glGetShaderiv(ap->shaders[i], GL_COMPILE_STATUS, &compiled);
+            if (!compiled) {
+                glGetShaderInfoLog(ap->shaders[i], sizeof(log), NULL, log);
+                printf("Compilation error in shader %s\n", log);
+            }
+        }
+        glGetProgramInfoLog(ap->program, sizeof(log), NULL, log);
+        printf("Link error in program %s\n", log);
+        // not through gp_gl_delete_program, this can run on the compiler thread and the program was never bound
+        glDeleteProgram(ap->program);
+        ap->program = 0;
+    }
+    glDeleteShader(ap->shaders[0]);
+    glDeleteShader(ap->shaders[1]);
+    ap->shaders[0] = 0;
+    ap->shaders[1] = 0;
+}
+
+// Issues the compile and the link, nothing here asks for a status
+void issue_async_program(AsyncProgram* ap) {
+    GLenum types[2] = {GL_VERTEX_SHADER, GL_FRAGMENT_SHADER};
+    const char* sources[2] = {ap->vertex_source, ap->fragment_source};
+    ap->program = glCreateProgram();
+    for (int i = 0; i < 2; ++i) {
+        ap->shaders[i] = glCreateShader(types[i]);
+        glShaderSource(ap->shaders[i], 1, &sources[i], NULL);
+        glCompileShader(ap->shaders[i]);
+        glAttachShader(ap->program, ap->shaders[i]);
+    }
+    for (int i = 0; i < 4; ++i) {
+        if (ap->attribs[i] != NULL) {
+            glBindAttribLocation(ap->program, i, ap->attribs[i]);
+        }
+    }
+    glLinkProgram(ap->program);
+}
+
+void shader_compiler_main(ShaderCompiler* sc) {
+    sc->make_current(sc->context);
+    std::unique_lock<std::mutex> guard(sc->lock);
+    while (sc->running) {
+        if (sc->first == NULL) {
+            sc->wake.wait(guard);
+            continue;
+        }
+        AsyncProgram* ap = sc->first;
+        sc->first = ap->next;
+        if (sc->first == NULL) {
+            sc->last = NULL;
+        }
+        guard.unlock();
+
+        issue_async_program(ap);
+        finish_async_program(ap);
+        // the program is only complete for the other context once this one has finished with it
+        glFinish();
+        ap->state.store(ASYNC_PROGRAM_DONE, std::memory_order_release);
+
+        guard.lock();
+    }
+    guard.unlock();
+    sc->make_current(NULL);
+}
+
+// Takes ownership of both sources. The attribute names have to outlive the compile.
+AsyncProgram* start_async_program(ShaderCompiler* sc, char* vertex_source, char* fragment_source, const char* attrib_name_0,
+                                  const char* attrib_name_1, const char* attrib_name_2, const char* attrib_name_3) {
+    AsyncProgram* ap = (AsyncProgram*) calloc(1, sizeof(AsyncProgram));
+    ap->vertex_source = vertex_source;
+    ap->fragment_source = fragment_source;
+    ap->attribs[0] = attrib_name_0;
+    ap->attribs[1] = attrib_name_1;
+    ap->attribs[2] = attrib_name_2;
+    ap->attribs[3] = attrib_name_3;
+    ap->state.store(ASYNC_PROGRAM_QUEUED);
+
+    if (vertex_source == NULL || fragment_source == NULL) {
+        ap->state.store(ASYNC_PROGRAM_DONE);
+        return ap;
+    }
+    if (sc->parallel) {
+        issue_async_program(ap);
+        ap->state.store(ASYNC_PROGRAM_LINKING);
+        return ap;
+    }
+    if (sc->context == NULL) {
+        issue_async_program(ap);
+        finish_async_program(ap);
+        ap->state.store(ASYNC_PROGRAM_DONE);
+        return ap;
+    }
+
+    std::lock_guard<std::mutex> guard(sc->lock);
+    if (!sc->running) {
+        sc->running = 1;
+        sc->worker = std::thread(shader_compiler_main, sc);
+    }
+    if (sc->last != NULL) {
+        sc->last->next = ap;
+    } else {
+        sc->first = ap;
+    }
+    sc->last = ap;
+    sc->wake.notify_one();
+    return ap;
+}
+
+// 1 once the program is done, ap->program is then 0 if it failed. Never waits for the compile.
+int poll_async_program(AsyncProgram* ap) {
+    int state = ap->state.load(std::memory_order_acquire);
+    if (state == ASYNC_PROGRAM_LINKING) {
+        GLint completed = GL_FALSE;
+        glGetProgramiv(ap->program, GL_COMPLETION_STATUS_KHR, &completed);
+        if (!completed) {
+            return 0;
+        }
+        finish_async_program(ap);
+        ap->state.store(ASYNC_PROGRAM_DONE);
+        return 1;
+    }
+    return state == ASYNC_PROGRAM_DONE;
+}
+
+// The program of one that is done belongs to the caller, one still compiling is dropped. Not for
+// programs the worker may be compiling, stop it first.
+void free_async_program(AsyncProgram* ap) {
+    if (ap->state.load() != ASYNC_PROGRAM_DONE && ap->program != 0) {
+        glDeleteShader(ap->shaders[0]);
+        glDeleteShader(ap->shaders[1]);
+        gp_gl_delete_program(ap->program);
+    }
+    free(ap->vertex_source);
+    free(ap->fragment_source);
+    free(ap);
+}
+
+// Queued programs stay queued, free them afterwards
+void stop_shader_compiler(ShaderCompiler* sc) {
+    {
+        std::lock_guard<std::mutex> guard(sc->lock);
+        if (!sc->running) {
+            return;
+        }
+        sc->running = 0;
+    }
+    sc->wake.notify_one();
+    sc->worker.join();
+}
+
+#endif
@@ -0,0 +1,229 @@
+#ifndef GP_SHADER_SOURCE_H
+#define GP_SHADER_SOURCE_H
+
+//
+// Shader sources with #include
+// shader_source returns a file with every #include "name" replaced by that file, looked up next to the
+// one including it. A file goes in at most once per source, like with #pragma once. This runs before the
+// GLSL preprocessor, an #ifdef around an #include doesn't keep the file out.
+// #line directives keep compile errors on the right line, their second number is the index of the file
+// in ShaderSources.files.
+//
+// Files are read once and kept. shader_source_changed reads one again when the file watcher saw it and
+// only reports a change if the content hash differs, the programs to recompile are the ones whose
+// shader_source_files contain it. An expanded source is kept with the hash of every file that went into
+// it and only expanded again when one of them changed.
+//
+
+#define SHADER_SOURCE_FILES 64 // one bit each in the masks
+#define SHADER_SOURCE_PATH 256
+#define SHADER_SOURCE_DEPTH 16 // nested includes
+
+typedef struct ShaderFile {
+    char path[SHADER_SOURCE_PATH];
+    char* text; // NULL if it couldn't be read
+    uint64_t hash;
+} ShaderFile;
+
+typedef struct ShaderExpansion {
+    char* text;
+    uint64_t files; // every file that went in, the root too
+    uint64_t hash;  // of their contents at the time
+} ShaderExpansion;
+
+typedef struct ShaderSources {
+    ShaderFile files[SHADER_SOURCE_FILES];
+    ShaderExpansion expansions[SHADER_SOURCE_FILES]; // by root file
+    int file_count;
+    int expanded;
+    int reused;
+} ShaderSources;
+
+ShaderSources shader_sources;
+
+typedef struct ShaderText {
+    char* data;
+    size_t length;
+    size_t capacity;
+} ShaderText;
+
+void append_shader_text(ShaderText* t, const char* s, size_t length) {
+    if (t->length + length + 1 > t->capacity) {
+        t->capacity = M_MAX(t->capacity * 2, t->length + length + 1);
+        t->data = (char*) realloc(t->data, t->capacity);
+    }
+    memcpy(t->data + t->length, s, length);
+    t->length += length;
+    t->data[t->length] = '\0';
+}
+
+uint64_t shader_files_hash(const ShaderSources* ss, uint64_t files) {
+    uint64_t hash = 1469598103934665603ull;
+    for (int i = 0; i < ss->file_count; ++i) {
+        if (files & (1ull << i)) {
+            hash = (hash ^ ss->files[i].hash) * 1099511628211ull;
+        }
+    }
+    return hash;
+}
+
+// Index of the file, read the first time it is asked for. -1 if the table is full.
+int shader_file(ShaderSources* ss, const char* path) {
+    for (int i = 0; i < ss->file_count; ++i) {
+        if (strcmp(ss->files[i].path, path) == 0) {
+            return i;
+        }
+    }
+    if (ss->file_count == SHADER_SOURCE_FILES) {
+        printf("shader sources: more than %d files, %s not loaded\n", SHADER_SOURCE_FILES, path);
+        return -1;
+    }
+    ShaderFile* f = &ss->files[ss->file_count];
+    snprintf(f->path, SHADER_SOURCE_PATH, "%s", path);
+    f->text = gp_read_entire_file_alloc(path);
+    f->hash = program_cache_hash(1469598103934665603ull, f->text);
+    return ss->file_count++;
+}
+
+int expand_shader_file(ShaderSources* ss, int index, ShaderText* out, uint64_t* included, int depth) {
+    const ShaderFile* f = &ss->files[index];
+    *included |= 1ull << index;
+    if (f->text == NULL) {
+        return 0;
+    }
+    if (depth > SHADER_SOURCE_DEPTH) {
+        printf("shader sources: includes nested too deep in %s\n", f->path);
+        return 0;
+    }
+
+    // includes are relative to the folder of this file
+    const char* slash = strrchr(f->path, '/');
+    int folder_length = slash != NULL ? (int)(slash - f->path) + 1 : 0;
+
+    int line = 1;
+    for (const char* p = f->text; *p != '\0'; ++line) {
+        const char* end = strchr(p, '\n');
+        size_t length = end != NULL ? (size_t)(end - p) + 1 : strlen(p);
+
+        const char* q = p;
+        while (*q == ' ' || *q == '\t') {
+            ++q;
+        }
+        if (strncmp(q, "#include", 8) != 0) {
+            append_shader_text(out, p, length);
+            p += length;
+            continue;
+        }
+
+        const char* name = strchr(q, '"');
+        const char* name_end = name != NULL ? strchr(name + 1, '"') : NULL;
+        if (name_end == NULL || (end != NULL && name_end > end)) {
+            printf("shader sources: %s(%d): expected #include \"file\"\n", f->path, line);
+            return 0;
+        }
+        char path[SHADER_SOURCE_PATH];
+        snprintf(path, SHADER_SOURCE_PATH, "%.*s%.*s", folder_length, f->path, (int)(name_end - name - 1), name + 1);
+        int child = shader_file(ss, path);
+        if (child < 0) {
+            return 0;
+        }
+        if (!(*included & (1ull << child))) {
+            char directive[64];
+            snprintf(directive, sizeof(directive), "#line 1 %d\n", child);
+            append_shader_text(out, directive, strlen(directive));
+            if (!expand_shader_file(ss, child, out, included, depth + 1)) {
+                printf("shader sources: %s(%d): can't include %s\n", f->path, line, path);
+                return 0;
+            }
+            // #line sets the number of the line after it
+            snprintf(directive, sizeof(directive), "\n#line %d %d\n", line + 1, index);
+            append_shader_text(out, directive, strlen(directive));
+        }
+        p += length;
+    }
+    return 1;
+}
+
+// The file at path with its includes expanded, owned by ss and valid until the next shader_source of
+// the same path. NULL if it or one of its includes can't be read.
+const char* shader_source(ShaderSources* ss, const char* path) {
+    int root = shader_file(ss, path);
+    if (root < 0) {
+        return NULL;
+    }
+    ShaderExpansion* e = &ss->expansions[root];
+    if (e->text != NULL && e->hash == shader_files_hash(ss, e->files)) {
+        ss->reused++;
+        return e->text;
+    }
+
+    ShaderText out = {NULL, 0, 0};
+    uint64_t files = 0;
+    int expanded = expand_shader_file(ss, root, &out, &files, 0);
+    free(e->text);
+    e->text = expanded ? out.data : NULL;
+    e->files = files;
+    e->hash = shader_files_hash(ss, files);
+    if (!expanded) {
+        free(out.data);
+    }
+    ss->expanded++;
+    return e->text;
+}
+
+// Copy of shader_source for whoever keeps it, free it when done
+char* shader_source_copy(ShaderSources* ss, const char* path) {
+    const char* source = shader_source(ss, path);
+    return source != NULL ? strdup(source) : NULL;
+}
+
+// Mask of the files that went into the last shader_source of path, 0 if there was none
+uint64_t shader_source_files(const ShaderSources* ss, const char* path) {
+    for (int i = 0; i < ss->file_count; ++i) {
+        if (strcmp(ss->files[i].path, path) == 0) {
+            return ss->expansions[i].files;
+        }
+    }
+    return 0;
+}
+
+// The watcher can report absolute paths, "/home/x/shaders/a.glsl" is the known "shaders/a.glsl"
+int shader_path_matches(const char* known, const char* changed) {
+    size_t known_length = strlen(known);
+    size_t changed_length = strlen(changed);
+    if (changed_length < known_length || strcmp(changed + changed_length - known_length, known) != 0) {
+        return 0;
+    }
+    return changed_length == known_length || changed[changed_length - known_length - 1] == '/';
+}
+
+// Reads the file again, returns its bit if the content is different, 0 if it is the same or unknown
+uint64_t shader_source_changed(ShaderSources* ss, const char* path) {
+    for (int i = 0; i < ss->file_count; ++i) {
+        ShaderFile* f = &ss->files[i];
+        if (!shader_path_matches(f->path, path)) {
+            continue;
+        }
+        char* text = gp_read_entire_file_alloc(f->path);
+        uint64_t hash = program_cache_hash(1469598103934665603ull, text);
+        if (hash == f->hash && (text == NULL) == (f->text == NULL)) {
+            free(text);
+            return 0;
+        }
+        free(f->text);
+        f->text = text;
+        f->hash = hash;
+        return 1ull << i;
+    }
+    return 0;
+}
+
+void free_shader_sources(ShaderSources* ss) {
+    for (int i = 0; i < ss->file_count; ++i) {
+        free(ss->files[i].text);
+        free(ss->expansions[i].text);
+    }
+    memset(ss, 0, sizeof(ShaderSources));
+}
+
+#endif
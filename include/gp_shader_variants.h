@@ -0,0 +1,326 @@
+#ifndef GP_SHADER_VARIANTS_H
+#define GP_SHADER_VARIANTS_H
+
+//
+// Variants of the uber shader
+// shaders/model_vertex_uber.glsl and model_fragment_uber.glsl hold every model shader, a variant is a
+// set of feature flags that become #defines right after the #version line. The flags are the key: the
+// first shader_variant_program of a key compiles it (through compile_program_cached, so a later run gets
+// it from disk), every other call returns the same program.
+//
+// prewarm_shader_variants compiles a list of keys on a thread of its own, with a context that shares
+// objects with the one drawing. A frame asking for a key the worker hasn't reached yet compiles it on
+// the spot, asking for the one it is compiling waits for it.
+//
+// reload_shader_variants takes the sources again and recompiles every variant in use through
+// gp_shader_compiler.h. The variants keep their current program until poll_shader_variant_reloads
+// finds the new one linked, a reload that fails keeps the old program for good.
+//
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#define SHADER_VARIANTS_MAX 64
+#define SHADER_VARIANTS_VERTEX "shaders/model_vertex_uber.glsl"
+#define SHADER_VARIANTS_FRAGMENT "shaders/model_fragment_uber.glsl"
+#define SHADER_VARIANT_DEFINES 512
+
+// Keep shader_feature_names in the same order
+typedef enum ShaderFeature {
+    SHADER_INSTANCED = 1 << 0,
+    SHADER_NORMAL_MAP = 1 << 1,
+    SHADER_AO_MAP = 1 << 2,
+    SHADER_ORM_MAP = 1 << 3,   // occlusion, roughness, metallic in one texture
+    SHADER_CLUSTERED = 1 << 4, // lights from gp_lights.h
+    SHADER_GBUFFER = 1 << 5,   // geometry pass of gp_deferred.h
+    SHADER_PHONG = 1 << 6,     // single light Phong instead of Cook-Torrance
+    SHADER_IBL = 1 << 7,       // ambient light from gp_ibl.h
+} ShaderFeature;
+
+#define SHADER_FEATURE_COUNT 8
+
+const char* shader_feature_names[SHADER_FEATURE_COUNT] = {
+    "INSTANCED", "NORMAL_MAP", "AO_MAP", "ORM_MAP", "CLUSTERED", "GBUFFER", "PHONG", "IBL"
+};
+
+typedef enum ShaderVariantState {
+    SHADER_VARIANT_COMPILING,
+    SHADER_VARIANT_READY,
+    SHADER_VARIANT_FAILED,
+} ShaderVariantState;
+
+typedef struct ShaderVariant {
+    uint32_t key;
+    GLuint program;
+    ShaderVariantState state;
+    AsyncProgram* reload; // replacement being compiled, NULL if none
+} ShaderVariant;
+
+typedef struct ShaderVariants {
+    char* vertex_source;
+    char* fragment_source;
+
+    // entries only get appended, a pointer to one stays valid
+    ShaderVariant variants[SHADER_VARIANTS_MAX];
+    int count;
+    std::mutex lock;
+    std::condition_variable compiled;
+
+    std::thread prewarm;
+    void (*make_current)(void* context);
+    void* context;
+    uint32_t prewarm_keys[SHADER_VARIANTS_MAX];
+    int prewarm_count;
+    std::atomic<int> prewarm_stop;
+    std::atomic<int> prewarm_done;
+
+    int compiled_here;   // by shader_variant_program
+    int compiled_prewarm;
+} ShaderVariants;
+
+ShaderVariants shader_variants;
+
+// Copy of source with one #define per feature of key after the #version line, free it when done
+char* shader_variant_source(const char* source, uint32_t key) {
+    char defines[SHADER_VARIANT_DEFINES];
+    int length = 0;
+    for (int i = 0; i < SHADER_FEATURE_COUNT; ++i) {
+        if (key & (1u << i)) {
+            length += snprintf(defines + length, SHADER_VARIANT_DEFINES - length, "#define %s\n", shader_feature_names[i]);
+        }
+    }
+
+    // #version has to stay the first line
+    const char* body = source;
+    if (strncmp(source, "#version", 8) == 0) {
+        const char* end = strchr(source, '\n');
+        body = end != NULL ? end + 1 : source + strlen(source);
+    }
+    int version_length = (int)(body - source);
+
+    size_t size = strlen(source) + length + 2;
+    char* result = (char*) malloc(size);
+    memcpy(result, source, version_length);
+    if (version_length > 0 && result[version_length - 1] != '\n') {
+        result[version_length++] = '\n';
+    }
+    memcpy(result + version_length, defines, length);
+    strcpy(result + version_length + length, body);
+    return result;
+}
+
+// 0 if a file couldn't be read
+int load_shader_variant_sources(ShaderVariants* sv) {
+    char* vertex = shader_source_copy(&shader_sources, SHADER_VARIANTS_VERTEX);
+    char* fragment = shader_source_copy(&shader_sources, SHADER_VARIANTS_FRAGMENT);
+    if (vertex == NULL || fragment == NULL) {
+        free(vertex);
+        free(fragment);
+        return 0;
+    }
+    std::lock_guard<std::mutex> guard(sv->lock);
+    free(sv->vertex_source);
+    free(sv->fragment_source);
+    sv->vertex_source = vertex;
+    sv->fragment_source = fragment;
+    return 1;
+}
+
+int init_shader_variants(ShaderVariants* sv) {
+    sv->vertex_source = NULL;
+    sv->fragment_source = NULL;
+    sv->count = 0;
+    sv->make_current = NULL;
+    sv->context = NULL;
+    sv->prewarm_count = 0;
+    sv->prewarm_stop.store(0);
+    sv->prewarm_done.store(0);
+    sv->compiled_here = 0;
+    sv->compiled_prewarm = 0;
+    return load_shader_variant_sources(sv);
+}
+
+GLuint compile_shader_variant(ShaderVariants* sv, uint32_t key) {
+    char* vertex;
+    char* fragment;
+    {
+        std::lock_guard<std::mutex> guard(sv->lock);
+        vertex = shader_variant_source(sv->vertex_source, key);
+        fragment = shader_variant_source(sv->fragment_source, key);
+    }
+    GLuint program = compile_program_cached(vertex, fragment, "position", "normal", "uv", "tangent");
+    free(vertex);
+    free(fragment);
+    return program;
+}
+
+// Finds the entry of key, adding it if there is none. *claimed is set when the caller has to compile it.
+ShaderVariant* claim_shader_variant(ShaderVariants* sv, uint32_t key, int* claimed) {
+    std::lock_guard<std::mutex> guard(sv->lock);
+    *claimed = 0;
+    for (int i = 0; i < sv->count; ++i) {
+        if (sv->variants[i].key == key) {
+            return &sv->variants[i];
+        }
+    }
+    if (sv->count == SHADER_VARIANTS_MAX) {
+        return NULL;
+    }
+    ShaderVariant* v = &sv->variants[sv->count++];
+    v->key = key;
+    v->program = 0;
+    v->state = SHADER_VARIANT_COMPILING;
+    v->reload = NULL;
+    *claimed = 1;
+    return v;
+}
+
+void finish_shader_variant(ShaderVariants* sv, ShaderVariant* v, GLuint program) {
+    {
+        std::lock_guard<std::mutex> guard(sv->lock);
+        v->program = program;
+        v->state = program != 0 ? SHADER_VARIANT_READY : SHADER_VARIANT_FAILED;
+    }
+    sv->compiled.notify_all();
+}
+
+// Program of the variant, 0 if it doesn't compile
+GLuint shader_variant_program(ShaderVariants* sv, uint32_t key) {
+    int claimed;
+    ShaderVariant* v = claim_shader_variant(sv, key, &claimed);
+    if (v == NULL) {
+        printf("shader variants: more than %d variants, 0x%x not compiled\n", SHADER_VARIANTS_MAX, key);
+        return 0;
+    }
+    if (claimed) {
+        finish_shader_variant(sv, v, compile_shader_variant(sv, key));
+        sv->compiled_here++;
+    }
+
+    std::unique_lock<std::mutex> guard(sv->lock);
+    sv->compiled.wait(guard, [v] { return v->state != SHADER_VARIANT_COMPILING; });
+    return v->program;
+}
+
+void prewarm_shader_variants_main(ShaderVariants* sv) {
+    sv->make_current(sv->context);
+    for (int i = 0; i < sv->prewarm_count && !sv->prewarm_stop.load(std::memory_order_relaxed); ++i) {
+        int claimed;
+        ShaderVariant* v = claim_shader_variant(sv, sv->prewarm_keys[i], &claimed);
+        if (v == NULL || !claimed) {
+            continue;
+        }
+        GLuint program = compile_shader_variant(sv, sv->prewarm_keys[i]);
+        // the program is only complete for the other context once this one has finished with it
+        glFinish();
+        finish_shader_variant(sv, v, program);
+        sv->compiled_prewarm++;
+    }
+    sv->make_current(NULL);
+    sv->prewarm_done.store(1, std::memory_order_release);
+}
+
+// Starts compiling keys on another thread. make_current(context) makes a context sharing objects with
+// the drawing one current on that thread, make_current(NULL) releases it at the end.
+void prewarm_shader_variants(ShaderVariants* sv, const uint32_t* keys, int count, void (*make_current)(void*), void* context) {
+    assert(!sv->prewarm.joinable());
+    sv->prewarm_count = M_MIN(count, SHADER_VARIANTS_MAX);
+    memcpy(sv->prewarm_keys, keys, sv->prewarm_count * sizeof(uint32_t));
+    sv->make_current = make_current;
+    sv->context = context;
+    sv->prewarm_stop.store(0);
+    sv->prewarm_done.store(0);
+    sv->prewarm = std::thread(prewarm_shader_variants_main, sv);
+}
+
+void wait_shader_prewarm(ShaderVariants* sv, int stop) {
+    if (sv->prewarm.joinable()) {
+        sv->prewarm_stop.store(stop);
+        sv->prewarm.join();
+    }
+}
+
+int shader_variants_reloading(ShaderVariants* sv) {
+    for (int i = 0; i < sv->count; ++i) {
+        if (sv->variants[i].reload != NULL) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Takes the sources again from gp_shader_source.h and starts compiling every variant from them,
+// variants nobody asked for yet will be compiled from the new sources when they are. Returns 0 without
+// doing anything while the previous reload or the prewarm is still going, try again on a later frame.
+int reload_shader_variants(ShaderVariants* sv, ShaderCompiler* sc) {
+    if (sv->prewarm.joinable()) {
+        if (!sv->prewarm_done.load(std::memory_order_acquire)) {
+            return 0;
+        }
+        // done, the worker context is free for the shader compiler
+        sv->prewarm.join();
+    }
+    if (shader_variants_reloading(sv)) {
+        return 0;
+    }
+    if (!load_shader_variant_sources(sv)) {
+        return 1;
+    }
+    for (int i = 0; i < sv->count; ++i) {
+        ShaderVariant* v = &sv->variants[i];
+        v->reload = start_async_program(sc, shader_variant_source(sv->vertex_source, v->key),
+                                        shader_variant_source(sv->fragment_source, v->key),
+                                        "position", "normal", "uv", "tangent");
+    }
+    return 1;
+}
+
+// Swaps in the reloaded programs that are done. The programs they replace go to retired (room for
+// SHADER_VARIANTS_MAX), for the caller to delete once nothing refers to them. Returns how many were swapped.
+int poll_shader_variant_reloads(ShaderVariants* sv, GLuint* retired, int* retired_count) {
+    int swapped = 0;
+    *retired_count = 0;
+    for (int i = 0; i < sv->count; ++i) {
+        ShaderVariant* v = &sv->variants[i];
+        if (v->reload == NULL || !poll_async_program(v->reload)) {
+            continue;
+        }
+        GLuint program = v->reload->program;
+        free_async_program(v->reload);
+        v->reload = NULL;
+        if (program == 0) {
+            printf("shader variants: 0x%x didn't compile, keeping the old one\n", v->key);
+            continue;
+        }
+        if (v->program != 0) {
+            retired[(*retired_count)++] = v->program;
+        }
+        std::lock_guard<std::mutex> guard(sv->lock);
+        v->program = program;
+        v->state = SHADER_VARIANT_READY;
+        swapped++;
+    }
+    return swapped;
+}
+
+// Stop the shader compiler first, it may still be working on a reload
+void free_shader_variants(ShaderVariants* sv) {
+    wait_shader_prewarm(sv, 1);
+    for (int i = 0; i < sv->count; ++i) {
+        if (sv->variants[i].reload != NULL) {
+            free_async_program(sv->variants[i].reload);
+        }
+        if (sv->variants[i].program != 0) {
+            gp_gl_delete_program(sv->variants[i].program);
+        }
+    }
+    sv->count = 0;
+    free(sv->vertex_source);
+    free(sv->fragment_source);
+    sv->vertex_source = NULL;
+    sv->fragment_source = NULL;
+}
+
+#endif
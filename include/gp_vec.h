@@ -0,0 +1,270 @@
+#ifndef GP_VEC_H
+#define GP_VEC_H
+
+//
+// Vector and matrix types for C++ code
+// vec<N, T> for N = 2, 3, 4 and a column major mat4 of floats, with the names of GLSL (vec3, dot,
+// cross, normalize...). Everything but length and normalize is constexpr, so constant transforms and
+// tables can be built at compile time (length and normalize are too where the compiler can tell a
+// constant evaluation apart, gcc 9 and clang 9 on). The operations are forced inline, a loop calling
+// them sees plain float math it can vectorize.
+//
+// vec3 converts to and from float3 and vec4 to and from float4, mat4::data() goes to the m_mat4_*
+// functions and glUniformMatrix4fv. vec2 and vec4 are aligned to their size, vec3 is packed like float3.
+// Needs C++14.
+//
+
+#include <math.h>
+
+#define GP_VEC_INLINE [[gnu::always_inline]] inline
+
+#if defined(__has_builtin)
+    #if __has_builtin(__builtin_is_constant_evaluated)
+        #define GP_VEC_CONSTEXPR_SQRT 1
+    #endif
+#endif
+
+#ifdef GP_VEC_CONSTEXPR_SQRT
+    #define GP_VEC_SQRT_CONSTEXPR constexpr
+#else
+    #define GP_VEC_SQRT_CONSTEXPR
+#endif
+
+template <int N, typename T> struct vec;
+
+template <typename T> struct alignas(2 * sizeof(T)) vec<2, T> {
+    T x, y;
+
+    constexpr vec() : x(), y() {}
+    constexpr vec(T x, T y) : x(x), y(y) {}
+    explicit constexpr vec(T s) : x(s), y(s) {}
+
+    GP_VEC_INLINE constexpr T& operator[](int i) { return i == 0 ? x : y; }
+    GP_VEC_INLINE constexpr const T& operator[](int i) const { return i == 0 ? x : y; }
+};
+
+template <typename T> struct vec<3, T> {
+    T x, y, z;
+
+    constexpr vec() : x(), y(), z() {}
+    constexpr vec(T x, T y, T z) : x(x), y(y), z(z) {}
+    explicit constexpr vec(T s) : x(s), y(s), z(s) {}
+    constexpr vec(const float3& v) : x(v.x), y(v.y), z(v.z) {}
+
+    constexpr operator float3() const { return float3{(float) x, (float) y, (float) z}; }
+
+    GP_VEC_INLINE constexpr T& operator[](int i) { return i == 0 ? x : (i == 1 ? y : z); }
+    GP_VEC_INLINE constexpr const T& operator[](int i) const { return i == 0 ? x : (i == 1 ? y : z); }
+};
+
+template <typename T> struct alignas(4 * sizeof(T)) vec<4, T> {
+    T x, y, z, w;
+
+    constexpr vec() : x(), y(), z(), w() {}
+    constexpr vec(T x, T y, T z, T w) : x(x), y(y), z(z), w(w) {}
+    constexpr vec(const vec<3, T>& v, T w) : x(v.x), y(v.y), z(v.z), w(w) {}
+    explicit constexpr vec(T s) : x(s), y(s), z(s), w(s) {}
+    constexpr vec(const float4& v) : x(v.x), y(v.y), z(v.z), w(v.w) {}
+
+    constexpr operator float4() const { return float4{(float) x, (float) y, (float) z, (float) w}; }
+    constexpr vec<3, T> xyz() const { return vec<3, T>(x, y, z); }
+
+    GP_VEC_INLINE constexpr T& operator[](int i) { return i == 0 ? x : (i == 1 ? y : (i == 2 ? z : w)); }
+    GP_VEC_INLINE constexpr const T& operator[](int i) const { return i == 0 ? x : (i == 1 ? y : (i == 2 ? z : w)); }
+};
+
+typedef vec<2, float> vec2;
+typedef vec<3, float> vec3;
+typedef vec<4, float> vec4;
+typedef vec<2, int> ivec2;
+typedef vec<3, int> ivec3;
+typedef vec<4, int> ivec4;
+
+static_assert(sizeof(vec3) == sizeof(float3), "vec3 has the layout of float3");
+static_assert(sizeof(vec4) == 16 && alignof(vec4) == 16, "vec4 is one SSE register");
+
+////////////////////////////////////////////////////
+// Component wise
+
+template <int N, typename T> GP_VEC_INLINE constexpr vec<N, T>& operator+=(vec<N, T>& a, const vec<N, T>& b) {
+    for (int i = 0; i < N; ++i) a[i] += b[i];
+    return a;
+}
+
+template <int N, typename T> GP_VEC_INLINE constexpr vec<N, T>& operator-=(vec<N, T>& a, const vec<N, T>& b) {
+    for (int i = 0; i < N; ++i) a[i] -= b[i];
+    return a;
+}
+
+template <int N, typename T> GP_VEC_INLINE constexpr vec<N, T>& operator*=(vec<N, T>& a, const vec<N, T>& b) {
+    for (int i = 0; i < N; ++i) a[i] *= b[i];
+    return a;
+}
+
+template <int N, typename T> GP_VEC_INLINE constexpr vec<N, T>& operator/=(vec<N, T>& a, const vec<N, T>& b) {
+    for (int i = 0; i < N; ++i) a[i] /= b[i];
+    return a;
+}
+
+template <int N, typename T> GP_VEC_INLINE constexpr vec<N, T>& operator*=(vec<N, T>& a, T s) {
+    for (int i = 0; i < N; ++i) a[i] *= s;
+    return a;
+}
+
+template <int N, typename T> GP_VEC_INLINE constexpr vec<N, T>& operator/=(vec<N, T>& a, T s) {
+    for (int i = 0; i < N; ++i) a[i] /= s;
+    return a;
+}
+
+template <int N, typename T> GP_VEC_INLINE constexpr vec<N, T> operator+(vec<N, T> a, const vec<N, T>& b) { return a += b; }
+template <int N, typename T> GP_VEC_INLINE constexpr vec<N, T> operator-(vec<N, T> a, const vec<N, T>& b) { return a -= b; }
+template <int N, typename T> GP_VEC_INLINE constexpr vec<N, T> operator*(vec<N, T> a, const vec<N, T>& b) { return a *= b; }
+template <int N, typename T> GP_VEC_INLINE constexpr vec<N, T> operator/(vec<N, T> a, const vec<N, T>& b) { return a /= b; }
+template <int N, typename T> GP_VEC_INLINE constexpr vec<N, T> operator+(vec<N, T> a, T s) { return a += vec<N, T>(s); }
+template <int N, typename T> GP_VEC_INLINE constexpr vec<N, T> operator-(vec<N, T> a, T s) { return a -= vec<N, T>(s); }
+template <int N, typename T> GP_VEC_INLINE constexpr vec<N, T> operator*(vec<N, T> a, T s) { return a *= s; }
+template <int N, typename T> GP_VEC_INLINE constexpr vec<N, T> operator*(T s, vec<N, T> a) { return a *= s; }
+template <int N, typename T> GP_VEC_INLINE constexpr vec<N, T> operator/(vec<N, T> a, T s) { return a /= s; }
+
+template <int N, typename T> GP_VEC_INLINE constexpr vec<N, T> operator-(vec<N, T> a) {
+    for (int i = 0; i < N; ++i) a[i] = -a[i];
+    return a;
+}
+
+template <int N, typename T> GP_VEC_INLINE constexpr bool operator==(const vec<N, T>& a, const vec<N, T>& b) {
+    for (int i = 0; i < N; ++i) {
+        if (a[i] != b[i]) return false;
+    }
+    return true;
+}
+
+template <int N, typename T> GP_VEC_INLINE constexpr bool operator!=(const vec<N, T>& a, const vec<N, T>& b) { return !(a == b); }
+
+template <int N, typename T> GP_VEC_INLINE constexpr vec<N, T> min(vec<N, T> a, const vec<N, T>& b) {
+    for (int i = 0; i < N; ++i) a[i] = b[i] < a[i] ? b[i] : a[i];
+    return a;
+}
+
+template <int N, typename T> GP_VEC_INLINE constexpr vec<N, T> max(vec<N, T> a, const vec<N, T>& b) {
+    for (int i = 0; i < N; ++i) a[i] = b[i] > a[i] ? b[i] : a[i];
+    return a;
+}
+
+template <int N, typename T> GP_VEC_INLINE constexpr vec<N, T> abs(vec<N, T> a) {
+    for (int i = 0; i < N; ++i) a[i] = a[i] < 0 ? -a[i] : a[i];
+    return a;
+}
+
+template <int N, typename T> GP_VEC_INLINE constexpr vec<N, T> mix(const vec<N, T>& a, const vec<N, T>& b, T t) {
+    return a + (b - a) * t;
+}
+
+////////////////////////////////////////////////////
+// Geometry
+
+template <int N, typename T> GP_VEC_INLINE constexpr T dot(const vec<N, T>& a, const vec<N, T>& b) {
+    T d = a[0] * b[0];
+    for (int i = 1; i < N; ++i) d += a[i] * b[i];
+    return d;
+}
+
+template <typename T> GP_VEC_INLINE constexpr vec<3, T> cross(const vec<3, T>& a, const vec<3, T>& b) {
+    return vec<3, T>(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+}
+
+// Newton's method for constant evaluation, sqrtf otherwise
+GP_VEC_INLINE GP_VEC_SQRT_CONSTEXPR float vec_sqrt(float v) {
+#ifdef GP_VEC_CONSTEXPR_SQRT
+    if (__builtin_is_constant_evaluated()) {
+        if (!(v > 0.0f)) return v == 0.0f ? 0.0f : NAN;
+        double r = v > 1.0f ? v : 1.0;
+        for (int i = 0; i < 64; ++i) r = 0.5 * (r + v / r);
+        return (float) r;
+    }
+#endif
+    return sqrtf(v);
+}
+
+template <int N> GP_VEC_INLINE GP_VEC_SQRT_CONSTEXPR float length(const vec<N, float>& a) {
+    return vec_sqrt(dot(a, a));
+}
+
+// Zero for a zero vector, like M_NORMALIZE3
+template <int N> GP_VEC_INLINE GP_VEC_SQRT_CONSTEXPR vec<N, float> normalize(const vec<N, float>& a) {
+    float l = length(a);
+    return l > 0.0f ? a * (1.0f / l) : vec<N, float>();
+}
+
+////////////////////////////////////////////////////
+// mat4, column major like m_mat4_*
+
+struct alignas(16) mat4 {
+    vec4 c[4];
+
+    // identity
+    constexpr mat4() : c{vec4(1, 0, 0, 0), vec4(0, 1, 0, 0), vec4(0, 0, 1, 0), vec4(0, 0, 0, 1)} {}
+    constexpr mat4(const vec4& c0, const vec4& c1, const vec4& c2, const vec4& c3) : c{c0, c1, c2, c3} {}
+
+    static constexpr mat4 load(const float* m) {
+        return mat4(vec4(m[0], m[1], m[2], m[3]), vec4(m[4], m[5], m[6], m[7]),
+                    vec4(m[8], m[9], m[10], m[11]), vec4(m[12], m[13], m[14], m[15]));
+    }
+
+    GP_VEC_INLINE constexpr vec4& operator[](int i) { return c[i]; }
+    GP_VEC_INLINE constexpr const vec4& operator[](int i) const { return c[i]; }
+
+    // the 16 floats, for m_mat4_* and glUniformMatrix4fv
+    float* data() { return &c[0].x; }
+    const float* data() const { return &c[0].x; }
+};
+
+static_assert(sizeof(mat4) == 16 * sizeof(float), "mat4 is 16 floats with no padding");
+
+GP_VEC_INLINE constexpr vec4 operator*(const mat4& m, const vec4& v) {
+    return m.c[0] * v.x + m.c[1] * v.y + m.c[2] * v.z + m.c[3] * v.w;
+}
+
+GP_VEC_INLINE constexpr mat4 operator*(const mat4& a, const mat4& b) {
+    return mat4(a * b.c[0], a * b.c[1], a * b.c[2], a * b.c[3]);
+}
+
+GP_VEC_INLINE constexpr mat4& operator*=(mat4& a, const mat4& b) {
+    return a = a * b;
+}
+
+GP_VEC_INLINE constexpr bool operator==(const mat4& a, const mat4& b) {
+    return a.c[0] == b.c[0] && a.c[1] == b.c[1] && a.c[2] == b.c[2] && a.c[3] == b.c[3];
+}
+
+// m_mat4_transform3 and m_mat4_rotate3
+GP_VEC_INLINE constexpr vec3 transform_point(const mat4& m, const vec3& p) {
+    return (m.c[0] * p.x + m.c[1] * p.y + m.c[2] * p.z + m.c[3]).xyz();
+}
+
+GP_VEC_INLINE constexpr vec3 transform_direction(const mat4& m, const vec3& d) {
+    return (m.c[0] * d.x + m.c[1] * d.y + m.c[2] * d.z).xyz();
+}
+
+GP_VEC_INLINE constexpr mat4 transpose(const mat4& m) {
+    return mat4(vec4(m.c[0].x, m.c[1].x, m.c[2].x, m.c[3].x), vec4(m.c[0].y, m.c[1].y, m.c[2].y, m.c[3].y),
+                vec4(m.c[0].z, m.c[1].z, m.c[2].z, m.c[3].z), vec4(m.c[0].w, m.c[1].w, m.c[2].w, m.c[3].w));
+}
+
+GP_VEC_INLINE constexpr mat4 translation(const vec3& t) {
+    return mat4(vec4(1, 0, 0, 0), vec4(0, 1, 0, 0), vec4(0, 0, 1, 0), vec4(t, 1.0f));
+}
+
+GP_VEC_INLINE constexpr mat4 scaling(const vec3& s) {
+    return mat4(vec4(s.x, 0, 0, 0), vec4(0, s.y, 0, 0), vec4(0, 0, s.z, 0), vec4(0, 0, 0, 1));
+}
+
+// Rotation from an orthonormal basis, the axes become the first 3 columns
+GP_VEC_INLINE constexpr mat4 basis(const vec3& x, const vec3& y, const vec3& z) {
+    return mat4(vec4(x, 0.0f), vec4(y, 0.0f), vec4(z, 0.0f), vec4(0, 0, 0, 1));
+}
+
+static_assert(cross(vec3(1, 0, 0), vec3(0, 1, 0)) == vec3(0, 0, 1), "cross is right handed");
+static_assert(transform_point(translation(vec3(1, 2, 3)) * scaling(vec3(2)), vec3(1)) == vec3(3, 4, 5),
+              "scale first, then translate");
+
+#endif
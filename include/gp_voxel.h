@@ -0,0 +1,541 @@
+#ifndef GP_VOXEL_H
+#define GP_VOXEL_H
+
+//
+// Sparse voxelization of a mesh
+// The cube around the mesh bounds is split in resolution^3 voxels, grouped in bricks of 8^3. Only
+// bricks a triangle touches exist: each keeps 512 occupancy bits and the attributes of its occupied
+// voxels, in bit order, in one shared array. A hash table finds a brick from its coordinates.
+//
+// The build runs on the job system in three steps:
+// 1. triangles are tested against the bricks their bounds cover (m_3d_tri_box_overlap) and give
+//    (brick, triangle) pairs
+// 2. the pairs are radix sorted, every run of the same brick becomes one brick
+// 3. bricks test their triangles against each voxel in the triangle bounds and average the normal and
+//    albedo of the ones they overlap, taken at the voxel center projected on the triangle
+// Triangles are visited in index order in every brick, the grid doesn't depend on the worker count.
+//
+
+#include "stb_image.h"
+
+#define VOXEL_BRICK 8
+#define VOXEL_BRICK_VOXELS (VOXEL_BRICK * VOXEL_BRICK * VOXEL_BRICK)
+#define VOXEL_BRICK_WORDS (VOXEL_BRICK_VOXELS / 64)
+#define VOXEL_KEY_BITS 10 // per brick coordinate, up to 8192 voxels a side
+#define VOXEL_TRIANGLE_GRAIN 1024
+#define VOXEL_BRICK_GRAIN 64
+
+typedef struct VoxelBrick {
+    uint64_t occupancy[VOXEL_BRICK_WORDS]; // bit x + 8 * (y + 8 * z) within the brick
+    int x, y, z;                           // brick coordinates, voxel / VOXEL_BRICK
+    int first;                             // first voxel of the brick in VoxelGrid::voxels
+} VoxelBrick;
+
+typedef struct Voxel {
+    uint32_t normal; // snorm8 x, y, z
+    uint32_t albedo; // rgba8
+} Voxel;
+
+typedef struct VoxelGrid {
+    int resolution;
+    float3 origin; // min corner of the grid
+    float voxel_size;
+    VoxelBrick* bricks; // sorted by brick key
+    int brick_count;
+    Voxel* voxels;
+    int voxel_count;
+    int* table; // brick index + 1 per slot, 0 for empty ones
+    int table_size;
+    size_t build_bytes; // peak of the temporary memory of the build
+} VoxelGrid;
+
+// rgba8 pixels, v = 0 on the first row like the GL textures loaded by main.c
+typedef struct VoxelTexture {
+    const unsigned char* pixels;
+    int width;
+    int height;
+} VoxelTexture;
+
+uint32_t voxel_brick_key(int x, int y, int z) {
+    return (uint32_t) x | ((uint32_t) y << VOXEL_KEY_BITS) | ((uint32_t) z << (2 * VOXEL_KEY_BITS));
+}
+
+uint32_t voxel_hash(uint32_t key) {
+    key ^= key >> 16;
+    key *= 0x7feb352d;
+    key ^= key >> 15;
+    key *= 0x846ca68b;
+    return key ^ (key >> 16);
+}
+
+// Index of the brick with these coordinates, -1 if it is empty
+int find_voxel_brick(const VoxelGrid* grid, int x, int y, int z) {
+    uint32_t key = voxel_brick_key(x, y, z);
+    int mask = grid->table_size - 1;
+    for (int slot = voxel_hash(key) & mask;; slot = (slot + 1) & mask) {
+        int b = grid->table[slot] - 1;
+        if (b < 0) {
+            return -1;
+        }
+        const VoxelBrick* brick = &grid->bricks[b];
+        if (brick->x == x && brick->y == y && brick->z == z) {
+            return b;
+        }
+    }
+}
+
+// Attributes of a voxel, NULL if it is empty or outside the grid
+const Voxel* get_voxel(const VoxelGrid* grid, int x, int y, int z) {
+    if (x < 0 || y < 0 || z < 0 || x >= grid->resolution || y >= grid->resolution || z >= grid->resolution) {
+        return NULL;
+    }
+    int b = find_voxel_brick(grid, x / VOXEL_BRICK, y / VOXEL_BRICK, z / VOXEL_BRICK);
+    if (b < 0) {
+        return NULL;
+    }
+    const VoxelBrick* brick = &grid->bricks[b];
+    int bit = x % VOXEL_BRICK + VOXEL_BRICK * (y % VOXEL_BRICK + VOXEL_BRICK * (z % VOXEL_BRICK));
+    uint64_t word = brick->occupancy[bit / 64];
+    if (!(word & (1ull << (bit % 64)))) {
+        return NULL;
+    }
+    int rank = __builtin_popcountll(word & ((1ull << (bit % 64)) - 1));
+    for (int w = 0; w < bit / 64; ++w) {
+        rank += __builtin_popcountll(brick->occupancy[w]);
+    }
+    return &grid->voxels[brick->first + rank];
+}
+
+size_t voxel_grid_bytes(const VoxelGrid* grid) {
+    return grid->brick_count * sizeof(VoxelBrick) + grid->voxel_count * sizeof(Voxel) + grid->table_size * sizeof(int);
+}
+
+void free_voxel_grid(VoxelGrid* grid) {
+    free(grid->bricks);
+    free(grid->voxels);
+    free(grid->table);
+    memset(grid, 0, sizeof(VoxelGrid));
+}
+
+////////////////////////////////////////////////////
+// build
+
+typedef struct VoxelBuffer {
+    void* data;
+    int count;
+    int capacity;
+} VoxelBuffer;
+
+void* voxel_buffer_push(VoxelBuffer* buffer, size_t element_size) {
+    if (buffer->count == buffer->capacity) {
+        buffer->capacity = M_MAX(256, buffer->capacity * 2);
+        buffer->data = realloc(buffer->data, buffer->capacity * element_size);
+    }
+    return (char*) buffer->data + element_size * buffer->count++;
+}
+
+typedef struct VoxelBuild {
+    VoxelGrid* grid;
+    const MeshData* mesh;
+    const VoxelTexture* albedo;
+    float3* tri_min; // triangle bounds
+    float3* tri_max;
+    VoxelBuffer* chunks; // pairs of step 1 then voxels of step 3, one buffer per chunk
+    uint64_t* pairs;     // brick key << 32 | triangle
+    int* brick_pairs;    // first pair of each brick, brick_count + 1 entries
+} VoxelBuild;
+
+void voxel_range(const VoxelGrid* grid, const float3* min, const float3* max, int lo[3], int hi[3]) {
+    const float* mn = (const float*) min;
+    const float* mx = (const float*) max;
+    const float* origin = (const float*) &grid->origin;
+    for (int k = 0; k < 3; ++k) {
+        lo[k] = M_CLAMP((int) floorf((mn[k] - origin[k]) / grid->voxel_size), 0, grid->resolution - 1);
+        hi[k] = M_CLAMP((int) floorf((mx[k] - origin[k]) / grid->voxel_size), 0, grid->resolution - 1);
+    }
+}
+
+void voxel_triangle(const VoxelBuild* vb, int t, float3* v0, float3* v1, float3* v2) {
+    const float* p = vb->mesh->positions + t * 9;
+    set_float3(v0, p[0], p[1], p[2]);
+    set_float3(v1, p[3], p[4], p[5]);
+    set_float3(v2, p[6], p[7], p[8]);
+}
+
+void voxel_pairs_job(void* data, int begin, int end) {
+    VoxelBuild* vb = (VoxelBuild*) data;
+    const VoxelGrid* grid = vb->grid;
+    VoxelBuffer* pairs = &vb->chunks[begin / VOXEL_TRIANGLE_GRAIN];
+    float brick_size = grid->voxel_size * VOXEL_BRICK;
+    float3 half = {brick_size * 0.5f, brick_size * 0.5f, brick_size * 0.5f};
+    for (int t = begin; t < end; ++t) {
+        float3 v0, v1, v2;
+        voxel_triangle(vb, t, &v0, &v1, &v2);
+        M_MIN3(vb->tri_min[t], v0, v1);
+        M_MIN3(vb->tri_min[t], vb->tri_min[t], v2);
+        M_MAX3(vb->tri_max[t], v0, v1);
+        M_MAX3(vb->tri_max[t], vb->tri_max[t], v2);
+        int lo[3], hi[3];
+        voxel_range(grid, &vb->tri_min[t], &vb->tri_max[t], lo, hi);
+        int single = lo[0] / VOXEL_BRICK == hi[0] / VOXEL_BRICK && lo[1] / VOXEL_BRICK == hi[1] / VOXEL_BRICK &&
+                     lo[2] / VOXEL_BRICK == hi[2] / VOXEL_BRICK;
+        for (int z = lo[2] / VOXEL_BRICK; z <= hi[2] / VOXEL_BRICK; ++z) {
+            for (int y = lo[1] / VOXEL_BRICK; y <= hi[1] / VOXEL_BRICK; ++y) {
+                for (int x = lo[0] / VOXEL_BRICK; x <= hi[0] / VOXEL_BRICK; ++x) {
+                    float3 center = {grid->origin.x + (x + 0.5f) * brick_size, grid->origin.y + (y + 0.5f) * brick_size,
+                                     grid->origin.z + (z + 0.5f) * brick_size};
+                    if (single || m_3d_tri_box_overlap(&center, &half, &v0, &v1, &v2)) {
+                        uint64_t* pair = (uint64_t*) voxel_buffer_push(pairs, sizeof(uint64_t));
+                        *pair = ((uint64_t) voxel_brick_key(x, y, z) << 32) | (uint32_t) t;
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Weights of the vertices at the point of the triangle plane closest to p, clamped to the triangle
+void voxel_barycentrics(const float3* p, const float3* v0, const float3* v1, const float3* v2, float w[3]) {
+    float3 e1, e2, d;
+    M_SUB3(e1, *v1, *v0);
+    M_SUB3(e2, *v2, *v0);
+    M_SUB3(d, *p, *v0);
+    float d11 = M_DOT3(e1, e1), d12 = M_DOT3(e1, e2), d22 = M_DOT3(e2, e2);
+    float dp1 = M_DOT3(d, e1), dp2 = M_DOT3(d, e2);
+    float det = d11 * d22 - d12 * d12;
+    float u = det > 0.0f ? (d22 * dp1 - d12 * dp2) / det : 0.0f;
+    float v = det > 0.0f ? (d11 * dp2 - d12 * dp1) / det : 0.0f;
+    w[0] = M_MAX(1.0f - u - v, 0.0f);
+    w[1] = M_MAX(u, 0.0f);
+    w[2] = M_MAX(v, 0.0f);
+    float sum = w[0] + w[1] + w[2];
+    for (int k = 0; k < 3; ++k) {
+        w[k] /= sum;
+    }
+}
+
+void sample_voxel_albedo(const VoxelTexture* texture, float u, float v, float3* color) {
+    if (texture == NULL) {
+        set_float3(color, 1.0, 1.0, 1.0);
+        return;
+    }
+    int x = (int) floorf(u * texture->width) % texture->width;
+    int y = (int) floorf(v * texture->height) % texture->height;
+    x = x < 0 ? x + texture->width : x;
+    y = y < 0 ? y + texture->height : y;
+    const unsigned char* p = texture->pixels + (y * texture->width + x) * 4;
+    set_float3(color, p[0] / 255.0f, p[1] / 255.0f, p[2] / 255.0f);
+}
+
+int8_t voxel_snorm8(float x) {
+    return (int8_t) roundf(M_CLAMP(x, -1.0f, 1.0f) * 127.0f);
+}
+
+uint8_t voxel_unorm8(float x) {
+    return (uint8_t) roundf(M_CLAMP(x, 0.0f, 1.0f) * 255.0f);
+}
+
+void voxel_bricks_job(void* data, int begin, int end) {
+    VoxelBuild* vb = (VoxelBuild*) data;
+    const VoxelGrid* grid = vb->grid;
+    const MeshData* mesh = vb->mesh;
+    VoxelBuffer* voxels = &vb->chunks[begin / VOXEL_BRICK_GRAIN];
+    float3 half = {grid->voxel_size * 0.5f, grid->voxel_size * 0.5f, grid->voxel_size * 0.5f};
+    // normal xyz, albedo rgb and the number of triangles per voxel of the brick
+    float sums[VOXEL_BRICK_VOXELS][7];
+
+    for (int b = begin; b < end; ++b) {
+        VoxelBrick* brick = &grid->bricks[b];
+        memset(brick->occupancy, 0, sizeof(brick->occupancy));
+        memset(sums, 0, sizeof(sums));
+        int brick_lo[3] = {brick->x * VOXEL_BRICK, brick->y * VOXEL_BRICK, brick->z * VOXEL_BRICK};
+
+        for (int p = vb->brick_pairs[b]; p < vb->brick_pairs[b + 1]; ++p) {
+            int t = (int) (vb->pairs[p] & 0xFFFFFFFF);
+            float3 v0, v1, v2;
+            voxel_triangle(vb, t, &v0, &v1, &v2);
+            float3 face_normal, e1, e2;
+            M_SUB3(e1, v1, v0);
+            M_SUB3(e2, v2, v0);
+            M_CROSS3(face_normal, e1, e2);
+
+            int lo[3], hi[3];
+            voxel_range(grid, &vb->tri_min[t], &vb->tri_max[t], lo, hi);
+            for (int k = 0; k < 3; ++k) {
+                lo[k] = M_MAX(lo[k], brick_lo[k]) - brick_lo[k];
+                hi[k] = M_MIN(hi[k], brick_lo[k] + VOXEL_BRICK - 1) - brick_lo[k];
+            }
+            for (int z = lo[2]; z <= hi[2]; ++z) {
+                for (int y = lo[1]; y <= hi[1]; ++y) {
+                    for (int x = lo[0]; x <= hi[0]; ++x) {
+                        float3 center = {grid->origin.x + (brick_lo[0] + x + 0.5f) * grid->voxel_size,
+                                         grid->origin.y + (brick_lo[1] + y + 0.5f) * grid->voxel_size,
+                                         grid->origin.z + (brick_lo[2] + z + 0.5f) * grid->voxel_size};
+                        if (!m_3d_tri_box_overlap(&center, &half, &v0, &v1, &v2)) {
+                            continue;
+                        }
+                        int bit = x + VOXEL_BRICK * (y + VOXEL_BRICK * z);
+                        brick->occupancy[bit / 64] |= 1ull << (bit % 64);
+
+                        float w[3];
+                        voxel_barycentrics(&center, &v0, &v1, &v2, w);
+                        float3 n = face_normal;
+                        if (mesh->normals != NULL) {
+                            const float* vn = mesh->normals + t * 9;
+                            set_float3(&n, w[0] * vn[0] + w[1] * vn[3] + w[2] * vn[6], w[0] * vn[1] + w[1] * vn[4] + w[2] * vn[7],
+                                       w[0] * vn[2] + w[1] * vn[5] + w[2] * vn[8]);
+                        }
+                        M_NORMALIZE3(n, n);
+                        float3 color = {1.0, 1.0, 1.0};
+                        if (mesh->uvs != NULL) {
+                            const float* uv = mesh->uvs + t * 6;
+                            sample_voxel_albedo(vb->albedo, w[0] * uv[0] + w[1] * uv[2] + w[2] * uv[4],
+                                                w[0] * uv[1] + w[1] * uv[3] + w[2] * uv[5], &color);
+                        }
+                        float* sum = sums[bit];
+                        sum[0] += n.x;
+                        sum[1] += n.y;
+                        sum[2] += n.z;
+                        sum[3] += color.x;
+                        sum[4] += color.y;
+                        sum[5] += color.z;
+                        sum[6] += 1.0f;
+                    }
+                }
+            }
+        }
+
+        // first is relative to the chunk until every chunk is counted
+        brick->first = voxels->count;
+        for (int w = 0; w < VOXEL_BRICK_WORDS; ++w) {
+            for (uint64_t bits = brick->occupancy[w]; bits != 0; bits &= bits - 1) {
+                const float* sum = sums[w * 64 + __builtin_ctzll(bits)];
+                float3 n = {sum[0], sum[1], sum[2]};
+                float l = M_LENGHT3(n);
+                float s = l > 0.0f ? 1.0f / l : 0.0f;
+                float c = 1.0f / sum[6];
+                Voxel* voxel = (Voxel*) voxel_buffer_push(voxels, sizeof(Voxel));
+                voxel->normal = (uint8_t) voxel_snorm8(n.x * s) | ((uint32_t) (uint8_t) voxel_snorm8(n.y * s) << 8) |
+                                ((uint32_t) (uint8_t) voxel_snorm8(n.z * s) << 16);
+                voxel->albedo = voxel_unorm8(sum[3] * c) | ((uint32_t) voxel_unorm8(sum[4] * c) << 8) |
+                                ((uint32_t) voxel_unorm8(sum[5] * c) << 16) | 0xFF000000u;
+            }
+        }
+    }
+}
+
+// Chunks of a parallel_for with a fixed grain, appended in chunk order
+int concat_voxel_chunks(VoxelBuffer* chunks, int chunk_count, size_t element_size, void** dest, int* offsets) {
+    int total = 0;
+    for (int c = 0; c < chunk_count; ++c) {
+        offsets[c] = total;
+        total += chunks[c].count;
+    }
+    *dest = malloc(M_MAX(total, 1) * element_size);
+    for (int c = 0; c < chunk_count; ++c) {
+        memcpy((char*) *dest + offsets[c] * element_size, chunks[c].data, chunks[c].count * element_size);
+        free(chunks[c].data);
+        memset(&chunks[c], 0, sizeof(VoxelBuffer));
+    }
+    return total;
+}
+
+// Voxelizes the triangles of mesh (positions, optional normals and uvs, one vertex per corner) in
+// resolution^3 voxels over the cube around bounds. albedo can be NULL (white), js can be NULL.
+void voxelize_mesh(VoxelGrid* grid, JobSystem* js, const MeshData* mesh, const MeshBounds* bounds, int resolution,
+                   const VoxelTexture* albedo) {
+    assert(resolution > 0 && resolution <= (VOXEL_BRICK << VOXEL_KEY_BITS));
+    memset(grid, 0, sizeof(VoxelGrid));
+    grid->resolution = resolution;
+    float3 extent;
+    M_SUB3(extent, bounds->max, bounds->min);
+    // a little larger than the bounds so the faces on them fall inside
+    float size = M_MAX(M_MAX(extent.x, extent.y), extent.z) * 1.001f;
+    grid->voxel_size = size / resolution;
+    M_ADD3(grid->origin, bounds->min, bounds->max);
+    mul_scalar(&grid->origin, 0.5);
+    grid->origin.x -= size * 0.5f;
+    grid->origin.y -= size * 0.5f;
+    grid->origin.z -= size * 0.5f;
+
+    VoxelBuild vb;
+    memset(&vb, 0, sizeof(VoxelBuild));
+    int triangle_count = mesh->vertex_count / 3;
+    vb.grid = grid;
+    vb.mesh = mesh;
+    vb.albedo = albedo;
+    vb.tri_min = (float3*) malloc(M_MAX(triangle_count, 1) * sizeof(float3));
+    vb.tri_max = (float3*) malloc(M_MAX(triangle_count, 1) * sizeof(float3));
+    size_t bytes = 2 * triangle_count * sizeof(float3);
+
+    // 1. brick, triangle pairs
+    int chunk_count = (triangle_count + VOXEL_TRIANGLE_GRAIN - 1) / VOXEL_TRIANGLE_GRAIN;
+    vb.chunks = (VoxelBuffer*) calloc(M_MAX(chunk_count, 1), sizeof(VoxelBuffer));
+    int* offsets = (int*) malloc(M_MAX(chunk_count, 1) * sizeof(int));
+    parallel_for(js, triangle_count, VOXEL_TRIANGLE_GRAIN, voxel_pairs_job, &vb);
+    for (int c = 0; c < chunk_count; ++c) {
+        bytes += vb.chunks[c].capacity * sizeof(uint64_t);
+    }
+    grid->build_bytes = bytes;
+    void* pairs;
+    int pair_count = concat_voxel_chunks(vb.chunks, chunk_count, sizeof(uint64_t), &pairs, offsets);
+    free(vb.chunks);
+    free(offsets);
+
+    // 2. sort them, one brick per key
+    uint64_t* scratch = (uint64_t*) malloc(M_MAX(pair_count, 1) * sizeof(uint64_t));
+    bytes += 2 * pair_count * sizeof(uint64_t);
+    grid->build_bytes = M_MAX(grid->build_bytes, bytes);
+    vb.pairs = radix_sort_u64((uint64_t*) pairs, scratch, pair_count);
+    free(vb.pairs == pairs ? scratch : pairs);
+
+    int brick_count = 0;
+    for (int p = 0; p < pair_count; ++p) {
+        brick_count += p == 0 || (vb.pairs[p] >> 32) != (vb.pairs[p - 1] >> 32);
+    }
+    grid->brick_count = brick_count;
+    grid->bricks = (VoxelBrick*) malloc(M_MAX(brick_count, 1) * sizeof(VoxelBrick));
+    vb.brick_pairs = (int*) malloc((brick_count + 1) * sizeof(int));
+    const uint32_t key_mask = (1u << VOXEL_KEY_BITS) - 1;
+    for (int p = 0, b = 0; p < pair_count; ++p) {
+        uint32_t key = (uint32_t) (vb.pairs[p] >> 32);
+        if (p == 0 || key != (uint32_t) (vb.pairs[p - 1] >> 32)) {
+            VoxelBrick* brick = &grid->bricks[b];
+            brick->x = key & key_mask;
+            brick->y = (key >> VOXEL_KEY_BITS) & key_mask;
+            brick->z = key >> (2 * VOXEL_KEY_BITS);
+            vb.brick_pairs[b++] = p;
+        }
+    }
+    vb.brick_pairs[brick_count] = pair_count;
+
+    // 3. voxels of every brick
+    chunk_count = (brick_count + VOXEL_BRICK_GRAIN - 1) / VOXEL_BRICK_GRAIN;
+    vb.chunks = (VoxelBuffer*) calloc(M_MAX(chunk_count, 1), sizeof(VoxelBuffer));
+    offsets = (int*) malloc(M_MAX(chunk_count, 1) * sizeof(int));
+    parallel_for(js, brick_count, VOXEL_BRICK_GRAIN, voxel_bricks_job, &vb);
+    bytes = pair_count * sizeof(uint64_t) + (brick_count + 1) * sizeof(int) + 2 * triangle_count * sizeof(float3);
+    for (int c = 0; c < chunk_count; ++c) {
+        bytes += vb.chunks[c].capacity * sizeof(Voxel);
+    }
+    grid->build_bytes = M_MAX(grid->build_bytes, bytes);
+    void* voxels;
+    grid->voxel_count = concat_voxel_chunks(vb.chunks, chunk_count, sizeof(Voxel), &voxels, offsets);
+    grid->voxels = (Voxel*) voxels;
+    for (int b = 0; b < brick_count; ++b) {
+        grid->bricks[b].first += offsets[b / VOXEL_BRICK_GRAIN];
+    }
+    free(vb.chunks);
+    free(offsets);
+    free(vb.pairs);
+    free(vb.brick_pairs);
+    free(vb.tri_min);
+    free(vb.tri_max);
+
+    grid->table_size = 64;
+    while (grid->table_size < brick_count * 2) {
+        grid->table_size *= 2;
+    }
+    grid->table = (int*) calloc(grid->table_size, sizeof(int));
+    for (int b = 0; b < brick_count; ++b) {
+        const VoxelBrick* brick = &grid->bricks[b];
+        int slot = voxel_hash(voxel_brick_key(brick->x, brick->y, brick->z)) & (grid->table_size - 1);
+        while (grid->table[slot] != 0) {
+            slot = (slot + 1) & (grid->table_size - 1);
+        }
+        grid->table[slot] = b + 1;
+    }
+}
+
+////////////////////////////////////////////////////
+// benchmark
+
+#define VOXEL_BENCH_MESH "models/FireHydrant/FireHydrantMesh.obj"
+#define VOXEL_BENCH_ALBEDO "models/FireHydrant/fire_hydrant_Base_Color.png"
+
+uint64_t voxel_grid_hash(const VoxelGrid* grid) {
+    uint64_t hash = 1469598103934665603ull;
+    const uint32_t* words = (const uint32_t*) grid->bricks;
+    for (size_t i = 0; i < grid->brick_count * sizeof(VoxelBrick) / 4; ++i) {
+        hash = (hash ^ words[i]) * 1099511628211ull;
+    }
+    words = (const uint32_t*) grid->voxels;
+    for (size_t i = 0; i < grid->voxel_count * sizeof(Voxel) / 4; ++i) {
+        hash = (hash ^ words[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+// Every occupied voxel has to be found through the table, and as many empty ones as there are bricks
+// (the neighbours of each brick on x) must not be
+int check_voxel_grid(const VoxelGrid* grid) {
+    int found = 0;
+    for (int b = 0; b < grid->brick_count; ++b) {
+        const VoxelBrick* brick = &grid->bricks[b];
+        for (int bit = 0; bit < VOXEL_BRICK_VOXELS; ++bit) {
+            int x = brick->x * VOXEL_BRICK + bit % VOXEL_BRICK;
+            int y = brick->y * VOXEL_BRICK + bit / VOXEL_BRICK % VOXEL_BRICK;
+            int z = brick->z * VOXEL_BRICK + bit / (VOXEL_BRICK * VOXEL_BRICK);
+            int occupied = (brick->occupancy[bit / 64] >> (bit % 64)) & 1;
+            found += occupied && get_voxel(grid, x, y, z) != NULL;
+            if (!occupied && get_voxel(grid, x, y, z) != NULL) {
+                return 0;
+            }
+        }
+    }
+    return found == grid->voxel_count;
+}
+
+// --bench voxel: FireHydrantMesh.obj at 128, 512 and 1024 voxels a side with 1 to max_workers workers,
+// the grid has to be the same for all of them. Memory is the grid, next to the bits of a dense grid,
+// and the peak of the temporary buffers of the build.
+void gp_voxel_benchmark(int max_workers) {
+    const int resolutions[] = {128, 512, 1024};
+    if (max_workers <= 0) {
+        max_workers = (int) std::thread::hardware_concurrency();
+    }
+    max_workers = M_CLAMP(max_workers, 1, JOBS_MAX_WORKERS);
+
+    MeshData mesh;
+    MeshBounds bounds;
+    if (!load_mesh_data(VOXEL_BENCH_MESH, &mesh, &bounds)) {
+        printf("voxel benchmark: can't load %s\n", VOXEL_BENCH_MESH);
+        return;
+    }
+    VoxelTexture albedo;
+    int channels;
+    albedo.pixels = stbi_load(VOXEL_BENCH_ALBEDO, &albedo.width, &albedo.height, &channels, 4);
+
+    printf("voxel benchmark: %s, %d triangles, up to %d workers\n", VOXEL_BENCH_MESH, mesh.vertex_count / 3, max_workers);
+    for (int r = 0; r < 3; ++r) {
+        int resolution = resolutions[r];
+        uint64_t reference = 0;
+        double single_ms = 0.0;
+        VoxelGrid grid;
+        for (int workers = 1; workers <= max_workers; ++workers) {
+            JobSystem* js = create_job_system(workers);
+            g_timer timer;
+            start_timer(&timer);
+            voxelize_mesh(&grid, js, &mesh, &bounds, resolution, albedo.pixels != NULL ? &albedo : NULL);
+            stop_timer(&timer);
+            destroy_job_system(js);
+            double ms = compute_timer_millis_diff(&timer);
+            uint64_t hash = voxel_grid_hash(&grid);
+            if (workers == 1) {
+                reference = hash;
+                single_ms = ms;
+                double dense = (double) resolution * resolution * resolution / 8.0;
+                printf("  %4d^3  %7d bricks  %9d voxels  grid %7.2f MB (dense bits %7.2f MB)  build peak %7.2f MB  lookup %s\n",
+                       resolution, grid.brick_count, grid.voxel_count, voxel_grid_bytes(&grid) / 1048576.0,
+                       dense / 1048576.0, grid.build_bytes / 1048576.0, check_voxel_grid(&grid) ? "ok" : "MISMATCH");
+            }
+            printf("  %4d^3  %2d workers %9.2f ms %5.2fx%s\n", resolution, workers, ms, single_ms / ms,
+                   hash == reference ? "" : "  MISMATCH");
+            free_voxel_grid(&grid);
+        }
+    }
+    stbi_image_free((void*) albedo.pixels);
+    free_mesh_data(&mesh);
+}
+
+#endif
@@ -144,11 +144,28 @@ typedef struct {float x, y, z;} float3; /* float3 (doesn't exist in opencl) */
 /* basic math */
 MMAPI unsigned int m_next_power_of_two(unsigned int x);
 
-/* rand (Marsaglia MWC generator) */
+/* rand (Marsaglia MWC generator), global state: not for concurrent use, see m_rng */
 MMAPI void m_srand(unsigned int z, unsigned int w);
 MMAPI unsigned int m_rand(void);
 MMAPI float m_randf(void); /* (0 - 1) range */
 
+/* m_rng: xoshiro128** generator with its own state, one per thread or per job.
+   m_rng_seed expands a 64 bit seed (splitmix64), m_rng_jump advances the state by 2^64 draws:
+   m_rng_split gives dest the current stream and jumps rng past it, so streams split from one seed
+   never overlap. Floats are in [0 - 1) range with 24 bits. The sphere and hemisphere samples are
+   direct (no rejection), uniform except m_rng_cosine_hemisphere (cosine weighted around normal). */
+typedef struct {unsigned int s[4];} m_rng;
+
+MMAPI void m_rng_seed(m_rng *rng, unsigned long long seed);
+MMAPI void m_rng_jump(m_rng *rng);
+MMAPI void m_rng_split(m_rng *dest, m_rng *rng);
+MMAPI unsigned int m_rng_next(m_rng *rng);
+MMAPI float m_rng_float(m_rng *rng);
+MMAPI void m_rng_on_unit_sphere(float3 *dest, m_rng *rng);
+MMAPI void m_rng_in_unit_sphere(float3 *dest, m_rng *rng);
+MMAPI void m_rng_on_hemisphere(float3 *dest, m_rng *rng, const float3 *normal);
+MMAPI void m_rng_cosine_hemisphere(float3 *dest, m_rng *rng, const float3 *normal);
+
 /* interpolation */
 MMAPI float m_interpolation_cubic(float y0, float y1, float y2, float y3, float mu);
 MMAPI float m_interpolation_catmullrom(float y0, float y1, float y2, float y3, float mu);
@@ -185,6 +202,76 @@ MMAPI void m_mat4_inverse_rotate3(float3 *dest, const float *matrix, const float
 MMAPI void m_mat4_transform3(float3 *dest, const float *matrix, const float3 *src);
 MMAPI void m_mat4_transform4(float4 *dest, const float *matrix, const float4 *src);
 
+/* SIMD (x86 with gcc or clang):
+   m_mat4_mul, m_mat4_inverse, m_mat4_transform3/4 and m_mat4_lookat go through a table of
+   functions that starts on the scalar code. m_simd_init picks the best level the cpu has (cpuid),
+   call it once at startup before other threads use the matrix functions. m_simd_set_level forces
+   a level (lower if the cpu lacks it) and returns the one in use.
+   SSE4.1 mul and transform add in the scalar order and match it bit for bit, AVX2 fuses them (fma),
+   inverse and lookat round differently: all of them stay within a few ulp of the scalar code.
+   The _scalar functions are the portable versions, always available. */
+#define M_SIMD_SCALAR 0
+#define M_SIMD_SSE41 1
+#define M_SIMD_AVX2 2
+
+MMAPI int m_simd_init(void);
+MMAPI int m_simd_set_level(int level);
+MMAPI int m_simd_level(void);
+MMAPI const char *m_simd_level_name(int level);
+
+MMAPI void m_mat4_lookat_scalar(float *dest, const float3 *pos, const float3 *dir, const float3 *up);
+MMAPI void m_mat4_mul_scalar(float *dest, const float *A, const float *B);
+MMAPI void m_mat4_inverse_scalar(float *dest, const float *src);
+MMAPI void m_mat4_transform3_scalar(float3 *dest, const float *matrix, const float3 *src);
+MMAPI void m_mat4_transform4_scalar(float4 *dest, const float *matrix, const float4 *src);
+
+/* batched, on structure of arrays: x, y and z of count elements in 3 streams.
+   The elements before the streams reach 16 (SSE4.1) or 32 (AVX2) byte alignment and the ones
+   after the last full register go through the scalar code, streams that can't all be aligned
+   together get unaligned loads. dest can be src. The SIMD level is the one of m_simd_init. */
+typedef struct {float *x, *y, *z;} float3_soa;
+
+MMAPI void m_mat4_transform3_soa(const float3_soa *dest, const float *matrix, const float3_soa *src, int count); /* points */
+MMAPI void m_mat4_rotate3_soa(const float3_soa *dest, const float *matrix, const float3_soa *src, int count);    /* directions */
+MMAPI void m_normalize3_soa(const float3_soa *dest, const float3_soa *src, int count);
+MMAPI void m_mat4_transform_aabb_soa(const float3_soa *dest_min, const float3_soa *dest_max, const float *matrix, const float3_soa *src_min, const float3_soa *src_max, int count);
+MMAPI void m_mat4_mul_array(float *dest, const float *A, const float *B, int count); /* count matrices of 16 floats, dest[i] = A[i] * B[i] */
+
+/* batched quaternions, x, y, z and w streams. mu has one factor per element.
+   m_quat_nlerp_soa is the normalized lerp (along the shorter arc), m_quat_slerp_soa approximates
+   m_quat_slerp by correcting mu of the nlerp with a polynomial fit on the angle (Kapoulkine),
+   the error stays around 1e-3 radian at most. m_quat_normalize_soa gives the identity for zero quaternions,
+   m_quat_to_mat3_soa writes the rotation matrix as 9 streams, column major like m_mat4. */
+typedef struct {float *x, *y, *z, *w;} float4_soa;
+
+MMAPI void m_quat_nlerp_soa(const float4_soa *dest, const float4_soa *A, const float4_soa *B, const float *mu, int count);
+MMAPI void m_quat_slerp_soa(const float4_soa *dest, const float4_soa *A, const float4_soa *B, const float *mu, int count);
+MMAPI void m_quat_normalize_soa(const float4_soa *dest, const float4_soa *src, int count);
+MMAPI void m_quat_to_mat3_soa(float *const *dest, const float4_soa *src, int count);
+
+/* batched ray tests, one ray against count triangles or boxes given as streams (_soa), or count
+   rays given as streams against one triangle or box (_packet). dest gets the distance of each hit,
+   M_RAY_MISS when there is none, the return value is the number of hits.
+   Triangles are only hit in front of the origin (t > 0), u and v are the barycentrics of vert2
+   and vert3 (only meaningful for hits). Boxes give the distance where the ray enters them, 0 when
+   the origin is inside, boxes behind the origin are missed.
+   NaN anywhere in a ray, triangle or box is a miss, so are degenerate triangles. Directions can
+   have zero components (infinite inverse), a ray lying in the plane of a box face is inside. */
+#define M_RAY_MISS 3.402823466e+38f
+
+MMAPI int m_3d_ray_triangle_intersection_soa(float *dest, float *u, float *v, const float3 *ray_origin, const float3 *ray_direction, const float3_soa *vert1, const float3_soa *vert2, const float3_soa *vert3, int count);
+MMAPI int m_3d_ray_box_intersection_soa(float *dest, const float3 *ray_origin, const float3 *ray_direction, const float3_soa *box_min, const float3_soa *box_max, int count);
+MMAPI int m_3d_ray_packet_triangle_intersection(float *dest, float *u, float *v, const float3_soa *ray_origin, const float3_soa *ray_direction, const float3 *vert1, const float3 *vert2, const float3 *vert3, int count);
+MMAPI int m_3d_ray_packet_box_intersection(float *dest, const float3_soa *ray_origin, const float3_soa *ray_direction, const float3 *box_min, const float3 *box_max, int count);
+
+/* batched uniform floats from 8 m_rng streams in lanes, lane i is the i-th stream split from rng.
+   Every 8 floats take one draw of each lane and a last partial group still advances all of them,
+   so the values don't depend on the SIMD level. dest has no alignment requirement. */
+typedef struct {unsigned int s[4][8];} m_rng8;
+
+MMAPI void m_rng8_split(m_rng8 *dest, m_rng *rng);
+MMAPI void m_rng8_fill_uniform(float *dest, m_rng8 *rng, float min, float max, int count); /* [min - max) */
+
 /* 2d */
 MMAPI int   m_2d_line_to_line_intersection(float2 *dest, float2 *p11, float2 *p12, float2 *p21, float2 *p22);
 MMAPI int   m_2d_box_to_box_collision(float2 *min1, float2 *max1, float2 *min2, float2 *max2);
@@ -251,6 +338,139 @@ MMAPI float m_randf(void)
    return (u + 1.0) * 2.328306435454494e-10;
 }
 
+#define M__RNG_UNIT 5.9604644775390625e-8f /* 2^-24 */
+
+static unsigned int m__rotl(unsigned int x, int k)
+{
+   return (x << k) | (x >> (32 - k));
+}
+
+static unsigned long long m__splitmix64(unsigned long long *x)
+{
+   unsigned long long z = (*x += 0x9e3779b97f4a7c15ull);
+   z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+   z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+   return z ^ (z >> 31);
+}
+
+MMAPI void m_rng_seed(m_rng *rng, unsigned long long seed)
+{
+   unsigned long long a = m__splitmix64(&seed);
+   unsigned long long b = m__splitmix64(&seed);
+   rng->s[0] = (unsigned int)a;
+   rng->s[1] = (unsigned int)(a >> 32);
+   rng->s[2] = (unsigned int)b;
+   rng->s[3] = (unsigned int)(b >> 32);
+}
+
+MMAPI unsigned int m_rng_next(m_rng *rng)
+{
+   unsigned int *s = rng->s;
+   unsigned int r = m__rotl(s[1] * 5, 7) * 9;
+   unsigned int t = s[1] << 9;
+   s[2] ^= s[0];
+   s[3] ^= s[1];
+   s[1] ^= s[2];
+   s[0] ^= s[3];
+   s[2] ^= t;
+   s[3] = m__rotl(s[3], 11);
+   return r;
+}
+
+MMAPI void m_rng_jump(m_rng *rng)
+{
+   static const unsigned int jump[4] = {0x8764000b, 0xf542d2d3, 0x6fa035c3, 0x77f2db5b};
+   unsigned int s[4] = {0, 0, 0, 0};
+   int i, b;
+   for (i = 0; i < 4; i++) {
+      for (b = 0; b < 32; b++) {
+         if (jump[i] & (1u << b)) {
+            s[0] ^= rng->s[0];
+            s[1] ^= rng->s[1];
+            s[2] ^= rng->s[2];
+            s[3] ^= rng->s[3];
+         }
+         m_rng_next(rng);
+      }
+   }
+   rng->s[0] = s[0];
+   rng->s[1] = s[1];
+   rng->s[2] = s[2];
+   rng->s[3] = s[3];
+}
+
+MMAPI void m_rng_split(m_rng *dest, m_rng *rng)
+{
+   *dest = *rng;
+   m_rng_jump(rng);
+}
+
+MMAPI float m_rng_float(m_rng *rng)
+{
+   return (float)(m_rng_next(rng) >> 8) * M__RNG_UNIT;
+}
+
+MMAPI void m_rng_on_unit_sphere(float3 *dest, m_rng *rng)
+{
+   float z = 1.0f - 2.0f * m_rng_float(rng);
+   float a = 6.28318530717958647692f * m_rng_float(rng);
+   float r = sqrtf(M_MAX(0.0f, 1.0f - z * z));
+   dest->x = r * cosf(a);
+   dest->y = r * sinf(a);
+   dest->z = z;
+}
+
+MMAPI void m_rng_in_unit_sphere(float3 *dest, m_rng *rng)
+{
+   /* the volume within radius r grows with r^3, and so does the chance that the largest of 3
+      uniform draws is below r: that largest draw is the radius, without a cube root */
+   float u0 = m_rng_float(rng), u1 = m_rng_float(rng), u2 = m_rng_float(rng);
+   float r = M_MAX(M_MAX(u0, u1), u2);
+   m_rng_on_unit_sphere(dest, rng);
+   dest->x *= r;
+   dest->y *= r;
+   dest->z *= r;
+}
+
+MMAPI void m_rng_on_hemisphere(float3 *dest, m_rng *rng, const float3 *normal)
+{
+   m_rng_on_unit_sphere(dest, rng);
+   if (M_DOT3(*dest, *normal) < 0.0f) {
+      dest->x = -dest->x;
+      dest->y = -dest->y;
+      dest->z = -dest->z;
+   }
+}
+
+MMAPI void m_rng_cosine_hemisphere(float3 *dest, m_rng *rng, const float3 *normal)
+{
+   /* a point on the unit sphere tangent to the surface, seen from the surface (Lambert) */
+   float3 d;
+   float l;
+   m_rng_on_unit_sphere(&d, rng);
+   M_ADD3(d, d, *normal);
+   l = M_DOT3(d, d);
+   if (l < 1e-12f) {
+      *dest = *normal;
+      return;
+   }
+   l = 1.0f / sqrtf(l);
+   dest->x = d.x * l;
+   dest->y = d.y * l;
+   dest->z = d.z * l;
+}
+
+MMAPI void m_rng8_split(m_rng8 *dest, m_rng *rng)
+{
+   int lane, k;
+   for (lane = 0; lane < 8; lane++) {
+      m_rng stream;
+      m_rng_split(&stream, rng);
+      for (k = 0; k < 4; k++)
+         dest->s[k][lane] = stream.s[k];
+   }
+}
+
 MMAPI float m_interpolation_cubic(float y0, float y1, float y2, float y3, float mu)
 {
    float a0, a1, a2, a3, mu2;
@@ -473,7 +693,7 @@ MMAPI void m_mat4_ortho(float *dest, float left, float right, float bottom, floa
    dest[15] = 1.0f;
 }
 
-MMAPI void m_mat4_lookat(float *dest, const float3 *pos, const float3 *dir, const float3 *up)
+MMAPI void m_mat4_lookat_scalar(float *dest, const float3 *pos, const float3 *dir, const float3 *up)
 {
    float3 lftn, upn, dirn;
 
@@ -561,7 +781,7 @@ MMAPI void m_mat4_scale(float *dest, const float3 *scale)
    dest[10] = scale->z;
 }
 
-MMAPI void m_mat4_mul(float *dest, const float *A, const float *B)
+MMAPI void m_mat4_mul_scalar(float *dest, const float *A, const float *B)
 {
    dest[0] = A[0] * B[0] + A[4] * B[1] + A[8] * B[2] + A[12] * B[3];
    dest[1] = A[1] * B[0] + A[5] * B[1] + A[9] * B[2] + A[13] * B[3];
@@ -688,7 +908,7 @@ MMAPI void m_mat4_inverse_transpose(float *dest, const float *src)
    }
 }
 
-MMAPI void m_mat4_inverse(float *dest, const float *src)
+MMAPI void m_mat4_inverse_scalar(float *dest, const float *src)
 {
    float tmp[16];
    m_mat4_inverse_transpose(tmp, src);
@@ -746,14 +966,14 @@ MMAPI void m_mat4_inverse_rotate3(float3 *dest, const float *matrix, const float
    dest->z = matrix[8] * src->x + matrix[9] * src->y + matrix[10] * src->z;
 }
 
-MMAPI void m_mat4_transform3(float3 *dest, const float *matrix, const float3 *src)
+MMAPI void m_mat4_transform3_scalar(float3 *dest, const float *matrix, const float3 *src)
 {
    dest->x = matrix[0] * src->x + matrix[4] * src->y + matrix[8] * src->z + matrix[12];
    dest->y = matrix[1] * src->x + matrix[5] * src->y + matrix[9] * src->z + matrix[13];
    dest->z = matrix[2] * src->x + matrix[6] * src->y + matrix[10] * src->z + matrix[14];
 }
 
-MMAPI void m_mat4_transform4(float4 *dest, const float *matrix, const float4 *src)
+MMAPI void m_mat4_transform4_scalar(float4 *dest, const float *matrix, const float4 *src)
 {
    dest->x = matrix[0] * src->x + matrix[4] * src->y + matrix[8] * src->z + matrix[12] * src->w;
    dest->y = matrix[1] * src->x + matrix[5] * src->y + matrix[9] * src->z + matrix[13] * src->w;
@@ -761,6 +981,1710 @@ MMAPI void m_mat4_transform4(float4 *dest, const float *matrix, const float4 *sr
    dest->w = matrix[3] * src->x + matrix[7] * src->y + matrix[11] * src->z + matrix[15] * src->w;
 }
 
+/* batched scalar code, also the head and tail of the SIMD versions */
+static void m__transform3_soa_range(const float3_soa *dest, const float *m, const float3_soa *src, int begin, int end, int translate)
+{
+   int i;
+   for (i = begin; i < end; i++) {
+      float x = src->x[i], y = src->y[i], z = src->z[i];
+      if (translate) {
+         dest->x[i] = m[0] * x + m[4] * y + m[8] * z + m[12];
+         dest->y[i] = m[1] * x + m[5] * y + m[9] * z + m[13];
+         dest->z[i] = m[2] * x + m[6] * y + m[10] * z + m[14];
+      }
+      else {
+         dest->x[i] = m[0] * x + m[4] * y + m[8] * z;
+         dest->y[i] = m[1] * x + m[5] * y + m[9] * z;
+         dest->z[i] = m[2] * x + m[6] * y + m[10] * z;
+      }
+   }
+}
+
+static void m__normalize3_soa_range(const float3_soa *dest, const float3_soa *src, int begin, int end)
+{
+   int i;
+   for (i = begin; i < end; i++) {
+      float3 v, n;
+      v.x = src->x[i]; v.y = src->y[i]; v.z = src->z[i];
+      M_NORMALIZE3(n, v);
+      dest->x[i] = n.x; dest->y[i] = n.y; dest->z[i] = n.z;
+   }
+}
+
+/* each axis of the result is the translation plus the smaller (larger) of the
+   products of the matrix with the min and max of every source axis */
+static void m__transform_aabb_soa_range(const float3_soa *dest_min, const float3_soa *dest_max, const float *m, const float3_soa *src_min, const float3_soa *src_max, int begin, int end)
+{
+   int i, j, k;
+   for (i = begin; i < end; i++) {
+      float mn[3], mx[3], lo[3], hi[3];
+      mn[0] = src_min->x[i]; mn[1] = src_min->y[i]; mn[2] = src_min->z[i];
+      mx[0] = src_max->x[i]; mx[1] = src_max->y[i]; mx[2] = src_max->z[i];
+      for (j = 0; j < 3; j++) {
+         lo[j] = hi[j] = m[12 + j];
+         for (k = 0; k < 3; k++) {
+            float a = m[k * 4 + j] * mn[k];
+            float b = m[k * 4 + j] * mx[k];
+            lo[j] += M_MIN(a, b);
+            hi[j] += M_MAX(a, b);
+         }
+      }
+      dest_min->x[i] = lo[0]; dest_min->y[i] = lo[1]; dest_min->z[i] = lo[2];
+      dest_max->x[i] = hi[0]; dest_max->y[i] = hi[1]; dest_max->z[i] = hi[2];
+   }
+}
+
+static void m__mat4_transform3_soa_scalar(const float3_soa *dest, const float *matrix, const float3_soa *src, int count)
+{
+   m__transform3_soa_range(dest, matrix, src, 0, count, 1);
+}
+
+static void m__mat4_rotate3_soa_scalar(const float3_soa *dest, const float *matrix, const float3_soa *src, int count)
+{
+   m__transform3_soa_range(dest, matrix, src, 0, count, 0);
+}
+
+static void m__normalize3_soa_scalar(const float3_soa *dest, const float3_soa *src, int count)
+{
+   m__normalize3_soa_range(dest, src, 0, count);
+}
+
+static void m__mat4_transform_aabb_soa_scalar(const float3_soa *dest_min, const float3_soa *dest_max, const float *matrix, const float3_soa *src_min, const float3_soa *src_max, int count)
+{
+   m__transform_aabb_soa_range(dest_min, dest_max, matrix, src_min, src_max, 0, count);
+}
+
+static void m__mat4_mul_array_scalar(float *dest, const float *A, const float *B, int count)
+{
+   int i;
+   for (i = 0; i < count; i++)
+      m_mat4_mul_scalar(dest + i * 16, A + i * 16, B + i * 16);
+}
+
+/* mu of the nlerp corrected towards the slerp one, the fit is on |dot(A, B)| = cos(angle) */
+#define M__SLERP_CORRECTION(t, d, k)\
+   k = (1.0904f + d * (-3.2452f + d * (3.55645f - d * 1.43519f))) * (t - 0.5f) * (t - 0.5f)\
+     + (0.848013f + d * (-1.06021f + d * 0.215638f));\
+   t = t + t * (t - 0.5f) * (t - 1.0f) * k;
+
+static void m__quat_lerp_soa_range(const float4_soa *dest, const float4_soa *A, const float4_soa *B, const float *mu, int begin, int end, int correct)
+{
+   int i;
+   for (i = begin; i < end; i++) {
+      float ax = A->x[i], ay = A->y[i], az = A->z[i], aw = A->w[i];
+      float bx = B->x[i], by = B->y[i], bz = B->z[i], bw = B->w[i];
+      float d = ax * bx + ay * by + az * bz + aw * bw;
+      float t = mu[i], ia, ib, x, y, z, w, l;
+      if (correct) {
+         float ad = M_ABS(d), k;
+         M__SLERP_CORRECTION(t, ad, k);
+      }
+      ia = 1.0f - t;
+      ib = d < 0.0f ? -t : t;
+      x = ax * ia + bx * ib;
+      y = ay * ia + by * ib;
+      z = az * ia + bz * ib;
+      w = aw * ia + bw * ib;
+      l = x * x + y * y + z * z + w * w;
+      if (l > 1e-16f) {
+         l = 1.0f / sqrtf(l);
+         dest->x[i] = x * l; dest->y[i] = y * l; dest->z[i] = z * l; dest->w[i] = w * l;
+      }
+      else {
+         dest->x[i] = 0.0f; dest->y[i] = 0.0f; dest->z[i] = 0.0f; dest->w[i] = 1.0f;
+      }
+   }
+}
+
+static void m__quat_normalize_soa_range(const float4_soa *dest, const float4_soa *src, int begin, int end)
+{
+   int i;
+   for (i = begin; i < end; i++) {
+      float x = src->x[i], y = src->y[i], z = src->z[i], w = src->w[i];
+      float l = x * x + y * y + z * z + w * w;
+      if (l > 1e-16f) {
+         l = 1.0f / sqrtf(l);
+         dest->x[i] = x * l; dest->y[i] = y * l; dest->z[i] = z * l; dest->w[i] = w * l;
+      }
+      else {
+         dest->x[i] = 0.0f; dest->y[i] = 0.0f; dest->z[i] = 0.0f; dest->w[i] = 1.0f;
+      }
+   }
+}
+
+static void m__quat_to_mat3_soa_range(float *const *dest, const float4_soa *src, int begin, int end)
+{
+   int i;
+   for (i = begin; i < end; i++) {
+      float x = src->x[i], y = src->y[i], z = src->z[i], w = src->w[i];
+      float x2 = x + x, y2 = y + y, z2 = z + z;
+      float xx = x * x2, yy = y * y2, zz = z * z2;
+      float xy = x * y2, xz = x * z2, yz = y * z2;
+      float wx = w * x2, wy = w * y2, wz = w * z2;
+      dest[0][i] = 1.0f - (yy + zz); dest[1][i] = xy + wz; dest[2][i] = xz - wy;
+      dest[3][i] = xy - wz; dest[4][i] = 1.0f - (xx + zz); dest[5][i] = yz + wx;
+      dest[6][i] = xz + wy; dest[7][i] = yz - wx; dest[8][i] = 1.0f - (xx + yy);
+   }
+}
+
+static void m__quat_nlerp_soa_scalar(const float4_soa *dest, const float4_soa *A, const float4_soa *B, const float *mu, int count)
+{
+   m__quat_lerp_soa_range(dest, A, B, mu, 0, count, 0);
+}
+
+static void m__quat_slerp_soa_scalar(const float4_soa *dest, const float4_soa *A, const float4_soa *B, const float *mu, int count)
+{
+   m__quat_lerp_soa_range(dest, A, B, mu, 0, count, 1);
+}
+
+static void m__quat_normalize_soa_scalar(const float4_soa *dest, const float4_soa *src, int count)
+{
+   m__quat_normalize_soa_range(dest, src, 0, count);
+}
+
+static void m__quat_to_mat3_soa_scalar(float *const *dest, const float4_soa *src, int count)
+{
+   m__quat_to_mat3_soa_range(dest, src, 0, count);
+}
+
+/* Moller-Trumbore like m_3d_ray_triangle_intersection, every test is a comparison that NaN fails.
+   Leaves as early as it does, most triangles of a batch are missed on u, u and v are left as they
+   are on a miss. e1 and e2 are the edges from a to vert2 and vert3. */
+static float m__ray_triangle_edges(const float3 *o, const float3 *d, const float3 *a, const float3 *e1, const float3 *e2, float *u, float *v)
+{
+   float3 p, s, q;
+   float det, inv, t;
+   M_CROSS3(p, *d, *e2);
+   det = M_DOT3(*e1, p);
+   if (!(M_ABS(det) > 0.0f))
+      return M_RAY_MISS;
+   inv = 1.0f / det;
+   M_SUB3(s, *o, *a);
+   *u = M_DOT3(s, p) * inv;
+   if (!(*u >= 0.0f && *u <= 1.0f))
+      return M_RAY_MISS;
+   M_CROSS3(q, s, *e1);
+   *v = M_DOT3(*d, q) * inv;
+   if (!(*v >= 0.0f && *u + *v <= 1.0f))
+      return M_RAY_MISS;
+   t = M_DOT3(*e2, q) * inv;
+   if (t > 0.0f && t < M_RAY_MISS)
+      return t;
+   return M_RAY_MISS;
+}
+
+/* slab test, an axis where the origin lies on a face plane of a direction with 0 (0 * inf) is skipped */
+static float m__ray_box(const float3 *o, const float3 *inv, const float3 *lo, const float3 *hi)
+{
+   const float *of = &o->x, *invf = &inv->x, *lof = &lo->x, *hif = &hi->x;
+   float tnear = 0.0f, tfar = M_RAY_MISS;
+   int k;
+   for (k = 0; k < 3; k++) {
+      float a = lof[k] - of[k], b = hif[k] - of[k], t0, t1;
+      if (a != a || b != b || invf[k] != invf[k])
+         return M_RAY_MISS;
+      t0 = a * invf[k];
+      t1 = b * invf[k];
+      if (t0 != t0 || t1 != t1)
+         continue;
+      tnear = M_MAX(M_MIN(t0, t1), tnear);
+      tfar = M_MIN(M_MAX(t0, t1), tfar);
+   }
+   return tnear <= tfar ? tnear : M_RAY_MISS;
+}
+
+static int m__ray_triangle_soa_range(float *dest, float *u, float *v, const float3 *o, const float3 *d, const float3_soa *A, const float3_soa *B, const float3_soa *C, int begin, int end)
+{
+   int i, hits = 0;
+   for (i = begin; i < end; i++) {
+      float3 a = {A->x[i], A->y[i], A->z[i]};
+      float3 e1 = {B->x[i] - a.x, B->y[i] - a.y, B->z[i] - a.z}, e2 = {C->x[i] - a.x, C->y[i] - a.y, C->z[i] - a.z};
+      dest[i] = m__ray_triangle_edges(o, d, &a, &e1, &e2, &u[i], &v[i]);
+      hits += dest[i] != M_RAY_MISS;
+   }
+   return hits;
+}
+
+static int m__ray_box_soa_range(float *dest, const float3 *o, const float3 *d, const float3_soa *lo, const float3_soa *hi, int begin, int end)
+{
+   float3 inv = {1.0f / d->x, 1.0f / d->y, 1.0f / d->z};
+   int i, hits = 0;
+   for (i = begin; i < end; i++) {
+      float3 l = {lo->x[i], lo->y[i], lo->z[i]}, h = {hi->x[i], hi->y[i], hi->z[i]};
+      dest[i] = m__ray_box(o, &inv, &l, &h);
+      hits += dest[i] != M_RAY_MISS;
+   }
+   return hits;
+}
+
+static int m__ray_packet_triangle_range(float *dest, float *u, float *v, const float3_soa *O, const float3_soa *D, const float3 *a, const float3 *b, const float3 *c, int begin, int end)
+{
+   float3 e1, e2;
+   int i, hits = 0;
+   M_SUB3(e1, *b, *a);
+   M_SUB3(e2, *c, *a);
+   for (i = begin; i < end; i++) {
+      float3 o = {O->x[i], O->y[i], O->z[i]}, d = {D->x[i], D->y[i], D->z[i]};
+      dest[i] = m__ray_triangle_edges(&o, &d, a, &e1, &e2, &u[i], &v[i]);
+      hits += dest[i] != M_RAY_MISS;
+   }
+   return hits;
+}
+
+static int m__ray_packet_box_range(float *dest, const float3_soa *O, const float3_soa *D, const float3 *lo, const float3 *hi, int begin, int end)
+{
+   int i, hits = 0;
+   for (i = begin; i < end; i++) {
+      float3 o = {O->x[i], O->y[i], O->z[i]}, inv = {1.0f / D->x[i], 1.0f / D->y[i], 1.0f / D->z[i]};
+      dest[i] = m__ray_box(&o, &inv, lo, hi);
+      hits += dest[i] != M_RAY_MISS;
+   }
+   return hits;
+}
+
+static int m__ray_triangle_soa_scalar(float *dest, float *u, float *v, const float3 *o, const float3 *d, const float3_soa *A, const float3_soa *B, const float3_soa *C, int count)
+{
+   return m__ray_triangle_soa_range(dest, u, v, o, d, A, B, C, 0, count);
+}
+
+static int m__ray_box_soa_scalar(float *dest, const float3 *o, const float3 *d, const float3_soa *lo, const float3_soa *hi, int count)
+{
+   return m__ray_box_soa_range(dest, o, d, lo, hi, 0, count);
+}
+
+static int m__ray_packet_triangle_scalar(float *dest, float *u, float *v, const float3_soa *O, const float3_soa *D, const float3 *a, const float3 *b, const float3 *c, int count)
+{
+   return m__ray_packet_triangle_range(dest, u, v, O, D, a, b, c, 0, count);
+}
+
+static int m__ray_packet_box_scalar(float *dest, const float3_soa *O, const float3_soa *D, const float3 *lo, const float3 *hi, int count)
+{
+   return m__ray_packet_box_range(dest, O, D, lo, hi, 0, count);
+}
+
+static void m__rng8_fill_uniform_scalar(float *dest, m_rng8 *rng, float min, float max, int count)
+{
+   float scale = max - min;
+   int i, lane;
+   for (i = 0; i < count; i += 8) {
+      for (lane = 0; lane < 8; lane++) {
+         m_rng stream;
+         float u;
+         stream.s[0] = rng->s[0][lane];
+         stream.s[1] = rng->s[1][lane];
+         stream.s[2] = rng->s[2][lane];
+         stream.s[3] = rng->s[3][lane];
+         u = m_rng_float(&stream);
+         rng->s[0][lane] = stream.s[0];
+         rng->s[1][lane] = stream.s[1];
+         rng->s[2][lane] = stream.s[2];
+         rng->s[3][lane] = stream.s[3];
+         if (i + lane < count)
+            dest[i + lane] = min + scale * u;
+      }
+   }
+}
+
+/* SIMD kernels, see m_simd_init */
+#if !defined(__OPENCL_VERSION__) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define M__SIMD_X86
+#endif
+
+#ifdef M__SIMD_X86
+
+#include <immintrin.h>
+#include <stdint.h>
+
+#define M__SSE41 __attribute__((target("sse4.1")))
+#define M__AVX2 __attribute__((target("avx2,fma")))
+#define M__SWIZZLE(v, x, y, z, w) _mm_shuffle_ps(v, v, _MM_SHUFFLE(w, z, y, x))
+#define M__SHUFFLE(a, b, x, y, z, w) _mm_shuffle_ps(a, b, _MM_SHUFFLE(w, z, y, x))
+
+M__SSE41 static void m__mat4_mul_sse41(float *dest, const float *A, const float *B)
+{
+   __m128 a0 = _mm_loadu_ps(A);
+   __m128 a1 = _mm_loadu_ps(A + 4);
+   __m128 a2 = _mm_loadu_ps(A + 8);
+   __m128 a3 = _mm_loadu_ps(A + 12);
+   __m128 r[4]; int i;
+
+   /* same order of additions as the scalar code, dest can be A or B */
+   for (i = 0; i < 4; i++) {
+      __m128 b = _mm_loadu_ps(B + i * 4);
+      __m128 c = _mm_mul_ps(a0, M__SWIZZLE(b, 0, 0, 0, 0));
+      c = _mm_add_ps(c, _mm_mul_ps(a1, M__SWIZZLE(b, 1, 1, 1, 1)));
+      c = _mm_add_ps(c, _mm_mul_ps(a2, M__SWIZZLE(b, 2, 2, 2, 2)));
+      r[i] = _mm_add_ps(c, _mm_mul_ps(a3, M__SWIZZLE(b, 3, 3, 3, 3)));
+   }
+   _mm_storeu_ps(dest, r[0]);
+   _mm_storeu_ps(dest + 4, r[1]);
+   _mm_storeu_ps(dest + 8, r[2]);
+   _mm_storeu_ps(dest + 12, r[3]);
+}
+
+M__AVX2 static void m__mat4_mul_avx2(float *dest, const float *A, const float *B)
+{
+   /* two columns of dest per register, the columns of A in both halves */
+   __m256 a0 = _mm256_broadcast_ps((const __m128 *)A);
+   __m256 a1 = _mm256_broadcast_ps((const __m128 *)(A + 4));
+   __m256 a2 = _mm256_broadcast_ps((const __m128 *)(A + 8));
+   __m256 a3 = _mm256_broadcast_ps((const __m128 *)(A + 12));
+   __m256 b01 = _mm256_loadu_ps(B);
+   __m256 b23 = _mm256_loadu_ps(B + 8);
+   __m256 r01, r23;
+
+   r01 = _mm256_mul_ps(a0, _mm256_permute_ps(b01, 0x00));
+   r23 = _mm256_mul_ps(a0, _mm256_permute_ps(b23, 0x00));
+   r01 = _mm256_fmadd_ps(a1, _mm256_permute_ps(b01, 0x55), r01);
+   r23 = _mm256_fmadd_ps(a1, _mm256_permute_ps(b23, 0x55), r23);
+   r01 = _mm256_fmadd_ps(a2, _mm256_permute_ps(b01, 0xaa), r01);
+   r23 = _mm256_fmadd_ps(a2, _mm256_permute_ps(b23, 0xaa), r23);
+   r01 = _mm256_fmadd_ps(a3, _mm256_permute_ps(b01, 0xff), r01);
+   r23 = _mm256_fmadd_ps(a3, _mm256_permute_ps(b23, 0xff), r23);
+   _mm256_storeu_ps(dest, r01);
+   _mm256_storeu_ps(dest + 8, r23);
+}
+
+/* 2x2 matrices (x y / z w) for the block inverse */
+M__SSE41 static inline __m128 m__mat2_mul(__m128 a, __m128 b)
+{
+   return _mm_add_ps(_mm_mul_ps(a, M__SWIZZLE(b, 0, 3, 0, 3)),
+                     _mm_mul_ps(M__SWIZZLE(a, 1, 0, 3, 2), M__SWIZZLE(b, 2, 1, 2, 1)));
+}
+
+/* adjugate(a) * b */
+M__SSE41 static inline __m128 m__mat2_adj_mul(__m128 a, __m128 b)
+{
+   return _mm_sub_ps(_mm_mul_ps(M__SWIZZLE(a, 3, 3, 0, 0), b),
+                     _mm_mul_ps(M__SWIZZLE(a, 1, 1, 2, 2), M__SWIZZLE(b, 2, 3, 0, 1)));
+}
+
+/* a * adjugate(b) */
+M__SSE41 static inline __m128 m__mat2_mul_adj(__m128 a, __m128 b)
+{
+   return _mm_sub_ps(_mm_mul_ps(a, M__SWIZZLE(b, 3, 0, 3, 0)),
+                     _mm_mul_ps(M__SWIZZLE(a, 1, 0, 3, 2), M__SWIZZLE(b, 2, 1, 2, 1)));
+}
+
+/* Block inverse over the 2x2 sub matrices, the same whether the 4 vectors are rows or columns */
+M__SSE41 static void m__mat4_inverse_sse41(float *dest, const float *src)
+{
+   __m128 c0 = _mm_loadu_ps(src);
+   __m128 c1 = _mm_loadu_ps(src + 4);
+   __m128 c2 = _mm_loadu_ps(src + 8);
+   __m128 c3 = _mm_loadu_ps(src + 12);
+   __m128 a = _mm_movelh_ps(c0, c1);
+   __m128 b = _mm_movehl_ps(c1, c0);
+   __m128 c = _mm_movelh_ps(c2, c3);
+   __m128 d = _mm_movehl_ps(c3, c2);
+   __m128 det_sub, det_a, det_b, det_c, det_d, d_c, a_b, x, y, z, w, det, tr, rdet;
+
+   /* determinants of a, b, c and d */
+   det_sub = _mm_sub_ps(_mm_mul_ps(M__SHUFFLE(c0, c2, 0, 2, 0, 2), M__SHUFFLE(c1, c3, 1, 3, 1, 3)),
+                        _mm_mul_ps(M__SHUFFLE(c0, c2, 1, 3, 1, 3), M__SHUFFLE(c1, c3, 0, 2, 0, 2)));
+   det_a = M__SWIZZLE(det_sub, 0, 0, 0, 0);
+   det_b = M__SWIZZLE(det_sub, 1, 1, 1, 1);
+   det_c = M__SWIZZLE(det_sub, 2, 2, 2, 2);
+   det_d = M__SWIZZLE(det_sub, 3, 3, 3, 3);
+
+   d_c = m__mat2_adj_mul(d, c);
+   a_b = m__mat2_adj_mul(a, b);
+   x = _mm_sub_ps(_mm_mul_ps(det_d, a), m__mat2_mul(b, d_c));
+   w = _mm_sub_ps(_mm_mul_ps(det_a, d), m__mat2_mul(c, a_b));
+   y = _mm_sub_ps(_mm_mul_ps(det_b, c), m__mat2_mul_adj(d, a_b));
+   z = _mm_sub_ps(_mm_mul_ps(det_c, b), m__mat2_mul_adj(a, d_c));
+
+   /* |m| = |a||d| + |b||c| - trace(a_b * d_c) */
+   tr = _mm_mul_ps(a_b, M__SWIZZLE(d_c, 0, 2, 1, 3));
+   tr = _mm_hadd_ps(tr, tr);
+   tr = _mm_hadd_ps(tr, tr);
+   det = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(det_a, det_d), _mm_mul_ps(det_b, det_c)), tr);
+
+   if (_mm_cvtss_f32(det) == 0.0f) {
+      m_mat4_identity(dest);
+      return;
+   }
+
+   rdet = _mm_div_ps(_mm_setr_ps(1.0f, -1.0f, -1.0f, 1.0f), det);
+   x = _mm_mul_ps(x, rdet);
+   y = _mm_mul_ps(y, rdet);
+   z = _mm_mul_ps(z, rdet);
+   w = _mm_mul_ps(w, rdet);
+
+   /* adjugate of the blocks back to columns */
+   _mm_storeu_ps(dest, M__SHUFFLE(x, y, 3, 1, 3, 1));
+   _mm_storeu_ps(dest + 4, M__SHUFFLE(x, y, 2, 0, 2, 0));
+   _mm_storeu_ps(dest + 8, M__SHUFFLE(z, w, 3, 1, 3, 1));
+   _mm_storeu_ps(dest + 12, M__SHUFFLE(z, w, 2, 0, 2, 0));
+}
+
+M__SSE41 static inline __m128 m__cross3_sse41(__m128 a, __m128 b)
+{
+   __m128 c = _mm_sub_ps(_mm_mul_ps(a, M__SWIZZLE(b, 1, 2, 0, 3)), _mm_mul_ps(M__SWIZZLE(a, 1, 2, 0, 3), b));
+   return M__SWIZZLE(c, 1, 2, 0, 3);
+}
+
+M__SSE41 static void m__mat4_lookat_sse41(float *dest, const float3 *pos, const float3 *dir, const float3 *up)
+{
+   __m128 d = _mm_setr_ps(dir->x, dir->y, dir->z, 0.0f);
+   __m128 u = _mm_setr_ps(up->x, up->y, up->z, 0.0f);
+   __m128 lft = m__cross3_sse41(d, u);
+   __m128 upn = m__cross3_sse41(lft, d);
+   __m128 w = _mm_setzero_ps();
+   __m128 l, m, t;
+
+   /* x, y and z of left, up and -dir side by side: they are the first 3 columns of dest,
+      the 3 axes get normalized (like M_NORMALIZE3) with one square root */
+   _MM_TRANSPOSE4_PS(lft, upn, d, w);
+   l = _mm_add_ps(_mm_add_ps(_mm_mul_ps(lft, lft), _mm_mul_ps(upn, upn)), _mm_mul_ps(d, d));
+   l = _mm_sqrt_ps(l);
+   m = _mm_div_ps(_mm_setr_ps(1.0f, 1.0f, -1.0f, 0.0f), l);
+   m = _mm_and_ps(m, _mm_cmpgt_ps(l, _mm_setzero_ps()));
+   lft = _mm_mul_ps(lft, m);
+   upn = _mm_mul_ps(upn, m);
+   d = _mm_mul_ps(d, m);
+
+   /* translation, -dot(axis, pos) */
+   t = _mm_mul_ps(lft, _mm_set1_ps(pos->x));
+   t = _mm_add_ps(t, _mm_mul_ps(upn, _mm_set1_ps(pos->y)));
+   t = _mm_add_ps(t, _mm_mul_ps(d, _mm_set1_ps(pos->z)));
+   t = _mm_sub_ps(_mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f), t);
+
+   _mm_storeu_ps(dest, lft);
+   _mm_storeu_ps(dest + 4, upn);
+   _mm_storeu_ps(dest + 8, d);
+   _mm_storeu_ps(dest + 12, t);
+}
+
+M__SSE41 static void m__mat4_transform3_sse41(float3 *dest, const float *matrix, const float3 *src)
+{
+   __m128 r = _mm_mul_ps(_mm_loadu_ps(matrix), _mm_set1_ps(src->x));
+   r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(matrix + 4), _mm_set1_ps(src->y)));
+   r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(matrix + 8), _mm_set1_ps(src->z)));
+   r = _mm_add_ps(r, _mm_loadu_ps(matrix + 12));
+   /* dest has room for 3 floats */
+   _mm_storel_pi((__m64 *)dest, r);
+   _mm_store_ss(&dest->z, _mm_movehl_ps(r, r));
+}
+
+M__SSE41 static void m__mat4_transform4_sse41(float4 *dest, const float *matrix, const float4 *src)
+{
+   __m128 v = _mm_loadu_ps(&src->x);
+   __m128 r = _mm_mul_ps(_mm_loadu_ps(matrix), M__SWIZZLE(v, 0, 0, 0, 0));
+   r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(matrix + 4), M__SWIZZLE(v, 1, 1, 1, 1)));
+   r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(matrix + 8), M__SWIZZLE(v, 2, 2, 2, 2)));
+   r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(matrix + 12), M__SWIZZLE(v, 3, 3, 3, 3)));
+   _mm_storeu_ps(&dest->x, r);
+}
+
+M__AVX2 static void m__mat4_transform3_avx2(float3 *dest, const float *matrix, const float3 *src)
+{
+   __m128 r = _mm_fmadd_ps(_mm_loadu_ps(matrix), _mm_set1_ps(src->x), _mm_loadu_ps(matrix + 12));
+   r = _mm_fmadd_ps(_mm_loadu_ps(matrix + 4), _mm_set1_ps(src->y), r);
+   r = _mm_fmadd_ps(_mm_loadu_ps(matrix + 8), _mm_set1_ps(src->z), r);
+   _mm_storel_pi((__m64 *)dest, r);
+   _mm_store_ss(&dest->z, _mm_movehl_ps(r, r));
+}
+
+M__AVX2 static void m__mat4_transform4_avx2(float4 *dest, const float *matrix, const float4 *src)
+{
+   __m128 v = _mm_loadu_ps(&src->x);
+   __m128 r = _mm_mul_ps(_mm_loadu_ps(matrix), _mm_permute_ps(v, 0x00));
+   r = _mm_fmadd_ps(_mm_loadu_ps(matrix + 4), _mm_permute_ps(v, 0x55), r);
+   r = _mm_fmadd_ps(_mm_loadu_ps(matrix + 8), _mm_permute_ps(v, 0xaa), r);
+   r = _mm_fmadd_ps(_mm_loadu_ps(matrix + 12), _mm_permute_ps(v, 0xff), r);
+   _mm_storeu_ps(&dest->x, r);
+}
+
+/* Batched kernels. The bodies are inlined with constant aligned and translate flags, they cover
+   [begin, end) in whole registers and the wrappers give the rest to the scalar code. The AVX2
+   wrappers clear the upper halves before it: gcc leaves them dirty when the scalar tail is a tail
+   call, and every SSE instruction after (libm included) would then pay for the transition. */
+#define M__INLINE inline __attribute__((always_inline))
+#define M__LOAD4(p, aligned) ((aligned) ? _mm_load_ps(p) : _mm_loadu_ps(p))
+#define M__STORE4(p, v, aligned) if (aligned) _mm_store_ps(p, v); else _mm_storeu_ps(p, v)
+#define M__LOAD8(p, aligned) ((aligned) ? _mm256_load_ps(p) : _mm256_loadu_ps(p))
+#define M__STORE8(p, v, aligned) if (aligned) _mm256_store_ps(p, v); else _mm256_storeu_ps(p, v)
+
+/* scalar elements before every stream is aligned to bytes, -1 if they can't all be */
+static int m__soa_head(const float *const *streams, int n, int count, int bytes)
+{
+   uintptr_t first = (uintptr_t)streams[0];
+   int head, i;
+   if (first & (sizeof(float) - 1))
+      return -1;
+   head = (int)(((bytes - (first & (bytes - 1))) & (bytes - 1)) / sizeof(float));
+   if (head >= count)
+      return count;
+   for (i = 1; i < n; i++) {
+      if ((uintptr_t)(streams[i] + head) & (bytes - 1))
+         return -1;
+   }
+   return head;
+}
+
+/* splits count in a scalar head, whole registers of width and a scalar tail */
+static void m__soa_split(const float *const *streams, int n, int count, int width, int *begin, int *end, int *aligned)
+{
+   int head = m__soa_head(streams, n, count, width * (int)sizeof(float));
+   *aligned = head >= 0;
+   *begin = head >= 0 ? head : 0;
+   *end = *begin + ((count - *begin) / width) * width;
+}
+
+M__SSE41 static M__INLINE void m__transform3_soa_sse41_body(const float3_soa *dest, const float *m, const float3_soa *src, int begin, int end, int translate, int aligned)
+{
+   __m128 m0 = _mm_set1_ps(m[0]), m1 = _mm_set1_ps(m[1]), m2 = _mm_set1_ps(m[2]);
+   __m128 m4 = _mm_set1_ps(m[4]), m5 = _mm_set1_ps(m[5]), m6 = _mm_set1_ps(m[6]);
+   __m128 m8 = _mm_set1_ps(m[8]), m9 = _mm_set1_ps(m[9]), m10 = _mm_set1_ps(m[10]);
+   __m128 m12 = _mm_set1_ps(m[12]), m13 = _mm_set1_ps(m[13]), m14 = _mm_set1_ps(m[14]);
+   int i;
+   for (i = begin; i < end; i += 4) {
+      __m128 x = M__LOAD4(src->x + i, aligned);
+      __m128 y = M__LOAD4(src->y + i, aligned);
+      __m128 z = M__LOAD4(src->z + i, aligned);
+      __m128 rx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m0, x), _mm_mul_ps(m4, y)), _mm_mul_ps(m8, z));
+      __m128 ry = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m1, x), _mm_mul_ps(m5, y)), _mm_mul_ps(m9, z));
+      __m128 rz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m2, x), _mm_mul_ps(m6, y)), _mm_mul_ps(m10, z));
+      if (translate) {
+         rx = _mm_add_ps(rx, m12);
+         ry = _mm_add_ps(ry, m13);
+         rz = _mm_add_ps(rz, m14);
+      }
+      M__STORE4(dest->x + i, rx, aligned);
+      M__STORE4(dest->y + i, ry, aligned);
+      M__STORE4(dest->z + i, rz, aligned);
+   }
+}
+
+M__SSE41 static void m__transform3_soa_sse41(const float3_soa *dest, const float *matrix, const float3_soa *src, int count, int translate)
+{
+   const float *streams[6] = {dest->x, dest->y, dest->z, src->x, src->y, src->z};
+   int begin, end, aligned;
+   m__soa_split(streams, 6, count, 4, &begin, &end, &aligned);
+   m__transform3_soa_range(dest, matrix, src, 0, begin, translate);
+   if (aligned) {
+      if (translate) m__transform3_soa_sse41_body(dest, matrix, src, begin, end, 1, 1);
+      else m__transform3_soa_sse41_body(dest, matrix, src, begin, end, 0, 1);
+   }
+   else {
+      if (translate) m__transform3_soa_sse41_body(dest, matrix, src, begin, end, 1, 0);
+      else m__transform3_soa_sse41_body(dest, matrix, src, begin, end, 0, 0);
+   }
+   m__transform3_soa_range(dest, matrix, src, end, count, translate);
+}
+
+M__SSE41 static void m__mat4_transform3_soa_sse41(const float3_soa *dest, const float *matrix, const float3_soa *src, int count)
+{
+   m__transform3_soa_sse41(dest, matrix, src, count, 1);
+}
+
+M__SSE41 static void m__mat4_rotate3_soa_sse41(const float3_soa *dest, const float *matrix, const float3_soa *src, int count)
+{
+   m__transform3_soa_sse41(dest, matrix, src, count, 0);
+}
+
+M__SSE41 static M__INLINE void m__normalize3_soa_sse41_body(const float3_soa *dest, const float3_soa *src, int begin, int end, int aligned)
+{
+   __m128 one = _mm_set1_ps(1.0f), zero = _mm_setzero_ps();
+   int i;
+   for (i = begin; i < end; i += 4) {
+      __m128 x = M__LOAD4(src->x + i, aligned);
+      __m128 y = M__LOAD4(src->y + i, aligned);
+      __m128 z = M__LOAD4(src->z + i, aligned);
+      __m128 l = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z)));
+      __m128 s = _mm_and_ps(_mm_div_ps(one, l), _mm_cmpgt_ps(l, zero));
+      M__STORE4(dest->x + i, _mm_mul_ps(x, s), aligned);
+      M__STORE4(dest->y + i, _mm_mul_ps(y, s), aligned);
+      M__STORE4(dest->z + i, _mm_mul_ps(z, s), aligned);
+   }
+}
+
+M__SSE41 static void m__normalize3_soa_sse41(const float3_soa *dest, const float3_soa *src, int count)
+{
+   const float *streams[6] = {dest->x, dest->y, dest->z, src->x, src->y, src->z};
+   int begin, end, aligned;
+   m__soa_split(streams, 6, count, 4, &begin, &end, &aligned);
+   m__normalize3_soa_range(dest, src, 0, begin);
+   if (aligned) m__normalize3_soa_sse41_body(dest, src, begin, end, 1);
+   else m__normalize3_soa_sse41_body(dest, src, begin, end, 0);
+   m__normalize3_soa_range(dest, src, end, count);
+}
+
+M__SSE41 static M__INLINE void m__transform_aabb_soa_sse41_body(const float3_soa *dest_min, const float3_soa *dest_max, const float *m, const float3_soa *src_min, const float3_soa *src_max, int begin, int end, int aligned)
+{
+   int i, j, k;
+   for (i = begin; i < end; i += 4) {
+      __m128 mn[3], mx[3], lo[3], hi[3];
+      mn[0] = M__LOAD4(src_min->x + i, aligned);
+      mn[1] = M__LOAD4(src_min->y + i, aligned);
+      mn[2] = M__LOAD4(src_min->z + i, aligned);
+      mx[0] = M__LOAD4(src_max->x + i, aligned);
+      mx[1] = M__LOAD4(src_max->y + i, aligned);
+      mx[2] = M__LOAD4(src_max->z + i, aligned);
+      for (j = 0; j < 3; j++) {
+         lo[j] = hi[j] = _mm_set1_ps(m[12 + j]);
+         for (k = 0; k < 3; k++) {
+            __m128 e = _mm_set1_ps(m[k * 4 + j]);
+            __m128 a = _mm_mul_ps(e, mn[k]);
+            __m128 b = _mm_mul_ps(e, mx[k]);
+            lo[j] = _mm_add_ps(lo[j], _mm_min_ps(a, b));
+            hi[j] = _mm_add_ps(hi[j], _mm_max_ps(a, b));
+         }
+      }
+      M__STORE4(dest_min->x + i, lo[0], aligned);
+      M__STORE4(dest_min->y + i, lo[1], aligned);
+      M__STORE4(dest_min->z + i, lo[2], aligned);
+      M__STORE4(dest_max->x + i, hi[0], aligned);
+      M__STORE4(dest_max->y + i, hi[1], aligned);
+      M__STORE4(dest_max->z + i, hi[2], aligned);
+   }
+}
+
+M__SSE41 static void m__mat4_transform_aabb_soa_sse41(const float3_soa *dest_min, const float3_soa *dest_max, const float *matrix, const float3_soa *src_min, const float3_soa *src_max, int count)
+{
+   const float *streams[12] = {dest_min->x, dest_min->y, dest_min->z, dest_max->x, dest_max->y, dest_max->z,
+                               src_min->x, src_min->y, src_min->z, src_max->x, src_max->y, src_max->z};
+   int begin, end, aligned;
+   m__soa_split(streams, 12, count, 4, &begin, &end, &aligned);
+   m__transform_aabb_soa_range(dest_min, dest_max, matrix, src_min, src_max, 0, begin);
+   if (aligned) m__transform_aabb_soa_sse41_body(dest_min, dest_max, matrix, src_min, src_max, begin, end, 1);
+   else m__transform_aabb_soa_sse41_body(dest_min, dest_max, matrix, src_min, src_max, begin, end, 0);
+   m__transform_aabb_soa_range(dest_min, dest_max, matrix, src_min, src_max, end, count);
+}
+
+/* matrices are whole registers, no head or tail */
+M__SSE41 static void m__mat4_mul_array_sse41(float *dest, const float *A, const float *B, int count)
+{
+   int i;
+   for (i = 0; i < count; i++)
+      m__mat4_mul_sse41(dest + i * 16, A + i * 16, B + i * 16);
+}
+
+M__AVX2 static M__INLINE void m__transform3_soa_avx2_body(const float3_soa *dest, const float *m, const float3_soa *src, int begin, int end, int translate, int aligned)
+{
+   __m256 m0 = _mm256_set1_ps(m[0]), m1 = _mm256_set1_ps(m[1]), m2 = _mm256_set1_ps(m[2]);
+   __m256 m4 = _mm256_set1_ps(m[4]), m5 = _mm256_set1_ps(m[5]), m6 = _mm256_set1_ps(m[6]);
+   __m256 m8 = _mm256_set1_ps(m[8]), m9 = _mm256_set1_ps(m[9]), m10 = _mm256_set1_ps(m[10]);
+   __m256 m12 = _mm256_set1_ps(translate ? m[12] : 0.0f);
+   __m256 m13 = _mm256_set1_ps(translate ? m[13] : 0.0f);
+   __m256 m14 = _mm256_set1_ps(translate ? m[14] : 0.0f);
+   int i;
+   for (i = begin; i < end; i += 8) {
+      __m256 x = M__LOAD8(src->x + i, aligned);
+      __m256 y = M__LOAD8(src->y + i, aligned);
+      __m256 z = M__LOAD8(src->z + i, aligned);
+      __m256 rx, ry, rz;
+      if (translate) {
+         rx = _mm256_fmadd_ps(m0, x, m12);
+         ry = _mm256_fmadd_ps(m1, x, m13);
+         rz = _mm256_fmadd_ps(m2, x, m14);
+      }
+      else {
+         rx = _mm256_mul_ps(m0, x);
+         ry = _mm256_mul_ps(m1, x);
+         rz = _mm256_mul_ps(m2, x);
+      }
+      rx = _mm256_fmadd_ps(m8, z, _mm256_fmadd_ps(m4, y, rx));
+      ry = _mm256_fmadd_ps(m9, z, _mm256_fmadd_ps(m5, y, ry));
+      rz = _mm256_fmadd_ps(m10, z, _mm256_fmadd_ps(m6, y, rz));
+      M__STORE8(dest->x + i, rx, aligned);
+      M__STORE8(dest->y + i, ry, aligned);
+      M__STORE8(dest->z + i, rz, aligned);
+   }
+}
+
+M__AVX2 static void m__transform3_soa_avx2(const float3_soa *dest, const float *matrix, const float3_soa *src, int count, int translate)
+{
+   const float *streams[6] = {dest->x, dest->y, dest->z, src->x, src->y, src->z};
+   int begin, end, aligned;
+   m__soa_split(streams, 6, count, 8, &begin, &end, &aligned);
+   m__transform3_soa_range(dest, matrix, src, 0, begin, translate);
+   if (aligned) {
+      if (translate) m__transform3_soa_avx2_body(dest, matrix, src, begin, end, 1, 1);
+      else m__transform3_soa_avx2_body(dest, matrix, src, begin, end, 0, 1);
+   }
+   else {
+      if (translate) m__transform3_soa_avx2_body(dest, matrix, src, begin, end, 1, 0);
+      else m__transform3_soa_avx2_body(dest, matrix, src, begin, end, 0, 0);
+   }
+   _mm256_zeroupper();
+   m__transform3_soa_range(dest, matrix, src, end, count, translate);
+}
+
+M__AVX2 static void m__mat4_transform3_soa_avx2(const float3_soa *dest, const float *matrix, const float3_soa *src, int count)
+{
+   m__transform3_soa_avx2(dest, matrix, src, count, 1);
+}
+
+M__AVX2 static void m__mat4_rotate3_soa_avx2(const float3_soa *dest, const float *matrix, const float3_soa *src, int count)
+{
+   m__transform3_soa_avx2(dest, matrix, src, count, 0);
+}
+
+M__AVX2 static M__INLINE void m__normalize3_soa_avx2_body(const float3_soa *dest, const float3_soa *src, int begin, int end, int aligned)
+{
+   __m256 one = _mm256_set1_ps(1.0f), zero = _mm256_setzero_ps();
+   int i;
+   for (i = begin; i < end; i += 8) {
+      __m256 x = M__LOAD8(src->x + i, aligned);
+      __m256 y = M__LOAD8(src->y + i, aligned);
+      __m256 z = M__LOAD8(src->z + i, aligned);
+      __m256 l = _mm256_sqrt_ps(_mm256_fmadd_ps(z, z, _mm256_fmadd_ps(y, y, _mm256_mul_ps(x, x))));
+      __m256 s = _mm256_and_ps(_mm256_div_ps(one, l), _mm256_cmp_ps(l, zero, _CMP_GT_OQ));
+      M__STORE8(dest->x + i, _mm256_mul_ps(x, s), aligned);
+      M__STORE8(dest->y + i, _mm256_mul_ps(y, s), aligned);
+      M__STORE8(dest->z + i, _mm256_mul_ps(z, s), aligned);
+   }
+}
+
+M__AVX2 static void m__normalize3_soa_avx2(const float3_soa *dest, const float3_soa *src, int count)
+{
+   const float *streams[6] = {dest->x, dest->y, dest->z, src->x, src->y, src->z};
+   int begin, end, aligned;
+   m__soa_split(streams, 6, count, 8, &begin, &end, &aligned);
+   m__normalize3_soa_range(dest, src, 0, begin);
+   if (aligned) m__normalize3_soa_avx2_body(dest, src, begin, end, 1);
+   else m__normalize3_soa_avx2_body(dest, src, begin, end, 0);
+   _mm256_zeroupper();
+   m__normalize3_soa_range(dest, src, end, count);
+}
+
+M__AVX2 static M__INLINE void m__transform_aabb_soa_avx2_body(const float3_soa *dest_min, const float3_soa *dest_max, const float *m, const float3_soa *src_min, const float3_soa *src_max, int begin, int end, int aligned)
+{
+   int i, j, k;
+   for (i = begin; i < end; i += 8) {
+      __m256 mn[3], mx[3], lo[3], hi[3];
+      mn[0] = M__LOAD8(src_min->x + i, aligned);
+      mn[1] = M__LOAD8(src_min->y + i, aligned);
+      mn[2] = M__LOAD8(src_min->z + i, aligned);
+      mx[0] = M__LOAD8(src_max->x + i, aligned);
+      mx[1] = M__LOAD8(src_max->y + i, aligned);
+      mx[2] = M__LOAD8(src_max->z + i, aligned);
+      for (j = 0; j < 3; j++) {
+         lo[j] = hi[j] = _mm256_set1_ps(m[12 + j]);
+         for (k = 0; k < 3; k++) {
+            __m256 e = _mm256_set1_ps(m[k * 4 + j]);
+            __m256 a = _mm256_mul_ps(e, mn[k]);
+            __m256 b = _mm256_mul_ps(e, mx[k]);
+            lo[j] = _mm256_add_ps(lo[j], _mm256_min_ps(a, b));
+            hi[j] = _mm256_add_ps(hi[j], _mm256_max_ps(a, b));
+         }
+      }
+      M__STORE8(dest_min->x + i, lo[0], aligned);
+      M__STORE8(dest_min->y + i, lo[1], aligned);
+      M__STORE8(dest_min->z + i, lo[2], aligned);
+      M__STORE8(dest_max->x + i, hi[0], aligned);
+      M__STORE8(dest_max->y + i, hi[1], aligned);
+      M__STORE8(dest_max->z + i, hi[2], aligned);
+   }
+}
+
+M__AVX2 static void m__mat4_transform_aabb_soa_avx2(const float3_soa *dest_min, const float3_soa *dest_max, const float *matrix, const float3_soa *src_min, const float3_soa *src_max, int count)
+{
+   const float *streams[12] = {dest_min->x, dest_min->y, dest_min->z, dest_max->x, dest_max->y, dest_max->z,
+                               src_min->x, src_min->y, src_min->z, src_max->x, src_max->y, src_max->z};
+   int begin, end, aligned;
+   m__soa_split(streams, 12, count, 8, &begin, &end, &aligned);
+   m__transform_aabb_soa_range(dest_min, dest_max, matrix, src_min, src_max, 0, begin);
+   if (aligned) m__transform_aabb_soa_avx2_body(dest_min, dest_max, matrix, src_min, src_max, begin, end, 1);
+   else m__transform_aabb_soa_avx2_body(dest_min, dest_max, matrix, src_min, src_max, begin, end, 0);
+   _mm256_zeroupper();
+   m__transform_aabb_soa_range(dest_min, dest_max, matrix, src_min, src_max, end, count);
+}
+
+M__AVX2 static void m__mat4_mul_array_avx2(float *dest, const float *A, const float *B, int count)
+{
+   int i;
+   for (i = 0; i < count; i++)
+      m__mat4_mul_avx2(dest + i * 16, A + i * 16, B + i * 16);
+}
+
+M__SSE41 static M__INLINE void m__quat_store_normalized_sse41(const float4_soa *dest, int i, __m128 x, __m128 y, __m128 z, __m128 w, int aligned)
+{
+   __m128 l = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_add_ps(_mm_mul_ps(z, z), _mm_mul_ps(w, w)));
+   __m128 valid = _mm_cmpgt_ps(l, _mm_set1_ps(1e-16f));
+   __m128 s = _mm_and_ps(_mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(l)), valid);
+   M__STORE4(dest->x + i, _mm_mul_ps(x, s), aligned);
+   M__STORE4(dest->y + i, _mm_mul_ps(y, s), aligned);
+   M__STORE4(dest->z + i, _mm_mul_ps(z, s), aligned);
+   M__STORE4(dest->w + i, _mm_blendv_ps(_mm_set1_ps(1.0f), _mm_mul_ps(w, s), valid), aligned);
+}
+
+M__SSE41 static M__INLINE void m__quat_lerp_soa_sse41_body(const float4_soa *dest, const float4_soa *A, const float4_soa *B, const float *mu, int begin, int end, int correct, int aligned)
+{
+   __m128 sign = _mm_set1_ps(-0.0f), one = _mm_set1_ps(1.0f), half = _mm_set1_ps(0.5f);
+   int i;
+   for (i = begin; i < end; i += 4) {
+      __m128 ax = M__LOAD4(A->x + i, aligned), ay = M__LOAD4(A->y + i, aligned);
+      __m128 az = M__LOAD4(A->z + i, aligned), aw = M__LOAD4(A->w + i, aligned);
+      __m128 bx = M__LOAD4(B->x + i, aligned), by = M__LOAD4(B->y + i, aligned);
+      __m128 bz = M__LOAD4(B->z + i, aligned), bw = M__LOAD4(B->w + i, aligned);
+      __m128 t = M__LOAD4(mu + i, aligned);
+      __m128 d = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)), _mm_mul_ps(az, bz)), _mm_mul_ps(aw, bw));
+      __m128 ia, ib;
+      if (correct) {
+         __m128 ad = _mm_andnot_ps(sign, d);
+         __m128 th = _mm_sub_ps(t, half);
+         __m128 ka = _mm_add_ps(_mm_set1_ps(3.55645f), _mm_mul_ps(ad, _mm_set1_ps(-1.43519f)));
+         __m128 kb = _mm_add_ps(_mm_set1_ps(-1.06021f), _mm_mul_ps(ad, _mm_set1_ps(0.215638f)));
+         __m128 k;
+         ka = _mm_add_ps(_mm_set1_ps(-3.2452f), _mm_mul_ps(ad, ka));
+         ka = _mm_add_ps(_mm_set1_ps(1.0904f), _mm_mul_ps(ad, ka));
+         kb = _mm_add_ps(_mm_set1_ps(0.848013f), _mm_mul_ps(ad, kb));
+         k = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(ka, th), th), kb);
+         t = _mm_add_ps(t, _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(t, th), _mm_sub_ps(t, one)), k));
+      }
+      /* B along the shorter arc: the sign of the dot goes to its factor */
+      ia = _mm_sub_ps(one, t);
+      ib = _mm_xor_ps(t, _mm_and_ps(d, sign));
+      m__quat_store_normalized_sse41(dest, i,
+         _mm_add_ps(_mm_mul_ps(ax, ia), _mm_mul_ps(bx, ib)),
+         _mm_add_ps(_mm_mul_ps(ay, ia), _mm_mul_ps(by, ib)),
+         _mm_add_ps(_mm_mul_ps(az, ia), _mm_mul_ps(bz, ib)),
+         _mm_add_ps(_mm_mul_ps(aw, ia), _mm_mul_ps(bw, ib)), aligned);
+   }
+}
+
+M__SSE41 static void m__quat_lerp_soa_sse41(const float4_soa *dest, const float4_soa *A, const float4_soa *B, const float *mu, int count, int correct)
+{
+   const float *streams[13] = {dest->x, dest->y, dest->z, dest->w, A->x, A->y, A->z, A->w, B->x, B->y, B->z, B->w, mu};
+   int begin, end, aligned;
+   m__soa_split(streams, 13, count, 4, &begin, &end, &aligned);
+   m__quat_lerp_soa_range(dest, A, B, mu, 0, begin, correct);
+   if (aligned) {
+      if (correct) m__quat_lerp_soa_sse41_body(dest, A, B, mu, begin, end, 1, 1);
+      else m__quat_lerp_soa_sse41_body(dest, A, B, mu, begin, end, 0, 1);
+   }
+   else {
+      if (correct) m__quat_lerp_soa_sse41_body(dest, A, B, mu, begin, end, 1, 0);
+      else m__quat_lerp_soa_sse41_body(dest, A, B, mu, begin, end, 0, 0);
+   }
+   m__quat_lerp_soa_range(dest, A, B, mu, end, count, correct);
+}
+
+M__SSE41 static void m__quat_nlerp_soa_sse41(const float4_soa *dest, const float4_soa *A, const float4_soa *B, const float *mu, int count)
+{
+   m__quat_lerp_soa_sse41(dest, A, B, mu, count, 0);
+}
+
+M__SSE41 static void m__quat_slerp_soa_sse41(const float4_soa *dest, const float4_soa *A, const float4_soa *B, const float *mu, int count)
+{
+   m__quat_lerp_soa_sse41(dest, A, B, mu, count, 1);
+}
+
+M__SSE41 static M__INLINE void m__quat_normalize_soa_sse41_body(const float4_soa *dest, const float4_soa *src, int begin, int end, int aligned)
+{
+   int i;
+   for (i = begin; i < end; i += 4) {
+      m__quat_store_normalized_sse41(dest, i, M__LOAD4(src->x + i, aligned), M__LOAD4(src->y + i, aligned),
+                                     M__LOAD4(src->z + i, aligned), M__LOAD4(src->w + i, aligned), aligned);
+   }
+}
+
+M__SSE41 static void m__quat_normalize_soa_sse41(const float4_soa *dest, const float4_soa *src, int count)
+{
+   const float *streams[8] = {dest->x, dest->y, dest->z, dest->w, src->x, src->y, src->z, src->w};
+   int begin, end, aligned;
+   m__soa_split(streams, 8, count, 4, &begin, &end, &aligned);
+   m__quat_normalize_soa_range(dest, src, 0, begin);
+   if (aligned) m__quat_normalize_soa_sse41_body(dest, src, begin, end, 1);
+   else m__quat_normalize_soa_sse41_body(dest, src, begin, end, 0);
+   m__quat_normalize_soa_range(dest, src, end, count);
+}
+
+M__SSE41 static M__INLINE void m__quat_to_mat3_soa_sse41_body(float *const *dest, const float4_soa *src, int begin, int end, int aligned)
+{
+   __m128 one = _mm_set1_ps(1.0f);
+   int i;
+   for (i = begin; i < end; i += 4) {
+      __m128 x = M__LOAD4(src->x + i, aligned), y = M__LOAD4(src->y + i, aligned);
+      __m128 z = M__LOAD4(src->z + i, aligned), w = M__LOAD4(src->w + i, aligned);
+      __m128 x2 = _mm_add_ps(x, x), y2 = _mm_add_ps(y, y), z2 = _mm_add_ps(z, z);
+      __m128 xx = _mm_mul_ps(x, x2), yy = _mm_mul_ps(y, y2), zz = _mm_mul_ps(z, z2);
+      __m128 xy = _mm_mul_ps(x, y2), xz = _mm_mul_ps(x, z2), yz = _mm_mul_ps(y, z2);
+      __m128 wx = _mm_mul_ps(w, x2), wy = _mm_mul_ps(w, y2), wz = _mm_mul_ps(w, z2);
+      M__STORE4(dest[0] + i, _mm_sub_ps(one, _mm_add_ps(yy, zz)), aligned);
+      M__STORE4(dest[1] + i, _mm_add_ps(xy, wz), aligned);
+      M__STORE4(dest[2] + i, _mm_sub_ps(xz, wy), aligned);
+      M__STORE4(dest[3] + i, _mm_sub_ps(xy, wz), aligned);
+      M__STORE4(dest[4] + i, _mm_sub_ps(one, _mm_add_ps(xx, zz)), aligned);
+      M__STORE4(dest[5] + i, _mm_add_ps(yz, wx), aligned);
+      M__STORE4(dest[6] + i, _mm_add_ps(xz, wy), aligned);
+      M__STORE4(dest[7] + i, _mm_sub_ps(yz, wx), aligned);
+      M__STORE4(dest[8] + i, _mm_sub_ps(one, _mm_add_ps(xx, yy)), aligned);
+   }
+}
+
+M__SSE41 static void m__quat_to_mat3_soa_sse41(float *const *dest, const float4_soa *src, int count)
+{
+   const float *streams[13] = {dest[0], dest[1], dest[2], dest[3], dest[4], dest[5], dest[6], dest[7], dest[8],
+                               src->x, src->y, src->z, src->w};
+   int begin, end, aligned;
+   m__soa_split(streams, 13, count, 4, &begin, &end, &aligned);
+   m__quat_to_mat3_soa_range(dest, src, 0, begin);
+   if (aligned) m__quat_to_mat3_soa_sse41_body(dest, src, begin, end, 1);
+   else m__quat_to_mat3_soa_sse41_body(dest, src, begin, end, 0);
+   m__quat_to_mat3_soa_range(dest, src, end, count);
+}
+
+M__AVX2 static M__INLINE void m__quat_store_normalized_avx2(const float4_soa *dest, int i, __m256 x, __m256 y, __m256 z, __m256 w, int aligned)
+{
+   __m256 l = _mm256_fmadd_ps(w, w, _mm256_fmadd_ps(z, z, _mm256_fmadd_ps(y, y, _mm256_mul_ps(x, x))));
+   __m256 valid = _mm256_cmp_ps(l, _mm256_set1_ps(1e-16f), _CMP_GT_OQ);
+   __m256 s = _mm256_and_ps(_mm256_div_ps(_mm256_set1_ps(1.0f), _mm256_sqrt_ps(l)), valid);
+   M__STORE8(dest->x + i, _mm256_mul_ps(x, s), aligned);
+   M__STORE8(dest->y + i, _mm256_mul_ps(y, s), aligned);
+   M__STORE8(dest->z + i, _mm256_mul_ps(z, s), aligned);
+   M__STORE8(dest->w + i, _mm256_blendv_ps(_mm256_set1_ps(1.0f), _mm256_mul_ps(w, s), valid), aligned);
+}
+
+M__AVX2 static M__INLINE void m__quat_lerp_soa_avx2_body(const float4_soa *dest, const float4_soa *A, const float4_soa *B, const float *mu, int begin, int end, int correct, int aligned)
+{
+   __m256 sign = _mm256_set1_ps(-0.0f), one = _mm256_set1_ps(1.0f), half = _mm256_set1_ps(0.5f);
+   int i;
+   for (i = begin; i < end; i += 8) {
+      __m256 ax = M__LOAD8(A->x + i, aligned), ay = M__LOAD8(A->y + i, aligned);
+      __m256 az = M__LOAD8(A->z + i, aligned), aw = M__LOAD8(A->w + i, aligned);
+      __m256 bx = M__LOAD8(B->x + i, aligned), by = M__LOAD8(B->y + i, aligned);
+      __m256 bz = M__LOAD8(B->z + i, aligned), bw = M__LOAD8(B->w + i, aligned);
+      __m256 t = M__LOAD8(mu + i, aligned);
+      __m256 d = _mm256_fmadd_ps(aw, bw, _mm256_fmadd_ps(az, bz, _mm256_fmadd_ps(ay, by, _mm256_mul_ps(ax, bx))));
+      __m256 ia, ib;
+      if (correct) {
+         __m256 ad = _mm256_andnot_ps(sign, d);
+         __m256 th = _mm256_sub_ps(t, half);
+         __m256 ka = _mm256_fmadd_ps(ad, _mm256_set1_ps(-1.43519f), _mm256_set1_ps(3.55645f));
+         __m256 kb = _mm256_fmadd_ps(ad, _mm256_set1_ps(0.215638f), _mm256_set1_ps(-1.06021f));
+         __m256 k;
+         ka = _mm256_fmadd_ps(ad, ka, _mm256_set1_ps(-3.2452f));
+         ka = _mm256_fmadd_ps(ad, ka, _mm256_set1_ps(1.0904f));
+         kb = _mm256_fmadd_ps(ad, kb, _mm256_set1_ps(0.848013f));
+         k = _mm256_fmadd_ps(_mm256_mul_ps(ka, th), th, kb);
+         t = _mm256_fmadd_ps(_mm256_mul_ps(_mm256_mul_ps(t, th), _mm256_sub_ps(t, one)), k, t);
+      }
+      ia = _mm256_sub_ps(one, t);
+      ib = _mm256_xor_ps(t, _mm256_and_ps(d, sign));
+      m__quat_store_normalized_avx2(dest, i,
+         _mm256_fmadd_ps(bx, ib, _mm256_mul_ps(ax, ia)),
+         _mm256_fmadd_ps(by, ib, _mm256_mul_ps(ay, ia)),
+         _mm256_fmadd_ps(bz, ib, _mm256_mul_ps(az, ia)),
+         _mm256_fmadd_ps(bw, ib, _mm256_mul_ps(aw, ia)), aligned);
+   }
+}
+
+M__AVX2 static void m__quat_lerp_soa_avx2(const float4_soa *dest, const float4_soa *A, const float4_soa *B, const float *mu, int count, int correct)
+{
+   const float *streams[13] = {dest->x, dest->y, dest->z, dest->w, A->x, A->y, A->z, A->w, B->x, B->y, B->z, B->w, mu};
+   int begin, end, aligned;
+   m__soa_split(streams, 13, count, 8, &begin, &end, &aligned);
+   m__quat_lerp_soa_range(dest, A, B, mu, 0, begin, correct);
+   if (aligned) {
+      if (correct) m__quat_lerp_soa_avx2_body(dest, A, B, mu, begin, end, 1, 1);
+      else m__quat_lerp_soa_avx2_body(dest, A, B, mu, begin, end, 0, 1);
+   }
+   else {
+      if (correct) m__quat_lerp_soa_avx2_body(dest, A, B, mu, begin, end, 1, 0);
+      else m__quat_lerp_soa_avx2_body(dest, A, B, mu, begin, end, 0, 0);
+   }
+   _mm256_zeroupper();
+   m__quat_lerp_soa_range(dest, A, B, mu, end, count, correct);
+}
+
+M__AVX2 static void m__quat_nlerp_soa_avx2(const float4_soa *dest, const float4_soa *A, const float4_soa *B, const float *mu, int count)
+{
+   m__quat_lerp_soa_avx2(dest, A, B, mu, count, 0);
+}
+
+M__AVX2 static void m__quat_slerp_soa_avx2(const float4_soa *dest, const float4_soa *A, const float4_soa *B, const float *mu, int count)
+{
+   m__quat_lerp_soa_avx2(dest, A, B, mu, count, 1);
+}
+
+M__AVX2 static M__INLINE void m__quat_normalize_soa_avx2_body(const float4_soa *dest, const float4_soa *src, int begin, int end, int aligned)
+{
+   int i;
+   for (i = begin; i < end; i += 8) {
+      m__quat_store_normalized_avx2(dest, i, M__LOAD8(src->x + i, aligned), M__LOAD8(src->y + i, aligned),
+                                    M__LOAD8(src->z + i, aligned), M__LOAD8(src->w + i, aligned), aligned);
+   }
+}
+
+M__AVX2 static void m__quat_normalize_soa_avx2(const float4_soa *dest, const float4_soa *src, int count)
+{
+   const float *streams[8] = {dest->x, dest->y, dest->z, dest->w, src->x, src->y, src->z, src->w};
+   int begin, end, aligned;
+   m__soa_split(streams, 8, count, 8, &begin, &end, &aligned);
+   m__quat_normalize_soa_range(dest, src, 0, begin);
+   if (aligned) m__quat_normalize_soa_avx2_body(dest, src, begin, end, 1);
+   else m__quat_normalize_soa_avx2_body(dest, src, begin, end, 0);
+   _mm256_zeroupper();
+   m__quat_normalize_soa_range(dest, src, end, count);
+}
+
+M__AVX2 static M__INLINE void m__quat_to_mat3_soa_avx2_body(float *const *dest, const float4_soa *src, int begin, int end, int aligned)
+{
+   __m256 one = _mm256_set1_ps(1.0f);
+   int i;
+   for (i = begin; i < end; i += 8) {
+      __m256 x = M__LOAD8(src->x + i, aligned), y = M__LOAD8(src->y + i, aligned);
+      __m256 z = M__LOAD8(src->z + i, aligned), w = M__LOAD8(src->w + i, aligned);
+      __m256 x2 = _mm256_add_ps(x, x), y2 = _mm256_add_ps(y, y), z2 = _mm256_add_ps(z, z);
+      __m256 xx = _mm256_mul_ps(x, x2), yy = _mm256_mul_ps(y, y2), zz = _mm256_mul_ps(z, z2);
+      __m256 xy = _mm256_mul_ps(x, y2), xz = _mm256_mul_ps(x, z2), yz = _mm256_mul_ps(y, z2);
+      __m256 wx = _mm256_mul_ps(w, x2), wy = _mm256_mul_ps(w, y2), wz = _mm256_mul_ps(w, z2);
+      M__STORE8(dest[0] + i, _mm256_sub_ps(one, _mm256_add_ps(yy, zz)), aligned);
+      M__STORE8(dest[1] + i, _mm256_add_ps(xy, wz), aligned);
+      M__STORE8(dest[2] + i, _mm256_sub_ps(xz, wy), aligned);
+      M__STORE8(dest[3] + i, _mm256_sub_ps(xy, wz), aligned);
+      M__STORE8(dest[4] + i, _mm256_sub_ps(one, _mm256_add_ps(xx, zz)), aligned);
+      M__STORE8(dest[5] + i, _mm256_add_ps(yz, wx), aligned);
+      M__STORE8(dest[6] + i, _mm256_add_ps(xz, wy), aligned);
+      M__STORE8(dest[7] + i, _mm256_sub_ps(yz, wx), aligned);
+      M__STORE8(dest[8] + i, _mm256_sub_ps(one, _mm256_add_ps(xx, yy)), aligned);
+   }
+}
+
+M__AVX2 static void m__quat_to_mat3_soa_avx2(float *const *dest, const float4_soa *src, int count)
+{
+   const float *streams[13] = {dest[0], dest[1], dest[2], dest[3], dest[4], dest[5], dest[6], dest[7], dest[8],
+                               src->x, src->y, src->z, src->w};
+   int begin, end, aligned;
+   m__soa_split(streams, 13, count, 8, &begin, &end, &aligned);
+   m__quat_to_mat3_soa_range(dest, src, 0, begin);
+   if (aligned) m__quat_to_mat3_soa_avx2_body(dest, src, begin, end, 1);
+   else m__quat_to_mat3_soa_avx2_body(dest, src, begin, end, 0);
+   _mm256_zeroupper();
+   m__quat_to_mat3_soa_range(dest, src, end, count);
+}
+
+/* Ray kernels, the SSE4.1 ones evaluate the scalar expressions in the same order (same results), the
+   AVX2 ones fuse them (fma). */
+typedef struct {__m128 x, y, z;} m__float3x4;
+typedef struct {__m256 x, y, z;} m__float3x8;
+
+#define M__MSUB(a, b, c, d) _mm_sub_ps(_mm_mul_ps(a, b), _mm_mul_ps(c, d))
+#define M__DOT(ax, ay, az, bx, by, bz) _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)), _mm_mul_ps(az, bz))
+
+M__SSE41 static M__INLINE __m128 m__ray_triangle_sse41(const m__float3x4 *o, const m__float3x4 *d, const m__float3x4 *a, const m__float3x4 *b, const m__float3x4 *c, __m128 *u, __m128 *v)
+{
+   __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f), miss = _mm_set1_ps(M_RAY_MISS);
+   __m128 e1x = _mm_sub_ps(b->x, a->x), e1y = _mm_sub_ps(b->y, a->y), e1z = _mm_sub_ps(b->z, a->z);
+   __m128 e2x = _mm_sub_ps(c->x, a->x), e2y = _mm_sub_ps(c->y, a->y), e2z = _mm_sub_ps(c->z, a->z);
+   __m128 sx = _mm_sub_ps(o->x, a->x), sy = _mm_sub_ps(o->y, a->y), sz = _mm_sub_ps(o->z, a->z);
+   __m128 px = M__MSUB(d->y, e2z, d->z, e2y), py = M__MSUB(d->z, e2x, d->x, e2z), pz = M__MSUB(d->x, e2y, d->y, e2x);
+   __m128 qx = M__MSUB(sy, e1z, sz, e1y), qy = M__MSUB(sz, e1x, sx, e1z), qz = M__MSUB(sx, e1y, sy, e1x);
+   __m128 det = M__DOT(e1x, e1y, e1z, px, py, pz);
+   __m128 inv = _mm_div_ps(one, det);
+   __m128 uu = _mm_mul_ps(M__DOT(sx, sy, sz, px, py, pz), inv);
+   __m128 vv = _mm_mul_ps(M__DOT(d->x, d->y, d->z, qx, qy, qz), inv);
+   __m128 t = _mm_mul_ps(M__DOT(e2x, e2y, e2z, qx, qy, qz), inv);
+   __m128 adet = _mm_andnot_ps(_mm_set1_ps(-0.0f), det);
+   __m128 uv = _mm_add_ps(uu, vv);
+   __m128 hit = _mm_and_ps(_mm_cmpgt_ps(adet, zero), _mm_cmpge_ps(uu, zero));
+   hit = _mm_and_ps(hit, _mm_and_ps(_mm_cmpge_ps(vv, zero), _mm_cmple_ps(uv, one)));
+   hit = _mm_and_ps(hit, _mm_and_ps(_mm_cmpgt_ps(t, zero), _mm_cmplt_ps(t, miss)));
+   *u = uu;
+   *v = vv;
+   return _mm_blendv_ps(miss, t, hit);
+}
+
+/* inv is 1 / direction, NaN compares false so the axes with 0 * inf drop out of the min / max */
+M__SSE41 static M__INLINE __m128 m__ray_box_sse41(const m__float3x4 *o, const m__float3x4 *inv, const m__float3x4 *lo, const m__float3x4 *hi)
+{
+   __m128 tnear = _mm_setzero_ps(), miss = _mm_set1_ps(M_RAY_MISS), tfar = miss;
+   __m128 valid = _mm_castsi128_ps(_mm_set1_epi32(-1));
+   const __m128 *of = &o->x, *invf = &inv->x, *lof = &lo->x, *hif = &hi->x;
+   int k;
+   for (k = 0; k < 3; k++) {
+      __m128 a = _mm_sub_ps(lof[k], of[k]), b = _mm_sub_ps(hif[k], of[k]);
+      __m128 i = invf[k];
+      __m128 t0 = _mm_mul_ps(a, i), t1 = _mm_mul_ps(b, i);
+      __m128 skip = _mm_cmpunord_ps(t0, t1);
+      valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpord_ps(a, b), _mm_cmpord_ps(i, i)));
+      tnear = _mm_max_ps(_mm_or_ps(_mm_min_ps(t0, t1), skip), tnear);
+      tfar = _mm_min_ps(_mm_or_ps(_mm_max_ps(t0, t1), skip), tfar);
+   }
+   valid = _mm_and_ps(valid, _mm_cmple_ps(tnear, tfar));
+   return _mm_blendv_ps(miss, tnear, valid);
+}
+
+M__SSE41 static M__INLINE int m__ray_triangle_soa_sse41_body(float *dest, float *u, float *v, const float3 *o, const float3 *d, const float3_soa *A, const float3_soa *B, const float3_soa *C, int begin, int end, int aligned)
+{
+   m__float3x4 ro = {_mm_set1_ps(o->x), _mm_set1_ps(o->y), _mm_set1_ps(o->z)};
+   m__float3x4 rd = {_mm_set1_ps(d->x), _mm_set1_ps(d->y), _mm_set1_ps(d->z)};
+   __m128 miss = _mm_set1_ps(M_RAY_MISS);
+   int i, hits = 0;
+   for (i = begin; i < end; i += 4) {
+      m__float3x4 a = {M__LOAD4(A->x + i, aligned), M__LOAD4(A->y + i, aligned), M__LOAD4(A->z + i, aligned)};
+      m__float3x4 b = {M__LOAD4(B->x + i, aligned), M__LOAD4(B->y + i, aligned), M__LOAD4(B->z + i, aligned)};
+      m__float3x4 c = {M__LOAD4(C->x + i, aligned), M__LOAD4(C->y + i, aligned), M__LOAD4(C->z + i, aligned)};
+      __m128 uu, vv, t = m__ray_triangle_sse41(&ro, &rd, &a, &b, &c, &uu, &vv);
+      M__STORE4(dest + i, t, aligned);
+      M__STORE4(u + i, uu, aligned);
+      M__STORE4(v + i, vv, aligned);
+      hits += __builtin_popcount(_mm_movemask_ps(_mm_cmpneq_ps(t, miss)));
+   }
+   return hits;
+}
+
+M__SSE41 static int m__ray_triangle_soa_sse41(float *dest, float *u, float *v, const float3 *o, const float3 *d, const float3_soa *A, const float3_soa *B, const float3_soa *C, int count)
+{
+   const float *streams[12] = {dest, u, v, A->x, A->y, A->z, B->x, B->y, B->z, C->x, C->y, C->z};
+   int begin, end, aligned, hits;
+   m__soa_split(streams, 12, count, 4, &begin, &end, &aligned);
+   hits = m__ray_triangle_soa_range(dest, u, v, o, d, A, B, C, 0, begin);
+   if (aligned) hits += m__ray_triangle_soa_sse41_body(dest, u, v, o, d, A, B, C, begin, end, 1);
+   else hits += m__ray_triangle_soa_sse41_body(dest, u, v, o, d, A, B, C, begin, end, 0);
+   return hits + m__ray_triangle_soa_range(dest, u, v, o, d, A, B, C, end, count);
+}
+
+M__SSE41 static M__INLINE int m__ray_box_soa_sse41_body(float *dest, const float3 *o, const float3 *d, const float3_soa *lo, const float3_soa *hi, int begin, int end, int aligned)
+{
+   m__float3x4 ro = {_mm_set1_ps(o->x), _mm_set1_ps(o->y), _mm_set1_ps(o->z)};
+   m__float3x4 inv = {_mm_set1_ps(1.0f / d->x), _mm_set1_ps(1.0f / d->y), _mm_set1_ps(1.0f / d->z)};
+   __m128 miss = _mm_set1_ps(M_RAY_MISS);
+   int i, hits = 0;
+   for (i = begin; i < end; i += 4) {
+      m__float3x4 l = {M__LOAD4(lo->x + i, aligned), M__LOAD4(lo->y + i, aligned), M__LOAD4(lo->z + i, aligned)};
+      m__float3x4 h = {M__LOAD4(hi->x + i, aligned), M__LOAD4(hi->y + i, aligned), M__LOAD4(hi->z + i, aligned)};
+      __m128 t = m__ray_box_sse41(&ro, &inv, &l, &h);
+      M__STORE4(dest + i, t, aligned);
+      hits += __builtin_popcount(_mm_movemask_ps(_mm_cmpneq_ps(t, miss)));
+   }
+   return hits;
+}
+
+M__SSE41 static int m__ray_box_soa_sse41(float *dest, const float3 *o, const float3 *d, const float3_soa *lo, const float3_soa *hi, int count)
+{
+   const float *streams[7] = {dest, lo->x, lo->y, lo->z, hi->x, hi->y, hi->z};
+   int begin, end, aligned, hits;
+   m__soa_split(streams, 7, count, 4, &begin, &end, &aligned);
+   hits = m__ray_box_soa_range(dest, o, d, lo, hi, 0, begin);
+   if (aligned) hits += m__ray_box_soa_sse41_body(dest, o, d, lo, hi, begin, end, 1);
+   else hits += m__ray_box_soa_sse41_body(dest, o, d, lo, hi, begin, end, 0);
+   return hits + m__ray_box_soa_range(dest, o, d, lo, hi, end, count);
+}
+
+M__SSE41 static M__INLINE int m__ray_packet_triangle_sse41_body(float *dest, float *u, float *v, const float3_soa *O, const float3_soa *D, const float3 *a, const float3 *b, const float3 *c, int begin, int end, int aligned)
+{
+   m__float3x4 va = {_mm_set1_ps(a->x), _mm_set1_ps(a->y), _mm_set1_ps(a->z)};
+   m__float3x4 vb = {_mm_set1_ps(b->x), _mm_set1_ps(b->y), _mm_set1_ps(b->z)};
+   m__float3x4 vc = {_mm_set1_ps(c->x), _mm_set1_ps(c->y), _mm_set1_ps(c->z)};
+   __m128 miss = _mm_set1_ps(M_RAY_MISS);
+   int i, hits = 0;
+   for (i = begin; i < end; i += 4) {
+      m__float3x4 o = {M__LOAD4(O->x + i, aligned), M__LOAD4(O->y + i, aligned), M__LOAD4(O->z + i, aligned)};
+      m__float3x4 d = {M__LOAD4(D->x + i, aligned), M__LOAD4(D->y + i, aligned), M__LOAD4(D->z + i, aligned)};
+      __m128 uu, vv, t = m__ray_triangle_sse41(&o, &d, &va, &vb, &vc, &uu, &vv);
+      M__STORE4(dest + i, t, aligned);
+      M__STORE4(u + i, uu, aligned);
+      M__STORE4(v + i, vv, aligned);
+      hits += __builtin_popcount(_mm_movemask_ps(_mm_cmpneq_ps(t, miss)));
+   }
+   return hits;
+}
+
+M__SSE41 static int m__ray_packet_triangle_sse41(float *dest, float *u, float *v, const float3_soa *O, const float3_soa *D, const float3 *a, const float3 *b, const float3 *c, int count)
+{
+   const float *streams[9] = {dest, u, v, O->x, O->y, O->z, D->x, D->y, D->z};
+   int begin, end, aligned, hits;
+   m__soa_split(streams, 9, count, 4, &begin, &end, &aligned);
+   hits = m__ray_packet_triangle_range(dest, u, v, O, D, a, b, c, 0, begin);
+   if (aligned) hits += m__ray_packet_triangle_sse41_body(dest, u, v, O, D, a, b, c, begin, end, 1);
+   else hits += m__ray_packet_triangle_sse41_body(dest, u, v, O, D, a, b, c, begin, end, 0);
+   return hits + m__ray_packet_triangle_range(dest, u, v, O, D, a, b, c, end, count);
+}
+
+M__SSE41 static M__INLINE int m__ray_packet_box_sse41_body(float *dest, const float3_soa *O, const float3_soa *D, const float3 *lo, const float3 *hi, int begin, int end, int aligned)
+{
+   m__float3x4 l = {_mm_set1_ps(lo->x), _mm_set1_ps(lo->y), _mm_set1_ps(lo->z)};
+   m__float3x4 h = {_mm_set1_ps(hi->x), _mm_set1_ps(hi->y), _mm_set1_ps(hi->z)};
+   __m128 one = _mm_set1_ps(1.0f), miss = _mm_set1_ps(M_RAY_MISS);
+   int i, hits = 0;
+   for (i = begin; i < end; i += 4) {
+      m__float3x4 o = {M__LOAD4(O->x + i, aligned), M__LOAD4(O->y + i, aligned), M__LOAD4(O->z + i, aligned)};
+      m__float3x4 inv = {_mm_div_ps(one, M__LOAD4(D->x + i, aligned)), _mm_div_ps(one, M__LOAD4(D->y + i, aligned)),
+                         _mm_div_ps(one, M__LOAD4(D->z + i, aligned))};
+      __m128 t = m__ray_box_sse41(&o, &inv, &l, &h);
+      M__STORE4(dest + i, t, aligned);
+      hits += __builtin_popcount(_mm_movemask_ps(_mm_cmpneq_ps(t, miss)));
+   }
+   return hits;
+}
+
+M__SSE41 static int m__ray_packet_box_sse41(float *dest, const float3_soa *O, const float3_soa *D, const float3 *lo, const float3 *hi, int count)
+{
+   const float *streams[7] = {dest, O->x, O->y, O->z, D->x, D->y, D->z};
+   int begin, end, aligned, hits;
+   m__soa_split(streams, 7, count, 4, &begin, &end, &aligned);
+   hits = m__ray_packet_box_range(dest, O, D, lo, hi, 0, begin);
+   if (aligned) hits += m__ray_packet_box_sse41_body(dest, O, D, lo, hi, begin, end, 1);
+   else hits += m__ray_packet_box_sse41_body(dest, O, D, lo, hi, begin, end, 0);
+   return hits + m__ray_packet_box_range(dest, O, D, lo, hi, end, count);
+}
+
+#undef M__MSUB
+#undef M__DOT
+#define M__MSUB8(a, b, c, d) _mm256_fmsub_ps(a, b, _mm256_mul_ps(c, d))
+#define M__DOT8(ax, ay, az, bx, by, bz) _mm256_fmadd_ps(az, bz, _mm256_fmadd_ps(ay, by, _mm256_mul_ps(ax, bx)))
+
+M__AVX2 static M__INLINE __m256 m__ray_triangle_avx2(const m__float3x8 *o, const m__float3x8 *d, const m__float3x8 *a, const m__float3x8 *b, const m__float3x8 *c, __m256 *u, __m256 *v)
+{
+   __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f), miss = _mm256_set1_ps(M_RAY_MISS);
+   __m256 e1x = _mm256_sub_ps(b->x, a->x), e1y = _mm256_sub_ps(b->y, a->y), e1z = _mm256_sub_ps(b->z, a->z);
+   __m256 e2x = _mm256_sub_ps(c->x, a->x), e2y = _mm256_sub_ps(c->y, a->y), e2z = _mm256_sub_ps(c->z, a->z);
+   __m256 sx = _mm256_sub_ps(o->x, a->x), sy = _mm256_sub_ps(o->y, a->y), sz = _mm256_sub_ps(o->z, a->z);
+   __m256 px = M__MSUB8(d->y, e2z, d->z, e2y), py = M__MSUB8(d->z, e2x, d->x, e2z), pz = M__MSUB8(d->x, e2y, d->y, e2x);
+   __m256 qx = M__MSUB8(sy, e1z, sz, e1y), qy = M__MSUB8(sz, e1x, sx, e1z), qz = M__MSUB8(sx, e1y, sy, e1x);
+   __m256 det = M__DOT8(e1x, e1y, e1z, px, py, pz);
+   __m256 inv = _mm256_div_ps(one, det);
+   __m256 uu = _mm256_mul_ps(M__DOT8(sx, sy, sz, px, py, pz), inv);
+   __m256 vv = _mm256_mul_ps(M__DOT8(d->x, d->y, d->z, qx, qy, qz), inv);
+   __m256 t = _mm256_mul_ps(M__DOT8(e2x, e2y, e2z, qx, qy, qz), inv);
+   __m256 adet = _mm256_andnot_ps(_mm256_set1_ps(-0.0f), det);
+   __m256 uv = _mm256_add_ps(uu, vv);
+   __m256 hit = _mm256_and_ps(_mm256_cmp_ps(adet, zero, _CMP_GT_OQ), _mm256_cmp_ps(uu, zero, _CMP_GE_OQ));
+   hit = _mm256_and_ps(hit, _mm256_and_ps(_mm256_cmp_ps(vv, zero, _CMP_GE_OQ), _mm256_cmp_ps(uv, one, _CMP_LE_OQ)));
+   hit = _mm256_and_ps(hit, _mm256_and_ps(_mm256_cmp_ps(t, zero, _CMP_GT_OQ), _mm256_cmp_ps(t, miss, _CMP_LT_OQ)));
+   *u = uu;
+   *v = vv;
+   return _mm256_blendv_ps(miss, t, hit);
+}
+
+/* inv is 1 / direction, NaN compares false so the axes with 0 * inf drop out of the min / max */
+M__AVX2 static M__INLINE __m256 m__ray_box_avx2(const m__float3x8 *o, const m__float3x8 *inv, const m__float3x8 *lo, const m__float3x8 *hi)
+{
+   __m256 tnear = _mm256_setzero_ps(), miss = _mm256_set1_ps(M_RAY_MISS), tfar = miss;
+   __m256 valid = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+   const __m256 *of = &o->x, *invf = &inv->x, *lof = &lo->x, *hif = &hi->x;
+   int k;
+   for (k = 0; k < 3; k++) {
+      __m256 a = _mm256_sub_ps(lof[k], of[k]), b = _mm256_sub_ps(hif[k], of[k]);
+      __m256 i = invf[k];
+      __m256 t0 = _mm256_mul_ps(a, i), t1 = _mm256_mul_ps(b, i);
+      __m256 skip = _mm256_cmp_ps(t0, t1, _CMP_UNORD_Q);
+      valid = _mm256_and_ps(valid, _mm256_and_ps(_mm256_cmp_ps(a, b, _CMP_ORD_Q), _mm256_cmp_ps(i, i, _CMP_ORD_Q)));
+      tnear = _mm256_max_ps(_mm256_or_ps(_mm256_min_ps(t0, t1), skip), tnear);
+      tfar = _mm256_min_ps(_mm256_or_ps(_mm256_max_ps(t0, t1), skip), tfar);
+   }
+   valid = _mm256_and_ps(valid, _mm256_cmp_ps(tnear, tfar, _CMP_LE_OQ));
+   return _mm256_blendv_ps(miss, tnear, valid);
+}
+
+M__AVX2 static M__INLINE int m__ray_triangle_soa_avx2_body(float *dest, float *u, float *v, const float3 *o, const float3 *d, const float3_soa *A, const float3_soa *B, const float3_soa *C, int begin, int end, int aligned)
+{
+   m__float3x8 ro = {_mm256_set1_ps(o->x), _mm256_set1_ps(o->y), _mm256_set1_ps(o->z)};
+   m__float3x8 rd = {_mm256_set1_ps(d->x), _mm256_set1_ps(d->y), _mm256_set1_ps(d->z)};
+   __m256 miss = _mm256_set1_ps(M_RAY_MISS);
+   int i, hits = 0;
+   for (i = begin; i < end; i += 8) {
+      m__float3x8 a = {M__LOAD8(A->x + i, aligned), M__LOAD8(A->y + i, aligned), M__LOAD8(A->z + i, aligned)};
+      m__float3x8 b = {M__LOAD8(B->x + i, aligned), M__LOAD8(B->y + i, aligned), M__LOAD8(B->z + i, aligned)};
+      m__float3x8 c = {M__LOAD8(C->x + i, aligned), M__LOAD8(C->y + i, aligned), M__LOAD8(C->z + i, aligned)};
+      __m256 uu, vv, t = m__ray_triangle_avx2(&ro, &rd, &a, &b, &c, &uu, &vv);
+      M__STORE8(dest + i, t, aligned);
+      M__STORE8(u + i, uu, aligned);
+      M__STORE8(v + i, vv, aligned);
+      hits += __builtin_popcount(_mm256_movemask_ps(_mm256_cmp_ps(t, miss, _CMP_NEQ_OQ)));
+   }
+   return hits;
+}
+
+M__AVX2 static int m__ray_triangle_soa_avx2(float *dest, float *u, float *v, const float3 *o, const float3 *d, const float3_soa *A, const float3_soa *B, const float3_soa *C, int count)
+{
+   const float *streams[12] = {dest, u, v, A->x, A->y, A->z, B->x, B->y, B->z, C->x, C->y, C->z};
+   int begin, end, aligned, hits;
+   m__soa_split(streams, 12, count, 8, &begin, &end, &aligned);
+   hits = m__ray_triangle_soa_range(dest, u, v, o, d, A, B, C, 0, begin);
+   if (aligned) hits += m__ray_triangle_soa_avx2_body(dest, u, v, o, d, A, B, C, begin, end, 1);
+   else hits += m__ray_triangle_soa_avx2_body(dest, u, v, o, d, A, B, C, begin, end, 0);
+   _mm256_zeroupper();
+   return hits + m__ray_triangle_soa_range(dest, u, v, o, d, A, B, C, end, count);
+}
+
+M__AVX2 static M__INLINE int m__ray_box_soa_avx2_body(float *dest, const float3 *o, const float3 *d, const float3_soa *lo, const float3_soa *hi, int begin, int end, int aligned)
+{
+   m__float3x8 ro = {_mm256_set1_ps(o->x), _mm256_set1_ps(o->y), _mm256_set1_ps(o->z)};
+   m__float3x8 inv = {_mm256_set1_ps(1.0f / d->x), _mm256_set1_ps(1.0f / d->y), _mm256_set1_ps(1.0f / d->z)};
+   __m256 miss = _mm256_set1_ps(M_RAY_MISS);
+   int i, hits = 0;
+   for (i = begin; i < end; i += 8) {
+      m__float3x8 l = {M__LOAD8(lo->x + i, aligned), M__LOAD8(lo->y + i, aligned), M__LOAD8(lo->z + i, aligned)};
+      m__float3x8 h = {M__LOAD8(hi->x + i, aligned), M__LOAD8(hi->y + i, aligned), M__LOAD8(hi->z + i, aligned)};
+      __m256 t = m__ray_box_avx2(&ro, &inv, &l, &h);
+      M__STORE8(dest + i, t, aligned);
+      hits += __builtin_popcount(_mm256_movemask_ps(_mm256_cmp_ps(t, miss, _CMP_NEQ_OQ)));
+   }
+   return hits;
+}
+
+M__AVX2 static int m__ray_box_soa_avx2(float *dest, const float3 *o, const float3 *d, const float3_soa *lo, const float3_soa *hi, int count)
+{
+   const float *streams[7] = {dest, lo->x, lo->y, lo->z, hi->x, hi->y, hi->z};
+   int begin, end, aligned, hits;
+   m__soa_split(streams, 7, count, 8, &begin, &end, &aligned);
+   hits = m__ray_box_soa_range(dest, o, d, lo, hi, 0, begin);
+   if (aligned) hits += m__ray_box_soa_avx2_body(dest, o, d, lo, hi, begin, end, 1);
+   else hits += m__ray_box_soa_avx2_body(dest, o, d, lo, hi, begin, end, 0);
+   _mm256_zeroupper();
+   return hits + m__ray_box_soa_range(dest, o, d, lo, hi, end, count);
+}
+
+M__AVX2 static M__INLINE int m__ray_packet_triangle_avx2_body(float *dest, float *u, float *v, const float3_soa *O, const float3_soa *D, const float3 *a, const float3 *b, const float3 *c, int begin, int end, int aligned)
+{
+   m__float3x8 va = {_mm256_set1_ps(a->x), _mm256_set1_ps(a->y), _mm256_set1_ps(a->z)};
+   m__float3x8 vb = {_mm256_set1_ps(b->x), _mm256_set1_ps(b->y), _mm256_set1_ps(b->z)};
+   m__float3x8 vc = {_mm256_set1_ps(c->x), _mm256_set1_ps(c->y), _mm256_set1_ps(c->z)};
+   __m256 miss = _mm256_set1_ps(M_RAY_MISS);
+   int i, hits = 0;
+   for (i = begin; i < end; i += 8) {
+      m__float3x8 o = {M__LOAD8(O->x + i, aligned), M__LOAD8(O->y + i, aligned), M__LOAD8(O->z + i, aligned)};
+      m__float3x8 d = {M__LOAD8(D->x + i, aligned), M__LOAD8(D->y + i, aligned), M__LOAD8(D->z + i, aligned)};
+      __m256 uu, vv, t = m__ray_triangle_avx2(&o, &d, &va, &vb, &vc, &uu, &vv);
+      M__STORE8(dest + i, t, aligned);
+      M__STORE8(u + i, uu, aligned);
+      M__STORE8(v + i, vv, aligned);
+      hits += __builtin_popcount(_mm256_movemask_ps(_mm256_cmp_ps(t, miss, _CMP_NEQ_OQ)));
+   }
+   return hits;
+}
+
+M__AVX2 static int m__ray_packet_triangle_avx2(float *dest, float *u, float *v, const float3_soa *O, const float3_soa *D, const float3 *a, const float3 *b, const float3 *c, int count)
+{
+   const float *streams[9] = {dest, u, v, O->x, O->y, O->z, D->x, D->y, D->z};
+   int begin, end, aligned, hits;
+   m__soa_split(streams, 9, count, 8, &begin, &end, &aligned);
+   hits = m__ray_packet_triangle_range(dest, u, v, O, D, a, b, c, 0, begin);
+   if (aligned) hits += m__ray_packet_triangle_avx2_body(dest, u, v, O, D, a, b, c, begin, end, 1);
+   else hits += m__ray_packet_triangle_avx2_body(dest, u, v, O, D, a, b, c, begin, end, 0);
+   _mm256_zeroupper();
+   return hits + m__ray_packet_triangle_range(dest, u, v, O, D, a, b, c, end, count);
+}
+
+M__AVX2 static M__INLINE int m__ray_packet_box_avx2_body(float *dest, const float3_soa *O, const float3_soa *D, const float3 *lo, const float3 *hi, int begin, int end, int aligned)
+{
+   m__float3x8 l = {_mm256_set1_ps(lo->x), _mm256_set1_ps(lo->y), _mm256_set1_ps(lo->z)};
+   m__float3x8 h = {_mm256_set1_ps(hi->x), _mm256_set1_ps(hi->y), _mm256_set1_ps(hi->z)};
+   __m256 one = _mm256_set1_ps(1.0f), miss = _mm256_set1_ps(M_RAY_MISS);
+   int i, hits = 0;
+   for (i = begin; i < end; i += 8) {
+      m__float3x8 o = {M__LOAD8(O->x + i, aligned), M__LOAD8(O->y + i, aligned), M__LOAD8(O->z + i, aligned)};
+      m__float3x8 inv = {_mm256_div_ps(one, M__LOAD8(D->x + i, aligned)), _mm256_div_ps(one, M__LOAD8(D->y + i, aligned)),
+                         _mm256_div_ps(one, M__LOAD8(D->z + i, aligned))};
+      __m256 t = m__ray_box_avx2(&o, &inv, &l, &h);
+      M__STORE8(dest + i, t, aligned);
+      hits += __builtin_popcount(_mm256_movemask_ps(_mm256_cmp_ps(t, miss, _CMP_NEQ_OQ)));
+   }
+   return hits;
+}
+
+M__AVX2 static int m__ray_packet_box_avx2(float *dest, const float3_soa *O, const float3_soa *D, const float3 *lo, const float3 *hi, int count)
+{
+   const float *streams[7] = {dest, O->x, O->y, O->z, D->x, D->y, D->z};
+   int begin, end, aligned, hits;
+   m__soa_split(streams, 7, count, 8, &begin, &end, &aligned);
+   hits = m__ray_packet_box_range(dest, O, D, lo, hi, 0, begin);
+   if (aligned) hits += m__ray_packet_box_avx2_body(dest, O, D, lo, hi, begin, end, 1);
+   else hits += m__ray_packet_box_avx2_body(dest, O, D, lo, hi, begin, end, 0);
+   _mm256_zeroupper();
+   return hits + m__ray_packet_box_range(dest, O, D, lo, hi, end, count);
+}
+
+#undef M__MSUB8
+#undef M__DOT8
+
+/* xoshiro128** on 4 or 8 lanes, the multiplies by 5 and 9 are shifts and adds */
+#define M__RNG_NEXT(r, s, shl, shr, add, bxor, bor) {\
+   r = add(shl(s[1], 2), s[1]);\
+   r = bor(shl(r, 7), shr(r, 25));\
+   r = add(shl(r, 3), r);\
+   t = shl(s[1], 9);\
+   s[2] = bxor(s[2], s[0]);\
+   s[3] = bxor(s[3], s[1]);\
+   s[1] = bxor(s[1], s[2]);\
+   s[0] = bxor(s[0], s[3]);\
+   s[2] = bxor(s[2], t);\
+   s[3] = bor(shl(s[3], 11), shr(s[3], 21));\
+}
+
+M__SSE41 static void m__rng8_fill_uniform_sse41(float *dest, m_rng8 *rng, float min, float max, int count)
+{
+   __m128i lo[4], hi[4], r, t;
+   __m128 vmin = _mm_set1_ps(min), scale = _mm_set1_ps(max - min), unit = _mm_set1_ps(M__RNG_UNIT);
+   int i, k, end = count & ~7;
+   for (k = 0; k < 4; k++) {
+      lo[k] = _mm_loadu_si128((const __m128i *)rng->s[k]);
+      hi[k] = _mm_loadu_si128((const __m128i *)(rng->s[k] + 4));
+   }
+   for (i = 0; i < end; i += 8) {
+      __m128 u;
+      M__RNG_NEXT(r, lo, _mm_slli_epi32, _mm_srli_epi32, _mm_add_epi32, _mm_xor_si128, _mm_or_si128);
+      u = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(r, 8)), unit);
+      _mm_storeu_ps(dest + i, _mm_add_ps(vmin, _mm_mul_ps(scale, u)));
+      M__RNG_NEXT(r, hi, _mm_slli_epi32, _mm_srli_epi32, _mm_add_epi32, _mm_xor_si128, _mm_or_si128);
+      u = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(r, 8)), unit);
+      _mm_storeu_ps(dest + i + 4, _mm_add_ps(vmin, _mm_mul_ps(scale, u)));
+   }
+   for (k = 0; k < 4; k++) {
+      _mm_storeu_si128((__m128i *)rng->s[k], lo[k]);
+      _mm_storeu_si128((__m128i *)(rng->s[k] + 4), hi[k]);
+   }
+   m__rng8_fill_uniform_scalar(dest + end, rng, min, max, count - end);
+}
+
+M__AVX2 static void m__rng8_fill_uniform_avx2(float *dest, m_rng8 *rng, float min, float max, int count)
+{
+   __m256i s[4], r, t;
+   __m256 vmin = _mm256_set1_ps(min), scale = _mm256_set1_ps(max - min), unit = _mm256_set1_ps(M__RNG_UNIT);
+   int i, k, end = count & ~7;
+   for (k = 0; k < 4; k++)
+      s[k] = _mm256_loadu_si256((const __m256i *)rng->s[k]);
+   for (i = 0; i < end; i += 8) {
+      __m256 u;
+      M__RNG_NEXT(r, s, _mm256_slli_epi32, _mm256_srli_epi32, _mm256_add_epi32, _mm256_xor_si256, _mm256_or_si256);
+      /* no fma, the same rounding as the scalar code */
+      u = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(r, 8)), unit);
+      _mm256_storeu_ps(dest + i, _mm256_add_ps(vmin, _mm256_mul_ps(scale, u)));
+   }
+   for (k = 0; k < 4; k++)
+      _mm256_storeu_si256((__m256i *)rng->s[k], s[k]);
+   _mm256_zeroupper();
+   m__rng8_fill_uniform_scalar(dest + end, rng, min, max, count - end);
+}
+
+#undef M__RNG_NEXT
+
+static int m__simd_best(void)
+{
+   __builtin_cpu_init();
+   if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+      return M_SIMD_AVX2;
+   if (__builtin_cpu_supports("sse4.1"))
+      return M_SIMD_SSE41;
+   return M_SIMD_SCALAR;
+}
+
+#else
+
+static int m__simd_best(void)
+{
+   return M_SIMD_SCALAR;
+}
+
+#endif /* M__SIMD_X86 */
+
+static int m__simd_level = M_SIMD_SCALAR;
+static void (*m__mat4_lookat)(float *dest, const float3 *pos, const float3 *dir, const float3 *up) = m_mat4_lookat_scalar;
+static void (*m__mat4_mul)(float *dest, const float *A, const float *B) = m_mat4_mul_scalar;
+static void (*m__mat4_inverse)(float *dest, const float *src) = m_mat4_inverse_scalar;
+static void (*m__mat4_transform3)(float3 *dest, const float *matrix, const float3 *src) = m_mat4_transform3_scalar;
+static void (*m__mat4_transform4)(float4 *dest, const float *matrix, const float4 *src) = m_mat4_transform4_scalar;
+static void (*m__mat4_transform3_soa)(const float3_soa *dest, const float *matrix, const float3_soa *src, int count) = m__mat4_transform3_soa_scalar;
+static void (*m__mat4_rotate3_soa)(const float3_soa *dest, const float *matrix, const float3_soa *src, int count) = m__mat4_rotate3_soa_scalar;
+static void (*m__normalize3_soa)(const float3_soa *dest, const float3_soa *src, int count) = m__normalize3_soa_scalar;
+static void (*m__mat4_transform_aabb_soa)(const float3_soa *dest_min, const float3_soa *dest_max, const float *matrix, const float3_soa *src_min, const float3_soa *src_max, int count) = m__mat4_transform_aabb_soa_scalar;
+static void (*m__mat4_mul_array)(float *dest, const float *A, const float *B, int count) = m__mat4_mul_array_scalar;
+static void (*m__quat_nlerp_soa)(const float4_soa *dest, const float4_soa *A, const float4_soa *B, const float *mu, int count) = m__quat_nlerp_soa_scalar;
+static void (*m__quat_slerp_soa)(const float4_soa *dest, const float4_soa *A, const float4_soa *B, const float *mu, int count) = m__quat_slerp_soa_scalar;
+static void (*m__quat_normalize_soa)(const float4_soa *dest, const float4_soa *src, int count) = m__quat_normalize_soa_scalar;
+static void (*m__quat_to_mat3_soa)(float *const *dest, const float4_soa *src, int count) = m__quat_to_mat3_soa_scalar;
+static int (*m__ray_triangle_soa)(float *dest, float *u, float *v, const float3 *o, const float3 *d, const float3_soa *A, const float3_soa *B, const float3_soa *C, int count) = m__ray_triangle_soa_scalar;
+static int (*m__ray_box_soa)(float *dest, const float3 *o, const float3 *d, const float3_soa *lo, const float3_soa *hi, int count) = m__ray_box_soa_scalar;
+static int (*m__ray_packet_triangle)(float *dest, float *u, float *v, const float3_soa *O, const float3_soa *D, const float3 *a, const float3 *b, const float3 *c, int count) = m__ray_packet_triangle_scalar;
+static int (*m__ray_packet_box)(float *dest, const float3_soa *O, const float3_soa *D, const float3 *lo, const float3 *hi, int count) = m__ray_packet_box_scalar;
+static void (*m__rng8_fill_uniform)(float *dest, m_rng8 *rng, float min, float max, int count) = m__rng8_fill_uniform_scalar;
+
+MMAPI int m_simd_set_level(int level)
+{
+   int best = m__simd_best();
+   if (level > best)
+      level = best;
+   if (level < M_SIMD_SCALAR)
+      level = M_SIMD_SCALAR;
+
+   m__mat4_lookat = m_mat4_lookat_scalar;
+   m__mat4_mul = m_mat4_mul_scalar;
+   m__mat4_inverse = m_mat4_inverse_scalar;
+   m__mat4_transform3 = m_mat4_transform3_scalar;
+   m__mat4_transform4 = m_mat4_transform4_scalar;
+   m__mat4_transform3_soa = m__mat4_transform3_soa_scalar;
+   m__mat4_rotate3_soa = m__mat4_rotate3_soa_scalar;
+   m__normalize3_soa = m__normalize3_soa_scalar;
+   m__mat4_transform_aabb_soa = m__mat4_transform_aabb_soa_scalar;
+   m__mat4_mul_array = m__mat4_mul_array_scalar;
+   m__quat_nlerp_soa = m__quat_nlerp_soa_scalar;
+   m__quat_slerp_soa = m__quat_slerp_soa_scalar;
+   m__quat_normalize_soa = m__quat_normalize_soa_scalar;
+   m__quat_to_mat3_soa = m__quat_to_mat3_soa_scalar;
+   m__ray_triangle_soa = m__ray_triangle_soa_scalar;
+   m__ray_box_soa = m__ray_box_soa_scalar;
+   m__ray_packet_triangle = m__ray_packet_triangle_scalar;
+   m__ray_packet_box = m__ray_packet_box_scalar;
+   m__rng8_fill_uniform = m__rng8_fill_uniform_scalar;
+
+#ifdef M__SIMD_X86
+   /* a single inverse or lookat has no work for 8 lanes, AVX2 keeps the SSE4.1 ones */
+   if (level >= M_SIMD_SSE41) {
+      m__mat4_lookat = m__mat4_lookat_sse41;
+      m__mat4_mul = m__mat4_mul_sse41;
+      m__mat4_inverse = m__mat4_inverse_sse41;
+      m__mat4_transform3 = m__mat4_transform3_sse41;
+      m__mat4_transform4 = m__mat4_transform4_sse41;
+      m__mat4_transform3_soa = m__mat4_transform3_soa_sse41;
+      m__mat4_rotate3_soa = m__mat4_rotate3_soa_sse41;
+      m__normalize3_soa = m__normalize3_soa_sse41;
+      m__mat4_transform_aabb_soa = m__mat4_transform_aabb_soa_sse41;
+      m__mat4_mul_array = m__mat4_mul_array_sse41;
+      m__quat_nlerp_soa = m__quat_nlerp_soa_sse41;
+      m__quat_slerp_soa = m__quat_slerp_soa_sse41;
+      m__quat_normalize_soa = m__quat_normalize_soa_sse41;
+      m__quat_to_mat3_soa = m__quat_to_mat3_soa_sse41;
+      m__ray_triangle_soa = m__ray_triangle_soa_sse41;
+      m__ray_box_soa = m__ray_box_soa_sse41;
+      m__ray_packet_triangle = m__ray_packet_triangle_sse41;
+      m__ray_packet_box = m__ray_packet_box_sse41;
+      m__rng8_fill_uniform = m__rng8_fill_uniform_sse41;
+   }
+   if (level >= M_SIMD_AVX2) {
+      m__mat4_mul = m__mat4_mul_avx2;
+      m__mat4_transform3 = m__mat4_transform3_avx2;
+      m__mat4_transform4 = m__mat4_transform4_avx2;
+      m__mat4_transform3_soa = m__mat4_transform3_soa_avx2;
+      m__mat4_rotate3_soa = m__mat4_rotate3_soa_avx2;
+      m__normalize3_soa = m__normalize3_soa_avx2;
+      m__mat4_transform_aabb_soa = m__mat4_transform_aabb_soa_avx2;
+      m__mat4_mul_array = m__mat4_mul_array_avx2;
+      m__quat_nlerp_soa = m__quat_nlerp_soa_avx2;
+      m__quat_slerp_soa = m__quat_slerp_soa_avx2;
+      m__quat_normalize_soa = m__quat_normalize_soa_avx2;
+      m__quat_to_mat3_soa = m__quat_to_mat3_soa_avx2;
+      m__ray_triangle_soa = m__ray_triangle_soa_avx2;
+      m__ray_box_soa = m__ray_box_soa_avx2;
+      m__ray_packet_triangle = m__ray_packet_triangle_avx2;
+      m__ray_packet_box = m__ray_packet_box_avx2;
+      m__rng8_fill_uniform = m__rng8_fill_uniform_avx2;
+   }
+#endif
+
+   m__simd_level = level;
+   return level;
+}
+
+MMAPI int m_simd_init(void)
+{
+   return m_simd_set_level(M_SIMD_AVX2);
+}
+
+MMAPI int m_simd_level(void)
+{
+   return m__simd_level;
+}
+
+MMAPI const char *m_simd_level_name(int level)
+{
+   switch (level) {
+   case M_SIMD_SSE41: return "sse4.1";
+   case M_SIMD_AVX2: return "avx2";
+   default: return "scalar";
+   }
+}
+
+MMAPI void m_mat4_lookat(float *dest, const float3 *pos, const float3 *dir, const float3 *up)
+{
+   m__mat4_lookat(dest, pos, dir, up);
+}
+
+MMAPI void m_mat4_mul(float *dest, const float *A, const float *B)
+{
+   m__mat4_mul(dest, A, B);
+}
+
+MMAPI void m_mat4_inverse(float *dest, const float *src)
+{
+   m__mat4_inverse(dest, src);
+}
+
+MMAPI void m_mat4_transform3(float3 *dest, const float *matrix, const float3 *src)
+{
+   m__mat4_transform3(dest, matrix, src);
+}
+
+MMAPI void m_mat4_transform4(float4 *dest, const float *matrix, const float4 *src)
+{
+   m__mat4_transform4(dest, matrix, src);
+}
+
+MMAPI void m_mat4_transform3_soa(const float3_soa *dest, const float *matrix, const float3_soa *src, int count)
+{
+   m__mat4_transform3_soa(dest, matrix, src, count);
+}
+
+MMAPI void m_mat4_rotate3_soa(const float3_soa *dest, const float *matrix, const float3_soa *src, int count)
+{
+   m__mat4_rotate3_soa(dest, matrix, src, count);
+}
+
+MMAPI void m_normalize3_soa(const float3_soa *dest, const float3_soa *src, int count)
+{
+   m__normalize3_soa(dest, src, count);
+}
+
+MMAPI void m_mat4_transform_aabb_soa(const float3_soa *dest_min, const float3_soa *dest_max, const float *matrix, const float3_soa *src_min, const float3_soa *src_max, int count)
+{
+   m__mat4_transform_aabb_soa(dest_min, dest_max, matrix, src_min, src_max, count);
+}
+
+MMAPI void m_mat4_mul_array(float *dest, const float *A, const float *B, int count)
+{
+   m__mat4_mul_array(dest, A, B, count);
+}
+
+MMAPI void m_quat_nlerp_soa(const float4_soa *dest, const float4_soa *A, const float4_soa *B, const float *mu, int count)
+{
+   m__quat_nlerp_soa(dest, A, B, mu, count);
+}
+
+MMAPI void m_quat_slerp_soa(const float4_soa *dest, const float4_soa *A, const float4_soa *B, const float *mu, int count)
+{
+   m__quat_slerp_soa(dest, A, B, mu, count);
+}
+
+MMAPI void m_quat_normalize_soa(const float4_soa *dest, const float4_soa *src, int count)
+{
+   m__quat_normalize_soa(dest, src, count);
+}
+
+MMAPI void m_quat_to_mat3_soa(float *const *dest, const float4_soa *src, int count)
+{
+   m__quat_to_mat3_soa(dest, src, count);
+}
+
+MMAPI int m_3d_ray_triangle_intersection_soa(float *dest, float *u, float *v, const float3 *ray_origin, const float3 *ray_direction, const float3_soa *vert1, const float3_soa *vert2, const float3_soa *vert3, int count)
+{
+   return m__ray_triangle_soa(dest, u, v, ray_origin, ray_direction, vert1, vert2, vert3, count);
+}
+
+MMAPI int m_3d_ray_box_intersection_soa(float *dest, const float3 *ray_origin, const float3 *ray_direction, const float3_soa *box_min, const float3_soa *box_max, int count)
+{
+   return m__ray_box_soa(dest, ray_origin, ray_direction, box_min, box_max, count);
+}
+
+MMAPI int m_3d_ray_packet_triangle_intersection(float *dest, float *u, float *v, const float3_soa *ray_origin, const float3_soa *ray_direction, const float3 *vert1, const float3 *vert2, const float3 *vert3, int count)
+{
+   return m__ray_packet_triangle(dest, u, v, ray_origin, ray_direction, vert1, vert2, vert3, count);
+}
+
+MMAPI int m_3d_ray_packet_box_intersection(float *dest, const float3_soa *ray_origin, const float3_soa *ray_direction, const float3 *box_min, const float3 *box_max, int count)
+{
+   return m__ray_packet_box(dest, ray_origin, ray_direction, box_min, box_max, count);
+}
+
+MMAPI void m_rng8_fill_uniform(float *dest, m_rng8 *rng, float min, float max, int count)
+{
+   m__rng8_fill_uniform(dest, rng, min, max, count);
+}
+
 MMAPI float m_2d_polygon_area(float2 *points, int count)
 {
    float fx, fy, a; int p;
@@ -11,6 +11,25 @@
 
 #define GP_INCLUDE_FILEWATCHER
 #include "include/gp_lib.h"
+#include "include/gp_vec.h"
+#include "include/gp_program_cache.h"
+#include "include/gp_shader_source.h"
+#include "include/gp_shader_compiler.h"
+#include "include/gp_shader_variants.h"
+#include "include/gp_instancing.h"
+#include "include/gp_mesh_pool.h"
+#include "include/gp_render_queue.h"
+#include "include/gp_jobs.h"
+#include "include/gp_cull.h"
+#include "include/gp_occlusion.h"
+#include "include/gp_lights.h"
+#include "include/gp_deferred.h"
+#include "include/gp_ibl.h"
+#include "include/gp_math_bench.h"
+#include "include/gp_anim.h"
+#include "include/gp_bvh.h"
+#include "include/gp_voxel.h"
+#include "include/gp_scene.h"
 
 #define STB_TRUETYPE_IMPLEMENTATION
 #include "stb_truetype.h"
@@ -45,6 +64,41 @@ float distance_light = 1.0;
 float3 light_dir = {1.0,1.0,1.0};
 
 int frame = 0;
+double frame_time_avg_ms = 0.0;
+
+// Number of round.obj copies drawn with instancing, 0 draws the single model. Cycled with I.
+int stress_instances = 0;
+BOOL culling = TRUE;
+// Depth only pass before shading, toggled with P
+BOOL depth_prepass = FALSE;
+// CPU occlusion culling against the nearest occluders, toggled with O
+BOOL occlusion = FALSE;
+// Stress meshes in the shared pool go out with one glMultiDrawElementsIndirect per program and material, toggled with M
+BOOL multi_draw = FALSE;
+// Deferred shading through the G-buffer instead of forward, toggled with G or started with --deferred
+BOOL deferred = FALSE;
+// Clustered point lights over the stress objects, cycled with L, --lights N sets the starting count.
+// With lights on, the stress objects are drawn with the clustered shader instead of the single light one.
+int light_count = 0;
+#define MAX_DEMO_LIGHTS 1000
+// --stress: grows stress_instances from 1 to STRESS_MAX_INSTANCES and prints the frame time of each step
+BOOL stress_sweep = FALSE;
+#define STRESS_MAX_INSTANCES 100000
+#define STRESS_SWEEP_FRAMES 240
+// --stress-indirect, --stress-deferred: flag the sweep measures off and on at every step, NULL for none
+BOOL* stress_compare = NULL;
+// --no-program-cache: compile every program from source, to compare startup times
+BOOL use_program_cache = TRUE;
+// --threads N: workers of the job system, 0 uses one per hardware thread
+int job_workers = 0;
+// Single model with the old Phong normal mapping look instead of Cook-Torrance, toggled with N
+BOOL phong_model = FALSE;
+// --no-prewarm: no prewarm_window, shader variants are only compiled when first drawn and hot reload
+// only stays off the frame with the parallel compile extension
+BOOL prewarm_shaders = TRUE;
+// --ibl file.hdr: equirectangular environment for the ambient light, baked once into ibl_cache/.
+// Without one the environment is black.
+const char* ibl_path = NULL;
 
 void windowclose_callback(WIN * window);
 void windowsize_callback(WIN * window, int width, int height);
@@ -56,6 +110,8 @@ void frame_timer();
 
 
 WIN* window;
+// hidden, its context shares objects with the one of window so shader variants can be compiled on it
+WIN* prewarm_window = NULL;
 
 typedef struct Camera {
     float3 position;
@@ -84,7 +140,7 @@ void load_texture(const char* file, GLuint* tex) {
     // Create one OpenGL texture
     glGenTextures(1, tex);
 
-    glBindTexture(GL_TEXTURE_2D, *tex);
+    gp_gl_bind_texture(0, GL_TEXTURE_2D, *tex);
 
     if (bitdepth <= 1) {
     	glTexImage2D(GL_TEXTURE_2D, 0,GL_RGBA, width, height, 0, GL_RED, GL_UNSIGNED_BYTE, data);
@@ -126,7 +182,7 @@ int init(int w, int h) {
     }
 
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 2);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 #ifdef __APPLE__
@@ -141,6 +197,15 @@ int init(int w, int h) {
     }else {
     	log("glfwCreateWindow Success\n");
     }
+
+    if (prewarm_shaders) {
+        glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+        prewarm_window = glfwCreateWindow(1, 1, "prewarm", NULL, window);
+        glfwWindowHint(GLFW_VISIBLE, GL_TRUE);
+        if (!prewarm_window) {
+            log("no shared context, shader variants are compiled on first use\n");
+        }
+    }
 	
 	log("Setting callbacks\n");
     glfwSetWindowCloseCallback(window, windowclose_callback);
@@ -157,7 +222,10 @@ int init(int w, int h) {
         return 1;
     }
 
+	gp_gl_state_init();
+
 	mv_ef_init("extra/Inconsolata-Regular.ttf", 48.0, NULL, NULL);
+	gp_gl_state_forget(GP_GL_STATE_ALL);
 
 	start_filewatcher("shaders/");
 
@@ -167,6 +235,12 @@ int init(int w, int h) {
 void teardown() {
 	log("Exiting program\n");
 	stop_filewatcher();
+	stop_shader_compiler(&shader_compiler);
+	free_shader_variants(&shader_variants);
+	free_shader_sources(&shader_sources);
+	if (prewarm_window) {
+		glfwDestroyWindow(prewarm_window);
+	}
 	glfwTerminate();
 }
 
@@ -175,12 +249,10 @@ BOOL should_exit_gameplay_loop() {
 }
 
 GLuint load_arrow_shaders() {
-    char* str_vert = gp_read_entire_file_alloc("shaders/arrow_vertex.glsl");
-    char* str_frag = gp_read_entire_file_alloc("shaders/arrow_fragment.glsl");
-    GLuint program = compile_shader_program(str_vert,str_frag,
+    const char* str_vert = shader_source(&shader_sources, "shaders/arrow_vertex.glsl");
+    const char* str_frag = shader_source(&shader_sources, "shaders/arrow_fragment.glsl");
+    GLuint program = compile_program_cached(str_vert,str_frag,
                                                           "position", NULL, NULL, NULL);
-    free(str_vert);
-    free(str_frag);
 
     return program;
 }
@@ -197,7 +269,7 @@ void load_arrow_mesh(GLuint* vao, Arrow* arr, int len, int* arrows_point_count)
 
     // Generate a VAO
     glGenVertexArrays(1, vao);
-    glBindVertexArray(*vao);
+    gp_gl_bind_vertex_array(*vao);
 
     GLfloat* points = NULL;
     GLfloat* colors = NULL;
@@ -260,7 +332,7 @@ void load_arrow_mesh(GLuint* vao, Arrow* arr, int len, int* arrows_point_count)
     {
         GLuint vbo;
         glGenBuffers(1, &vbo);
-        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        gp_gl_bind_buffer(GL_ARRAY_BUFFER, vbo);
         glBufferData(
             GL_ARRAY_BUFFER,
             3 * (len * elems_arrow) * sizeof(GLfloat),
@@ -277,7 +349,7 @@ void load_arrow_mesh(GLuint* vao, Arrow* arr, int len, int* arrows_point_count)
     {
         GLuint vbo;
         glGenBuffers(1, &vbo);
-        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        gp_gl_bind_buffer(GL_ARRAY_BUFFER, vbo);
         glBufferData(
             GL_ARRAY_BUFFER,
             3 * (len * elems_arrow) * sizeof(GLfloat),
@@ -290,41 +362,28 @@ void load_arrow_mesh(GLuint* vao, Arrow* arr, int len, int* arrows_point_count)
         //printf("Arrows: VertexAttribArray 1 -> Colors\n");
     }
 
-    glBindVertexArray(0);
+    gp_gl_bind_vertex_array(0);
     //printf("Arrows: Mesh loaded\n");
 }
 
 void set_arrow(Arrow* dest, float3 a, float3 b) {
-    float scale = 0.03;
+    const float scale = 0.03f;
 
-    float3 dir = b - a;
-    float3 normal;
+    vec3 start = a;
+    vec3 dir = vec3(b) - start;
 
+    float d = dot(dir, vec3(Z_AXIS));
+    vec3 normal = (d != -1.0f && d != 1.0f) ? cross(dir, vec3(Z_AXIS)) : cross(dir, vec3(Y_AXIS));
 
-    float dot = M_DOT3(dir,Z_AXIS);
-    if(dot != -1.0 && dot != 1.0) {
-        M_CROSS3(normal, dir, Z_AXIS);
-    } else {
-        M_CROSS3(normal, dir, Y_AXIS);
-    }
-    
-    M_NORMALIZE3(dir, dir);
-    M_NORMALIZE3(normal, normal);
-
-    normal = normal * scale;
-    dir = dir * scale;
-
+    dir = normalize(dir) * scale;
+    normal = normalize(normal) * scale;
+    vec3 ortho = normalize(cross(dir, normal)) * scale;
 
-    dest->a = (normal + a);
-    dest->b = ((normal * -1.0) + a);
+    dest->a = start + normal;
+    dest->b = start - normal;
     dest->c = b;
-
-    float3 ortho;
-    M_CROSS3(ortho, dir, normal);
-    M_NORMALIZE3(ortho , ortho);    
-    ortho = ortho * scale;
-    dest->a2 = (ortho + a);
-    dest->b2 = ((ortho * -1.0) + a);
+    dest->a2 = start + ortho;
+    dest->b2 = start - ortho;
     dest->c2 = b;
 }
 
@@ -340,27 +399,148 @@ void update_arrows(Arrow* arrows, int number_arrows, Camera camera, float3* ligh
     set_arrow(&arrows[idx++], ORIGIN, light_dir);
 }
 
-GLuint load_model_shaders() {
-	//char* str_vert = gp_read_entire_file_alloc("shaders/model_vertex_normal_mapping_2.glsl");
-	//char* str_frag = gp_read_entire_file_alloc("shaders/model_fragment_normal_mapping_2.glsl");
-    char* str_vert = gp_read_entire_file_alloc("shaders/model_vertex_pbr_1.glsl");
-    char* str_frag = gp_read_entire_file_alloc("shaders/model_fragment_pbr_1.glsl");
-    GLuint program = compile_shader_program(str_vert,str_frag,
-    													  "position", "normal", "uv", "tangent");
-    free(str_vert);
-    free(str_frag);
+// Uber shader variants of the scene programs, see gp_shader_variants.h
+#define MODEL_SHADER_KEY (SHADER_NORMAL_MAP | SHADER_IBL)
+#define PHONG_SHADER_KEY (SHADER_NORMAL_MAP | SHADER_PHONG)
+#define INSTANCED_SHADER_KEY (SHADER_INSTANCED | SHADER_NORMAL_MAP | SHADER_IBL)
+#define CLUSTERED_SHADER_KEY (SHADER_INSTANCED | SHADER_NORMAL_MAP | SHADER_CLUSTERED | SHADER_IBL)
+#define GBUFFER_SHADER_KEY (SHADER_NORMAL_MAP | SHADER_AO_MAP | SHADER_GBUFFER)
+#define GBUFFER_INSTANCED_SHADER_KEY (SHADER_INSTANCED | SHADER_NORMAL_MAP | SHADER_AO_MAP | SHADER_GBUFFER)
+
+// Everything the demo can draw with, prewarmed in this order
+const uint32_t demo_shader_keys[] = {
+    MODEL_SHADER_KEY, INSTANCED_SHADER_KEY, GBUFFER_SHADER_KEY, GBUFFER_INSTANCED_SHADER_KEY,
+    CLUSTERED_SHADER_KEY, PHONG_SHADER_KEY
+};
+
+void make_prewarm_context_current(void* context) {
+    glfwMakeContextCurrent((GLFWwindow*) context);
+}
+
+void* get_gl_proc(const char* name) {
+    return (void*) glfwGetProcAddress(name);
+}
+
+// Points a scene program at the variant, the old program stays if the variant doesn't compile
+BOOL set_scene_variant(Scene* scene, int index, uint32_t key) {
+    GLuint program = shader_variant_program(&shader_variants, key);
+    if (program == 0) {
+        return FALSE;
+    }
+    if (program != scene->programs[index].program) {
+        set_scene_program(scene, index, program);
+    }
+    return TRUE;
+}
+
+#define LIGHTING_VERTEX_SHADER "shaders/deferred_vertex.glsl"
+#define LIGHTING_FRAGMENT_SHADER "shaders/deferred_fragment.glsl"
+
+GLuint load_deferred_lighting_shaders() {
+    const char* str_vert = shader_source(&shader_sources, LIGHTING_VERTEX_SHADER);
+    const char* str_frag = shader_source(&shader_sources, LIGHTING_FRAGMENT_SHADER);
+    GLuint program = compile_program_cached(str_vert,str_frag,
+                                                          NULL, NULL, NULL, NULL);
 
     return program;
 }
 
+GLuint load_depth_shaders(BOOL instanced) {
+    const char* str_vert = shader_source(&shader_sources, instanced ? "shaders/depth_vertex_instanced.glsl" : "shaders/depth_vertex.glsl");
+    const char* str_frag = shader_source(&shader_sources, "shaders/depth_fragment.glsl");
+    GLuint program = compile_program_cached(str_vert,str_frag,
+                                                          "position", NULL, NULL, NULL);
+
+    return program;
+}
+
+int next_light_count(int current) {
+    if (current == 0) {
+        return 1;
+    }
+    if (current >= MAX_DEMO_LIGHTS) {
+        return 0;
+    }
+    return current * 10;
+}
+
+// Light 0 is the usual light, the rest are scattered over the stress grid
+void update_demo_lights(LightClusters* lights, int count, float time) {
+    resize_point_lights(lights, count);
+    if (count == 0) {
+        return;
+    }
+    int side = (int) ceilf(cbrtf((float) M_MAX(stress_instances, 1)));
+    float half = M_MAX(1.0f, (side - 1) * 0.35f * 0.5f + 0.3f);
+    float3 center = {0.0, 0.5, 0.0};
+    float3 half_extent = {half, half, half};
+    animate_point_lights(lights, &center, &half_extent, 0.6f, time);
+
+    PointLight* sun = &lights->lights[0];
+    sun->position = light_dir;
+    sun->radius = 20.0f;
+    set_float3(&sun->color, 1.0, 1.0, 1.0);
+    sun->intensity = 1.0f;
+}
+
+int next_stress_instances(int current) {
+    if (current == 0) {
+        return 1;
+    }
+    if (current >= STRESS_MAX_INSTANCES) {
+        return 0;
+    }
+    return current * 10;
+}
+
+// Sweep step, run once per frame. Skips the first frames after every change so buffer growth doesn't count.
+void update_stress_sweep() {
+    static int sweep_frame = 0;
+    static double sweep_start = 0.0;
+    int warmup_frames = 30;
+
+    if (stress_instances == 0) {
+        stress_instances = 1;
+        sweep_frame = 0;
+    }
+
+    if (sweep_frame == warmup_frames) {
+        sweep_start = glfwGetTime();
+    }
+
+    if (sweep_frame == warmup_frames + STRESS_SWEEP_FRAMES) {
+        double ms = 1000.0 * (glfwGetTime() - sweep_start) / STRESS_SWEEP_FRAMES;
+        log("stress: %7d instances %8.3f ms/frame multi draw %d deferred %d lights %d\n", stress_instances, ms,
+            multi_draw, deferred, light_count);
+
+        if (stress_compare != NULL && !*stress_compare) {
+            *stress_compare = TRUE;
+            sweep_frame = 0;
+            return;
+        }
+        if (stress_compare != NULL) {
+            *stress_compare = FALSE;
+        }
+        stress_instances = next_stress_instances(stress_instances);
+        sweep_frame = 0;
+        if (stress_instances == 0) {
+            stress_sweep = FALSE;
+            glfwSetWindowShouldClose(window, GL_TRUE);
+        }
+        return;
+    }
+    sweep_frame++;
+}
+
 void gameplay_loop(int w, int h) {
-	char* debug_string = (char*) malloc(200 * sizeof(char));
+	char* debug_string = (char*) malloc(512 * sizeof(char));
 
 	GLuint model_vao;
     int model_point_count = 0;
-    //assert(load_mesh("models/chest/Chest.obj", &model_vao, &model_point_count));
-    //assert(load_mesh("models/FireHydrant/FireHydrantMesh.obj", &model_vao, &model_point_count));
-    assert(load_mesh("models/round.obj", &model_vao, &model_point_count));
+    MeshBounds model_bounds;
+    //assert(load_mesh("models/chest/Chest.obj", &model_vao, &model_point_count, &model_bounds));
+    //assert(load_mesh("models/FireHydrant/FireHydrantMesh.obj", &model_vao, &model_point_count, &model_bounds));
+    assert(load_mesh("models/round.obj", &model_vao, &model_point_count, &model_bounds));
     
 
     GLuint model_texture;
@@ -430,7 +610,9 @@ void gameplay_loop(int w, int h) {
 	float projection_matrix[] = M_MAT4_IDENTITY();
 	
     float aspect = w / (float)h;
-    m_mat4_perspective(projection_matrix, 10.0, aspect, 0.1, 100.0);
+    float near_plane = 0.1;
+    float far_plane = 100.0;
+    m_mat4_perspective(projection_matrix, 10.0, aspect, near_plane, far_plane);
     m_mat4_identity(view_matrix);
 
     Camera* camera = (Camera*) malloc(sizeof(Camera));
@@ -443,9 +625,6 @@ void gameplay_loop(int w, int h) {
 	set_float3(&model_scale,0.8,0.8,0.8);
 	m_mat4_scale(model_scale_matrix, &model_scale);
 
-	GLuint model_program = load_model_shaders();
-
-
     GLuint arrow_program = load_arrow_shaders();
     GLuint arrow_vao;
     
@@ -456,23 +635,106 @@ void gameplay_loop(int w, int h) {
     int arrows_point_count = 0;
     load_arrow_mesh(&arrow_vao, arrows, number_arrows, &arrows_point_count);
 
-    GLuint loc_arrow_model_matrix = glGetUniformLocation(arrow_program, "u_model_matrix");
-    GLuint loc_arrow_view_matrix = glGetUniformLocation(arrow_program, "u_view_matrix");
-    GLuint loc_arrow_projecion_matrix = glGetUniformLocation(arrow_program, "u_projection_matrix");
+    Scene scene;
+    init_scene(&scene);
+    scene.jobs = create_job_system(job_workers);
+    log("job system with %d workers\n", scene.jobs->worker_count);
+
+    uint32_t model_key = phong_model ? PHONG_SHADER_KEY : MODEL_SHADER_KEY;
+    int model_program = add_scene_program(&scene, shader_variant_program(&shader_variants, model_key), FALSE);
+    int instanced_program = add_scene_program(&scene, shader_variant_program(&shader_variants, INSTANCED_SHADER_KEY), TRUE);
+    int arrow_program_index = add_scene_program(&scene, arrow_program, FALSE);
+    scene.programs[model_program].depth_program = add_scene_program(&scene, load_depth_shaders(FALSE), FALSE);
+    scene.programs[instanced_program].depth_program = add_scene_program(&scene, load_depth_shaders(TRUE), TRUE);
+    int clustered_program = add_scene_program(&scene, shader_variant_program(&shader_variants, CLUSTERED_SHADER_KEY), TRUE);
+    scene.programs[clustered_program].depth_program = scene.programs[instanced_program].depth_program;
+
+    // deferred path, the arrows stay forward
+    scene.programs[model_program].gbuffer_program = add_scene_program(&scene, shader_variant_program(&shader_variants, GBUFFER_SHADER_KEY), FALSE);
+    scene.programs[instanced_program].gbuffer_program = add_scene_program(&scene, shader_variant_program(&shader_variants, GBUFFER_INSTANCED_SHADER_KEY), TRUE);
+    scene.programs[clustered_program].gbuffer_program = scene.programs[instanced_program].gbuffer_program;
+    scene.lighting_program = add_scene_program(&scene, load_deferred_lighting_shaders(), FALSE);
+    if (!create_gbuffer(&scene.gbuffer, w, h)) {
+        log("deferred shading not available\n");
+    }
 
-    GLuint loc_time = glGetUniformLocation(model_program, "u_time");
-    GLuint loc_light = glGetUniformLocation(model_program, "u_light");
-    GLuint loc_camera_world = glGetUniformLocation(model_program, "u_camera_world");
-	GLuint loc_model_matrix = glGetUniformLocation(model_program, "u_model_matrix");
-    GLuint loc_view_matrix = glGetUniformLocation(model_program, "u_view_matrix");
-    GLuint loc_projecion_matrix = glGetUniformLocation(model_program, "u_projection_matrix");
-    GLuint loc_texture_0 = glGetUniformLocation(model_program, "u_texture");
+    LightClusters lights;
+    init_light_clusters(&lights);
+    create_light_textures(&lights);
+    lights.jobs = scene.jobs;
+    lights.width = w;
+    lights.height = h;
+
+    IBL ibl;
+    init_ibl(&ibl);
+    ibl.jobs = scene.jobs;
+    if (ibl_path != NULL) {
+        bake_ibl(&ibl, ibl_path, "ibl_cache");
+    }
+    create_ibl_textures(&ibl);
+
+    int model_mesh = add_scene_mesh(&scene, model_vao, model_point_count, TRUE, &model_bounds);
+
+    // box that fits inside the head of round.obj, the ears and the nose are left out
+    OccluderMesh model_occluder;
+    float3 occluder_min = {-0.5, -0.3, -0.5};
+    float3 occluder_max = {0.5, 0.6, 0.5};
+    make_box_occluder(&model_occluder, &occluder_min, &occluder_max);
+    scene.meshes[model_mesh].occluder = &model_occluder;
+    create_occlusion_buffer(&scene.occlusion_buffer, 256, 256 * h / w);
+    int arrow_mesh = add_scene_mesh(&scene, arrow_vao, arrows_point_count, FALSE, NULL);
+
+    // the stress scene cycles through these, all in the mesh pool so runs of them can be one indirect draw
+    const char* stress_mesh_files[] = {"models/round.obj", "models/cube.obj", "models/ico.obj", "models/sphere3.obj"};
+    int stress_mesh_count = 0;
+    int first_stress_mesh = scene.mesh_count;
+    for (int i = 0; i < (int)(sizeof(stress_mesh_files) / sizeof(stress_mesh_files[0])); ++i) {
+        MeshData data;
+        MeshBounds bounds;
+        if (!load_mesh_data(stress_mesh_files[i], &data, &bounds)) {
+            continue;
+        }
+        add_scene_pool_mesh(&scene, &data, &bounds);
+        free_mesh_data(&data);
+        stress_mesh_count++;
+    }
+    assert(stress_mesh_count > 0);
+    scene.meshes[first_stress_mesh].occluder = &model_occluder;
+
+    GLuint model_textures[MATERIAL_TEXTURES] = {model_texture, pbr_albedomap_texture, pbr_normalmap_texture,
+                                                pbr_metallicmap_texture, pbr_roughnessmap_texture, pbr_aomap_texture};
+    float4 no_tint = {1.0, 1.0, 1.0, 1.0};
+    int model_material = add_scene_material(&scene, model_textures, no_tint);
+    int arrow_material = add_scene_material(&scene, NULL, no_tint);
+
+    // a few tints so the stress scene has more than one material to batch by
+    int stress_material_count = 4;
+    int first_stress_material = scene.material_count;
+    for (int i = 0; i < stress_material_count; ++i) {
+        float4 tint = {0.5f + 0.5f * (i & 1), 0.5f + 0.25f * (i & 2), 1.0f - 0.15f * i, 0.5f + 0.15f * i};
+        add_scene_material(&scene, model_textures, tint);
+    }
 
-    GLuint loc_pbr_albedomap = glGetUniformLocation(model_program, "u_albedoMap");
-    GLuint loc_pbr_normalmap = glGetUniformLocation(model_program, "u_normalMap");
-    GLuint loc_pbr_metallicmap = glGetUniformLocation(model_program, "u_metallicMap");
-    GLuint loc_pbr_roughnessmap = glGetUniformLocation(model_program, "u_roughnessMap");
-    GLuint loc_pbr_aomap = glGetUniformLocation(model_program, "u_aoMap");
+    int model_object = add_scene_object(&scene, model_program, model_mesh, model_material, PASS_OPAQUE);
+    int arrow_object = add_scene_object(&scene, arrow_program_index, arrow_mesh, arrow_material, PASS_OPAQUE);
+    int first_stress_object = scene.object_count;
+    int current_stress_instances = 0;
+    int current_stress_program = instanced_program;
+
+    log("program cache: %d loaded %d compiled %d rejected %.2f ms\n", program_cache.hits, program_cache.compiled,
+        program_cache.rejected, program_cache.ms);
+    // deferred lighting program being recompiled, the variants keep their own
+    AsyncProgram* lighting_reload = NULL;
+    // a file of theirs changed since their last reload started
+    BOOL variants_changed = FALSE;
+    BOOL lighting_changed = FALSE;
+
+    FrameParams frame_params;
+    frame_params.near_plane = near_plane;
+    frame_params.far_plane = far_plane;
+    frame_params.view_matrix = view_matrix;
+    frame_params.projection_matrix = projection_matrix;
+    frame_params.ibl = &ibl;
 
 	glEnable(GL_DEPTH_TEST);
     glClearColor(0.3f, 0.5f, 0.5f, 1.0f);
@@ -480,89 +742,134 @@ void gameplay_loop(int w, int h) {
 	
     while(!should_exit_gameplay_loop()) {
     	frame_timer();
+    	gp_gl_state_new_frame();
     	glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
 
     	update_camera(camera, view_matrix);
 
         update_arrows(arrows, number_arrows, *camera, NULL, 0);
         load_arrow_mesh(&arrow_vao, arrows, number_arrows, &arrows_point_count);
+        scene.meshes[arrow_mesh].vao = arrow_vao;
+        scene.meshes[arrow_mesh].point_count = arrows_point_count;
 
 
 		m_mat4_rotation_axis(model_rotation_matrix, &Y_AXIS, 0.00001 * frame);		
 		m_mat4_mul(model_matrix, model_scale_matrix, model_rotation_matrix);
 
-    	if(1){
-			glUseProgram(model_program);
-
-			glActiveTexture(GL_TEXTURE0);
-			glBindTexture(GL_TEXTURE_2D, model_texture);
-			glUniform1i(loc_texture_0, 0);
-
-			glActiveTexture(GL_TEXTURE1);
-			glBindTexture(GL_TEXTURE_2D, pbr_albedomap_texture);
-			glUniform1i(loc_pbr_albedomap, 1);
-
-			glActiveTexture(GL_TEXTURE2);
-			glBindTexture(GL_TEXTURE_2D, pbr_normalmap_texture);
-			glUniform1i(loc_pbr_normalmap, 2);
-
-			glActiveTexture(GL_TEXTURE3);
-			glBindTexture(GL_TEXTURE_2D, pbr_metallicmap_texture);
-			glUniform1i(loc_pbr_metallicmap, 3);
-
-			glActiveTexture(GL_TEXTURE4);
-			glBindTexture(GL_TEXTURE_2D, pbr_roughnessmap_texture);
-			glUniform1i(loc_pbr_roughnessmap, 4);
-
-			glActiveTexture(GL_TEXTURE5);
-			glBindTexture(GL_TEXTURE_2D, pbr_aomap_texture);
-			glUniform1i(loc_pbr_aomap, 5);
-
-
-            float time =  frame/500.0f;
-            glUniform1f(loc_time, time);
-
-            sprintf(debug_string, "-> %f %f %f - light %f %f %f",camera->position.x,camera->position.y,camera->position.z, light_dir.x,light_dir.y,light_dir.z);
-            glUniform3f(loc_camera_world,camera->position.x,camera->position.y,camera->position.z );
-            glUniform3f(loc_light, light_dir.x, light_dir.y, light_dir.z);
+        if (stress_sweep) {
+            update_stress_sweep();
+        }
 
-        	glUniformMatrix4fv(loc_model_matrix, 1, GL_FALSE, model_matrix);
-			glUniformMatrix4fv(loc_view_matrix, 1, GL_FALSE, view_matrix);
-			glUniformMatrix4fv(loc_projecion_matrix, 1, GL_FALSE, projection_matrix);
-			glBindVertexArray(model_vao);
-			glDrawArrays(GL_TRIANGLES, 0, model_point_count);
-    	}
+        uint32_t next_model_key = phong_model ? PHONG_SHADER_KEY : MODEL_SHADER_KEY;
+        if (next_model_key != model_key && set_scene_variant(&scene, model_program, next_model_key)) {
+            model_key = next_model_key;
+        }
 
-        if (1) {
-            glUseProgram(arrow_program);
-            
-            glUniformMatrix4fv(loc_arrow_model_matrix, 1, GL_FALSE, model_matrix);
-            glUniformMatrix4fv(loc_arrow_view_matrix, 1, GL_FALSE, view_matrix);
-            glUniformMatrix4fv(loc_arrow_projecion_matrix, 1, GL_FALSE, projection_matrix);
-            
-            glBindVertexArray(arrow_vao);
-            glDrawArrays(GL_TRIANGLES, 0, arrows_point_count);
+        int stress_program = light_count > 0 ? clustered_program : instanced_program;
+        if (stress_instances != current_stress_instances || stress_program != current_stress_program) {
+            resize_stress_objects(&scene, first_stress_object, stress_instances, stress_program, first_stress_mesh,
+                                  stress_mesh_count, first_stress_material, stress_material_count);
+            current_stress_instances = stress_instances;
+            current_stress_program = stress_program;
+        }
+        update_stress_objects(&scene, first_stress_object, frame/500.0f);
+
+        copy_mat4(scene.objects[model_object].model_matrix, model_matrix);
+        copy_mat4(scene.objects[arrow_object].model_matrix, model_matrix);
+        scene.objects[model_object].enabled = (stress_instances == 0);
+
+        frame_params.frame = frame;
+        frame_params.time = frame/500.0f;
+        frame_params.camera_position = camera->position;
+        frame_params.light = light_dir;
+        frame_params.clusters = NULL;
+
+        // the deferred lighting pass always reads the clusters, with no extra lights it gets the usual one
+        int frame_lights = deferred ? M_MAX(light_count, 1) : light_count;
+        update_demo_lights(&lights, frame_lights, frame/500.0f);
+        if (frame_lights > 0) {
+            bin_point_lights(&lights, view_matrix, projection_matrix, near_plane, far_plane);
+            upload_light_clusters(&lights);
+            frame_params.clusters = &lights;
         }
 
+        scene.culling = culling;
+        scene.depth_prepass = depth_prepass;
+        scene.occlusion = occlusion;
+        scene.multi_draw = multi_draw;
+        scene.deferred = deferred;
+        cull_scene(&scene, &frame_params);
+        occlusion_cull_scene(&scene, &frame_params);
+        build_render_queue(&scene, &frame_params);
+        execute_render_queue(&scene, &frame_params);
+
+        snprintf(debug_string, 512, "-> %f %f %f - light %f %f %f - gl binds %d elided %d - instances %d visible %d culled %d occluded %d packets %d draws %d multi %d deferred %d - lights %d refs %d max %d - prepass %d depth %u shaded %u samples %.2fms",camera->position.x,camera->position.y,camera->position.z, light_dir.x,light_dir.y,light_dir.z,
+                gp_gl_state_calls(&gl_state.last_frame), gp_gl_state_elided(&gl_state.last_frame), stress_instances,
+                scene.cull_stats.visible, scene.cull_stats.culled, scene.occlusion_buffer.stats.occluded, scene.stats.packets, scene.stats.draw_calls, multi_draw, scene.deferred,
+                light_count, lights.stats.indices, lights.stats.max_per_cluster,
+                depth_prepass, scene.stats.depth_samples, scene.stats.shaded_samples, frame_time_avg_ms);
+
 		if (1){
 	    	float offset[2] = {15.0, -15.0};
 			float font_size = 18.0;
 			float width, height;
 			//sprintf(debug_string, "-> %.1f %.1f %.1f --> %.1f %.1f %.1f",camera->position.x,camera->position.y,camera->position.z,camera->look_at_point.x,camera->look_at_point.y,camera->look_at_point.z);
-            if (filewatcher_context->files_changed > 0) {
-				filewatcher_context->files_changed = 0;
-
-				printf("Recompiling model shader\n");
-				GLuint new_program = load_model_shaders();
-				if (new_program != 0) {
-					printf("Replacing model shaders\n");
-					model_program = new_program;
+            // Hot reload: the new programs compile in the background and are swapped in once linked,
+            // until then the old ones keep drawing
+            // only programs built from a file whose content changed are recompiled
+            FileEvent file_event;
+            while (poll_filewatcher(&file_event)) {
+                uint64_t changed = shader_source_changed(&shader_sources, file_event.path);
+                printf("Changed %s%s\n", file_event.path, changed ? "" : ", same content");
+                uint64_t variant_files = shader_source_files(&shader_sources, SHADER_VARIANTS_VERTEX)
+                                       | shader_source_files(&shader_sources, SHADER_VARIANTS_FRAGMENT);
+                uint64_t lighting_files = shader_source_files(&shader_sources, LIGHTING_VERTEX_SHADER)
+                                        | shader_source_files(&shader_sources, LIGHTING_FRAGMENT_SHADER);
+                variants_changed = variants_changed || (changed & variant_files) != 0;
+                lighting_changed = lighting_changed || (changed & lighting_files) != 0;
+            }
+            if (variants_changed && reload_shader_variants(&shader_variants, &shader_compiler)) {
+				variants_changed = FALSE;
+				printf("Recompiling model shaders\n");
+			}
+            if (lighting_changed && lighting_reload == NULL) {
+				lighting_changed = FALSE;
+				printf("Recompiling lighting shaders\n");
+				lighting_reload = start_async_program(&shader_compiler, shader_source_copy(&shader_sources, LIGHTING_VERTEX_SHADER),
+				                                      shader_source_copy(&shader_sources, LIGHTING_FRAGMENT_SHADER), NULL, NULL, NULL, NULL);
+			}
+
+			GLuint retired[SHADER_VARIANTS_MAX + 1];
+			int retired_count = 0;
+			if (poll_shader_variant_reloads(&shader_variants, retired, &retired_count) > 0) {
+				printf("Replacing model shaders\n");
+				set_scene_variant(&scene, model_program, model_key);
+				set_scene_variant(&scene, instanced_program, INSTANCED_SHADER_KEY);
+				set_scene_variant(&scene, clustered_program, CLUSTERED_SHADER_KEY);
+				set_scene_variant(&scene, scene.programs[model_program].gbuffer_program, GBUFFER_SHADER_KEY);
+				set_scene_variant(&scene, scene.programs[instanced_program].gbuffer_program, GBUFFER_INSTANCED_SHADER_KEY);
+			}
+			if (lighting_reload != NULL && poll_async_program(lighting_reload)) {
+				if (lighting_reload->program != 0) {
+					retired[retired_count++] = scene.programs[scene.lighting_program].program;
+					set_scene_program(&scene, scene.lighting_program, lighting_reload->program);
 				} else {
 					printf("\n\n\n\nERROR replacing shaders\n Keeping the old one for now\n\n\n\n");
 				}
+				free_async_program(lighting_reload);
+				lighting_reload = NULL;
+			}
+			if (retired_count > 0) {
+				// nothing in the scene refers to them anymore
+				gp_gl_use_program(0);
+				for (int i = 0; i < retired_count; ++i) {
+					gp_gl_delete_program(retired[i]);
+				}
 			}
 			mv_ef_string_dimensions(debug_string, &width, &height, font_size); // for potential alignment
 			mv_ef_draw(debug_string, NULL, offset, font_size);
+			// mv_ef_draw restores program, VAO and 2D textures, but not the active unit and the array buffer
+			gp_gl_state_forget(GP_GL_STATE_ACTIVE_TEXTURE | GP_GL_STATE_BUFFERS);
     	}
 
 		glfwSwapBuffers(window);
@@ -570,6 +877,16 @@ void gameplay_loop(int w, int h) {
         ++frame;
 	}
 
+	stop_shader_compiler(&shader_compiler);
+	if (lighting_reload != NULL) {
+		free_async_program(lighting_reload);
+	}
+	destroy_job_system(scene.jobs);
+	free_occlusion_buffer(&scene.occlusion_buffer);
+	free_occluder_mesh(&model_occluder);
+	free_light_clusters(&lights);
+	free_ibl(&ibl);
+	free_gbuffer(&scene.gbuffer);
 	free(debug_string);
 }
 
@@ -614,6 +931,54 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
         	distance_camera += increment;
         	log("+ y_axis\n");
         break;
+        case GLFW_KEY_C:
+            if (pressed) {
+                culling = !culling;
+                log("culling %d\n", culling);
+            }
+        break;
+        case GLFW_KEY_O:
+            if (pressed) {
+                occlusion = !occlusion;
+                log("occlusion culling %d\n", occlusion);
+            }
+        break;
+        case GLFW_KEY_P:
+            if (pressed) {
+                depth_prepass = !depth_prepass;
+                log("depth prepass %d\n", depth_prepass);
+            }
+        break;
+        case GLFW_KEY_M:
+            if (pressed) {
+                multi_draw = !multi_draw;
+                log("multi draw indirect %d\n", multi_draw);
+            }
+        break;
+        case GLFW_KEY_L:
+            if (pressed) {
+                light_count = next_light_count(light_count);
+                log("point lights %d\n", light_count);
+            }
+        break;
+        case GLFW_KEY_G:
+            if (pressed) {
+                deferred = !deferred;
+                log("deferred shading %d\n", deferred);
+            }
+        break;
+        case GLFW_KEY_N:
+            if (pressed) {
+                phong_model = !phong_model;
+                log("phong model %d\n", phong_model);
+            }
+        break;
+        case GLFW_KEY_I:
+            if (pressed) {
+                stress_instances = next_stress_instances(stress_instances);
+                log("stress instances %d\n", stress_instances);
+            }
+        break;
         default:
         	log("key %d not mapped directly\n", key);
     }
@@ -632,11 +997,195 @@ void error_callback(int error, const char* description) {
 	log("Error: %d -> %s\n", error, description );
 }
 
+// --bench vertex, needs a window. Draws round.obj with the single model program, once with the reference
+// shader that inverts the matrices per vertex and once with the current one that gets them per draw.
+// The rasterizer is off so only vertex work is timed, GPU time comes from GL_TIME_ELAPSED.
+void vertex_benchmark() {
+    int draws = 2000;
+    int samples = 5;
+
+    GLuint vao;
+    int point_count = 0;
+    MeshBounds bounds;
+    if (!load_mesh("models/round.obj", &vao, &point_count, &bounds)) {
+        return;
+    }
+
+    // the reference vertex shader has no world space tangent frame for the environment light
+    uint32_t key = MODEL_SHADER_KEY & ~SHADER_IBL;
+    char* str_vert = gp_read_entire_file_alloc("shaders/model_vertex_pbr_1_reference.glsl");
+    char* str_frag = shader_variant_source(shader_variants.fragment_source, key);
+    GLuint reference_program = compile_shader_program(str_vert, str_frag, "position", "normal", "uv", "tangent");
+    free(str_vert);
+    free(str_frag);
+
+    Scene scene;
+    init_scene(&scene);
+    const char* names[2] = {"per vertex inverse", "per draw uniforms"};
+    int programs[2] = {add_scene_program(&scene, reference_program, FALSE), add_scene_program(&scene, shader_variant_program(&shader_variants, key), FALSE)};
+
+    float view_matrix[] = M_MAT4_IDENTITY();
+    float projection_matrix[] = M_MAT4_IDENTITY();
+    float model_matrix[] = M_MAT4_IDENTITY();
+    Camera camera;
+    update_camera(&camera, view_matrix);
+    m_mat4_perspective(projection_matrix, 10.0, 1.0, 0.1, 100.0);
+
+    FrameParams params;
+    memset(&params, 0, sizeof(FrameParams));
+    params.far_plane = 100.0;
+    params.camera_position = camera.position;
+    params.light = light_dir;
+    params.view_matrix = view_matrix;
+    params.projection_matrix = projection_matrix;
+
+    GLuint query;
+    glGenQueries(1, &query);
+    glEnable(GL_RASTERIZER_DISCARD);
+    gp_gl_bind_vertex_array(vao);
+
+    printf("vertex benchmark: %d vertices x %d draws\n", point_count, draws);
+    for (int p = 0; p < 2; ++p) {
+        ModelProgram* program = &scene.programs[programs[p]];
+        gp_gl_use_program(program->program);
+        set_frame_uniforms(program, &params);
+
+        double best_gpu_ms = 1e30;
+        float best_cpu_ms = 1e30f;
+        for (int sample = 0; sample < samples; ++sample) {
+            g_timer timer;
+            start_timer(&timer);
+            glBeginQuery(GL_TIME_ELAPSED, query);
+            for (int d = 0; d < draws; ++d) {
+                // every draw gets its own matrix, like separate objects would
+                model_matrix[12] = (d % 100) * 0.01f;
+                model_matrix[14] = (d / 100) * 0.01f;
+                set_object_uniforms(program, &params, model_matrix);
+                glDrawArrays(GL_TRIANGLES, 0, point_count);
+            }
+            glEndQuery(GL_TIME_ELAPSED);
+            stop_timer(&timer);
+
+            GLuint64 ns = 0;
+            glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+            best_gpu_ms = M_MIN(best_gpu_ms, ns / 1e6);
+            best_cpu_ms = M_MIN(best_cpu_ms, compute_timer_millis_diff(&timer));
+        }
+        printf("  %-20s gpu %8.3f ms  %8.1f M vertices/s  cpu submit %7.3f ms\n", names[p], best_gpu_ms,
+               (double) point_count * draws / (best_gpu_ms * 1000.0), best_cpu_ms);
+    }
+
+    glDisable(GL_RASTERIZER_DISCARD);
+    glDeleteQueries(1, &query);
+}
+
+// CPU only benchmarks, they run without a window: ./a.out --bench <name>
+int run_benchmark(const char* name) {
+	if (strcmp(name, "cull") == 0) {
+		gp_cull_benchmark();
+		return 0;
+	}
+	if (strcmp(name, "jobs") == 0) {
+		gp_scene_benchmark(job_workers);
+		return 0;
+	}
+	if (strcmp(name, "occlusion") == 0) {
+		gp_occlusion_benchmark(job_workers);
+		return 0;
+	}
+	if (strcmp(name, "lights") == 0) {
+		gp_lights_benchmark(job_workers);
+		return 0;
+	}
+	if (strcmp(name, "ibl") == 0) {
+		gp_ibl_benchmark(job_workers, ibl_path);
+		return 0;
+	}
+	if (strcmp(name, "math") == 0) {
+		gp_math_benchmark();
+		return 0;
+	}
+	if (strcmp(name, "anim") == 0) {
+		gp_anim_benchmark(job_workers);
+		return 0;
+	}
+	if (strcmp(name, "bvh") == 0) {
+		gp_bvh_benchmark(job_workers);
+		return 0;
+	}
+	if (strcmp(name, "voxel") == 0) {
+		gp_voxel_benchmark(job_workers);
+		return 0;
+	}
+	printf("unknown benchmark %s\n", name);
+	return 1;
+}
+
 int main(int argc, char const *argv[]) {
 	int w = 1000;
 	int h = 800;
 
+	// before any thread uses the matrix functions
+	m_simd_init();
+
+	const char* benchmark = NULL;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--stress") == 0) {
+			stress_sweep = TRUE;
+		}
+		if (strcmp(argv[i], "--stress-indirect") == 0) {
+			stress_sweep = TRUE;
+			stress_compare = &multi_draw;
+		}
+		if (strcmp(argv[i], "--stress-deferred") == 0) {
+			stress_sweep = TRUE;
+			stress_compare = &deferred;
+		}
+		if (strcmp(argv[i], "--no-program-cache") == 0) {
+			use_program_cache = FALSE;
+		}
+		if (strcmp(argv[i], "--no-prewarm") == 0) {
+			prewarm_shaders = FALSE;
+		}
+		if (strcmp(argv[i], "--deferred") == 0) {
+			deferred = TRUE;
+		}
+		if (strcmp(argv[i], "--lights") == 0 && i + 1 < argc) {
+			light_count = M_CLAMP(atoi(argv[i + 1]), 0, MAX_DEMO_LIGHTS);
+		}
+		if (strcmp(argv[i], "--ibl") == 0 && i + 1 < argc) {
+			ibl_path = argv[i + 1];
+		}
+		if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+			job_workers = atoi(argv[i + 1]);
+		}
+		if (strcmp(argv[i], "--bench") == 0 && i + 1 < argc) {
+			benchmark = argv[i + 1];
+		}
+	}
+	if (benchmark != NULL && strcmp(benchmark, "vertex") == 0) {
+		prewarm_shaders = FALSE;
+		init(w, h);
+		init_shader_variants(&shader_variants);
+		vertex_benchmark();
+		teardown();
+		return 0;
+	}
+	if (benchmark != NULL) {
+		return run_benchmark(benchmark);
+	}
+
 	init(w, h);
+	init_program_cache(&program_cache, use_program_cache ? "shader_cache" : NULL);
+	if (!init_shader_variants(&shader_variants)) {
+		log("uber shader sources missing\n");
+	}
+	// after the prewarm the worker context goes to the shader compiler
+	init_shader_compiler(&shader_compiler, get_gl_proc, prewarm_window ? make_prewarm_context_current : NULL, prewarm_window);
+	if (prewarm_window) {
+		prewarm_shader_variants(&shader_variants, demo_shader_keys, sizeof(demo_shader_keys) / sizeof(demo_shader_keys[0]),
+		                        make_prewarm_context_current, prewarm_window);
+	}
 
 	gameplay_loop(w, h);
 
@@ -665,12 +1214,17 @@ void frame_timer() {
         avg_dt2 /= num_samples;
         double std_dt = sqrt(avg_dt2 - avg_dt*avg_dt);
         double ste_dt = std_dt / sqrt(num_samples);
+        frame_time_avg_ms = 1000.0*avg_dt;
 
         char window_title_string[128];
         sprintf(window_title_string, "dt: avg = %.3fms, std = %.3fms, ste = %.4fms. fps = %.1f", 1000.0*avg_dt, 1000.0*std_dt, 1000.0*ste_dt, 1.0/avg_dt);
         glfwSetWindowTitle(window, window_title_string);
 
         num_samples = 1.0/avg_dt;
+        if (num_samples < 1) {
+            // slower than 1 fps, happens with the bigger stress scenes
+            num_samples = 1;
+        }
         
         avg_dt = 0.0;
         avg_dt2 = 0.0;
@@ -0,0 +1,60 @@
+// Cook-Torrance with the GGX distribution, Smith geometry and Schlick fresnel, included by every shader
+// that shades with it
+
+float PI = 3.14159265359;
+
+float DistribuitionGGX(vec3 N, vec3 H, float roughness) {
+	float a = roughness * roughness;
+	float a2 = a*a;
+	float NdotH = max(dot(N,H), 0.0);
+	float NdotH2 = NdotH * NdotH;
+
+	float nom = a2;
+	float denom = (NdotH2 * (a2 - 1.0) + 1.0);
+	denom = PI * denom * denom;
+
+	return nom / denom;
+}
+
+float GeometrySchlickGGX(float NdotV, float roughness) {
+	float r = (roughness + 1.0);
+	float k = (r*r) / 8.0;
+
+	float nom = NdotV;
+	float denom = NdotV * (1.0 - k) + k;
+	return nom / denom;
+}
+
+float GeometrySmith(vec3 N, vec3 V, vec3 L, float roughness) {
+	float NdotV = max(dot(N, V), 0.0);
+	float NdotL = max(dot(N, L), 0.0);
+	float ggx2 = GeometrySchlickGGX(NdotV, roughness);
+	float ggx1 = GeometrySchlickGGX(NdotL, roughness);
+	return ggx1 * ggx2;
+}
+
+vec3 fresnelSchlick(float cosTheta, vec3 F0) {
+	return F0 + (1.0 - F0) * pow(1.0 - cosTheta, 5.0);
+}
+
+// Outgoing radiance towards V for unit radiance arriving from L
+vec3 cook_torrance(vec3 N, vec3 V, vec3 L, vec3 albedo, float metallic, float roughness) {
+	vec3 F0 = vec3(0.04);
+	F0 = mix(F0, albedo, metallic);
+	vec3 H = normalize(V + L);
+
+	float NDF = DistribuitionGGX(N,H, roughness);
+	float G = GeometrySmith(N,V,L, roughness);
+	vec3 F = fresnelSchlick(max(dot(H,V),0.0), F0);
+
+	vec3 kS = F;
+	vec3 kD = vec3(1.0) - kS;
+	kD *= 1.0 - metallic;
+
+	vec3 nominator = NDF * G * F;
+	float denominator = 4 * max(dot(N, V), 0.0) * max(dot(N, L), 0.0) + 0.001;
+	vec3 specular = nominator / denominator;
+
+	float NdotL = max(dot(N,L),0.0);
+	return (kD * albedo / PI + specular) * NdotL;
+}
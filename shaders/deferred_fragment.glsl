@@ -0,0 +1,53 @@
+#version 330
+
+
+in vec2 _uv;
+
+out vec4 frag_color;
+
+// see gp_deferred.h for the layout
+uniform sampler2D u_gbuffer_albedo_ao;
+uniform sampler2D u_gbuffer_normal;
+uniform sampler2D u_gbuffer_material;
+uniform sampler2D u_gbuffer_depth;
+
+uniform mat4 u_projection_matrix;
+
+// light clusters, see gp_lights.h
+#include "light_clusters.glsl"
+#include "octahedral.glsl"
+
+// Symmetric perspective only, the same assumption gp_lights.h makes for the clusters
+vec3 view_position(vec2 uv, float depth) {
+	vec3 ndc = vec3(uv, depth) * 2.0 - 1.0;
+	float z = -u_projection_matrix[3][2] / (ndc.z + u_projection_matrix[2][2]);
+	return vec3(-z * ndc.x / u_projection_matrix[0][0], -z * ndc.y / u_projection_matrix[1][1], z);
+}
+
+void main() {
+	float depth = texture(u_gbuffer_depth, _uv).r;
+	if (depth >= 1.0) {
+		discard;
+	}
+	vec4 albedo_ao = texture(u_gbuffer_albedo_ao, _uv);
+	vec2 material = texture(u_gbuffer_material, _uv).rg;
+
+	vec3 albedo = albedo_ao.rgb;
+	float metallic = material.r;
+	float roughness = material.g;
+	float ao = albedo_ao.a; // u_aoMap of the geometry pass, 0 (no ambient) without one like the forward shaders
+
+	vec3 position_view = view_position(_uv, depth);
+	vec3 N = decode_normal(texture(u_gbuffer_normal, _uv).rg);
+	vec3 V = normalize(-position_view);
+
+	vec3 Lo = cluster_lights(position_view, N, V, albedo, metallic, roughness);
+
+	vec3 ambient = vec3(0.09) * albedo * ao;
+	vec3 color = ambient + Lo;
+
+	color = color/ (color + vec3(1.0));
+	color = pow(color, vec3(1.0/2.2));
+
+	frag_color = vec4(color, 1.0);
+}
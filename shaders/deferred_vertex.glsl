@@ -0,0 +1,10 @@
+#version 330
+
+out vec2 _uv;
+
+// fullscreen triangle from gl_VertexID, no vertex buffer
+void main(){
+	vec2 corner = vec2(float((gl_VertexID << 1) & 2), float(gl_VertexID & 2));
+	_uv = corner;
+	gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);
+}
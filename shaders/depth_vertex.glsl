@@ -0,0 +1,14 @@
+#version 150
+
+in vec3 position;
+
+uniform mat4 u_view_matrix;
+uniform mat4 u_model_matrix;
+uniform mat4 u_projection_matrix;
+
+// same expression as model_vertex_uber.glsl, the shading pass tests with GL_EQUAL against this depth
+invariant gl_Position;
+
+void main(){
+	gl_Position =  u_projection_matrix * u_view_matrix * u_model_matrix * vec4(position, 1.0);
+}
@@ -0,0 +1,17 @@
+#version 330
+
+in vec3 position;
+
+// per instance, see gp_instancing.h
+layout(location = 4) in mat4 i_model_matrix;
+
+uniform mat4 u_view_matrix;
+uniform mat4 u_projection_matrix;
+
+// same expression as model_vertex_uber.glsl with INSTANCED, the shading pass tests with GL_EQUAL against this depth
+invariant gl_Position;
+
+void main(){
+	vec4 position_wor = i_model_matrix * vec4(position, 1.0);
+	gl_Position =  u_projection_matrix * u_view_matrix * position_wor;
+}
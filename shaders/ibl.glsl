@@ -0,0 +1,37 @@
+// Light of the environment baked by gp_ibl.h, split sum approximation. N and V in world space.
+#include "brdf.glsl"
+
+uniform vec3 u_sh[9];             // irradiance / pi
+uniform samplerCube u_prefiltered;
+uniform sampler2D u_brdf_lut;     // scale and bias on F0, by NdotV and roughness
+uniform float u_prefiltered_mips; // mip of roughness 1
+
+vec3 sh_irradiance(vec3 n) {
+	return u_sh[0] * 0.282095
+	     + u_sh[1] * 0.488603 * n.y
+	     + u_sh[2] * 0.488603 * n.z
+	     + u_sh[3] * 0.488603 * n.x
+	     + u_sh[4] * 1.092548 * n.x * n.y
+	     + u_sh[5] * 1.092548 * n.y * n.z
+	     + u_sh[6] * 0.315392 * (3.0 * n.z * n.z - 1.0)
+	     + u_sh[7] * 1.092548 * n.x * n.z
+	     + u_sh[8] * 0.546274 * (n.x * n.x - n.y * n.y);
+}
+
+vec3 fresnelSchlickRoughness(float cosTheta, vec3 F0, float roughness) {
+	return F0 + (max(vec3(1.0 - roughness), F0) - F0) * pow(1.0 - cosTheta, 5.0);
+}
+
+vec3 ibl_ambient(vec3 N, vec3 V, vec3 albedo, float metallic, float roughness) {
+	vec3 F0 = mix(vec3(0.04), albedo, metallic);
+	float NdotV = max(dot(N, V), 0.0);
+	vec3 kS = fresnelSchlickRoughness(NdotV, F0, roughness);
+	vec3 kD = (1.0 - kS) * (1.0 - metallic);
+	vec3 diffuse = max(sh_irradiance(N), 0.0) * albedo;
+
+	vec3 R = reflect(-V, N);
+	vec3 prefiltered = textureLod(u_prefiltered, R, roughness * u_prefiltered_mips).rgb;
+	vec2 brdf = texture(u_brdf_lut, vec2(NdotV, roughness)).rg;
+	vec3 specular = prefiltered * (F0 * brdf.x + brdf.y);
+	return kD * diffuse + specular;
+}
@@ -0,0 +1,42 @@
+// Point lights from the clusters of gp_lights.h, everything in view space
+
+#include "brdf.glsl"
+
+uniform usamplerBuffer u_cluster_grid;  // first index, light count
+uniform usamplerBuffer u_light_indices;
+uniform samplerBuffer u_light_data;     // view position and radius, color and intensity
+uniform ivec3 u_cluster_dims;
+uniform vec2 u_cluster_scale;           // clusters per pixel in x and y
+uniform vec2 u_cluster_depth;           // slice = log(view depth) * x + y
+
+int cluster_index(vec3 position_view) {
+	ivec2 tile = ivec2(gl_FragCoord.xy * u_cluster_scale);
+	int slice = int(log(-position_view.z) * u_cluster_depth.x + u_cluster_depth.y);
+	ivec3 c = clamp(ivec3(tile, slice), ivec3(0), u_cluster_dims - 1);
+	return (c.z * u_cluster_dims.y + c.y) * u_cluster_dims.x + c.x;
+}
+
+// Cook-Torrance summed over the lights of the fragment's cluster
+vec3 cluster_lights(vec3 position_view, vec3 N, vec3 V, vec3 albedo, float metallic, float roughness) {
+	vec3 Lo = vec3(0.0);
+	uvec2 cluster = texelFetch(u_cluster_grid, cluster_index(position_view)).xy;
+	for (uint i = 0u; i < cluster.y; ++i) {
+		int light = int(texelFetch(u_light_indices, int(cluster.x + i)).r);
+		vec4 light_position = texelFetch(u_light_data, light * 2);
+		vec4 light_color = texelFetch(u_light_data, light * 2 + 1);
+
+		vec3 to_light = light_position.xyz - position_view;
+		float distance2 = dot(to_light, to_light);
+		if (distance2 >= light_position.w * light_position.w) {
+			continue;
+		}
+
+		vec3 L = to_light * inversesqrt(distance2);
+		// inverse square falloff windowed to reach zero at the radius
+		float falloff = clamp(1.0 - pow(distance2 / (light_position.w * light_position.w), 2.0), 0.0, 1.0);
+		float attenuation = falloff * falloff / (distance2 + 0.01);
+		vec3 radiance = light_color.rgb * light_color.a * attenuation;
+		Lo += cook_torrance(N, V, L, albedo, metallic, roughness) * radiance;
+	}
+	return Lo;
+}
@@ -0,0 +1,155 @@
+#version 330
+
+// Uber shader for every model program, see model_vertex_uber.glsl. Features of this stage:
+//   NORMAL_MAP  normal from u_normalMap, the interpolated vertex normal otherwise
+//   AO_MAP      ambient occlusion from u_aoMap, without it there is no ambient term unless IBL is set
+//   ORM_MAP     occlusion, roughness and metallic packed in r, g and b of u_metallicMap
+//   CLUSTERED   Cook-Torrance over the point lights of the fragment's cluster
+//   GBUFFER     no lighting, the surface goes to the G-buffer
+//   PHONG       Phong with the single light, the old normal mapping shader
+//   IBL         ambient light from the environment baked by gp_ibl.h instead of a constant
+// Without CLUSTERED, GBUFFER or PHONG it is Cook-Torrance with the single light u_light.
+
+#if defined(CLUSTERED) || defined(GBUFFER)
+#define VIEW_SPACE
+#endif
+#if defined(GBUFFER) && (defined(CLUSTERED) || defined(PHONG))
+#error "GBUFFER doesn't shade, it can't be combined with CLUSTERED or PHONG"
+#endif
+#if defined(CLUSTERED) && defined(PHONG)
+#error "PHONG only has the single light"
+#endif
+#if defined(IBL) && (defined(GBUFFER) || defined(PHONG))
+#error "IBL is only for the Cook-Torrance paths"
+#endif
+
+in vec2 _uv;
+in vec4 _material; // albedo tint rgb, roughness scale
+
+#ifdef VIEW_SPACE
+in vec3 position_view;
+in mat3 tbn_view;
+#else
+in vec3 view_dir_tan;
+in vec3 light_dir_tan;
+#ifdef IBL
+in mat3 tbn_world;
+#endif
+#endif
+
+#ifdef GBUFFER
+// see gp_deferred.h for the layout
+layout(location = 0) out vec4 g_albedo_ao;
+layout(location = 1) out vec2 g_normal;
+layout(location = 2) out vec2 g_material;
+#else
+out vec4 frag_color;
+#endif
+
+uniform sampler2D u_texture;
+uniform sampler2D u_albedoMap;
+uniform sampler2D u_normalMap;
+uniform sampler2D u_metallicMap;
+uniform sampler2D u_roughnessMap;
+uniform sampler2D u_aoMap;
+
+// includes are expanded before the #ifdefs are looked at, see gp_shader_source.h
+#include "brdf.glsl"
+#ifdef CLUSTERED
+// light clusters, see gp_lights.h
+#include "light_clusters.glsl"
+#endif
+#ifdef GBUFFER
+#include "octahedral.glsl"
+#endif
+#ifdef IBL
+#include "ibl.glsl"
+#ifdef VIEW_SPACE
+uniform mat4 u_view_matrix;
+#endif
+#endif
+
+vec3 pow_v(vec3 v, float val) {
+	return vec3(pow(v.x,val), pow(v.y,val), pow(v.z,val));
+}
+
+void main() {
+	vec3 albedo = pow_v(texture(u_albedoMap, _uv).rgb, 2.2) * _material.rgb;
+#ifdef ORM_MAP
+	vec3 orm = texture(u_metallicMap, _uv).rgb;
+	float ao = orm.r;
+	float roughness = orm.g * _material.a;
+	float metallic = orm.b;
+#else
+	float metallic = texture(u_metallicMap, _uv).r;
+	float roughness = texture(u_roughnessMap, _uv).r * _material.a;
+#ifdef AO_MAP
+	float ao = texture(u_aoMap, _uv).r;
+#else
+	float ao = 0.0;
+#endif
+#endif
+
+#ifdef NORMAL_MAP
+	vec3 normal = texture (u_normalMap, _uv).rgb;
+	normal = normalize (normal * 2.0 - 1.0);
+#else
+	vec3 normal = vec3(0.0, 0.0, 1.0);
+#endif
+
+#ifdef VIEW_SPACE
+	vec3 N = normalize(tbn_view * normal);
+#else
+	vec3 N = normal;
+#endif
+
+#if defined(GBUFFER)
+	g_albedo_ao = vec4(albedo, ao);
+	g_normal = encode_normal(N) * 0.5 + 0.5;
+	g_material = vec2(metallic, roughness);
+#elif defined(PHONG)
+	vec3 L = normalize(light_dir_tan);
+	vec3 V = normalize(view_dir_tan);
+
+	vec3 Ia = vec3(0.2, 0.2, 0.2);
+	vec3 Id = vec3(0.7,0.7,0.7) * vec3(1.0, 0.5, 0.0) * max(dot(L, N), 0.0);
+	float specular_factor = pow(max(dot(reflect(-L, N), V), 0.0), 100.0);
+	vec3 Is = vec3(1.0,1.0,1.0) * vec3(0.5,0.5,0.5) * specular_factor;
+
+	vec3 c  = Is + Id + Ia;
+	frag_color = vec4(texture(u_albedoMap, _uv).rgb * _material.rgb * c, 1.0);
+#else
+	vec3 Lo = vec3(0.0);
+#ifdef CLUSTERED
+	vec3 V = normalize(-position_view);
+	Lo += cluster_lights(position_view, N, V, albedo, metallic, roughness);
+#else
+	vec3 V = normalize(view_dir_tan);
+	vec3 L = normalize(light_dir_tan);
+	float distance = length(light_dir_tan);
+	vec3 radiance = vec3(1.0) / (distance * distance);
+	Lo += cook_torrance(N, V, L, albedo, metallic, roughness) * radiance;
+#endif
+
+#ifdef IBL
+#ifdef VIEW_SPACE
+	// the view matrix only rotates and translates, its transpose takes directions back to world space
+	mat3 to_world = transpose(mat3(u_view_matrix));
+	vec3 ambient = ibl_ambient(to_world * N, to_world * V, albedo, metallic, roughness);
+#else
+	vec3 ambient = ibl_ambient(normalize(tbn_world * N), normalize(tbn_world * V), albedo, metallic, roughness);
+#endif
+#ifdef AO_MAP
+	ambient *= ao;
+#endif
+#else
+	vec3 ambient = vec3(0.09) * albedo * ao;
+#endif
+	vec3 color = ambient + Lo;
+
+	color = color/ (color + vec3(1.0));
+	color = pow(color, vec3(1.0/2.2));
+
+	frag_color = vec4(color, 1.0);
+#endif
+}
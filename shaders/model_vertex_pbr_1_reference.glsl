@@ -1,5 +1,7 @@
 #version 150
 
+// Reference for --bench vertex: the single light model vertex shader as it was, with the inverses computed per vertex
+
 in vec3 position;
 in vec2 uv;
 in vec3 normal;
@@ -14,14 +16,19 @@ uniform mat4 u_model_matrix;
 uniform mat4 u_projection_matrix;
 
 out vec2 _uv;
+out vec4 _material;
 
 out vec3 view_dir_tan;
 out vec3 light_dir_tan;
 
+// has to match the depth pre-pass exactly (shaders/depth_vertex*.glsl)
+invariant gl_Position;
+
 void main(){
 	
 	gl_Position =  u_projection_matrix * u_view_matrix * u_model_matrix * vec4(position, 1.0);
 	_uv = uv;
+	_material = vec4(1.0);
 
 	vec3 cam_pos_wor = (inverse(u_view_matrix) * vec4(0.0,0.0,0.0,1.0)).xyz;
 	vec3 light_dir_wor = u_light - position;
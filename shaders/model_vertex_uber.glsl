@@ -0,0 +1,106 @@
+#version 330
+
+// Uber shader for every model program, gp_shader_variants.h puts one #define per feature after the
+// version line:
+//   INSTANCED   model matrix and material tint per instance (gp_instancing.h), u_model_matrix otherwise
+//   CLUSTERED   point lights from the clusters of gp_lights.h, shading happens in view space
+//   GBUFFER     writes the surface to the G-buffer of gp_deferred.h, also in view space
+//   IBL         environment light of gp_ibl.h, the tangent space paths also pass a world space frame
+// Everything else shades the single light u_light in tangent space.
+
+#if defined(CLUSTERED) || defined(GBUFFER)
+#define VIEW_SPACE
+#endif
+
+in vec3 position;
+in vec2 uv;
+in vec3 normal;
+in vec4 tangent;
+
+#ifdef INSTANCED
+// per instance, see gp_instancing.h
+layout(location = 4) in mat4 i_model_matrix;
+layout(location = 8) in vec4 i_material;
+#else
+uniform mat4 u_model_matrix;
+// per draw, from the inverse model matrix on the CPU (set_object_uniforms in gp_scene.h)
+uniform vec3 u_camera_object;
+uniform vec3 u_light_object;
+uniform mat3 u_normal_matrix;
+#endif
+
+uniform vec3 u_light;
+uniform vec3 u_camera_world;
+
+uniform mat4 u_view_matrix;
+uniform mat4 u_projection_matrix;
+
+out vec2 _uv;
+out vec4 _material;
+
+#ifdef VIEW_SPACE
+out vec3 position_view;
+out mat3 tbn_view;
+#else
+out vec3 view_dir_tan;
+out vec3 light_dir_tan;
+#ifdef IBL
+out mat3 tbn_world;
+#endif
+#endif
+
+// has to match the depth pre-pass exactly (shaders/depth_vertex*.glsl)
+invariant gl_Position;
+
+void main(){
+#ifdef INSTANCED
+	vec4 position_wor = i_model_matrix * vec4(position, 1.0);
+	gl_Position =  u_projection_matrix * u_view_matrix * position_wor;
+	_material = i_material;
+	// Instances only rotate and scale uniformly, so the tangent frame can be moved with the upper 3x3
+	// instead of inverting the model matrix per vertex
+	mat3 normal_matrix = mat3(i_model_matrix);
+	mat3 tangent_matrix = mat3(i_model_matrix);
+#else
+	gl_Position =  u_projection_matrix * u_view_matrix * u_model_matrix * vec4(position, 1.0);
+	vec4 position_wor = u_model_matrix * vec4(position, 1.0);
+	_material = vec4(1.0);
+	mat3 normal_matrix = u_normal_matrix;
+	mat3 tangent_matrix = mat3(u_model_matrix);
+#endif
+	_uv = uv;
+
+#ifdef VIEW_SPACE
+	position_view = (u_view_matrix * position_wor).xyz;
+
+	mat3 view_rotation = mat3(u_view_matrix);
+	vec3 normal_view = normalize(view_rotation * (normal_matrix * normal));
+	vec3 tangent_view = normalize(view_rotation * (tangent_matrix * tangent.xyz));
+	vec3 bitangent_view = cross(normal_view, tangent_view) * tangent.w;
+	tbn_view = mat3(tangent_view, bitangent_view, normal_view);
+#else
+#ifdef INSTANCED
+	// tangent frame in world space
+	vec3 n = normalize(normal_matrix * normal);
+	vec3 t = normalize(tangent_matrix * tangent.xyz);
+	vec3 light_dir = u_light - position_wor.xyz;
+	vec3 view_dir = normalize(u_camera_world - position_wor.xyz);
+#else
+	// tangent frame in object space, camera and light were moved there on the CPU
+	vec3 n = normal;
+	vec3 t = tangent.xyz;
+	vec3 light_dir = u_light_object - position;
+	vec3 view_dir = normalize(u_camera_object - position);
+#endif
+	vec3 b = cross(n, t) * tangent.w;
+
+	view_dir_tan = vec3(dot(t, view_dir), dot(b, view_dir), dot(n, view_dir));
+	light_dir_tan = vec3(dot(t, light_dir), dot(b, light_dir), dot(n, light_dir));
+#ifdef IBL
+	// the environment is looked up in world space
+	vec3 normal_world = normalize(normal_matrix * normal);
+	vec3 tangent_world = normalize(tangent_matrix * tangent.xyz);
+	tbn_world = mat3(tangent_world, cross(normal_world, tangent_world) * tangent.w, normal_world);
+#endif
+#endif
+}